@@ -0,0 +1,245 @@
+// async_log.h
+//
+// lab1 和 lab2 共用的异步控制台输出。
+// 网络线程只把一行文本放进无锁的多生产者单消费者队列（一次原子交换），
+// 着色、写终端和 flush 都由唯一的输出线程完成，Windows 控制台再慢也不会卡住收发路径。
+// 重复出现的消息（例如每个坏包一条的校验和错误）用 LogRateLimit 在入队前限流，
+// 被抑制的条数附在下一条放行的消息后面。
+//
+// 只依赖 C++11 和 windows.h，两个实验的 Makefile 直接包含 ../common/async_log.h。
+
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <windows.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+const WORD LOG_COLOR_KEEP = 0;                  // 不修改控制台颜色
+const WORD LOG_COLOR_DEFAULT = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;  // 着色输出后恢复的颜色
+const unsigned LOG_BATCH_LINES = 256;           // 输出线程一次持有控制台锁最多写出的条数
+const unsigned LOG_IDLE_WAIT_MS = 100;          // 队列为空时输出线程的最长等待时间
+
+// 输出目标
+enum LogTarget {
+    LOG_STDOUT,
+    LOG_STDERR,
+};
+
+// ==================== 重复消息限流 ====================
+// 每个调用点一个实例：每个时间窗内最多放行 burst 条，其余只计数
+// allow 只有几次原子操作，不分配内存，可以放在每包都会经过的路径上
+class LogRateLimit {
+public:
+    explicit LogRateLimit(unsigned burst = 5, unsigned interval_ms = 1000)
+        : burst(burst), interval_ms(interval_ms), window_start(-1), in_window(0), suppressed(0) {}
+
+    // 功能: 判断这一条是否输出
+    // 参数: dropped-返回 true 时为上次放行以来被抑制的条数
+    // 返回: true-输出，false-抑制
+    bool allow(uint64_t& dropped) {
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t start = window_start.load(std::memory_order_relaxed);
+        if ((start < 0 || now - start >= (int64_t)interval_ms) &&
+            window_start.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+            in_window.store(0, std::memory_order_relaxed);
+        }
+        if (in_window.fetch_add(1, std::memory_order_relaxed) < burst) {
+            dropped = suppressed.exchange(0, std::memory_order_relaxed);
+            return true;
+        }
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+private:
+    unsigned burst;
+    unsigned interval_ms;
+    std::atomic<int64_t> window_start;
+    std::atomic<unsigned> in_window;
+    std::atomic<uint64_t> suppressed;
+};
+
+// ==================== 异步输出 ====================
+class AsyncLog {
+public:
+    AsyncLog() : tail(new Node), head(tail), sleeping(false), stopping(false), pushed(0), written(0) {
+        worker = std::thread(&AsyncLog::run, this);
+    }
+
+    // 退出时写完队列中剩余的内容
+    ~AsyncLog() {
+        stopping.store(true);
+        wake();
+        if (worker.joinable()) worker.join();
+        delete tail;
+    }
+
+    // 功能: 输出一行（末尾自动换行）
+    // 参数: color-控制台颜色（LOG_COLOR_KEEP 为不修改），text-内容，target-标准输出或标准错误
+    void line(WORD color, std::string text, LogTarget target = LOG_STDOUT) {
+        text.push_back('\n');
+        push(color, std::move(text), target);
+    }
+
+    void line(std::string text, LogTarget target = LOG_STDOUT) {
+        line(LOG_COLOR_KEEP, std::move(text), target);
+    }
+
+    // 功能: 经过限流后输出一行，被抑制的条数附在行尾
+    // 返回: 这一行是否放行，调用方可据此决定是否输出附带的后续行
+    bool line(LogRateLimit& limit, WORD color, std::string text, LogTarget target = LOG_STDOUT) {
+        uint64_t dropped = 0;
+        if (!limit.allow(dropped)) return false;
+        if (dropped) text += " (另有 " + std::to_string(dropped) + " 条相同消息被抑制)";
+        line(color, std::move(text), target);
+        return true;
+    }
+
+    // 功能: 原样输出，不换行（进度动画等用"\r"覆盖同一行的内容）
+    void raw(std::string text) {
+        push(LOG_COLOR_KEEP, std::move(text), LOG_STDOUT);
+    }
+
+    // 功能: 设置交互提示符，输出线程每写完一批后在新的一行重新显示它（空串表示没有提示符）
+    void set_prompt(const std::string& text, WORD color) {
+        std::lock_guard<std::mutex> lk(console);
+        prompt = text;
+        prompt_color = color;
+    }
+
+    // 功能: 等待此前放入的内容全部写到终端
+    // 说明: 会阻塞，只在阶段切换或同步输出之前调用，不要在收发路径上使用
+    void flush() {
+        uint64_t target = pushed.load();
+        std::unique_lock<std::mutex> lk(wake_mtx);
+        wake_cv.notify_one();
+        done_cv.wait(lk, [&]{ return written.load() >= target; });
+    }
+
+    // 控制台锁：输出线程写终端时持有，主线程做同步的交互输出时也应持有，避免行被拆开
+    std::mutex& console_mutex() { return console; }
+
+private:
+    struct Node {
+        std::atomic<Node*> next;
+        WORD color;
+        LogTarget target;
+        std::string text;
+        Node() : next(nullptr), color(LOG_COLOR_KEEP), target(LOG_STDOUT) {}
+    };
+
+    // 队列：tail 是已消费的哨兵节点，只由输出线程访问；head 是最后入队的节点，生产者原子交换
+    Node* tail;
+    std::atomic<Node*> head;
+
+    std::mutex wake_mtx;
+    std::condition_variable wake_cv;    // 唤醒输出线程
+    std::condition_variable done_cv;    // 通知 flush 的等待者
+    std::atomic<bool> sleeping;
+    std::atomic<bool> stopping;
+    std::atomic<uint64_t> pushed;
+    std::atomic<uint64_t> written;
+
+    std::mutex console;
+    std::string prompt;
+    WORD prompt_color = LOG_COLOR_KEEP;
+    std::thread worker;
+
+    void push(WORD color, std::string text, LogTarget target) {
+        Node* n = new Node;
+        n->color = color;
+        n->target = target;
+        n->text = std::move(text);
+        pushed.fetch_add(1);
+        Node* prev = head.exchange(n, std::memory_order_acq_rel);
+        // 链接与读取 sleeping 都用顺序一致序，和输出线程"设置 sleeping 后再检查队列"配对，不会两边都看不到对方
+        prev->next.store(n);
+        if (sleeping.load() && sleeping.exchange(false)) wake();
+    }
+
+    // 只在输出线程等待时才会取 wake_mtx，输出线程持有它的时间很短，从不在持有时写终端
+    void wake() {
+        std::lock_guard<std::mutex> lk(wake_mtx);
+        wake_cv.notify_one();
+    }
+
+    // 取出一个节点；队列为空（或生产者刚交换完 head 还没链接 next）时返回 nullptr
+    // 返回的节点成为新的哨兵，调用方处理完后释放旧哨兵
+    Node* pop() {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) return nullptr;
+        delete tail;
+        tail = next;
+        return next;
+    }
+
+    static void set_color(WORD color) {
+        if (color != LOG_COLOR_KEEP) SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), color);
+    }
+
+    void run() {
+        while (true) {
+            Node* n = pop();
+            if (!n) {
+                if (stopping.load()) break;
+                std::unique_lock<std::mutex> lk(wake_mtx);
+                sleeping.store(true);
+                // 设置 sleeping 之后再检查一次，避免与刚入队的生产者错过唤醒
+                if (!tail->next.load() && !stopping.load()) {
+                    wake_cv.wait_for(lk, std::chrono::milliseconds(LOG_IDLE_WAIT_MS));
+                }
+                sleeping.store(false);
+                continue;
+            }
+
+            uint64_t count = 0;
+            {
+                std::lock_guard<std::mutex> lk(console);
+                bool with_prompt = !prompt.empty();
+                if (with_prompt) std::cout << "\r" << std::string(prompt.size(), ' ') << "\r";
+                bool err = false;
+                while (n) {
+                    std::ostream& os = n->target == LOG_STDERR ? std::cerr : std::cout;
+                    err = err || n->target == LOG_STDERR;
+                    set_color(n->color);
+                    os << n->text;
+                    if (n->color != LOG_COLOR_KEEP) set_color(LOG_COLOR_DEFAULT);
+                    n->text = std::string();
+                    ++count;
+                    n = count < LOG_BATCH_LINES ? pop() : nullptr;
+                }
+                if (with_prompt) {
+                    set_color(prompt_color);
+                    std::cout << prompt;
+                    set_color(LOG_COLOR_DEFAULT);
+                }
+                std::cout.flush();
+                if (err) std::cerr.flush();
+            }
+            written.fetch_add(count);
+            std::lock_guard<std::mutex> lk(wake_mtx);
+            done_cv.notify_all();
+        }
+        std::cout.flush();
+        written.store(pushed.load());
+        std::lock_guard<std::mutex> lk(wake_mtx);
+        done_cv.notify_all();
+    }
+};
+
+// 进程内唯一的输出实例，第一次使用时启动输出线程
+inline AsyncLog& async_log() {
+    static AsyncLog log;
+    return log;
+}
+
+#endif // ASYNC_LOG_H
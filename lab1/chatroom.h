@@ -7,24 +7,38 @@
 #include <mutex>
 #include <string>
 #include <atomic>
+#include <memory>
 #include <conio.h>
+#include <algorithm>
+#include <string_view>
+#include <initializer_list>
+#include "shared_buffer.h"
 
 // 列举消息类型
 enum MsgType : uint8_t {
     // 用户消息类型 0x0..
-    CLIENT_LOGIN   = 0x01,
+    CLIENT_LOGIN   = 0x01,      // payload 为昵称，可选地跟一个 '\0' 和十进制消息 ID，表示只补发默认房间中该 ID 之后的历史
     CLIENT_MSG     = 0x02,
     CLIENT_LOGOUT  = 0x03,
+    CLIENT_JOIN_ROOM  = 0x04,   // payload 为房间名，不存在时自动创建
+    CLIENT_LEAVE_ROOM = 0x05,   // 离开当前房间，回到默认房间
     // 服务器消息类型 0x1..
-    SERVER_BROADCAST = 0x11,
+    SERVER_BROADCAST = 0x11,    // payload 为 "昵称: 正文"，末尾带消息标签（见 split_message_tag）
     SERVER_NOTICE    = 0x12,
     SERVER_LOGIN_REJECT = 0x13,
+    SERVER_HISTORY_MARK = 0x14, // payload 只有消息标签：房间名和其中最新一条消息的 ID，跟在历史回放之后
 };
 
+const char* const DEFAULT_ROOM = "lobby";   // 登录后默认进入的房间
+const size_t MAX_NICKNAME_LEN = 32;         // 昵称最大字节数（UTF-8），超过时服务器拒绝登录
+
+struct ClientOutbox;
+
 // 服务器端保存客户端信息结构体
 struct ClientInfo {
     SOCKET sock;
     std::string nickname; // UTF-8
+    std::shared_ptr<ClientOutbox> outbox; // 该客户端的发送队列（由服务端按引擎类型创建）
 };
 
 // ***一些工具函数
@@ -86,19 +100,224 @@ bool send_all(SOCKET s, const char* buf, int len) {
     return true;
 }
 
-// 构造并发送一帧数据
+// 构造一帧完整数据（不发送），payload 由若干片段依次拼接而成
 // 帧格式：4 字节长度信息 + 1 字节 type 信息 + payload
-// 只需要传入 type 和 payload，函数会自动构造完整帧并发送
-bool send_frame(SOCKET s, uint8_t type, const std::string& payload){
-    uint32_t len = 1 + (uint32_t)payload.size();    // len = type(1 byte) + payload size
+// 结果是引用计数的共享缓冲区：广播给 N 个用户时只分配和拷贝一次，所有发送队列指向同一份字节
+SharedBuffer encode_frame(uint8_t type, std::initializer_list<std::string_view> parts){
+    size_t payload_size = 0;
+    for (const auto& p : parts) payload_size += p.size();
+    uint32_t len = 1 + (uint32_t)payload_size;      // len = type(1 byte) + payload size
     uint32_t len_be = htonl(len);                   // 转为大端序用于网络传输
-    // 构建 buffer
     // buffer构成：4字节长度信息（已转换为大端） + 1字节type + payload
-    std::string buf;
-    buf.resize(4 + len);
-    memcpy(&buf[0], &len_be, 4);
+    SharedBuffer frame(4 + len);
+    char* buf = frame.writable();
+    memcpy(buf, &len_be, 4);
     buf[4] = (char)type;
-    // 拷贝到缓冲区，并调用 send_all 发送数据帧
-    if (!payload.empty()) memcpy(&buf[5], payload.data(), payload.size());
-    return send_all(s, buf.data(), (int)buf.size());
-}
\ No newline at end of file
+    size_t off = 5;
+    for (const auto& p : parts) {
+        if (!p.empty()) memcpy(buf + off, p.data(), p.size());
+        off += p.size();
+    }
+    return frame;
+}
+
+SharedBuffer encode_frame(uint8_t type, const std::string& payload){
+    return encode_frame(type, {std::string_view(payload)});
+}
+
+// 解析 payload 中 [begin, end) 的十进制数，为空或含非数字字符时返回 false
+bool parse_decimal(const std::string& payload, size_t begin, size_t end, uint64_t& value){
+    if (begin >= end) return false;
+    uint64_t v = 0;
+    for (size_t i = begin; i < end; ++i) {
+        char c = payload[i];
+        if (c < '0' || c > '9') return false;
+        v = v * 10 + (uint64_t)(c - '0');
+    }
+    value = v;
+    return true;
+}
+
+// 解析命令行参数中的十进制无符号整数，要求整个字符串都是数字且在 [min_value, max_value] 内
+// 返回: 格式错误或超出范围时返回 false，不抛异常，由调用方打印用法后退出
+bool parse_uint_arg(const char* text, uint64_t min_value, uint64_t max_value, uint64_t& value){
+    std::string s(text);
+    uint64_t v = 0;
+    if (s.size() > 19 || !parse_decimal(s, 0, s.size(), v) || v < min_value || v > max_value) return false;
+    value = v;
+    return true;
+}
+
+// 拆分 LOGIN 帧的 payload：昵称，以及可选的 '\0' + 上次收到的最后一条消息 ID
+// 没有 ID 或 ID 不是合法数字时 since 为 since_default
+void parse_login(const std::string& payload, std::string& nickname, uint64_t& since, uint64_t since_default){
+    size_t sep = payload.find('\0');
+    nickname = payload.substr(0, sep);
+    since = since_default;
+    if (sep != std::string::npos) parse_decimal(payload, sep + 1, payload.size(), since);
+}
+
+// 消息标签：'\0' + 房间名 + '\0' + 十进制消息 ID，接在 SERVER_BROADCAST 的正文之后（SERVER_HISTORY_MARK 没有正文）
+// ID 只在房间内递增，带上房间名，切换房间时交错到达的两个房间的帧也能分清
+// 编码时作为 encode_frame 的片段：{正文..., MESSAGE_TAG_SEP, 房间名, MESSAGE_TAG_SEP, ID}
+const std::string_view MESSAGE_TAG_SEP("\0", 1);
+
+// 拆分带标签的 payload：text 为标签之前的正文
+// 返回: 没有标签或 ID 不是合法数字时返回 false，此时 text 为整个 payload
+bool split_message_tag(const std::string& payload, std::string& text, std::string& room, uint64_t& id){
+    text = payload;
+    size_t id_sep = payload.rfind('\0');
+    if (id_sep == std::string::npos || id_sep == 0) return false;
+    size_t room_sep = payload.rfind('\0', id_sep - 1);
+    if (room_sep == std::string::npos || !parse_decimal(payload, id_sep + 1, payload.size(), id)) return false;
+    text = payload.substr(0, room_sep);
+    room = payload.substr(room_sep + 1, id_sep - room_sep - 1);
+    return true;
+}
+
+// 发送一帧已编码的数据
+bool send_frame(SOCKET s, const SharedBuffer& frame){
+    return send_all(s, frame.data(), (int)frame.size());
+}
+
+// 构造并发送一帧数据
+// 只需要传入 type 和 payload，函数会自动构造完整帧并调用 send_all 发送
+bool send_frame(SOCKET s, uint8_t type, const std::string& payload){
+    return send_frame(s, encode_frame(type, payload));
+}
+
+//===================增量帧读取器==================//
+
+const uint32_t MAX_FRAME_LEN = 64 * 1024;           // 单帧 len 字段（type + payload）的上限，超过视为非法帧
+const size_t FRAME_READER_BUF_SIZE = 128 * 1024;    // 阻塞读取时默认的环形缓冲区大小
+
+// next() 的返回结果
+enum FrameStatus {
+    FRAME_OK,           // 取出了一帧完整数据
+    FRAME_NEED_MORE,    // 缓冲区里没有完整帧，需要继续接收
+    FRAME_INVALID,      // len 为 0 或超过 MAX_FRAME_LEN，应断开连接
+};
+
+// 增量帧读取器
+// 一次 recv 尽量读满环形缓冲区的空闲空间，然后从中取出所有已完整到达的帧，不完整的帧留待下次拼接。
+// 小消息密集时一次 recv 可以取出多帧，代替原来每帧 3 次 recv（len、type、payload）。
+// 容量不足以容纳一个合法帧时按需扩容（上限由 MAX_FRAME_LEN 决定），因此初始容量可以按场景设小。
+class FrameReader {
+public:
+    explicit FrameReader(size_t capacity = FRAME_READER_BUF_SIZE)
+        : buf(capacity < 8 ? 8 : capacity), head(0), used(0), recv_count(0), frame_count(0) {}
+
+    // 取出一帧：只在缓冲区内解析，不会调用 recv
+    FrameStatus next(uint8_t& type, std::string& payload){
+        if (used < 5) return FRAME_NEED_MORE;
+        char hdr[5];
+        peek(hdr, 0, 5);
+        uint32_t len_be;
+        memcpy(&len_be, hdr, 4);
+        uint32_t len = ntohl(len_be);     // 网络字节序转为主机字节序，大端->小端
+        if (len < 1 || len > MAX_FRAME_LEN) return FRAME_INVALID;
+        if (used < 4 + (size_t)len) {
+            if (buf.size() < 4 + (size_t)len) grow(4 + (size_t)len);   // 保证这一帧能完整放下
+            return FRAME_NEED_MORE;
+        }
+        type = (uint8_t)hdr[4];
+        payload.resize(len - 1);
+        if (len > 1) peek(&payload[0], 5, len - 1);
+        consume(4 + (size_t)len);
+        frame_count++;
+        return FRAME_OK;
+    }
+
+    // 阻塞接收一次，把数据读入空闲空间（环形缓冲区回绕时用两段 WSABUF，仍只需一次系统调用）
+    // 返回值同 recv：>0 为读到的字节数，0 为对端关闭，<0 为出错
+    int fill(SOCKET s){
+        if (used == buf.size()) grow(buf.size() * 2);
+        WSABUF bufs[2];
+        DWORD count = free_segments(bufs);
+        DWORD got = 0, flags = 0;
+        recv_count++;
+        if (WSARecv(s, bufs, count, &got, &flags, NULL, NULL) == SOCKET_ERROR) return -1;
+        used += got;
+        return (int)got;
+    }
+
+    // 追加外部已接收的数据（IOCP 完成通知中的数据）；返回 false 表示积压超过单帧上限
+    bool feed(const char* data, size_t n){
+        recv_count++;
+        if (used + n > buf.size()) {
+            if (used + n > 2 * (4 + (size_t)MAX_FRAME_LEN)) return false;
+            grow(used + n);
+        }
+        WSABUF bufs[2];
+        DWORD count = free_segments(bufs);
+        for (DWORD i = 0; i < count && n > 0; ++i) {
+            size_t take = (std::min)((size_t)bufs[i].len, n);
+            memcpy(bufs[i].buf, data, take);
+            data += take;
+            n -= take;
+            used += take;
+        }
+        return true;
+    }
+
+    // 阻塞读取一帧：缓冲区内已有完整帧时直接返回，否则才调用 recv
+    // 返回 false 表示连接关闭、出错或收到非法帧
+    bool read_frame(SOCKET s, uint8_t& type, std::string& payload){
+        while (true) {
+            FrameStatus st = next(type, payload);
+            if (st == FRAME_OK) return true;
+            if (st == FRAME_INVALID) return false;
+            if (fill(s) <= 0) return false;
+        }
+    }
+
+    uint64_t recv_calls() const { return recv_count; }  // 接收次数（fill/feed 调用次数）
+    uint64_t frames() const { return frame_count; }     // 已取出的帧数
+
+private:
+    std::vector<char> buf;  // 环形缓冲区
+    size_t head;            // 第一个未读字节的位置
+    size_t used;            // 未读字节数
+    uint64_t recv_count;
+    uint64_t frame_count;
+
+    // 从 head 之后 off 处复制 n 字节（处理回绕）
+    void peek(char* dst, size_t off, size_t n){
+        size_t pos = (head + off) % buf.size();
+        size_t first = (std::min)(n, buf.size() - pos);
+        memcpy(dst, &buf[pos], first);
+        if (n > first) memcpy(dst + first, &buf[0], n - first);
+    }
+
+    void consume(size_t n){
+        head = (head + n) % buf.size();
+        used -= n;
+        if (used == 0) head = 0;    // 缓冲区为空时回到起点，减少回绕
+    }
+
+    // 空闲空间的一到两段（从写入位置到末尾，再从开头到 head）
+    DWORD free_segments(WSABUF bufs[2]){
+        size_t cap = buf.size();
+        size_t tail = (head + used) % cap;
+        size_t free_total = cap - used;
+        size_t first = (std::min)(free_total, cap - tail);
+        bufs[0].buf = &buf[tail];
+        bufs[0].len = (ULONG)first;
+        if (free_total > first) {
+            bufs[1].buf = &buf[0];
+            bufs[1].len = (ULONG)(free_total - first);
+            return 2;
+        }
+        return 1;
+    }
+
+    // 扩容到至少 min_cap 字节，并把未读数据线性化到新缓冲区开头
+    void grow(size_t min_cap){
+        size_t cap = buf.size();
+        while (cap < min_cap) cap *= 2;
+        std::vector<char> nb(cap);
+        if (used > 0) peek(&nb[0], 0, used);
+        buf.swap(nb);
+        head = 0;
+    }
+};
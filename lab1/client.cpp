@@ -12,33 +12,28 @@ std::atomic<bool> client_running(true);           // 客户端运行标志
 
 // 接收线程函数：循环地接收服务器发送的消息并打印到控制台
 void recv_thread(SOCKET s, const std::string& nickname){
+    FrameReader reader;
+    uint8_t type;
+    std::string payload;
     while (client_running){
-        // 和服务端一样的接收与检查逻辑
-        uint32_t len_be;
-        int rec = recv(s, (char*)&len_be, 4, MSG_WAITALL);
-        if (rec <= 0) break;
-        uint32_t len = ntohl(len_be);       // 服务器字节序转为主机字节序，大端->小端
-        if (len < 1) break;
-        uint8_t type;
-        rec = recv(s, (char*)&type, 1, MSG_WAITALL);
-        if (rec <= 0) break;
-        int payload_len = (int)len - 1;
-        std::string payload;
-        if (payload_len > 0) {
-            payload.resize(payload_len);
-            rec = recv(s, &payload[0], payload_len, MSG_WAITALL);
-            if (rec <= 0) break;
-        }
+        // 和服务端一样的接收与检查逻辑：一次 recv 可能带来多帧，缓冲区中有完整帧时直接取出
+        if (!reader.read_frame(s, type, payload)) break;
         // 根据消息类型打印不同的信息到 console
         if (type == SERVER_BROADCAST || type == SERVER_NOTICE) {
+            // 广播末尾的消息标签（房间名和消息 ID）不显示
+            std::string text = payload, room;
+            uint64_t id;
+            if (type == SERVER_BROADCAST) split_message_tag(payload, text, room, id);
             std::cout << "\r" << std::string(nickname.size() + 2, ' ') << "\r";  // 清除当前行
             set_console_color(type == SERVER_BROADCAST ? COLOR_DEFAULT : COLOR_YELLOW);
-            std::cout << payload << std::endl;
+            std::cout << text << std::endl;
             set_console_color(COLOR_DEFAULT);
             set_console_color(COLOR_CYAN);
             std::cout << nickname << ": ";  // 重新显示输入提示符
             set_console_color(COLOR_DEFAULT);
             std::cout.flush();
+        } else if (type == SERVER_HISTORY_MARK) {
+            // 历史回放结束，payload 为当前房间名和其中最新消息的 ID，控制台客户端不需要显示
         } else {
             // 未知类型，直接打印 raw 的 payload
             std::cout << "[unknown msg] " << payload << std::endl;
@@ -117,7 +112,7 @@ int main(){
 
     // 验证昵称是否合法
     auto is_valid_nickname = [](const std::string& name) -> bool {
-        if (name.empty()) return false;
+        if (name.empty() || name.size() > MAX_NICKNAME_LEN) return false;
         
         for (size_t i = 0; i < name.size(); ) {
             unsigned char c = name[i];
@@ -199,7 +194,7 @@ int main(){
     std::thread rcv(recv_thread, sock, nickname);
 
     set_console_color(COLOR_GREEN);
-    std::cout << "[CONNECTED] Type messages and press Enter to send. Type '/quit' to exit.\n";
+    std::cout << "[CONNECTED] Type messages and press Enter to send. '/join <room>' switches room, '/leave' returns to lobby, '/quit' exits.\n";
     set_console_color(COLOR_DEFAULT);
 
     // console 循环
@@ -219,7 +214,16 @@ int main(){
             send_frame(sock, CLIENT_LOGOUT, "");
             break;
         }
-        if (!send_frame(sock, CLIENT_MSG, line)) {
+        // 切换房间：/join <房间名> 进入（不存在则创建），/leave 回到默认房间
+        bool ok;
+        if (line.compare(0, 6, "/join ") == 0) {
+            ok = send_frame(sock, CLIENT_JOIN_ROOM, line.substr(6));
+        } else if (line == "/leave") {
+            ok = send_frame(sock, CLIENT_LEAVE_ROOM, "");
+        } else {
+            ok = send_frame(sock, CLIENT_MSG, line);
+        }
+        if (!ok) {
             set_console_color(COLOR_RED);
             std::cerr << "[ERROR] send failed\n";
             set_console_color(COLOR_DEFAULT);
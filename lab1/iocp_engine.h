@@ -0,0 +1,552 @@
+// iocp_engine.h
+//
+// 基于 I/O 完成端口 (IOCP) 的通用 TCP 连接引擎。
+// 固定大小的工作线程池（默认等于 CPU 核心数）处理所有连接的重叠 WSARecv/WSASend 完成通知，
+// 连接数不再决定线程数和栈内存。
+// 每个工作线程拥有自己的完成端口（分片）：连接在 attach 时轮流分配到某个分片，
+// 之后它的所有 I/O 完成通知都由同一个线程处理；上层也可以用 post_task 把任务固定投递到某个分片。
+// 上层继承 IocpEngine 并实现 on_recv / on_close 完成具体协议的解析。
+// 发送合并：同一连接排队的多帧用一次聚集 WSASend（多个 WSABUF）发出，
+// 在工作线程排空完成队列时或经过 set_flush_delay 设置的微秒级期限后刷新。
+// 发送队列里也可以放共享缓冲区的一段（send_slice）或文件区段（send_file），
+// 文件区段连同其头部由一次重叠 TransmitFile 发出，内核直接从文件缓存发送，不经过用户态缓冲区。
+
+#ifndef IOCP_ENGINE_H
+#define IOCP_ENGINE_H
+
+#include <winsock2.h>
+#include <windows.h>
+#include <mswsock.h>        // TransmitFile 扩展函数
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <atomic>
+#include <functional>
+#include "shared_buffer.h"
+
+const DWORD IOCP_RECV_BUF_SIZE = 8192;      // 每个连接的接收缓冲区大小
+const DWORD IOCP_MAX_SEND_BUFS = 64;        // 一次聚集 WSASend 最多携带的帧数
+const size_t IOCP_COALESCE_BYTES = 64 * 1024;   // 等待刷新期限时，积压达到该字节数立即发送
+const size_t TCP_SEGMENT_ESTIMATE = 1460;   // 估算 TCP 报文段数时使用的 MSS（以太网）
+
+// 发送统计：用于确认合并效果（每条消息的系统调用数、报文段数）
+// 报文段数按每次 WSASend 完成的字节数除以 MSS 估算（已启用 TCP_NODELAY，不再被 Nagle 合并）
+struct SendStats {
+    std::atomic<uint64_t> frames;       // 已发送完毕的帧（消息）数
+    std::atomic<uint64_t> bytes;        // 已发送的字节数
+    std::atomic<uint64_t> syscalls;     // WSASend / send 调用次数
+    std::atomic<uint64_t> segments;     // 估算的 TCP 报文段数
+
+    SendStats() : frames(0), bytes(0), syscalls(0), segments(0) {}
+
+    void on_write(size_t n) {
+        bytes += n;
+        segments += (n + TCP_SEGMENT_ESTIMATE - 1) / TCP_SEGMENT_ESTIMATE;
+    }
+};
+
+// IocpEngine::send 的结果
+enum SendResult {
+    SEND_OK,            // 已放入发送队列
+    SEND_CLOSED,        // 连接已关闭
+    SEND_OVERFLOW,      // 发送队列超过上限，连接已被断开
+};
+
+// 发送队列中的一项：内存数据（可以只发送共享缓冲区中的一段），或文件区段
+struct SendItem {
+    SharedBuffer buf;           // 内存数据；文件区段时为与文件内容一起发出的头部，可为空
+    size_t buf_offset;          // 只发送 buf 中 [buf_offset, buf_offset + buf_len) 的字节
+    size_t buf_len;
+    HANDLE file;                // 非空表示文件区段，由 TransmitFile 发送
+    uint64_t file_offset;
+    DWORD file_len;
+
+    explicit SendItem(const SharedBuffer& b, size_t offset = 0, size_t len = (size_t)-1)
+        : buf(b), buf_offset(offset), buf_len(len == (size_t)-1 ? b.size() - offset : len),
+          file(NULL), file_offset(0), file_len(0) {}
+
+    size_t size() const { return buf_len + file_len; }
+};
+
+// 重叠 I/O 操作类型
+enum IoOp : uint8_t {
+    IO_RECV = 1,
+    IO_SEND = 2,
+    IO_CLOSE = 3,   // 延迟关闭请求，由工作线程执行（调用方可能持有上层锁）
+    IO_TASK = 4,    // post_task 投递的任务，不属于任何连接
+    IO_FLUSH = 5,   // 刷新请求：把该连接已排队的帧合并发送
+};
+
+struct IocpConnection;
+
+// 重叠 I/O 上下文：OVERLAPPED 必须是第一个成员，完成通知返回的指针可直接转换回来
+struct IoContext {
+    OVERLAPPED ov;
+    IoOp op;
+    IocpConnection* conn;
+};
+
+// post_task 投递的任务
+struct IoTask : IoContext {
+    std::function<void()> fn;
+};
+
+// 一个 TCP 连接在引擎中的状态
+// 引用计数：引擎持有 1 个，每个未完成的重叠 I/O 各持有 1 个，归零时关闭 socket 并释放对象
+struct IocpConnection {
+    SOCKET sock;
+    unsigned shard;                     // 所属分片（工作线程）下标，attach 时分配
+    std::atomic<long> refs;
+    std::atomic<bool> closed;
+
+    IoContext recv_ctx;
+    char recv_buf[IOCP_RECV_BUF_SIZE];
+
+    IoContext send_ctx;
+    std::mutex send_mtx;                // 保护下面的发送状态
+    std::deque<SendItem> send_queue;    // 待发送的数据（共享缓冲区或文件区段，不拷贝），队首为正在发送的数据
+    size_t send_offset;                 // 队首一项已发送的字节数
+    size_t queued_bytes;                // 发送队列中所有项的总字节数
+    TRANSMIT_FILE_BUFFERS transmit_head;// 进行中的 TransmitFile 的头部描述，完成前必须保持有效
+    bool sending;                       // 是否有未完成的 WSASend
+    bool flush_pending;                 // 已投递刷新请求（或已在等待刷新期限），期间新帧只入队
+    bool flush_delayed;                 // 正在工作线程的 delayed 列表中等待刷新期限，flush_ctx 此时未投递
+    bool close_after_send;              // 发送队列清空后关闭连接
+    IoContext flush_ctx;
+
+    IoContext close_ctx;
+    std::atomic<bool> close_posted;     // 是否已投递过延迟关闭请求
+
+    explicit IocpConnection(SOCKET s)
+        : sock(s), shard(0), refs(1), closed(false), send_offset(0), queued_bytes(0), sending(false), flush_pending(false), flush_delayed(false),
+          close_after_send(false), close_posted(false) {
+        memset(&recv_ctx, 0, sizeof(recv_ctx));
+        recv_ctx.op = IO_RECV;
+        recv_ctx.conn = this;
+        memset(&send_ctx, 0, sizeof(send_ctx));
+        send_ctx.op = IO_SEND;
+        send_ctx.conn = this;
+        memset(&flush_ctx, 0, sizeof(flush_ctx));
+        flush_ctx.op = IO_FLUSH;
+        flush_ctx.conn = this;
+        memset(&transmit_head, 0, sizeof(transmit_head));
+        memset(&close_ctx, 0, sizeof(close_ctx));
+        close_ctx.op = IO_CLOSE;
+        close_ctx.conn = this;
+    }
+
+    virtual ~IocpConnection() {
+        if (sock != INVALID_SOCKET) closesocket(sock);
+    }
+
+    void add_ref() { refs++; }
+    void release() { if (--refs == 0) delete this; }
+};
+
+class IocpEngine {
+public:
+    IocpEngine() : next_shard(0), live_connections(0), send_queue_limit(0), flush_delay_us(0), transmit_file(nullptr) {}
+    virtual ~IocpEngine() { stop(); }
+
+    // 为每个工作线程创建一个完成端口并启动线程，workers 为 0 时取 CPU 核心数
+    // 工作线程数不超过核心数时，第 i 个线程绑定到第 i 个核心，分片数据留在同一核心的缓存里
+    bool start(unsigned workers = 0) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        unsigned cores = si.dwNumberOfProcessors > 0 ? (unsigned)si.dwNumberOfProcessors : 1;
+        if (workers == 0) workers = cores;
+        for (unsigned i = 0; i < workers; ++i) {
+            HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+            if (port == NULL) {
+                stop();
+                return false;
+            }
+            ports.push_back(port);
+        }
+        load_transmit_file();
+        bool pin = workers <= cores && cores <= 64;
+        for (unsigned i = 0; i < workers; ++i) {
+            threads.emplace_back(&IocpEngine::worker_loop, this, i, pin);
+        }
+        return true;
+    }
+
+    // 通知所有工作线程退出并等待其结束
+    void stop() {
+        for (size_t i = 0; i < threads.size(); ++i) {
+            PostQueuedCompletionStatus(ports[i], 0, 0, NULL);  // key 为 0 且无 OVERLAPPED 表示退出
+        }
+        for (auto& t : threads) {
+            if (t.joinable()) t.join();
+        }
+        threads.clear();
+        for (HANDLE port : ports) CloseHandle(port);
+        ports.clear();
+    }
+
+    // 把任务投递到指定分片，由该分片的工作线程按投递顺序执行
+    // 同一分片上的任务和该分片连接的 I/O 回调不会并发
+    bool post_task(unsigned shard, std::function<void()> fn) {
+        IoTask* task = new IoTask();
+        memset(&task->ov, 0, sizeof(OVERLAPPED));
+        task->op = IO_TASK;
+        task->conn = nullptr;
+        task->fn = std::move(fn);
+        if (!PostQueuedCompletionStatus(ports[shard % ports.size()], 0, 1, &task->ov)) {
+            delete task;
+            return false;
+        }
+        return true;
+    }
+
+    // 设置单个连接发送队列的字节上限，0 表示不限制
+    // 对端接收过慢导致积压超过上限时直接断开该连接，避免拖慢其他连接、占满内存
+    void set_send_queue_limit(size_t bytes) { send_queue_limit = bytes; }
+
+    // 设置刷新期限（微秒）：0 表示工作线程处理到刷新请求时立即发送（同一批广播已全部入队）；
+    // 大于 0 时第一帧入队后最多再等待这么久，让更多帧合并进同一次写，积压达到 IOCP_COALESCE_BYTES 时提前发送
+    // 工作线程的等待超时按毫秒取整，实际刷新粒度受系统定时器精度影响
+    void set_flush_delay(unsigned us) { flush_delay_us = us; }
+
+    const SendStats& stats() const { return send_stats; }
+
+    size_t worker_count() const { return threads.size(); }
+    unsigned shard_count() const { return (unsigned)ports.size(); }
+    long connection_count() const { return live_connections.load(); }
+
+    // 将已 accept 的连接轮流分配到一个分片并关联其完成端口，然后投递第一个接收请求
+    bool attach(IocpConnection* c) {
+        c->shard = next_shard++ % (unsigned)ports.size();
+        if (CreateIoCompletionPort((HANDLE)c->sock, ports[c->shard], (ULONG_PTR)c, 0) == NULL) {
+            return false;
+        }
+        live_connections++;
+        post_recv(c);
+        return true;
+    }
+
+    // 把一块数据放入连接的发送队列，不立即发送：
+    // 没有进行中的发送且尚未投递刷新请求时，向连接所属分片投递一个刷新请求，
+    // 工作线程处理到它之前入队的帧（例如同一批广播）会合并进同一次 WSASend；
+    // 正在发送时新帧留在队列里，上一次发送完成后一起发出
+    // 只增加共享缓冲区的引用计数，WSABUF 直接指向其中的字节
+    // 非阻塞：不会等待对端接收，可以在持有上层锁时调用
+    SendResult send(IocpConnection* c, const SharedBuffer& frame) {
+        return enqueue(c, SendItem(frame));
+    }
+
+    // 只发送共享缓冲区中 [offset, offset + len) 的字节（例如缓存文件的一个范围），不拷贝
+    SendResult send_slice(IocpConnection* c, const SharedBuffer& buf, size_t offset, size_t len) {
+        return enqueue(c, SendItem(buf, offset, len));
+    }
+
+    // 发送文件 file 中从 offset 开始的 len 字节，head 为紧挨在文件内容之前发出的数据（可为空）
+    // file 需要以 FILE_FLAG_OVERLAPPED 打开，并在发送完成前保持打开；多个连接可以同时发送同一个句柄
+    // 当前系统取不到 TransmitFile 时返回 SEND_CLOSED，调用方应改用内存数据
+    SendResult send_file(IocpConnection* c, const SharedBuffer& head, HANDLE file, uint64_t offset, DWORD len) {
+        if (!transmit_file) return SEND_CLOSED;
+        if (len == 0) return enqueue(c, SendItem(head));   // TransmitFile 的长度 0 表示整个文件
+        SendItem item(head);
+        item.file = file;
+        item.file_offset = offset;
+        item.file_len = len;
+        return enqueue(c, std::move(item));
+    }
+
+    bool transmit_file_available() const { return transmit_file != nullptr; }
+
+    // 发送队列中已有的数据发送完毕后再关闭连接（用于拒绝登录、服务器关闭通知等）
+    void close_after_send(IocpConnection* c) {
+        bool now;
+        {
+            std::lock_guard<std::mutex> lk(c->send_mtx);
+            c->close_after_send = true;
+            now = !c->sending && c->send_queue.empty();
+        }
+        if (now) request_close(c);
+    }
+
+    // 请求关闭连接：投递到完成端口由工作线程执行 close()，可以在持有上层锁时调用
+    void request_close(IocpConnection* c) {
+        if (c->closed || c->close_posted.exchange(true)) return;
+        c->add_ref();
+        if (!PostQueuedCompletionStatus(ports[c->shard], 0, (ULONG_PTR)c, &c->close_ctx.ov)) {
+            c->release();
+        }
+    }
+
+    // 关闭连接：取消未完成的 I/O，通知上层，并释放引擎持有的引用
+    // on_close 会在当前线程执行，调用方不能持有 on_close 内要获取的锁
+    void close(IocpConnection* c) {
+        {
+            std::lock_guard<std::mutex> lk(c->send_mtx);
+            if (c->closed) return;
+            c->closed = true;
+        }
+        shutdown(c->sock, SD_BOTH);
+        CancelIoEx((HANDLE)c->sock, NULL);
+        on_close(c);
+        live_connections--;
+        c->release();
+    }
+
+protected:
+    // 收到 n 字节数据，同一连接的回调不会并发执行
+    virtual void on_recv(IocpConnection* c, const char* data, size_t n) = 0;
+    // 连接关闭，只会调用一次
+    virtual void on_close(IocpConnection* c) = 0;
+
+private:
+    std::vector<HANDLE> ports;          // 每个工作线程一个完成端口
+    std::vector<std::thread> threads;
+    std::atomic<unsigned> next_shard;
+    std::atomic<long> live_connections;
+    size_t send_queue_limit;
+    unsigned flush_delay_us;
+    SendStats send_stats;
+    LPFN_TRANSMITFILE transmit_file;    // start 时取得，之后只读
+
+    // 单调时钟，微秒
+    static int64_t now_us() {
+        static LARGE_INTEGER freq = []{ LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+        LARGE_INTEGER t;
+        QueryPerformanceCounter(&t);
+        return (int64_t)(t.QuadPart / freq.QuadPart * 1000000 + t.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+    }
+
+    // send / send_slice / send_file 的公共部分：检查上限、入队，需要时投递刷新请求
+    SendResult enqueue(IocpConnection* c, SendItem&& item) {
+        bool ok = true;
+        bool post = false;
+        {
+            std::lock_guard<std::mutex> lk(c->send_mtx);
+            if (c->closed || c->close_posted) return SEND_CLOSED;
+            if (send_queue_limit && c->queued_bytes + item.size() > send_queue_limit) {
+                ok = false;
+            } else {
+                c->queued_bytes += item.size();
+                c->send_queue.push_back(std::move(item));
+                if (!c->sending && !c->flush_pending) {
+                    c->flush_pending = true;
+                    post = true;
+                } else if (c->flush_delayed && c->queued_bytes >= IOCP_COALESCE_BYTES) {
+                    // 等待刷新期限期间积压已足够大，立即重新投递刷新请求，不再等期限到达
+                    c->flush_delayed = false;
+                    post = true;
+                }
+            }
+        }
+        if (!ok) {
+            request_close(c);
+            return SEND_OVERFLOW;
+        }
+        if (post) {
+            c->add_ref();
+            if (!PostQueuedCompletionStatus(ports[c->shard], 0, (ULONG_PTR)c, &c->flush_ctx.ov)) {
+                c->release();
+                request_close(c);
+                return SEND_CLOSED;
+            }
+        }
+        return SEND_OK;
+    }
+
+    void post_recv(IocpConnection* c) {
+        if (c->closed) return;
+        WSABUF buf;
+        buf.buf = c->recv_buf;
+        buf.len = IOCP_RECV_BUF_SIZE;
+        DWORD flags = 0;
+        memset(&c->recv_ctx.ov, 0, sizeof(OVERLAPPED));
+        c->add_ref();
+        if (WSARecv(c->sock, &buf, 1, NULL, &flags, &c->recv_ctx.ov, NULL) == SOCKET_ERROR &&
+            WSAGetLastError() != WSA_IO_PENDING) {
+            c->release();
+            close(c);
+            return;
+        }
+        // 投递期间连接被其他线程关闭，补一次取消，避免该请求永远挂起
+        if (c->closed) CancelIoEx((HANDLE)c->sock, &c->recv_ctx.ov);
+    }
+
+    // 从扩展函数表取得 TransmitFile（不需要链接 mswsock 库），取不到时 send_file 不可用
+    void load_transmit_file() {
+        SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (s == INVALID_SOCKET) return;
+        GUID id = WSAID_TRANSMITFILE;
+        DWORD bytes = 0;
+        LPFN_TRANSMITFILE fn = nullptr;
+        if (WSAIoctl(s, SIO_GET_EXTENSION_FUNCTION_POINTER, &id, sizeof(id), &fn, sizeof(fn),
+                     &bytes, NULL, NULL) == 0) {
+            transmit_file = fn;
+        }
+        closesocket(s);
+    }
+
+    // 调用方需持有 send_mtx；队首是文件区段时用一次 TransmitFile 发出它（连同头部），
+    // 否则把队列前部最多 IOCP_MAX_SEND_BUFS 项内存数据合并为一次聚集 WSASend（遇到文件区段为止）
+    // 返回 false 表示发送失败，需要关闭连接
+    bool start_send_locked(IocpConnection* c) {
+        memset(&c->send_ctx.ov, 0, sizeof(OVERLAPPED));
+        const SendItem& front = c->send_queue.front();
+        if (front.file) {
+            // TransmitFile 只会整体完成或失败，不会停在中间
+            if (c->send_offset != 0) return false;
+            c->send_ctx.ov.Offset = (DWORD)(front.file_offset & 0xFFFFFFFFu);
+            c->send_ctx.ov.OffsetHigh = (DWORD)(front.file_offset >> 32);
+            TRANSMIT_FILE_BUFFERS* head = NULL;
+            if (front.buf_len > 0) {
+                c->transmit_head.Head = const_cast<char*>(front.buf.data()) + front.buf_offset;
+                c->transmit_head.HeadLength = (DWORD)front.buf_len;
+                c->transmit_head.Tail = NULL;
+                c->transmit_head.TailLength = 0;
+                head = &c->transmit_head;
+            }
+            c->sending = true;
+            c->add_ref();
+            send_stats.syscalls++;
+            if (!transmit_file(c->sock, front.file, front.file_len, 0, &c->send_ctx.ov, head, 0) &&
+                WSAGetLastError() != WSA_IO_PENDING) {
+                c->sending = false;
+                c->release();
+                return false;
+            }
+            return true;
+        }
+
+        WSABUF bufs[IOCP_MAX_SEND_BUFS];
+        DWORD n = 0;
+        for (auto it = c->send_queue.begin(); it != c->send_queue.end() && !it->file && n < IOCP_MAX_SEND_BUFS; ++it, ++n) {
+            size_t skip = n == 0 ? c->send_offset : 0;    // 队首一项可能已发送了一部分
+            bufs[n].buf = const_cast<char*>(it->buf.data()) + it->buf_offset + skip;
+            bufs[n].len = (ULONG)(it->buf_len - skip);
+        }
+        c->sending = true;
+        c->add_ref();
+        send_stats.syscalls++;
+        if (WSASend(c->sock, bufs, n, NULL, 0, &c->send_ctx.ov, NULL) == SOCKET_ERROR &&
+            WSAGetLastError() != WSA_IO_PENDING) {
+            c->sending = false;
+            c->release();
+            return false;
+        }
+        return true;
+    }
+
+    // 刷新请求或刷新期限到达：没有进行中的发送时把已排队的帧合并发出
+    // from_delay 为 true 表示 delayed 列表中的期限到达；若期间已提前重新投递了刷新请求，该项已失效
+    void flush(IocpConnection* c, bool from_delay = false) {
+        bool fail = false;
+        bool drained = false;
+        {
+            std::lock_guard<std::mutex> lk(c->send_mtx);
+            if (from_delay && !c->flush_delayed) return;
+            c->flush_delayed = false;
+            c->flush_pending = false;
+            if (c->closed || c->sending) return;
+            if (!c->send_queue.empty()) {
+                fail = !start_send_locked(c);
+            } else {
+                drained = c->close_after_send;
+            }
+        }
+        if (fail || drained) close(c);
+    }
+
+    // 是否还需要等待刷新期限：队列积压较少时才值得等待；返回 true 时连接标记为等待期限
+    bool should_delay_flush(IocpConnection* c) {
+        std::lock_guard<std::mutex> lk(c->send_mtx);
+        c->flush_delayed = !c->closed && !c->sending && c->queued_bytes < IOCP_COALESCE_BYTES;
+        return c->flush_delayed;
+    }
+
+    void on_send_complete(IocpConnection* c, bool ok, DWORD bytes) {
+        bool fail = !ok;
+        bool drained = false;
+        {
+            std::lock_guard<std::mutex> lk(c->send_mtx);
+            c->sending = false;
+            if (!fail && !c->closed) {
+                send_stats.on_write(bytes);
+                // 聚集发送可能跨越多项，依次弹出已完整发出的项
+                size_t done = c->send_offset + bytes;
+                while (!c->send_queue.empty() && done >= c->send_queue.front().size()) {
+                    done -= c->send_queue.front().size();
+                    c->queued_bytes -= c->send_queue.front().size();
+                    c->send_queue.pop_front();
+                    send_stats.frames++;
+                }
+                c->send_offset = done;
+                if (!c->send_queue.empty()) {
+                    fail = !start_send_locked(c);   // 发送期间积压的帧合并成下一次写
+                } else {
+                    drained = c->close_after_send;
+                }
+            }
+        }
+        if (fail || drained) close(c);
+    }
+
+    void worker_loop(unsigned index, bool pin) {
+        if (pin) SetThreadAffinityMask(GetCurrentThread(), (ULONG_PTR)1 << index);
+        HANDLE port = ports[index];
+        // 等待刷新期限的连接，按期限先后排列（期限 = 到达时间 + 固定延迟，天然有序），每项持有一个引用
+        std::deque<std::pair<int64_t, IocpConnection*>> delayed;
+        while (true) {
+            DWORD timeout = INFINITE;
+            if (!delayed.empty()) {
+                int64_t now = now_us();
+                while (!delayed.empty() && delayed.front().first <= now) {
+                    IocpConnection* c = delayed.front().second;
+                    delayed.pop_front();
+                    flush(c, true);
+                    c->release();
+                }
+                if (!delayed.empty()) timeout = (DWORD)((delayed.front().first - now + 999) / 1000);
+            }
+
+            DWORD bytes = 0;
+            ULONG_PTR key = 0;
+            LPOVERLAPPED ov = NULL;
+            BOOL ok = GetQueuedCompletionStatus(port, &bytes, &key, &ov, timeout);
+            if (ov == NULL) {
+                if (!ok && GetLastError() == WAIT_TIMEOUT) continue;   // 刷新期限到达
+                if (key == 0) break;    // stop() 投递的退出通知
+                continue;
+            }
+
+            IoContext* ctx = reinterpret_cast<IoContext*>(ov);
+            if (ctx->op == IO_TASK) {
+                IoTask* task = static_cast<IoTask*>(ctx);
+                task->fn();
+                delete task;
+                continue;
+            }
+            IocpConnection* c = ctx->conn;
+            if (ctx->op == IO_RECV) {
+                if (!ok || bytes == 0) {
+                    close(c);           // 对端关闭或出错
+                } else if (!c->closed) {
+                    on_recv(c, c->recv_buf, bytes);
+                    post_recv(c);
+                }
+            } else if (ctx->op == IO_SEND) {
+                on_send_complete(c, ok != FALSE, bytes);
+            } else if (ctx->op == IO_FLUSH) {
+                if (flush_delay_us > 0 && should_delay_flush(c)) {
+                    delayed.emplace_back(now_us() + flush_delay_us, c);
+                    continue;           // 引用转给 delayed，期限到达时释放
+                }
+                flush(c);
+            } else if (ctx->op == IO_CLOSE) {
+                close(c);
+            }
+            c->release();               // 释放该 I/O 持有的引用
+        }
+        for (auto& d : delayed) d.second->release();
+    }
+};
+
+#endif // IOCP_ENGINE_H
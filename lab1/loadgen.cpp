@@ -0,0 +1,329 @@
+// loadgen.cpp
+//
+// MinGW:
+//   g++ -std=c++17 -O2 loadgen.cpp -lws2_32 -o loadgen.exe
+//
+// Headless load generator for server.exe. Opens N simulated clients (LOGIN with generated nicknames),
+// lets the first S of them send CLIENT_MSG at a fixed rate, and measures on every receiving client
+// the fan-out latency from the timestamp embedded in each payload.
+//
+// Usage: loadgen.exe [--host IP] [--port N] [--clients N] [--senders S] [--rate R] [--size B]
+//                    [--duration SEC] [--drain MS] [--bad-login]
+//   --clients   simulated clients, all in #lobby (default 100)
+//   --senders   how many of them send messages (default 10)
+//   --rate      messages per second per sender (default 50)
+//   --size      CLIENT_MSG payload bytes, at least 24 (default 64)
+//   --duration  sending time in seconds (default 10)
+//   --drain     wait after sending stops before counting, in ms (default 1000)
+//   --bad-login before sending, log in one extra connection with an oversize nickname; the run fails
+//               unless the server answers SERVER_LOGIN_REJECT and no simulated client is dropped
+//
+// Report: connection setup rate, send/delivery throughput, p50/p99/p999/max fan-out latency (us).
+// Timestamps come from QueryPerformanceCounter, so loadgen must run all clients on one machine.
+
+#include "chatroom.h"
+#include <cstdlib>
+
+const size_t LOADGEN_SELECT_GROUP = 64;     // 每个接收线程负责的 socket 数（Windows 默认 FD_SETSIZE）
+const size_t LOADGEN_MIN_SIZE = 24;         // 载荷至少要放下时间戳和序号
+
+// 单调时钟，微秒
+int64_t now_us(){
+    static LARGE_INTEGER freq = []{ LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return (int64_t)(t.QuadPart / freq.QuadPart * 1000000 + t.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+}
+
+// 一个模拟客户端
+struct SimClient {
+    SOCKET sock = INVALID_SOCKET;
+    FrameReader reader{16 * 1024};
+    bool alive = false;
+    bool live = false;              // 已收到 SERVER_HISTORY_MARK，之后的广播才是本次压测的消息
+};
+
+// 一个接收线程的统计，线程结束后由主线程合并
+struct RecvStats {
+    std::vector<uint32_t> latencies;    // 每次投递的扇出延迟（微秒）
+    uint64_t delivered = 0;             // 收到的 SERVER_BROADCAST 帧数（不含登录时回放的历史）
+    uint64_t bytes = 0;                 // 收到的 payload 字节数
+    uint64_t rejected = 0;              // 登录被拒绝的客户端数
+    uint64_t dropped = 0;               // 被服务器断开的客户端数
+};
+
+std::atomic<bool> receiving(true);      // 接收线程运行标志
+std::atomic<bool> sending(true);        // 发送线程运行标志
+
+// 从 SERVER_BROADCAST 的 payload（"nick: <时间戳> <序号> xxx..."）中取出发送时间戳
+bool parse_timestamp(const std::string& payload, int64_t& ts){
+    size_t p = payload.find(": ");
+    if (p == std::string::npos) return false;
+    const char* begin = payload.c_str() + p + 2;
+    char* end = nullptr;
+    long long v = std::strtoll(begin, &end, 10);
+    if (end == begin) return false;
+    ts = (int64_t)v;
+    return true;
+}
+
+// 接收线程：用 select 同时等待一组 socket，可读时一次 fill 后取出所有完整帧
+void recv_group(std::vector<SimClient>* clients, size_t first, size_t last, RecvStats* st){
+    uint8_t type;
+    std::string payload;
+    while (receiving) {
+        fd_set rd;
+        FD_ZERO(&rd);
+        size_t watching = 0;
+        for (size_t i = first; i < last; ++i) {
+            if ((*clients)[i].alive) {
+                FD_SET((*clients)[i].sock, &rd);
+                watching++;
+            }
+        }
+        if (watching == 0) break;
+        timeval tv{0, 100 * 1000};      // 定期醒来检查 receiving
+        int n = select(0, &rd, NULL, NULL, &tv);
+        if (n <= 0) continue;
+
+        int64_t now = now_us();
+        for (size_t i = first; i < last; ++i) {
+            SimClient& c = (*clients)[i];
+            if (!c.alive || !FD_ISSET(c.sock, &rd)) continue;
+            if (c.reader.fill(c.sock) <= 0) {
+                c.alive = false;
+                st->dropped++;
+                continue;
+            }
+            FrameStatus fs;
+            while ((fs = c.reader.next(type, payload)) == FRAME_OK) {
+                if (type == SERVER_HISTORY_MARK) {
+                    c.live = true;
+                } else if (type == SERVER_BROADCAST && c.live) {
+                    // 登录时回放的历史消息带着旧时间戳，不计入投递和延迟
+                    int64_t ts;
+                    st->delivered++;
+                    st->bytes += payload.size();
+                    if (parse_timestamp(payload, ts) && now >= ts) st->latencies.push_back((uint32_t)(now - ts));
+                } else if (type == SERVER_LOGIN_REJECT) {
+                    st->rejected++;
+                }
+            }
+            if (fs == FRAME_INVALID) {
+                c.alive = false;
+                st->dropped++;
+            }
+        }
+    }
+}
+
+// 用超长昵称登录一个额外的连接：服务器应回复 SERVER_LOGIN_REJECT，而不是把超长的加入通知广播给房间
+// 返回: timeout_ms 内收到 SERVER_LOGIN_REJECT 时返回 true
+bool probe_oversize_login(const sockaddr_in& srv, int timeout_ms){
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCKET) return false;
+    bool rejected = false;
+    // LOGIN 帧本身仍是合法帧，但 "[昵称 joined #lobby]" 会超过 MAX_FRAME_LEN
+    std::string nickname(MAX_FRAME_LEN - 1, 'x');
+    if (connect(s, (const sockaddr*)&srv, sizeof(srv)) != SOCKET_ERROR && send_frame(s, CLIENT_LOGIN, nickname)) {
+        FrameReader reader;
+        uint8_t type;
+        std::string payload;
+        int64_t deadline = now_us() + (int64_t)timeout_ms * 1000;
+        while (!rejected) {
+            int64_t left = deadline - now_us();
+            if (left <= 0) break;
+            fd_set rd;
+            FD_ZERO(&rd);
+            FD_SET(s, &rd);
+            timeval tv{(long)(left / 1000000), (long)(left % 1000000)};
+            if (select(0, &rd, NULL, NULL, &tv) <= 0 || reader.fill(s) <= 0) break;
+            FrameStatus fs;
+            while ((fs = reader.next(type, payload)) == FRAME_OK) {
+                if (type == SERVER_LOGIN_REJECT) rejected = true;
+            }
+            if (fs == FRAME_INVALID) break;
+        }
+    }
+    closesocket(s);
+    return rejected;
+}
+
+// 发送线程：按固定速率让前 senders 个客户端发送消息，落后时补发
+void send_loop(std::vector<SimClient>* clients, size_t senders, double rate, size_t size,
+               int64_t duration_us, std::atomic<uint64_t>* sent){
+    std::vector<uint64_t> done(senders, 0);
+    int64_t start = now_us();
+    uint64_t seq = 0;
+    while (sending) {
+        int64_t elapsed = now_us() - start;
+        if (elapsed >= duration_us) break;
+        uint64_t due = (uint64_t)((double)elapsed / 1e6 * rate);
+        for (size_t i = 0; i < senders; ++i) {
+            SimClient& c = (*clients)[i];
+            while (done[i] < due) {
+                std::string msg = std::to_string(now_us()) + " " + std::to_string(seq++) + " ";
+                if (msg.size() < size) msg.append(size - msg.size(), 'x');
+                if (!send_frame(c.sock, CLIENT_MSG, msg)) break;
+                done[i]++;
+                (*sent)++;
+            }
+        }
+        Sleep(1);
+    }
+}
+
+// 已排序数组的百分位数
+uint32_t percentile(const std::vector<uint32_t>& sorted, double p){
+    if (sorted.empty()) return 0;
+    size_t idx = (size_t)(p * (double)sorted.size());
+    if (idx >= sorted.size()) idx = sorted.size() - 1;
+    return sorted[idx];
+}
+
+int main(int argc, char* argv[]){
+    // 解析启动参数
+    std::string host = "127.0.0.1";
+    int port = 12345;
+    size_t n_clients = 100, n_senders = 10, size = 64;
+    double rate = 50;
+    double duration = 10;
+    int drain_ms = 1000;
+    bool bad_login = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--bad-login") { bad_login = true; continue; }
+        if (i + 1 >= argc) arg = "";    // 其余参数都需要一个值
+        // 数值参数不是合法的数或超出范围时同样打印用法，不让 std::sto* 抛出未捕获的异常
+        const char* text = arg.empty() ? "" : argv[i + 1];
+        uint64_t v = 0;
+        char* end = nullptr;
+        double d = std::strtod(text, &end);
+        bool real_ok = end != text && *end == '\0' && d > 0 && d < 1e9;
+        bool ok = true, known = true;
+        if (arg == "--host") host = text;
+        else if (arg == "--port") { ok = parse_uint_arg(text, 1, 65535, v); port = (int)v; }
+        else if (arg == "--clients") { ok = parse_uint_arg(text, 1, 1000000, v); n_clients = (size_t)v; }
+        else if (arg == "--senders") { ok = parse_uint_arg(text, 0, 1000000, v); n_senders = (size_t)v; }
+        else if (arg == "--rate") { ok = real_ok; rate = d; }
+        else if (arg == "--size") { ok = parse_uint_arg(text, 0, MAX_FRAME_LEN - 1, v); size = (size_t)v; }
+        else if (arg == "--duration") { ok = real_ok; duration = d; }
+        else if (arg == "--drain") { ok = parse_uint_arg(text, 0, 3600 * 1000, v); drain_ms = (int)v; }
+        else known = ok = false;
+        if (!ok) {
+            if (known) std::cerr << "Invalid value for " << arg << ": '" << text << "'\n";
+            std::cerr << "Usage: loadgen.exe [--host IP] [--port N] [--clients N] [--senders S] [--rate R] [--size B]\n"
+                         "                   [--duration SEC] [--drain MS] [--bad-login]\n";
+            return 1;
+        }
+        ++i;
+    }
+    if (n_clients == 0) n_clients = 1;
+    if (n_senders > n_clients) n_senders = n_clients;
+    if (size < LOADGEN_MIN_SIZE) size = LOADGEN_MIN_SIZE;
+
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2,2), &wsa) != 0) {
+        std::cerr << "WSAStartup failed\n";
+        return 1;
+    }
+
+    sockaddr_in srv{};
+    srv.sin_family = AF_INET;
+    srv.sin_addr.s_addr = inet_addr(host.c_str());
+    srv.sin_port = htons((u_short)port);
+
+    // 建立连接并登录，统计连接建立速率
+    std::vector<SimClient> clients(n_clients);
+    std::string prefix = "lg" + std::to_string(GetCurrentProcessId()) + "_";  // 避免多个 loadgen 昵称冲突
+    size_t connected = 0;
+    int64_t t0 = now_us();
+    for (size_t i = 0; i < n_clients; ++i) {
+        SimClient& c = clients[i];
+        c.sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (c.sock == INVALID_SOCKET) continue;
+        BOOL on = TRUE;
+        setsockopt(c.sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+        if (connect(c.sock, (sockaddr*)&srv, sizeof(srv)) == SOCKET_ERROR ||
+            !send_frame(c.sock, CLIENT_LOGIN, prefix + std::to_string(i))) {
+            closesocket(c.sock);
+            c.sock = INVALID_SOCKET;
+            continue;
+        }
+        c.alive = true;
+        connected++;
+    }
+    double connect_s = (double)(now_us() - t0) / 1e6;
+    std::cout << "Connections: " << connected << "/" << n_clients << " in " << connect_s * 1000 << " ms ("
+              << (connect_s > 0 ? (double)connected / connect_s : 0) << " conn/s)\n";
+    if (connected < n_clients || !clients[0].alive) {
+        std::cerr << "[ERROR] some connections failed, is server.exe running on " << host << ":" << port << "?\n";
+        for (auto& c : clients) if (c.sock != INVALID_SOCKET) closesocket(c.sock);
+        WSACleanup();
+        return 1;
+    }
+
+    // 每组 socket 一个接收线程
+    size_t groups = (n_clients + LOADGEN_SELECT_GROUP - 1) / LOADGEN_SELECT_GROUP;
+    std::vector<RecvStats> stats(groups);
+    std::vector<std::thread> receivers;
+    for (size_t g = 0; g < groups; ++g) {
+        size_t first = g * LOADGEN_SELECT_GROUP;
+        size_t last = (std::min)(first + LOADGEN_SELECT_GROUP, n_clients);
+        receivers.emplace_back(recv_group, &clients, first, last, &stats[g]);
+    }
+    Sleep(200);     // 等待登录和进房间通知到达，不计入测量
+
+    // 超长昵称的登录应被拒绝，房间内的模拟客户端不受影响（是否有客户端被断开在最后统计）
+    bool bad_login_rejected = bad_login && probe_oversize_login(srv, 2000);
+
+    // 按速率发送，结束后等待在途消息
+    std::atomic<uint64_t> sent(0);
+    std::cout << "Sending: " << n_senders << " senders x " << rate << " msg/s, " << size << " bytes, "
+              << duration << " s\n";
+    int64_t t1 = now_us();
+    send_loop(&clients, n_senders, rate, size, (int64_t)(duration * 1e6), &sent);
+    double send_s = (double)(now_us() - t1) / 1e6;
+    Sleep(drain_ms);
+    receiving = false;
+    for (auto& t : receivers) t.join();
+
+    // 合并统计
+    RecvStats total;
+    for (auto& st : stats) {
+        total.delivered += st.delivered;
+        total.bytes += st.bytes;
+        total.rejected += st.rejected;
+        total.dropped += st.dropped;
+        total.latencies.insert(total.latencies.end(), st.latencies.begin(), st.latencies.end());
+    }
+    std::sort(total.latencies.begin(), total.latencies.end());
+    uint64_t expected = sent.load() * (n_clients - 1);
+
+    std::cout << "Sent: " << sent.load() << " msgs (" << (double)sent.load() / send_s << " msg/s)\n"
+              << "Delivered: " << total.delivered << "/" << expected << " msgs ("
+              << (double)total.delivered / send_s << " msg/s, "
+              << (double)total.bytes / send_s / (1024 * 1024) << " MB/s)\n";
+    if (total.rejected || total.dropped) {
+        std::cout << "Rejected logins: " << total.rejected << ", dropped by server: " << total.dropped << "\n";
+    }
+    std::cout << "Fan-out latency (us): p50 " << percentile(total.latencies, 0.50)
+              << "  p99 " << percentile(total.latencies, 0.99)
+              << "  p999 " << percentile(total.latencies, 0.999)
+              << "  max " << (total.latencies.empty() ? 0 : total.latencies.back()) << "\n";
+
+    bool failed = false;
+    if (bad_login) {
+        failed = !bad_login_rejected || total.dropped > 0;
+        std::cout << "Oversize login: " << (bad_login_rejected ? "rejected" : "NOT rejected") << ", "
+                  << total.dropped << " clients dropped -> " << (failed ? "FAIL" : "PASS") << "\n";
+    }
+
+    for (auto& c : clients) {
+        if (c.sock == INVALID_SOCKET) continue;
+        send_frame(c.sock, CLIENT_LOGOUT, "");
+        closesocket(c.sock);
+    }
+    WSACleanup();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+// room_history.h
+//
+// 房间消息历史：固定大小的字节环 + 固定条数的索引环。
+// 保存的是已编码好的完整帧（与 send_frame 发出的字节完全相同），回放时直接拷贝拼接，不再重新编码；
+// 每条消息有房间内单调递增的 ID。字节环在第一次保存消息时一次分配，之后不随流量增长，
+// 空间或条数不够时淘汰最旧的消息。
+
+#ifndef ROOM_HISTORY_H
+#define ROOM_HISTORY_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "shared_buffer.h"
+
+const size_t HISTORY_DEFAULT_BYTES = 256 * 1024;    // 每个房间字节环的默认大小
+const size_t HISTORY_DEFAULT_ENTRIES = 1024;        // 每个房间最多保留的消息条数
+const uint64_t HISTORY_NO_SINCE = ~0ull;            // replay 的 since 参数：未指定 ID，回放最近 N 条
+
+class RoomHistory {
+public:
+    RoomHistory(size_t arena_bytes = HISTORY_DEFAULT_BYTES, size_t max_entries = HISTORY_DEFAULT_ENTRIES)
+        : cap(arena_bytes),
+          entries(max_entries ? max_entries : 1), oldest(0), count(0), next_id(1) {}
+
+    // 功能: 为新消息分配 ID，编码并追加
+    // 参数: make_frame(id) 返回带该 ID 的完整帧（4 字节长度 + type + payload），在锁内调用
+    // 返回: 编码好的帧；帧比整个字节环还大（包括字节环大小为 0）时只分配 ID，不保存
+    // 说明: ID 的分配和入环在同一把锁内，线程引擎下并发追加时历史中的顺序与 ID 顺序一致
+    template <class FrameFn>
+    SharedBuffer append(FrameFn make_frame){
+        std::lock_guard<std::mutex> lk(mtx);
+        uint64_t id = next_id++;
+        SharedBuffer frame = make_frame(id);
+        size_t len = frame.size();
+        if (len == 0 || len > cap) return frame;
+        if (!arena) arena.reset(new char[cap]);     // 没人说过话的房间不占用字节环
+        if (count == entries.size()) evict();
+        size_t off;
+        while (!place(len, off)) evict();
+        memcpy(arena.get() + off, frame.data(), len);
+        Entry& e = entries[(oldest + count) % entries.size()];
+        e.id = id;
+        e.offset = off;
+        e.len = len;
+        count++;
+        return frame;
+    }
+
+    // 功能: 把要回放的消息拼接成一块连续缓冲区
+    // 参数: since 为客户端已收到的最后一条消息 ID（HISTORY_NO_SINCE 表示未提供），
+    //       max_count 为未提供 ID 时回放的最大条数，
+    //       make_tail(last_id, replayed) 返回追加在末尾的额外帧，last_id 为最新一条的 ID（还没有消息时为 0）
+    // 返回: 拼接好的缓冲区，入队一次即可由一次聚集写发出
+    // 说明: since 早于最旧的保留消息时回放全部保留的消息；make_tail 在锁内调用，看到的 ID 与回放内容一致
+    template <class TailFn>
+    SharedBuffer replay(uint64_t since, size_t max_count, TailFn make_tail) const {
+        std::lock_guard<std::mutex> lk(mtx);
+        size_t first = count;
+        if (since == HISTORY_NO_SINCE) {
+            first = count > max_count ? count - max_count : 0;
+        } else {
+            // ID 单调递增，从最新一条向前找到第一条 ID 不大于 since 的消息
+            while (first > 0 && at(first - 1).id > since) first--;
+        }
+        std::vector<SharedBuffer> tail = make_tail(next_id - 1, count - first);
+
+        size_t total = 0;
+        for (size_t i = first; i < count; ++i) total += at(i).len;
+        for (const auto& f : tail) total += f.size();
+        if (total == 0) return SharedBuffer();
+
+        SharedBuffer out(total);
+        char* p = out.writable();
+        for (size_t i = first; i < count; ++i) {
+            const Entry& e = at(i);
+            memcpy(p, arena.get() + e.offset, e.len);
+            p += e.len;
+        }
+        for (const auto& f : tail) {
+            memcpy(p, f.data(), f.size());
+            p += f.size();
+        }
+        return out;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lk(mtx);
+        return count;
+    }
+
+private:
+    struct Entry {
+        uint64_t id = 0;
+        size_t offset = 0;          // 在字节环中的起始位置，一帧总是连续存放
+        size_t len = 0;
+    };
+
+    mutable std::mutex mtx;         // IOCP 引擎下房间操作已在分片上串行，锁无竞争；线程引擎下保护并发追加
+    std::unique_ptr<char[]> arena;  // 第一次 append 保存消息时分配
+    size_t cap;
+    std::vector<Entry> entries;     // 索引环，容量固定
+    size_t oldest;                  // 最旧一条在索引环中的下标
+    size_t count;
+    uint64_t next_id;
+
+    const Entry& at(size_t i) const { return entries[(oldest + i) % entries.size()]; }
+
+    void evict(){
+        oldest = (oldest + 1) % entries.size();
+        count--;
+    }
+
+    // 在字节环中为 len 字节找一段连续空间；找不到时返回 false，由调用方淘汰最旧的消息后重试
+    // 数据区从最旧一条开始到最新一条结束：未回绕时占用 [tail, head)，回绕后占用 [tail, cap) 和 [0, head)
+    bool place(size_t len, size_t& off) const {
+        if (count == 0) { off = 0; return true; }
+        const Entry& first = at(0);
+        const Entry& last = at(count - 1);
+        size_t tail = first.offset;
+        size_t head = last.offset + last.len;
+        if (last.offset >= tail) {
+            // 未回绕：优先用末尾的空闲，不够时回到开头（末尾剩余的字节留空）
+            if (cap - head >= len) { off = head; return true; }
+            if (tail >= len) { off = 0; return true; }
+            return false;
+        }
+        if (tail - head >= len) { off = head; return true; }
+        return false;
+    }
+};
+
+#endif // ROOM_HISTORY_H
@@ -3,112 +3,505 @@
 // MinGW:
 //   g++ -std=c++17 server.cpp -lws2_32 -o server.exe
 //
-// Simple multi-client chat server using Winsock2 + std::thread.
+// Simple multi-client chat server using Winsock2.
 // Protocol: 4-byte big-endian length + 1-byte type + payload (UTF-8)
+//
+// Usage: server.exe [--engine iocp|thread] [--workers N] [--max-queue-bytes N] [--flush-us N]
+//                   [--history N] [--history-bytes N]
+//   iocp   (default) I/O completion port + fixed worker pool, threads do not grow with connections
+//   thread           one blocking std::thread per client (original engine)
+//   --max-queue-bytes  per-client outbound queue cap, a client exceeding it is disconnected (default 1 MB)
+//   --flush-us N       write coalescing deadline in microseconds: frames queued for one client are merged
+//                      into a single gathered write when the queue is drained or after N us (default 0)
+//   --history N        messages replayed to a client entering a room (default 20)
+//   --history-bytes N  per-room history ring size in bytes, 0 disables history (default 256 KB)
+//
+// Rooms: clients start in #lobby; CLIENT_JOIN_ROOM / CLIENT_LEAVE_ROOM switch rooms.
+//   Each room has its own member table and lock, and under iocp it is pinned to one worker,
+//   so fan-out for different rooms runs on different cores.
+//   A room is removed when its last member leaves (#lobby is kept); at most 256 other rooms exist at once.
+//
+// History: every room keeps its recent broadcasts as encoded frames in a fixed-size ring (room_history.h).
+//   On entering a room the client gets the last N messages, or everything after the ID it sent in LOGIN
+//   ("nickname\0<id>", lobby only), followed by SERVER_HISTORY_MARK carrying the newest ID, all in one write.
+//   Broadcasts and the mark end with a tag naming the room and the message ID (see split_message_tag).
 
 #include "chatroom.h"
-
-std::vector<ClientInfo> clients;            // 已连接客户端列表
-std::atomic<int> room_count(0);             // 当前房间人数
-std::mutex clients_mtx;                     // 保护 clients 列表的互斥锁
+#include "iocp_engine.h"
+#include "room_history.h"
+#include "../common/async_log.h"
+#include <deque>
+#include <condition_variable>
+#include <shared_mutex>
+#include <unordered_map>
+
+std::atomic<int> online_count(0);           // 当前在线总人数（各房间人数见 Room::members）
 std::atomic<bool> server_running(true);     // 服务器运行标志
 SOCKET listen_sock = INVALID_SOCKET;        // 监听 socket
 
-// 广播消息给所有客户端，except 参数指定排除的 socket（一般是发送者自己）
-void broadcast_except(SOCKET except, uint8_t type, const std::string& payload){
-    std::lock_guard<std::mutex> lk(clients_mtx);
-    for (auto it = clients.begin(); it != clients.end(); ){
-        SOCKET s = it->sock;
-        if (s == except) { ++it; continue; }
-        if (!send_frame(s, type, payload)) {
-            // 发送失败则移除该客户端
-            closesocket(s);
-            it = clients.erase(it);
-        } else ++it;
+IocpEngine* iocp_engine = nullptr;          // IOCP 引擎实例（线程引擎下为空）
+size_t max_queue_bytes = 1 << 20;           // 每个客户端发送队列的字节上限
+unsigned flush_delay_us = 0;                // 发送合并的刷新期限（微秒），0 表示队列排空即发送
+SendStats thread_send_stats;                // 线程引擎的发送统计（IOCP 引擎的统计在引擎内部）
+size_t history_replay = 20;                 // 进入房间时回放的历史消息条数
+size_t history_bytes = HISTORY_DEFAULT_BYTES;   // 每个房间历史字节环的大小，0 表示不保留历史
+
+// 各类事件的限流：大量客户端同时连接、断开或积压超限时，控制台每秒只显示前若干条
+LogRateLimit connect_log_limit(20);
+LogRateLimit disconnect_log_limit(20);
+LogRateLimit error_log_limit(10);
+
+// 在 ADMIN 提示符前插入一行事件信息，show_count 为 true 时附带当前在线总人数
+// 网络线程只把文本放进异步输出队列，着色、写终端和重新显示提示符都由输出线程完成
+void admin_log(WORD color, const std::string& line, bool show_count, LogRateLimit& limit){
+    if (!async_log().line(limit, color, line)) return;
+    if (show_count) async_log().line("Online users: " + std::to_string(online_count.load()));
+}
+
+//===================客户端发送队列==================//
+
+// 关闭 Nagle 算法：小帧的合并由发送队列完成，不再需要内核额外等待
+void set_nodelay(SOCKET s){
+    BOOL on = TRUE;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+// 阻塞地把多帧合并为一次聚集 WSASend 发出，部分发送时从断点继续
+bool send_gather(SOCKET s, const std::vector<SharedBuffer>& frames){
+    WSABUF bufs[IOCP_MAX_SEND_BUFS];
+    DWORD n = 0;
+    for (const auto& f : frames) {
+        bufs[n].buf = const_cast<char*>(f.data());
+        bufs[n].len = (ULONG)f.size();
+        ++n;
     }
+    DWORD first = 0;
+    while (first < n) {
+        DWORD sent = 0;
+        thread_send_stats.syscalls++;
+        if (WSASend(s, bufs + first, n - first, &sent, 0, NULL, NULL) == SOCKET_ERROR) return false;
+        thread_send_stats.on_write(sent);
+        while (first < n && sent >= bufs[first].len) {
+            sent -= bufs[first].len;
+            ++first;
+        }
+        if (first < n) {
+            bufs[first].buf += sent;
+            bufs[first].len -= sent;
+        }
+    }
+    thread_send_stats.frames += n;
+    return true;
 }
 
-// 遍历，从 clients 列表中移除指定 socket 的客户端
-void remove_client(SOCKET s){
-    std::lock_guard<std::mutex> lk(clients_mtx);
-    for (auto it = clients.begin(); it != clients.end(); ++it){
-        if (it->sock == s){
-            clients.erase(it);
-            break;
+// 每个客户端的发送队列：push 只入队不阻塞，由各自的发送机制在锁外排空
+// 积压超过 max_queue_bytes 的客户端被断开，不会拖慢其他客户端的广播
+struct ClientOutbox {
+    explicit ClientOutbox(const std::string& nick) : nickname(nick) {}
+    virtual ~ClientOutbox() {}
+
+    // 放入一帧完整数据；返回 false 表示连接已关闭或因积压超限被断开
+    virtual bool push(const SharedBuffer& frame) = 0;
+    // 已入队的数据发送完毕后关闭连接
+    virtual void close_after_flush() = 0;
+
+protected:
+    std::string nickname;
+
+    void log_overflow(){
+        admin_log(COLOR_RED, "[WARN] User [" + nickname + "] disconnected: outbound queue exceeded "
+                  + std::to_string(max_queue_bytes) + " bytes", false, error_log_limit);
+    }
+};
+
+// 线程引擎：每个客户端一个写线程，阻塞的 send 只会卡住该客户端自己的写线程
+// 代价是线程数翻倍（每个客户端一读一写），大量连接时应使用 IOCP 引擎
+class ThreadOutbox : public ClientOutbox {
+public:
+    ThreadOutbox(SOCKET s, const std::string& nick)
+        : ClientOutbox(nick), sock(s), queued_bytes(0), closed(false), flush_then_close(false), stopped(false) {
+        writer = std::thread(&ThreadOutbox::writer_loop, this);
+    }
+    ~ThreadOutbox() override { stop(); }
+
+    bool push(const SharedBuffer& frame) override {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            if (closed) return false;
+            if (queued_bytes + frame.size() <= max_queue_bytes) {
+                queue.push_back(frame);
+                queued_bytes += frame.size();
+                cv.notify_one();
+                return true;
+            }
+            // 积压超限：关闭连接，读线程从 recv 返回后完成清理
+            // shutdown 必须在锁内调用：读线程的 stop() 在同一把锁下置 closed 后才会 closesocket，
+            // 锁外调用可能落在已关闭甚至被复用的句柄上
+            closed = true;
+            shutdown(sock, SD_BOTH);
+        }
+        cv.notify_one();
+        log_overflow();
+        return false;
+    }
+
+    void close_after_flush() override {
+        std::lock_guard<std::mutex> lk(mtx);
+        flush_then_close = true;
+        cv.notify_one();
+    }
+
+    // 停止写线程（读线程清理时调用），之后才能关闭 socket；重复调用无效果
+    void stop(){
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            if (stopped) return;
+            stopped = true;
+            closed = true;
+        }
+        cv.notify_one();
+        shutdown(sock, SD_BOTH);    // 唤醒可能阻塞在 send 中的写线程
+        if (writer.joinable()) writer.join();
+    }
+
+private:
+    SOCKET sock;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<SharedBuffer> queue;
+    size_t queued_bytes;
+    bool closed;
+    bool flush_then_close;
+    bool stopped;
+    std::thread writer;
+
+    void writer_loop(){
+        std::unique_lock<std::mutex> lk(mtx);
+        while (true) {
+            cv.wait(lk, [this]{ return closed || flush_then_close || !queue.empty(); });
+            if (closed) return;
+            if (queue.empty()) {
+                // 队列已排空且要求关闭：关闭连接，读线程随后清理
+                lk.unlock();
+                shutdown(sock, SD_BOTH);
+                return;
+            }
+            // 设置了刷新期限时再等一会儿，让更多帧合并进同一次写
+            if (flush_delay_us > 0 && queued_bytes < IOCP_COALESCE_BYTES) {
+                cv.wait_for(lk, std::chrono::microseconds(flush_delay_us),
+                            [this]{ return closed || queued_bytes >= IOCP_COALESCE_BYTES; });
+                if (closed) return;
+            }
+            // 取出队列前部最多 IOCP_MAX_SEND_BUFS 帧
+            std::vector<SharedBuffer> batch;
+            while (!queue.empty() && batch.size() < IOCP_MAX_SEND_BUFS) {
+                queued_bytes -= queue.front().size();
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+
+            lk.unlock();                                    // 在锁外阻塞发送
+            bool ok = send_gather(sock, batch);
+            lk.lock();
+            if (!ok) {
+                closed = true;
+                lk.unlock();
+                shutdown(sock, SD_BOTH);
+                return;
+            }
+        }
+    }
+};
+
+// IOCP 引擎：直接使用连接自身的重叠发送队列，上限由引擎检查
+class IocpOutbox : public ClientOutbox {
+public:
+    IocpOutbox(IocpConnection* c, const std::string& nick) : ClientOutbox(nick), conn(c) {
+        conn->add_ref();            // 快照可能在连接关闭后仍持有 outbox，保证连接对象有效
+    }
+    ~IocpOutbox() override { conn->release(); }
+
+    bool push(const SharedBuffer& frame) override {
+        SendResult r = iocp_engine->send(conn, frame);
+        if (r == SEND_OVERFLOW) log_overflow();
+        return r == SEND_OK;
+    }
+
+    void close_after_flush() override { iocp_engine->close_after_send(conn); }
+
+private:
+    IocpConnection* conn;
+};
+
+//===================客户端注册表==================//
+
+// 已登录客户端的注册表
+// 稠密数组保存 ClientInfo 供广播顺序遍历，两个哈希索引分别按昵称和 socket 定位数组下标：
+// 查找、插入、删除都是 O(1)（删除时用最后一个元素填补空位）。
+// 读写锁允许昵称查询和广播快照并发进行，只有登录和离开需要独占。
+class ClientRegistry {
+public:
+    // 原子的检查并插入：昵称未被占用时加入并返回 true，检查与插入之间不会被其他登录插入
+    bool try_insert(const ClientInfo& ci){
+        std::unique_lock<std::shared_mutex> lk(mtx);
+        if (by_nick.count(ci.nickname)) return false;
+        by_nick[ci.nickname] = dense.size();
+        by_sock[ci.sock] = dense.size();
+        dense.push_back(ci);
+        return true;
+    }
+
+    // 按 socket 移除客户端，返回是否找到
+    bool remove(SOCKET s){
+        std::unique_lock<std::shared_mutex> lk(mtx);
+        auto it = by_sock.find(s);
+        if (it == by_sock.end()) return false;
+        size_t idx = it->second;
+        by_nick.erase(dense[idx].nickname);
+        by_sock.erase(it);
+        if (idx != dense.size() - 1) {
+            dense[idx] = std::move(dense.back());
+            by_nick[dense[idx].nickname] = idx;
+            by_sock[dense[idx].sock] = idx;
+        }
+        dense.pop_back();
+        return true;
+    }
+
+    bool contains_nickname(const std::string& nickname) const {
+        std::shared_lock<std::shared_mutex> lk(mtx);
+        return by_nick.count(nickname) != 0;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lk(mtx);
+        return dense.size();
+    }
+
+    // 复制除 except 以外所有客户端的发送队列（广播快照）
+    std::vector<std::shared_ptr<ClientOutbox>> snapshot(SOCKET except) const {
+        std::vector<std::shared_ptr<ClientOutbox>> out;
+        std::shared_lock<std::shared_mutex> lk(mtx);
+        out.reserve(dense.size());
+        for (const auto& c : dense) {
+            if (c.sock != except) out.push_back(c.outbox);
         }
+        return out;
+    }
+
+private:
+    mutable std::shared_mutex mtx;
+    std::vector<ClientInfo> dense;                      // 所有客户端，连续存放
+    std::unordered_map<std::string, size_t> by_nick;    // 昵称 -> dense 下标
+    std::unordered_map<SOCKET, size_t> by_sock;         // socket -> dense 下标
+};
+
+ClientRegistry clients;                     // 已连接客户端注册表
+
+// 广播已编码的帧给所有客户端，except 参数指定排除的 socket（一般是发送者自己）
+// 只在读锁内复制接收者列表的快照，入队在锁外进行，任何客户端都不会阻塞注册表
+// 所有接收者共享同一份帧数据，入队只增加引用计数
+void broadcast_except(SOCKET except, const SharedBuffer& frame){
+    std::vector<std::shared_ptr<ClientOutbox>> targets = clients.snapshot(except);
+    for (auto& t : targets) {
+        t->push(frame);   // 失败的客户端由其自身的关闭流程从列表移除
+    }
+}
+
+void broadcast_except(SOCKET except, uint8_t type, const std::string& payload){
+    broadcast_except(except, encode_frame(type, payload));
+}
+
+//===================房间==================//
+
+const size_t MAX_ROOM_NAME = 32;            // 房间名最大字节数
+const size_t MAX_ROOMS = 256;               // 同时存在的房间数上限（默认房间不计入）
+
+// 一个聊天房间：独立的成员表和锁，互不干扰
+// IOCP 引擎下每个房间固定由一个工作线程（分片）处理，房间内的进出和消息扇出都在该线程上按顺序执行，
+// 不同房间的流量落在不同核心上，不会争用同一把锁
+struct Room {
+    std::string name;
+    unsigned shard;                 // 负责该房间的 IOCP 分片
+    size_t users = 0;               // 已进入或正在进入的客户端数，由 RoomTable 在其锁内维护，归零时回收房间
+    ClientRegistry members;         // 房间成员，人数即 members.size()
+    RoomHistory history{history_bytes, HISTORY_DEFAULT_ENTRIES};    // 最近的广播帧，字节环大小固定，有消息时才分配
+};
+
+// 房间表：按名字查找或创建房间，新房间轮流分配到各个分片
+// 每次 acquire 都要有一次对应的 release；最后一个用户离开时房间从表中删除，默认房间一直保留
+class RoomTable {
+public:
+    RoomTable() : next_shard(0) {}
+
+    // 功能: 取得名为 name 的房间，不存在时创建，并把房间的用户数加一
+    // 返回: 房间；房间数已达 MAX_ROOMS 且 name 不是默认房间时返回空指针
+    std::shared_ptr<Room> acquire(const std::string& name){
+        std::unique_lock<std::shared_mutex> lk(mtx);
+        auto it = rooms.find(name);
+        if (it == rooms.end()) {
+            if (name != DEFAULT_ROOM && rooms.size() - rooms.count(DEFAULT_ROOM) >= MAX_ROOMS) return nullptr;
+            auto room = std::make_shared<Room>();
+            room->name = name;
+            room->shard = next_shard++;
+            it = rooms.emplace(name, std::move(room)).first;
+        }
+        it->second->users++;
+        return it->second;
+    }
+
+    // 功能: 客户端不再使用该房间，用户数归零时删除房间
+    // 说明: 已投递到分片上的任务仍持有房间的 shared_ptr，删除只是让之后的 acquire 创建新房间
+    void release(const std::shared_ptr<Room>& room){
+        std::unique_lock<std::shared_mutex> lk(mtx);
+        if (--room->users > 0 || room->name == DEFAULT_ROOM) return;
+        auto it = rooms.find(room->name);
+        if (it != rooms.end() && it->second == room) rooms.erase(it);
     }
+
+    // 列出所有房间及人数（管理员 /rooms 命令）
+    std::vector<std::pair<std::string, size_t>> list() const {
+        std::vector<std::pair<std::string, size_t>> out;
+        std::shared_lock<std::shared_mutex> lk(mtx);
+        for (const auto& kv : rooms) out.emplace_back(kv.first, kv.second->members.size());
+        return out;
+    }
+
+private:
+    mutable std::shared_mutex mtx;
+    std::unordered_map<std::string, std::shared_ptr<Room>> rooms;
+    unsigned next_shard;
+};
+
+RoomTable rooms;
+
+// 在房间所属的分片上执行 fn；线程引擎没有分片，直接在当前线程执行
+void run_in_room(const std::shared_ptr<Room>& room, std::function<void()> fn){
+    if (iocp_engine) iocp_engine->post_task(room->shard, std::move(fn));
+    else fn();
 }
 
-// 检查昵称是否已存在
-bool is_nickname_taken(const std::string& nickname){
-    std::lock_guard<std::mutex> lk(clients_mtx);
-    for (const auto& c : clients){
-        if (c.nickname == nickname){
+// 在房间内广播（只遍历本房间成员），except 为排除的 socket
+void room_broadcast(const Room& room, SOCKET except, const SharedBuffer& frame){
+    for (auto& t : room.members.snapshot(except)) t->push(frame);
+}
+
+// 客户端进入房间，通知房间内其他成员，并向本人回放历史消息、告知当前房间人数
+// since 为客户端已收到的最后一条消息 ID，HISTORY_NO_SINCE 表示回放最近 history_replay 条
+// 回放的帧、人数通知和 SERVER_HISTORY_MARK 拼成一块缓冲区入队，由一次写发出
+void room_enter(const std::shared_ptr<Room>& room, const ClientInfo& ci, uint64_t since = HISTORY_NO_SINCE){
+    run_in_room(room, [room, ci, since]{
+        if (!room->members.try_insert(ci)) return;
+        room_broadcast(*room, ci.sock, encode_frame(SERVER_NOTICE, {"[", ci.nickname, " joined #", room->name, "]"}));
+        // 在分片上执行，回放与本房间后续的广播不会交错，SERVER_HISTORY_MARK 之后收到的就是新消息
+        size_t users = room->members.size();
+        ci.outbox->push(room->history.replay(since, history_replay, [&](uint64_t last_id, size_t replayed){
+            std::vector<SharedBuffer> tail;
+            std::string info = "[You are in #" + room->name + ", " + std::to_string(users) + " users";
+            if (replayed) info += ", " + std::to_string(replayed) + " earlier messages above";
+            tail.push_back(encode_frame(SERVER_NOTICE, info + "]"));
+            tail.push_back(encode_frame(SERVER_HISTORY_MARK,
+                                        {MESSAGE_TAG_SEP, room->name, MESSAGE_TAG_SEP, std::to_string(last_id)}));
+            return tail;
+        }));
+    });
+}
+
+// 客户端离开房间；disconnected 为 true 表示断开连接，而不是切换到其他房间
+// 同时释放 acquire 时计入的用户数
+void room_leave(const std::shared_ptr<Room>& room, const ClientInfo& ci, bool disconnected){
+    run_in_room(room, [room, ci, disconnected]{
+        if (!room->members.remove(ci.sock)) return;
+        if (disconnected) {
+            room_broadcast(*room, INVALID_SOCKET, encode_frame(SERVER_NOTICE, {"[", ci.nickname, " left]"}));
+        } else {
+            room_broadcast(*room, INVALID_SOCKET, encode_frame(SERVER_NOTICE, {"[", ci.nickname, " left #", room->name, "]"}));
+        }
+    });
+    rooms.release(room);
+}
+
+// 处理已登录客户端发来的一帧（两个引擎共用），room 为该客户端当前所在的房间，切换房间时会被更新
+// 返回 false 表示客户端请求登出
+bool handle_client_frame(const ClientInfo& ci, std::shared_ptr<Room>& room, uint8_t type, const std::string& payload){
+    if (type == CLIENT_MSG) {
+        // 加上昵称前缀和消息标签后广播帧不能超过 MAX_FRAME_LEN，否则所有接收者都会把它当成非法帧而断开
+        // 开销：type + "昵称: " + '\0' + 房间名 + '\0' + 最多 20 位的十进制 ID
+        size_t overhead = 1 + ci.nickname.size() + 2 + 1 + room->name.size() + 1 + 20;
+        if (payload.size() + overhead > MAX_FRAME_LEN) {
+            ci.outbox->push(encode_frame(SERVER_NOTICE, "Message too long, not sent"));
             return true;
         }
+        // 广播用户发送的消息（本房间内，除本人外），昵称前缀和消息标签直接编码进共享帧，不再拼接临时字符串
+        std::shared_ptr<Room> r = room;
+        SOCKET self = ci.sock;
+        std::string nickname = ci.nickname;
+        // 在分片上先记入历史再扩散，历史中的顺序与成员收到的顺序一致；标签中的 ID 由历史分配
+        run_in_room(r, [r, self, nickname, payload]{
+            SharedBuffer frame = r->history.append([&](uint64_t id){
+                return encode_frame(SERVER_BROADCAST, {nickname, ": ", payload,
+                                                       MESSAGE_TAG_SEP, r->name, MESSAGE_TAG_SEP, std::to_string(id)});
+            });
+            room_broadcast(*r, self, frame);
+        });
+    } else if (type == CLIENT_JOIN_ROOM || type == CLIENT_LEAVE_ROOM) {
+        // 切换房间：LEAVE_ROOM 回到默认房间
+        std::string target = type == CLIENT_JOIN_ROOM ? payload : std::string(DEFAULT_ROOM);
+        // 房间名会写进消息标签，不能含 '\0'
+        if (target.empty() || target.size() > MAX_ROOM_NAME || target.find('\0') != std::string::npos) {
+            ci.outbox->push(encode_frame(SERVER_NOTICE, "Invalid room name"));
+        } else if (target != room->name) {
+            std::shared_ptr<Room> next = rooms.acquire(target);
+            if (!next) {
+                ci.outbox->push(encode_frame(SERVER_NOTICE, "Too many rooms, try again later"));
+            } else {
+                room_leave(room, ci, false);
+                room = next;
+                room_enter(room, ci);
+            }
+        }
+    } else if (type == CLIENT_LOGOUT) {
+        return false;
+    } else {
+        // 其他，暂时忽略
     }
-    return false;
+    return true;
+}
+
+// 昵称长度不超过 MAX_NICKNAME_LEN 且不含 '\0'，与房间名的检查相同（空昵称由调用方按 "Login required" 处理）
+bool valid_nickname(const std::string& nickname){
+    return nickname.size() <= MAX_NICKNAME_LEN && nickname.find('\0') == std::string::npos;
 }
 
 // 每个客户端连接对应的线程函数
-void client_thread_func(ClientInfo ci){
+// reader 是 accept 线程读取 LOGIN 帧时使用的读取器，其中可能已缓存了登录之后的数据
+// since 为 LOGIN 帧中携带的最后一条已收到消息的 ID
+void client_thread_func(ClientInfo ci, std::shared_ptr<ThreadOutbox> outbox, std::shared_ptr<FrameReader> reader,
+                        uint64_t since){
     // 获取客户端 socket 和昵称
     SOCKET s = ci.sock;
     std::string nickname = ci.nickname;
-    // 广播用户加入消息（加入本人除外）
-    std::string joinmsg = '[' + nickname + " joined]";
-    broadcast_except(s, SERVER_NOTICE, joinmsg);
+    // 进入默认房间，并通知房间内其他用户（加入本人除外），向本人回放历史
+    std::shared_ptr<Room> room = rooms.acquire(DEFAULT_ROOM);
+    room_enter(room, ci, since);
 
     // 主循环：只要服务器还在运行，一直监听接收并处理该客户端发送的消息
+    uint8_t type;
+    std::string payload;
     while (server_running){
-        // 读取长度信息（大端->小端转换，type+payload 总长度）
-        uint32_t len_be;
-        int rec = recv(s, (char*)&len_be, 4, MSG_WAITALL);  // 调用基本 socket 接收函数（流方式）
-        if (rec <= 0) break;
-        uint32_t len = ntohl(len_be);
-        if (len < 1) break; // invalid
-
-        // 读取类型信息
-        uint8_t type;
-        rec = recv(s, (char*)&type, 1, MSG_WAITALL);
-        if (rec <= 0) break;
-
-        // 读取 payload 内容
-        int payload_len = (int)len - 1;
-        std::string payload;
-        if (payload_len > 0) {
-            payload.resize(payload_len);
-            rec = recv(s, &payload[0], payload_len, MSG_WAITALL);
-            if (rec <= 0) break;
-        }
-
-        if (type == CLIENT_MSG) {
-            // 广播用户发送的消息（除本人外）
-            std::string out = nickname + ": " + payload;
-            broadcast_except(s, SERVER_BROADCAST, out);
-        } else if (type == CLIENT_LOGOUT) {
-            // 用户登出，跳出循环结束线程
-            break;
-        } else {
-            // 其他，暂时忽略
-        }
+        // 读取一帧：缓冲区中已有完整帧时不需要再调用 recv；连接关闭或非法帧（len 为 0 或过大）时退出
+        if (!reader->read_frame(s, type, payload)) break;
+        // 用户登出，跳出循环结束线程
+        if (!handle_client_frame(ci, room, type, payload)) break;
     }
 
-    // 清理工作
+    // 清理工作：先从注册表和房间移除并停止写线程，再关闭 socket
+    clients.remove(s);
+    room_leave(room, ci, true);
+    outbox->stop();
     closesocket(s);
-    remove_client(s);
-    room_count--;   // 减少房间人数
-    std::string leave = '[' + nickname + " left]";
-    broadcast_except(INVALID_SOCKET, SERVER_NOTICE, leave);
-    std::cout << "\r" << "ADMIN:" << "\r";
-    set_console_color(COLOR_YELLOW);
-    std::cout << "User [" << nickname << "] disconnected\n";
-    set_console_color(COLOR_DEFAULT);
-    std::cout << "Current room users: " << room_count.load() << std::endl;
-    set_console_color(COLOR_CYAN);
-    std::cout << "ADMIN: ";
-    set_console_color(COLOR_DEFAULT);
-    std::cout.flush();
+    online_count--;
+    admin_log(COLOR_YELLOW, "User [" + nickname + "] disconnected", true, disconnect_log_limit);
 }
 
 // 服务器端监听线程函数：接受新连接
@@ -122,87 +515,254 @@ void accept_thread_func(){
         if (clientSock == INVALID_SOCKET) {
             if (!server_running) break;
             // 未停止运行而接受失败，报错
-            std::cout << "\r" << "ADMIN:" << "\r";
-            set_console_color(COLOR_RED);
-            std::cerr << "[ERROR] accept failed\n";
-            set_console_color(COLOR_DEFAULT);
-            set_console_color(COLOR_CYAN);
-            std::cout << "ADMIN: ";
-            set_console_color(COLOR_DEFAULT);
-            std::cout.flush();
+            admin_log(COLOR_RED, "[ERROR] accept failed", false, error_log_limit);
             continue;
         }
+        set_nodelay(clientSock);
 
         // 初次握手：尝试读取登录 LOGIN 帧
-        uint32_t len_be;
-        int rec = recv(clientSock, (char*)&len_be, 4, MSG_WAITALL);
-        if (rec <= 0) { closesocket(clientSock); continue; }    // 无法读取有效 len 导致握手失败，回到循环等待下一个连接
-        uint32_t len = ntohl(len_be);
-        if (len < 1) { closesocket(clientSock); continue; }     // 登录帧定义无效
+        // 读取器随后交给该客户端的线程继续使用，登录帧之后已到达的数据不会丢失
+        auto reader = std::make_shared<FrameReader>();
         uint8_t type;
-        rec = recv(clientSock, (char*)&type, 1, MSG_WAITALL);   
-        if (rec <= 0) { closesocket(clientSock); continue; }    // 无法读取有效 type 导致握手失败，回到循环等待下一个连接
-        int payload_len = (int)len - 1;
         std::string payload;
-        if (payload_len > 0) {                                  // payload 长度大于 0（有效）则读取 payload 内容
-            payload.resize(payload_len);
-            rec = recv(clientSock, &payload[0], payload_len, MSG_WAITALL);
-            if (rec <= 0) { closesocket(clientSock); continue; }// 无法读取有效 payload 导致握手失败，回到循环等待下一个连接
+        if (!reader->read_frame(clientSock, type, payload)) {
+            closesocket(clientSock);    // 连接关闭或登录帧无效导致握手失败，回到循环等待下一个连接
+            continue;
         }
         // 初次握手成功，成功读取 LOGIN 帧全部信息
+        std::string nickname;
+        uint64_t since;
+        parse_login(payload, nickname, since, HISTORY_NO_SINCE);
 
         // 验证登录信息
-        if (type != CLIENT_LOGIN || payload.empty()){
+        if (type != CLIENT_LOGIN || nickname.empty()){
             // 无效 LOGIN 帧，依旧取消连接重回等待
             send_frame(clientSock, SERVER_NOTICE, "Login required");
             closesocket(clientSock);
             continue;
         }
 
-        // 检查昵称是否重复
-        if (is_nickname_taken(payload)){
-            send_frame(clientSock, SERVER_LOGIN_REJECT, "Nickname already taken");
+        // 昵称会写进广播给整个房间的进出通知，过长时通知帧会超过 MAX_FRAME_LEN，导致房间内所有人断开
+        if (!valid_nickname(nickname)) {
+            send_frame(clientSock, SERVER_LOGIN_REJECT, "Invalid nickname");
             closesocket(clientSock);
-            std::cout << "\r" << "ADMIN:" << "\r";
-            set_console_color(COLOR_RED);
-            std::cout << "[ERROR] Login rejected: nickname '" << payload << "' already in use\n";
-            set_console_color(COLOR_DEFAULT);
-            set_console_color(COLOR_CYAN);
-            std::cout << "ADMIN: ";
-            set_console_color(COLOR_DEFAULT);
-            std::cout.flush();
+            admin_log(COLOR_RED, "[ERROR] Login rejected: invalid nickname (" + std::to_string(nickname.size()) + " bytes)",
+                      false, error_log_limit);
             continue;
         }
 
-        // LOGIN 有效，添加客户端到服务器端 client 列表
+        // LOGIN 有效，检查昵称是否重复并添加客户端到服务器端注册表（原子操作）
+        auto outbox = std::make_shared<ThreadOutbox>(clientSock, nickname);
         ClientInfo ci;
         ci.sock = clientSock;
-        ci.nickname = payload;
+        ci.nickname = nickname;
+        ci.outbox = outbox;
 
-        // 添加时使用互斥锁保护 clients 列表
-        {
-            std::lock_guard<std::mutex> lk(clients_mtx);
-            clients.push_back(ci);
-            room_count++;  // 增加房间人数
+        if (!clients.try_insert(ci)){
+            outbox->stop();
+            send_frame(clientSock, SERVER_LOGIN_REJECT, "Nickname already taken");
+            closesocket(clientSock);
+            admin_log(COLOR_RED, "[ERROR] Login rejected: nickname '" + nickname + "' already in use", false, error_log_limit);
+            continue;
         }
+        online_count++;
         
         // 为该客户端启动一个新的服务端<->客户端通信线程，处理后续通信
-        std::thread t(client_thread_func, ci);
+        std::thread t(client_thread_func, ci, outbox, reader, since);
         t.detach();                             // 分离线程，交由系统自行回收
         
-        std::cout << "\r" << "ADMIN:" << "\r";
-        set_console_color(COLOR_GREEN);
-        std::cout << "User [" << payload << "] connected\n";
-        set_console_color(COLOR_DEFAULT);
-        std::cout << "Current room users: " << room_count.load() << std::endl;
-        set_console_color(COLOR_CYAN);
-        std::cout << "ADMIN: ";
-        set_console_color(COLOR_DEFAULT);
-        std::cout.flush();
+        admin_log(COLOR_GREEN, "User [" + nickname + "] connected", true, connect_log_limit);
     }
 }
 
-int main(){
+
+//===================IOCP 引擎：完成端口 + 固定工作线程池==================//
+
+// IOCP 连接的会话状态
+enum ChatSessionState {
+    SESSION_WAIT_LOGIN,     // 已连接，等待 LOGIN 帧
+    SESSION_ONLINE,         // 登录成功，已加入注册表
+    SESSION_CLOSING,        // 已拒绝或已关闭，忽略后续数据
+};
+
+// IOCP 引擎下每个客户端连接的状态机
+struct ChatConnection : IocpConnection {
+    std::mutex session_mtx;             // 保护 session，登录处理和关闭回调可能在不同工作线程上
+    ChatSessionState session = SESSION_WAIT_LOGIN;
+    ClientInfo info;                    // 登录成功后的客户端信息
+    std::shared_ptr<Room> room;         // 当前所在房间
+
+    FrameReader reader;                 // 拼接跨多次接收的帧，初始容量较小，遇到大帧时再扩容
+    uint8_t frame_type = 0;
+    std::string payload;                // 当前取出帧的 payload（复用以减少分配）
+
+    explicit ChatConnection(SOCKET s) : IocpConnection(s), reader(IOCP_RECV_BUF_SIZE) {}
+};
+
+class ChatIocpEngine : public IocpEngine {
+protected:
+    // 增量解析收到的字节流，取出所有已完整到达的帧交给 handle_frame 处理
+    void on_recv(IocpConnection* base, const char* data, size_t n) override {
+        ChatConnection* c = static_cast<ChatConnection*>(base);
+        if (!c->reader.feed(data, n)) { close(c); return; }
+        while (!c->closed) {
+            FrameStatus st = c->reader.next(c->frame_type, c->payload);
+            if (st == FRAME_NEED_MORE) break;                   // 剩余数据不足一帧，等待下一次接收
+            if (st == FRAME_INVALID) { close(c); return; }      // len 为 0 或超过 MAX_FRAME_LEN
+            handle_frame(c, c->frame_type, c->payload);
+        }
+    }
+
+    // 连接关闭：已登录的用户从列表移除并广播离开消息
+    // IocpOutbox 持有连接的引用，必须在这里丢掉 info.outbox，否则连接引用自身，永远不会析构
+    // 注册表快照和已投递的房间任务各自持有 outbox 的副本，它们用完后引用才归零
+    void on_close(IocpConnection* base) override {
+        ChatConnection* c = static_cast<ChatConnection*>(base);
+        bool was_online;
+        {
+            std::lock_guard<std::mutex> lk(c->session_mtx);
+            was_online = c->session == SESSION_ONLINE;
+            c->session = SESSION_CLOSING;
+        }
+        if (!was_online) return;
+
+        clients.remove(c->sock);
+        room_leave(c->room, c->info, true);
+        std::string nickname = c->info.nickname;
+        {
+            // close() 在调用 on_close 期间持有一个引用，这里释放 outbox 不会析构连接
+            std::lock_guard<std::mutex> lk(c->session_mtx);
+            c->info.outbox.reset();
+            c->room.reset();
+        }
+        online_count--;
+        admin_log(COLOR_YELLOW, "User [" + nickname + "] disconnected", true, disconnect_log_limit);
+    }
+
+private:
+    void handle_frame(ChatConnection* c, uint8_t type, const std::string& payload) {
+        std::unique_lock<std::mutex> lk(c->session_mtx);
+        if (c->session == SESSION_CLOSING) return;
+
+        if (c->session == SESSION_WAIT_LOGIN) {
+            // 验证登录信息，处理方式与线程引擎的 accept_thread_func 相同
+            std::string nickname;
+            uint64_t since;
+            parse_login(payload, nickname, since, HISTORY_NO_SINCE);
+            if (type != CLIENT_LOGIN || nickname.empty()) {
+                c->session = SESSION_CLOSING;
+                send(c, encode_frame(SERVER_NOTICE, "Login required"));
+                close_after_send(c);
+                return;
+            }
+
+            if (!valid_nickname(nickname)) {
+                c->session = SESSION_CLOSING;
+                send(c, encode_frame(SERVER_LOGIN_REJECT, "Invalid nickname"));
+                close_after_send(c);
+                lk.unlock();
+                admin_log(COLOR_RED, "[ERROR] Login rejected: invalid nickname (" + std::to_string(nickname.size()) + " bytes)",
+                          false, error_log_limit);
+                return;
+            }
+
+            // LOGIN 有效，检查昵称是否重复并添加客户端到注册表（原子操作）
+            ClientInfo ci;
+            ci.sock = c->sock;
+            ci.nickname = nickname;
+            ci.outbox = std::make_shared<IocpOutbox>(c, nickname);
+            if (!clients.try_insert(ci)) {
+                c->session = SESSION_CLOSING;
+                send(c, encode_frame(SERVER_LOGIN_REJECT, "Nickname already taken"));
+                close_after_send(c);
+                lk.unlock();
+                admin_log(COLOR_RED, "[ERROR] Login rejected: nickname '" + nickname + "' already in use", false, error_log_limit);
+                return;
+            }
+            online_count++;
+            c->info = ci;
+            c->room = rooms.acquire(DEFAULT_ROOM);
+            c->session = SESSION_ONLINE;
+            room_enter(c->room, ci, since);
+            lk.unlock();
+
+            admin_log(COLOR_GREEN, "User [" + nickname + "] connected", true, connect_log_limit);
+            return;
+        }
+
+        // 切换房间会修改 c->room，仍在 session_mtx 内进行，与 on_close 互斥
+        bool stay = handle_client_frame(c->info, c->room, type, payload);
+        lk.unlock();
+        if (!stay) close(c);
+    }
+};
+
+// IOCP 引擎的监听线程：只负责 accept 并把连接交给完成端口，登录握手由工作线程异步完成
+void iocp_accept_thread_func(){
+    while (server_running){
+        SOCKADDR_IN clientAddr;
+        int addrlen = sizeof(clientAddr);
+        SOCKET clientSock = accept(listen_sock, (SOCKADDR*)&clientAddr, &addrlen);
+        if (clientSock == INVALID_SOCKET) {
+            if (!server_running) break;
+            admin_log(COLOR_RED, "[ERROR] accept failed", false, error_log_limit);
+            continue;
+        }
+        set_nodelay(clientSock);
+
+        ChatConnection* c = new ChatConnection(clientSock);
+        if (!iocp_engine->attach(c)) {
+            c->release();   // 关联完成端口失败，释放连接（析构时关闭 socket）
+        }
+    }
+}
+
+int main(int argc, char* argv[]){
+    // 解析启动参数：选择服务器引擎和工作线程数
+    bool use_iocp = true;
+    unsigned workers = 0;                       // 0 表示取 CPU 核心数
+    auto usage = []{
+        std::cerr << "Usage: server.exe [--engine iocp|thread] [--workers N] [--max-queue-bytes N] [--flush-us N]"
+                     " [--history N] [--history-bytes N]\n";
+        return 1;
+    };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        // 数值参数：缺少值、不是十进制数或超出 [lo, hi] 时报告并打印用法
+        uint64_t v = 0;
+        auto value = [&](uint64_t lo, uint64_t hi){
+            if (i + 1 < argc && parse_uint_arg(argv[i + 1], lo, hi, v)) { ++i; return true; }
+            std::cerr << "Invalid value for " << arg << ", expected an integer in [" << lo << ", " << hi << "]\n";
+            return false;
+        };
+        if (arg == "--engine" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine == "thread") use_iocp = false;
+            else if (engine == "iocp") use_iocp = true;
+            else {
+                std::cerr << "Unknown engine '" << engine << "', expected iocp or thread\n";
+                return usage();
+            }
+        } else if (arg == "--workers") {
+            if (!value(0, 256)) return usage();
+            workers = (unsigned)v;
+        } else if (arg == "--max-queue-bytes") {
+            if (!value(0, 1ull << 40)) return usage();
+            max_queue_bytes = (size_t)v;
+        } else if (arg == "--flush-us") {
+            if (!value(0, 1000000)) return usage();
+            flush_delay_us = (unsigned)v;
+        } else if (arg == "--history") {
+            if (!value(0, HISTORY_DEFAULT_ENTRIES)) return usage();
+            history_replay = (size_t)v;
+        } else if (arg == "--history-bytes") {
+            if (!value(0, 1ull << 30)) return usage();
+            history_bytes = (size_t)v;
+        } else {
+            return usage();
+        }
+    }
+
     // 创建全局互斥量，确保只有一个服务器实例运行
     HANDLE hMutex = CreateMutexA(NULL, TRUE, "Global\\ChatServerMutex_12345");
     if (GetLastError() == ERROR_ALREADY_EXISTS) {
@@ -264,22 +824,46 @@ int main(){
         return 1;
     }
 
+    // 启动 IOCP 引擎的工作线程池
+    if (use_iocp) {
+        iocp_engine = new ChatIocpEngine();
+        if (!iocp_engine->start(workers)) {
+            std::cerr << "CreateIoCompletionPort failed\n";
+            closesocket(listen_sock);
+            WSACleanup();
+            return 1;
+        }
+        iocp_engine->set_send_queue_limit(max_queue_bytes);
+        iocp_engine->set_flush_delay(flush_delay_us);
+    }
+
     // console 输出服务器启动信息
     std::cout << "Chat server started on port 12345\n";
-    std::cout << "Type '/exit' to shutdown server\n";
+    if (use_iocp) {
+        std::cout << "Engine: iocp (" << iocp_engine->worker_count() << " workers)\n";
+    } else {
+        std::cout << "Engine: thread-per-client\n";
+    }
+    std::cout << "Type '/rooms' to list rooms, '/stats' for send counters, '/exit' to shutdown server\n";
+
+    // 事件行由异步输出线程写出，每批写完后重新显示 ADMIN 提示符
+    async_log().set_prompt("ADMIN: ", COLOR_CYAN);
 
-    // 启动接受连接线程 accept_thread_func
+    // 启动接受连接线程
     // 新建的 accept_th 是负责接受新连接的线程类实例
-    std::thread accept_th(accept_thread_func);
+    std::thread accept_th(use_iocp ? iocp_accept_thread_func : accept_thread_func);
 
     // console 主循环
     // 监听 console 输入，等待 /exit 命令以关闭服务器
     std::string line;
     while (server_running) {
-        set_console_color(COLOR_CYAN);
-        std::cout << "ADMIN: ";
-        set_console_color(COLOR_DEFAULT);
-        std::cout.flush();
+        {
+            std::lock_guard<std::mutex> lk(async_log().console_mutex());
+            set_console_color(COLOR_CYAN);
+            std::cout << "ADMIN: ";
+            set_console_color(COLOR_DEFAULT);
+            std::cout.flush();
+        }
         
         if (!read_console_line(line)) {
             break;
@@ -290,33 +874,60 @@ int main(){
             server_running = false;
             break;
         }
-        // 服务器端以管理员身份广播消息
-        std::lock_guard<std::mutex> lk(clients_mtx);    // 依旧锁机制保护 clients 列表
-        for (auto &c : clients) {
-            send_frame(c.sock, SERVER_NOTICE, std::string("★ADMIN★ ") + line);
+        // 列出所有房间及人数
+        if (line == "/rooms") {
+            std::lock_guard<std::mutex> lk(async_log().console_mutex());
+            for (const auto& r : rooms.list()) {
+                std::cout << "  #" << r.first << ": " << r.second << " users\n";
+            }
+            continue;
+        }
+        // 发送统计：每条消息平均的系统调用数和 TCP 报文段数（估算）
+        if (line == "/stats") {
+            const SendStats& st = iocp_engine ? iocp_engine->stats() : thread_send_stats;
+            uint64_t frames = st.frames.load();
+            double per = frames ? 1.0 / (double)frames : 0.0;
+            std::lock_guard<std::mutex> lk(async_log().console_mutex());
+            std::cout << "  frames sent: " << frames << ", bytes: " << st.bytes.load() << "\n"
+                      << "  send syscalls: " << st.syscalls.load() << " (" << st.syscalls.load() * per << " per message)\n"
+                      << "  est. segments: " << st.segments.load() << " (" << st.segments.load() * per << " per message)\n";
+            continue;
         }
+        // 服务器端以管理员身份广播消息
+        broadcast_except(INVALID_SOCKET, encode_frame(SERVER_NOTICE, {"★ADMIN★ ", line}));
     }
     // 停止运行后退出循环
 
-    // 关闭服务器，清理资源
+    // 关闭服务器，清理资源；先写完已排队的事件行，之后的输出不再需要提示符
+    async_log().set_prompt("", COLOR_DEFAULT);
+    async_log().flush();
     std::cout << "[TERMINATED] Shutting down...\n";
     closesocket(listen_sock);
 
     {
         // 通知所有客户端服务器关闭，并关闭它们的 socket
-        std::lock_guard<std::mutex> lk(clients_mtx);
-        for (auto &c : clients) {
-            send_frame(c.sock, SERVER_NOTICE, "Server is shutting down");
-            closesocket(c.sock);
+        // 通知放入各自的发送队列，发送完毕后关闭连接，由各连接的关闭流程移出列表
+        SharedBuffer notice = encode_frame(SERVER_NOTICE, "Server is shutting down");
+        for (auto &outbox : clients.snapshot(INVALID_SOCKET)) {
+            outbox->push(notice);
+            outbox->close_after_flush();
         }
-        // 清空客户端列表
-        clients.clear();
     }
 
     // 等待接受连接的线程退出
     if (accept_th.joinable()) accept_th.join();
 
+    // 最多等待 1 秒让关闭通知发送完毕
+    for (int i = 0; i < 100 && online_count.load() > 0; ++i) Sleep(10);
+
+    // 停止 IOCP 引擎的工作线程
+    if (iocp_engine) {
+        delete iocp_engine;
+        iocp_engine = nullptr;
+    }
+
     WSACleanup();       // 清理 Winsock 资源
+    async_log().flush();
     std::cout << "[TERMINATED] Server stopped.\n";
 
     // 释放互斥量
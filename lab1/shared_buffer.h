@@ -0,0 +1,59 @@
+// shared_buffer.h
+//
+// 引用计数的不可变字节块。
+// 计数和数据放在同一次分配里；复制 SharedBuffer 只增加计数，不拷贝数据，
+// 多个发送队列（WSABUF）可以同时指向同一份字节。
+
+#ifndef SHARED_BUFFER_H
+#define SHARED_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+class SharedBuffer {
+public:
+    SharedBuffer() : blk(nullptr) {}
+
+    // 分配 size 字节的未初始化缓冲区，调用方在共享之前通过 writable() 填充
+    explicit SharedBuffer(size_t size) {
+        void* mem = ::operator new(sizeof(Block) + size);
+        blk = new (mem) Block();
+        blk->refs = 1;
+        blk->size = size;
+    }
+
+    SharedBuffer(const SharedBuffer& o) : blk(o.blk) { if (blk) blk->refs++; }
+    SharedBuffer(SharedBuffer&& o) noexcept : blk(o.blk) { o.blk = nullptr; }
+    SharedBuffer& operator=(SharedBuffer o) noexcept {
+        Block* t = blk; blk = o.blk; o.blk = t;
+        return *this;
+    }
+    ~SharedBuffer() { release(); }
+
+    const char* data() const { return blk ? blk->bytes() : nullptr; }
+    size_t size() const { return blk ? blk->size : 0; }
+    bool empty() const { return size() == 0; }
+
+    // 仅在缓冲区被共享前使用
+    char* writable() { return blk ? blk->bytes() : nullptr; }
+
+private:
+    struct Block {
+        std::atomic<long> refs;
+        size_t size;
+        char* bytes() { return reinterpret_cast<char*>(this + 1); }
+    };
+    Block* blk;
+
+    void release() {
+        if (blk && --blk->refs == 0) {
+            blk->~Block();
+            ::operator delete(blk);
+        }
+        blk = nullptr;
+    }
+};
+
+#endif // SHARED_BUFFER_H
@@ -0,0 +1,467 @@
+// bench.cpp
+// 文件说明: 传输性能测试程序
+// 功能: 1. 按 文件大小 x 损伤配置 x 拥塞控制算法 的组合，依次启动接收端和发送端(经进程内的损伤代理)传输，
+//          核对输出文件，把吞吐率、有效吞吐率、重传比例和完成时间写成CSV和JSON Lines
+//       2. --proxy: 只运行损伤代理，手动启动的发送端和接收端经它通信(代替Router.exe)
+// 说明: 发送端和接收端以命令行参数启动(不再询问)，进度输出写入各自的日志文件；
+//       测试文件是固定种子的伪随机数据(不可压缩)，结果只反映拥塞控制、窗口和I/O的差别
+
+#include "protocol.h"
+#include "impair.h"
+#include "options.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+
+// ==================== 测试常量 ====================
+const uint16_t BENCH_DEFAULT_PORT = 21000;      // 接收端端口；代理使用 +100，发送端使用 +200(并行时各流再 +i)
+const int BENCH_DEFAULT_TIMEOUT_S = 120;        // 一次传输的最长时间
+const int BENCH_RECEIVER_READY_MS = 300;        // 启动接收端后等它绑定端口的时间
+const int BENCH_RECEIVER_EXIT_MS = 5000;        // 发送端结束后等接收端退出的时间
+const size_t BENCH_IO_BLOCK = 1024 * 1024;      // 生成和比较文件的块大小
+
+// ==================== 子进程 ====================
+// 功能: 启动程序，标准输出和标准错误写入日志文件，等待或结束它
+class ChildProcess {
+public:
+    ChildProcess() : started(false) { memset(&info, 0, sizeof(info)); }
+    ~ChildProcess() { kill(); }
+
+    // 参数: command-命令行(程序名在前，在本程序所在目录中查找), directory-工作目录, log_path-日志文件
+    // 返回: false-启动失败
+    bool start(const std::string& command, const std::string& directory, const std::string& log_path) {
+        SECURITY_ATTRIBUTES inherit;
+        memset(&inherit, 0, sizeof(inherit));
+        inherit.nLength = sizeof(inherit);
+        inherit.bInheritHandle = TRUE;
+        HANDLE log = CreateFileA(log_path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &inherit,
+                                 CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (log == INVALID_HANDLE_VALUE) return false;
+
+        STARTUPINFOA startup;
+        memset(&startup, 0, sizeof(startup));
+        startup.cb = sizeof(startup);
+        startup.dwFlags = STARTF_USESTDHANDLES;
+        startup.hStdInput = NULL;
+        startup.hStdOutput = log;
+        startup.hStdError = log;
+        std::vector<char> line(command.begin(), command.end());
+        line.push_back('\0');
+        started = CreateProcessA(NULL, line.data(), NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL,
+                                 directory.c_str(), &startup, &info) != 0;
+        CloseHandle(log);
+        return started;
+    }
+
+    // 功能: 等待进程退出，最长timeout_ms毫秒
+    // 返回: true-已退出
+    bool wait(DWORD timeout_ms) {
+        return started && WaitForSingleObject(info.hProcess, timeout_ms) == WAIT_OBJECT_0;
+    }
+
+    // 已退出时的退出码，未启动或未退出时为-1
+    int exit_code() {
+        DWORD code = 0;
+        if (!started || !GetExitCodeProcess(info.hProcess, &code) || code == STILL_ACTIVE) return -1;
+        return static_cast<int>(code);
+    }
+
+    void kill() {
+        if (!started) return;
+        if (!wait(0)) {
+            TerminateProcess(info.hProcess, 1);
+            WaitForSingleObject(info.hProcess, INFINITE);
+        }
+        CloseHandle(info.hThread);
+        CloseHandle(info.hProcess);
+        started = false;
+    }
+
+private:
+    PROCESS_INFORMATION info;
+    bool started;
+
+    ChildProcess(const ChildProcess&);
+    ChildProcess& operator=(const ChildProcess&);
+};
+
+// ==================== 测试文件 ====================
+
+// 功能: 解析 64K / 16M / 1G 形式的大小
+// 返回: 0-格式有误
+uint64_t parse_size(const std::string& text) {
+    char* end = NULL;
+    double v = strtod(text.c_str(), &end);
+    if (end == text.c_str() || v < 0) return 0;
+    uint64_t unit = 1;
+    if (*end == 'K' || *end == 'k') unit = 1024;
+    else if (*end == 'M' || *end == 'm') unit = 1024 * 1024;
+    else if (*end == 'G' || *end == 'g') unit = 1024ull * 1024 * 1024;
+    else if (*end != '\0') return 0;
+    return static_cast<uint64_t>(v * unit);
+}
+
+// 功能: 生成测试文件(已存在且大小相同时不再生成)
+bool prepare_file(const std::string& path, uint64_t size) {
+    std::ifstream existing(path.c_str(), std::ios::binary | std::ios::ate);
+    if (existing && static_cast<uint64_t>(existing.tellg()) == size) return true;
+    existing.close();
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    std::vector<uint64_t> block(BENCH_IO_BLOCK / sizeof(uint64_t));
+    uint64_t state = 0x9E3779B97F4A7C15ull ^ size;
+    for (uint64_t written = 0; written < size;) {
+        for (size_t i = 0; i < block.size(); ++i) {     // xorshift64
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            block[i] = state;
+        }
+        size_t n = static_cast<size_t>((std::min)(static_cast<uint64_t>(BENCH_IO_BLOCK), size - written));
+        out.write(reinterpret_cast<const char*>(block.data()), n);
+        written += n;
+    }
+    return out.good();
+}
+
+// 功能: 逐块比较两个文件
+bool same_file(const std::string& a, const std::string& b) {
+    std::ifstream fa(a.c_str(), std::ios::binary), fb(b.c_str(), std::ios::binary);
+    if (!fa || !fb) return false;
+    std::vector<char> ba(BENCH_IO_BLOCK), bb(BENCH_IO_BLOCK);
+    while (true) {
+        fa.read(ba.data(), ba.size());
+        fb.read(bb.data(), bb.size());
+        if (fa.gcount() != fb.gcount()) return false;
+        if (fa.gcount() == 0) return true;
+        if (memcmp(ba.data(), bb.data(), static_cast<size_t>(fa.gcount())) != 0) return false;
+    }
+}
+
+// 功能: 从发送端写出的JSON结果行中取一个数值字段
+double json_number(const std::string& line, const std::string& key) {
+    std::string pattern = "\"" + key + "\":";
+    size_t at = line.find(pattern);
+    return at == std::string::npos ? 0.0 : atof(line.c_str() + at + pattern.size());
+}
+
+sockaddr_in make_addr(const std::string& ip, uint16_t port) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr(ip.c_str());
+    return addr;
+}
+
+// ==================== 一次测试 ====================
+struct BenchCase {
+    uint64_t size;
+    ImpairmentProfile profile;
+    std::string cc;
+    int flows;
+    int run;
+};
+
+struct BenchResult {
+    bool ok;                    // 发送端成功退出且输出文件与输入相同
+    std::string error;          // 失败原因
+    double completion_ms;       // 从启动发送端到它退出(含握手和关闭)
+    double transfer_ms;         // 发送端统计的传输时间
+    double throughput_mbps;     // 链路上的发送速率(含头部、控制包和重传)
+    double goodput_mbps;        // 文件数据的有效吞吐率
+    double retransmissions;
+    double packets_sent;
+    double retransmit_ratio;    // 重传次数 / 发送的包数
+    double srtt_ms;
+    double rtt_p50_ms;          // 发送端RTT样本的中位数和99百分位
+    double rtt_p99_ms;
+    double timeouts;            // 超时次数、快速重传和不必要的重传包数(发送端诊断计数)
+    double fast_retransmits;
+    double spurious_retransmits;
+    ImpairmentStats proxy;      // 代理的丢弃、乱序和重复计数
+
+    BenchResult() : ok(false), completion_ms(0), transfer_ms(0), throughput_mbps(0), goodput_mbps(0),
+                    retransmissions(0), packets_sent(0), retransmit_ratio(0), srtt_ms(0),
+                    rtt_p50_ms(0), rtt_p99_ms(0), timeouts(0), fast_retransmits(0), spurious_retransmits(0) {}
+};
+
+struct BenchConfig {
+    std::string directory;      // 测试文件、输出文件和日志所在的目录
+    uint16_t port;
+    int timeout_s;
+    uint32_t seed;
+};
+
+// 功能: 启动代理、接收端和发送端完成一次传输，收集结果
+BenchResult run_case(const BenchConfig& config, const BenchCase& c) {
+    BenchResult result;
+    std::string input = "bench_" + std::to_string(c.size) + ".bin";
+    std::string output = "bench_" + std::to_string(c.size) + "_output.bin";
+    std::string dir = config.directory + "/";
+    std::string result_file = "bench_result.json";
+    DeleteFileA((dir + output).c_str());       // 已有输出文件时接收端会续传，每次都从头传输
+    DeleteFileA((dir + result_file).c_str());
+
+    // 1. 每个流一个代理: 代理端口+i 转发到 接收端端口+i
+    uint16_t rx_port = config.port;
+    uint16_t proxy_port = static_cast<uint16_t>(config.port + 100);
+    uint16_t tx_port = static_cast<uint16_t>(config.port + 200);
+    std::vector<std::unique_ptr<ImpairmentProxy>> proxies;
+    for (int i = 0; i < c.flows; ++i) {
+        proxies.emplace_back(new ImpairmentProxy(make_addr("127.0.0.1", static_cast<uint16_t>(proxy_port + i)),
+                                                 make_addr("127.0.0.1", static_cast<uint16_t>(rx_port + i)),
+                                                 c.profile, config.seed + static_cast<uint32_t>(c.run * 131 + i)));
+        if (!proxies.back()->start()) {
+            result.error = "代理绑定失败";
+            return result;
+        }
+    }
+
+    // 2. 启动接收端，再启动发送端
+    std::ostringstream rx_cmd, tx_cmd;
+    rx_cmd << "receiver.exe --listen 127.0.0.1:" << rx_port << " --flows " << c.flows;
+    tx_cmd << "sender.exe --local 127.0.0.1:" << tx_port << " --remote 127.0.0.1:" << proxy_port
+           << " --cc " << c.cc << " --flows " << c.flows << " --file " << input << " --result " << result_file;
+    ChildProcess receiver, sender;
+    if (!receiver.start(rx_cmd.str(), config.directory, dir + "bench_receiver.log")) {
+        result.error = "无法启动 receiver.exe";
+        return result;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_RECEIVER_READY_MS));
+    auto start_time = std::chrono::steady_clock::now();
+    if (!sender.start(tx_cmd.str(), config.directory, dir + "bench_sender.log")) {
+        result.error = "无法启动 sender.exe";
+        return result;
+    }
+
+    // 3. 等待发送端完成，接收端收到FIN后自行退出
+    bool finished = sender.wait(static_cast<DWORD>(config.timeout_s) * 1000);
+    result.completion_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    int sender_code = sender.exit_code();
+    sender.kill();
+    receiver.wait(BENCH_RECEIVER_EXIT_MS);
+    receiver.kill();
+    for (auto& proxy : proxies) {
+        proxy->stop();
+        result.proxy.add(proxy->impairment_stats());
+    }
+
+    // 4. 读取发送端的结果，核对输出文件
+    std::ifstream in((dir + result_file).c_str());
+    std::string line;
+    std::getline(in, line);
+    if (!finished) {
+        result.error = "超时";
+    } else if (sender_code != 0 || line.empty()) {
+        result.error = "发送端失败(见 bench_sender.log)";
+    } else if (!same_file(dir + input, dir + output)) {
+        result.error = "输出文件与输入不同";
+    } else {
+        result.ok = true;
+    }
+    result.transfer_ms = json_number(line, "transfer_ms");
+    result.throughput_mbps = json_number(line, "throughput_mbps");
+    result.goodput_mbps = json_number(line, "goodput_mbps");
+    result.retransmissions = json_number(line, "retransmissions");
+    result.packets_sent = json_number(line, "packets_sent");
+    result.retransmit_ratio = json_number(line, "retransmit_ratio");
+    result.srtt_ms = json_number(line, "srtt_ms");
+    result.rtt_p50_ms = json_number(line, "rtt_p50_ms");
+    result.rtt_p99_ms = json_number(line, "rtt_p99_ms");
+    result.timeouts = json_number(line, "timeouts");
+    result.fast_retransmits = json_number(line, "fast_retransmits");
+    result.spurious_retransmits = json_number(line, "spurious_retransmits");
+    if (result.ok) DeleteFileA((dir + output).c_str());
+    return result;
+}
+
+// ==================== 结果输出 ====================
+const char* BENCH_CSV_HEADER =
+    "size_bytes,profile,cc,flows,run,ok,completion_ms,transfer_ms,throughput_mbps,goodput_mbps,"
+    "retransmissions,packets_sent,retransmit_ratio,srtt_ms,rtt_p50_ms,rtt_p99_ms,timeouts,fast_retransmits,"
+    "spurious_retransmits,proxy_lost,proxy_queue_drops,proxy_reordered,"
+    "proxy_duplicated,error";
+
+void write_csv(std::ostream& out, const BenchCase& c, const BenchResult& r) {
+    out << std::fixed << std::setprecision(3)
+        << c.size << ",\"" << c.profile.name << "\"," << c.cc << "," << c.flows << "," << c.run << ","
+        << (r.ok ? 1 : 0) << "," << r.completion_ms << "," << r.transfer_ms << "," << r.throughput_mbps << ","
+        << r.goodput_mbps << "," << static_cast<uint64_t>(r.retransmissions) << ","
+        << static_cast<uint64_t>(r.packets_sent) << "," << std::setprecision(5) << r.retransmit_ratio << ","
+        << std::setprecision(3) << r.srtt_ms << "," << r.rtt_p50_ms << "," << r.rtt_p99_ms << ","
+        << static_cast<uint64_t>(r.timeouts) << "," << static_cast<uint64_t>(r.fast_retransmits) << ","
+        << static_cast<uint64_t>(r.spurious_retransmits) << "," << r.proxy.lost << "," << r.proxy.queue_drops << ","
+        << r.proxy.reordered << "," << r.proxy.duplicated << ",\"" << r.error << "\"" << std::endl;
+}
+
+void write_json(std::ostream& out, const BenchCase& c, const BenchResult& r) {
+    out << std::fixed << std::setprecision(3)
+        << "{\"size_bytes\":" << c.size << ",\"profile\":\"" << c.profile.name << "\",\"impairment\":\""
+        << c.profile.describe() << "\",\"cc\":\"" << c.cc << "\",\"flows\":" << c.flows << ",\"run\":" << c.run
+        << ",\"ok\":" << (r.ok ? "true" : "false") << ",\"completion_ms\":" << r.completion_ms
+        << ",\"transfer_ms\":" << r.transfer_ms << ",\"throughput_mbps\":" << r.throughput_mbps
+        << ",\"goodput_mbps\":" << r.goodput_mbps << ",\"retransmissions\":" << static_cast<uint64_t>(r.retransmissions)
+        << ",\"packets_sent\":" << static_cast<uint64_t>(r.packets_sent) << ",\"retransmit_ratio\":"
+        << std::setprecision(5) << r.retransmit_ratio << std::setprecision(3) << ",\"srtt_ms\":" << r.srtt_ms
+        << ",\"rtt_p50_ms\":" << r.rtt_p50_ms << ",\"rtt_p99_ms\":" << r.rtt_p99_ms << ",\"timeouts\":"
+        << static_cast<uint64_t>(r.timeouts) << ",\"fast_retransmits\":" << static_cast<uint64_t>(r.fast_retransmits)
+        << ",\"spurious_retransmits\":" << static_cast<uint64_t>(r.spurious_retransmits)
+        << ",\"proxy\":{\"lost\":" << r.proxy.lost << ",\"queue_drops\":" << r.proxy.queue_drops
+        << ",\"reordered\":" << r.proxy.reordered << ",\"duplicated\":" << r.proxy.duplicated << "}"
+        << ",\"error\":\"" << r.error << "\"}" << std::endl;
+}
+
+// ==================== 只运行代理 ====================
+// 功能: 按配置转发，直到按下回车，然后显示代理的统计
+int run_proxy(const CommandLine& args) {
+    std::string listen_ip, forward_ip;
+    uint16_t listen_port = 0, forward_port = 0;
+    ImpairmentProfile profile;
+    if (!args.endpoint("listen", listen_ip, listen_port) || !args.endpoint("forward", forward_ip, forward_port)) {
+        std::cerr << "用法: bench.exe --proxy --listen IP:端口 --forward IP:端口 [--profile 配置] [--flows N] [--seed N]"
+                  << std::endl;
+        return 1;
+    }
+    if (!profile.parse(args.get("profile", "lan"))) {
+        std::cerr << "无效的损伤配置: " << args.get("profile", "lan") << std::endl;
+        return 1;
+    }
+    int flows = static_cast<int>((std::max)(1L, (std::min)(args.number("flows", 1), static_cast<long>(MAX_PARALLEL_FLOWS))));
+    uint32_t seed = static_cast<uint32_t>(args.number("seed", 1));
+
+    std::vector<std::unique_ptr<ImpairmentProxy>> proxies;
+    for (int i = 0; i < flows; ++i) {
+        proxies.emplace_back(new ImpairmentProxy(make_addr(listen_ip, static_cast<uint16_t>(listen_port + i)),
+                                                 make_addr(forward_ip, static_cast<uint16_t>(forward_port + i)),
+                                                 profile, seed + i));
+        if (!proxies.back()->start()) {
+            std::cerr << "绑定失败，错误码: " << WSAGetLastError() << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "\n════════ 损伤代理已启动 ════════" << std::endl;
+    std::cout << "监听: " << listen_ip << ":" << listen_port << " -> " << forward_ip << ":" << forward_port
+              << " (" << flows << " 个流)" << std::endl;
+    std::cout << "配置: " << profile.describe() << std::endl;
+    std::cout << "按回车停止..." << std::endl;
+    std::cin.get();
+
+    ImpairmentStats total;
+    for (auto& proxy : proxies) {
+        proxy->stop();
+        total.add(proxy->impairment_stats());
+    }
+    std::cout << "──────────────────────────────" << std::endl;
+    std::cout << "  收到数据报:  " << total.received << std::endl;
+    std::cout << "  转发数据报:  " << total.delivered << std::endl;
+    std::cout << "  随机丢弃:    " << total.lost << std::endl;
+    std::cout << "  队列满丢弃:  " << total.queue_drops << std::endl;
+    std::cout << "  乱序:        " << total.reordered << std::endl;
+    std::cout << "  重复:        " << total.duplicated << std::endl;
+    std::cout << "──────────────────────────────" << std::endl;
+    return 0;
+}
+
+// 用法: bench.exe [--sizes 1M,16M,64M] [--profiles "lan;wan;lossy"] [--cc reno,cubic,bbr] [--flows N] [--runs N]
+//                 [--port N] [--timeout 秒] [--dir 目录] [--csv 文件] [--json 文件] [--seed N]
+//       bench.exe --proxy --listen IP:端口 --forward IP:端口 [--profile 配置] [--flows N]
+//       配置为预设名(lan/wan/lossy/reorder/dup/bottleneck/hostile)或 "delay=20,loss=0.01,..."，多个配置用 ; 分隔
+int main(int argc, char* argv[]) {
+    WinsockInitializer winsock;
+    CommandLine args(argc, argv);
+    if (args.has("proxy")) return run_proxy(args);
+
+    // 1. 测试矩阵
+    BenchConfig config;
+    config.directory = args.get("dir", "bench_data");
+    config.port = static_cast<uint16_t>(args.number("port", BENCH_DEFAULT_PORT));
+    config.timeout_s = static_cast<int>(args.number("timeout", BENCH_DEFAULT_TIMEOUT_S));
+    config.seed = static_cast<uint32_t>(args.number("seed", 1));
+    int flows = static_cast<int>((std::max)(1L, (std::min)(args.number("flows", 1), static_cast<long>(MAX_PARALLEL_FLOWS))));
+    int runs = static_cast<int>((std::max)(1L, args.number("runs", 1)));
+
+    std::vector<uint64_t> sizes;
+    std::vector<std::string> size_items = CommandLine::split_list(args.get("sizes", "1M,16M,64M"));
+    for (size_t i = 0; i < size_items.size(); ++i) {
+        uint64_t size = parse_size(size_items[i]);
+        if (size == 0) {
+            std::cerr << "无效的文件大小: " << size_items[i] << std::endl;
+            return 1;
+        }
+        sizes.push_back(size);
+    }
+    // 配置中含逗号，多个配置之间用分号分隔
+    std::vector<ImpairmentProfile> profiles;
+    std::vector<std::string> profile_items = CommandLine::split_list(args.get("profiles", "lan;wan;lossy"), ';');
+    for (size_t i = 0; i < profile_items.size(); ++i) {
+        ImpairmentProfile profile;
+        if (!profile.parse(profile_items[i])) {
+            std::cerr << "无效的损伤配置: " << profile_items[i] << std::endl;
+            return 1;
+        }
+        profiles.push_back(profile);
+    }
+    std::vector<std::string> ccs = CommandLine::split_list(args.get("cc", "reno,cubic,bbr"));
+
+    // 2. 准备测试文件和结果文件
+    CreateDirectoryA(config.directory.c_str(), NULL);
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        if (!prepare_file(config.directory + "/bench_" + std::to_string(sizes[i]) + ".bin", sizes[i])) {
+            std::cerr << "无法生成测试文件" << std::endl;
+            return 1;
+        }
+    }
+    std::ofstream csv(args.get("csv", "bench_results.csv").c_str(), std::ios::trunc);
+    std::ofstream json(args.get("json", "bench_results.jsonl").c_str(), std::ios::trunc);
+    if (!csv || !json) {
+        std::cerr << "无法写入结果文件" << std::endl;
+        return 1;
+    }
+    csv << BENCH_CSV_HEADER << std::endl;
+
+    size_t total = sizes.size() * profiles.size() * ccs.size() * runs;
+    std::cout << "\n════════ 传输性能测试 ════════" << std::endl;
+    std::cout << "  " << sizes.size() << " 种大小 x " << profiles.size() << " 种损伤配置 x " << ccs.size()
+              << " 种算法 x " << runs << " 次 = " << total << " 次传输 (" << flows << " 个流)" << std::endl;
+    std::cout << "  大小(字节)   配置        算法   完成(ms)   有效吞吐(Mbps)  重传比例  结果" << std::endl;
+
+    // 3. 依次运行
+    size_t failures = 0;
+    for (size_t s = 0; s < sizes.size(); ++s) {
+        for (size_t p = 0; p < profiles.size(); ++p) {
+            for (size_t k = 0; k < ccs.size(); ++k) {
+                for (int run = 0; run < runs; ++run) {
+                    BenchCase c;
+                    c.size = sizes[s];
+                    c.profile = profiles[p];
+                    c.cc = ccs[k];
+                    c.flows = flows;
+                    c.run = run;
+                    BenchResult r = run_case(config, c);
+                    if (!r.ok) failures++;
+                    write_csv(csv, c, r);
+                    write_json(json, c, r);
+                    std::cout << "  " << std::setw(11) << c.size << "  " << std::left << std::setw(10)
+                              << c.profile.name.substr(0, 10) << "  " << std::setw(5) << c.cc << std::right
+                              << "  " << std::setw(9) << std::fixed << std::setprecision(1) << r.completion_ms
+                              << "  " << std::setw(14) << std::setprecision(2) << r.goodput_mbps
+                              << "  " << std::setw(8) << std::setprecision(4) << r.retransmit_ratio
+                              << "  " << (r.ok ? "✓" : "✗ " + r.error) << std::endl;
+                }
+            }
+        }
+    }
+
+    std::cout << "──────────────────────────────" << std::endl;
+    std::cout << "  完成: " << (total - failures) << "/" << total << "，结果已写入 "
+              << args.get("csv", "bench_results.csv") << " 和 " << args.get("json", "bench_results.jsonl") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,273 @@
+// checksum.h
+// 文件说明: 反码求和校验和(Internet checksum)的计算内核
+// 功能: 按64位字或SSE2/AVX2向量累加，最后一次性折叠进位；运行时按CPU特性选择实现
+// 包含: 分段累加、边累加边复制、RFC 1624增量更新
+//
+// 说明: 反码求和与字节序无关(RFC 1071)——按本机小端字累加后把结果的两个字节交换，
+//       与按大端16位字逐个累加的结果相同，因此可以直接用宽字加载，不需要逐字节移位
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CHECKSUM_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang需要为使用SSE2/AVX2指令的函数单独指定目标，其余代码仍按默认指令集编译
+#if defined(__GNUC__)
+#define CHECKSUM_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CHECKSUM_TARGET(isa)
+#endif
+
+// ==================== 折叠与字节交换 ====================
+
+// 把64位累加器折叠为16位反码和
+inline uint32_t checksum_fold64(uint64_t acc) {
+    acc = (acc & 0xFFFFFFFFull) + (acc >> 32);
+    acc = (acc & 0xFFFFFFFFull) + (acc >> 32);
+    uint32_t sum = static_cast<uint32_t>(acc);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return sum;
+}
+
+// 本机(小端)字序的16位反码和转换为大端字序(Windows x86/x64都是小端)
+inline uint32_t checksum_to_be(uint32_t sum16) {
+    return ((sum16 >> 8) | (sum16 << 8)) & 0xFFFF;
+}
+
+// ==================== 64位标量内核 ====================
+// 每次加载8字节，把高低32位加到64位累加器(2^32 ≡ 1 mod 0xFFFF，等价于4个16位字的反码和)
+
+// 累加 [p, p+n)，n为偶数时末尾没有单字节；返回本机字序的64位累加器
+inline uint64_t checksum_accumulate_scalar(const uint8_t* p, size_t n, uint64_t acc) {
+    while (n >= 32) {
+        uint64_t w[4];
+        memcpy(w, p, 32);
+        acc += (w[0] & 0xFFFFFFFFull) + (w[0] >> 32);
+        acc += (w[1] & 0xFFFFFFFFull) + (w[1] >> 32);
+        acc += (w[2] & 0xFFFFFFFFull) + (w[2] >> 32);
+        acc += (w[3] & 0xFFFFFFFFull) + (w[3] >> 32);
+        p += 32;
+        n -= 32;
+    }
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        acc += (w & 0xFFFFFFFFull) + (w >> 32);
+        p += 8;
+        n -= 8;
+    }
+    while (n >= 2) {
+        uint16_t w;
+        memcpy(&w, p, 2);
+        acc += w;
+        p += 2;
+        n -= 2;
+    }
+    if (n) acc += p[0];     // 奇数长度: 最后一个字节是大端字的高8位，即小端字的低8位
+    return acc;
+}
+
+inline uint32_t checksum_partial_scalar(const uint8_t* p, size_t n) {
+    return checksum_to_be(checksum_fold64(checksum_accumulate_scalar(p, n, 0)));
+}
+
+inline uint32_t checksum_copy_scalar(uint8_t* dst, const uint8_t* src, size_t n) {
+    uint64_t acc = 0;
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, src, 8);
+        memcpy(dst, &w, 8);
+        acc += (w & 0xFFFFFFFFull) + (w >> 32);
+        src += 8;
+        dst += 8;
+        n -= 8;
+    }
+    memcpy(dst, src, n);
+    acc = checksum_accumulate_scalar(src, n, acc);
+    return checksum_to_be(checksum_fold64(acc));
+}
+
+#ifdef CHECKSUM_X86
+// ==================== SSE2内核 ====================
+// 16位字零扩展为32位后按4个通道累加；每个通道每块最多加2*0xFFFF，
+// 每 CHECKSUM_SIMD_FLUSH 块把通道和转到64位累加器，避免32位溢出
+const size_t CHECKSUM_SIMD_FLUSH = 16384;
+
+CHECKSUM_TARGET("sse2")
+inline uint64_t checksum_lanes_sse2(__m128i lanes) {
+    uint32_t v[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(v), lanes);
+    return static_cast<uint64_t>(v[0]) + v[1] + v[2] + v[3];
+}
+
+CHECKSUM_TARGET("sse2")
+inline uint32_t checksum_sse2_impl(uint8_t* dst, const uint8_t* src, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t acc = 0;
+    while (n >= 16) {
+        size_t blocks = n / 16;
+        if (blocks > CHECKSUM_SIMD_FLUSH) blocks = CHECKSUM_SIMD_FLUSH;
+        __m128i lanes = _mm_setzero_si128();
+        for (size_t i = 0; i < blocks; ++i) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+            if (dst) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+                dst += 16;
+            }
+            lanes = _mm_add_epi32(lanes, _mm_unpacklo_epi16(v, zero));
+            lanes = _mm_add_epi32(lanes, _mm_unpackhi_epi16(v, zero));
+            src += 16;
+        }
+        acc += checksum_lanes_sse2(lanes);
+        n -= blocks * 16;
+    }
+    if (dst) memcpy(dst, src, n);
+    acc = checksum_accumulate_scalar(src, n, acc);
+    return checksum_to_be(checksum_fold64(acc));
+}
+
+inline uint32_t checksum_partial_sse2(const uint8_t* p, size_t n) { return checksum_sse2_impl(NULL, p, n); }
+inline uint32_t checksum_copy_sse2(uint8_t* dst, const uint8_t* src, size_t n) { return checksum_sse2_impl(dst, src, n); }
+
+// ==================== AVX2内核 ====================
+// 与SSE2相同的做法，每次处理32字节(8个32位通道)
+CHECKSUM_TARGET("avx2")
+inline uint32_t checksum_avx2_impl(uint8_t* dst, const uint8_t* src, size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t acc = 0;
+    while (n >= 32) {
+        size_t blocks = n / 32;
+        if (blocks > CHECKSUM_SIMD_FLUSH) blocks = CHECKSUM_SIMD_FLUSH;
+        __m256i lanes = _mm256_setzero_si256();
+        for (size_t i = 0; i < blocks; ++i) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+            if (dst) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), v);
+                dst += 32;
+            }
+            lanes = _mm256_add_epi32(lanes, _mm256_unpacklo_epi16(v, zero));
+            lanes = _mm256_add_epi32(lanes, _mm256_unpackhi_epi16(v, zero));
+            src += 32;
+        }
+        uint32_t v[8];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(v), lanes);
+        for (int i = 0; i < 8; ++i) acc += v[i];
+        n -= blocks * 32;
+    }
+    if (dst) memcpy(dst, src, n);
+    acc = checksum_accumulate_scalar(src, n, acc);
+    return checksum_to_be(checksum_fold64(acc));
+}
+
+inline uint32_t checksum_partial_avx2(const uint8_t* p, size_t n) { return checksum_avx2_impl(NULL, p, n); }
+inline uint32_t checksum_copy_avx2(uint8_t* dst, const uint8_t* src, size_t n) { return checksum_avx2_impl(dst, src, n); }
+
+// ==================== CPU特性检测 ====================
+inline bool cpu_has_sse2() {
+#if defined(_M_X64) || defined(__x86_64__)
+    return true;    // x64的基本指令集
+#elif defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 1);
+    return (r[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") != 0;
+#endif
+}
+
+// AVX2除了CPU支持，还需要操作系统保存YMM寄存器(OSXSAVE + XCR0)
+inline bool cpu_has_avx2() {
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 0);
+    if (r[0] < 7) return false;
+    __cpuid(r, 1);
+    if ((r[2] & (1 << 27)) == 0 || (r[2] & (1 << 28)) == 0) return false;
+    if ((_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(r, 7, 0);
+    return (r[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif // CHECKSUM_X86
+
+// ==================== 运行时选择内核 ====================
+struct ChecksumKernel {
+    const char* name;
+    uint32_t (*partial)(const uint8_t* p, size_t n);                    // 大端字序的16位部分和
+    uint32_t (*copy)(uint8_t* dst, const uint8_t* src, size_t n);       // 复制的同时计算部分和
+};
+
+// 第一次使用时检测一次CPU特性(函数内静态变量的初始化是线程安全的)
+inline const ChecksumKernel& checksum_kernel() {
+    static const ChecksumKernel kernel = []() {
+        ChecksumKernel k = { "scalar64", checksum_partial_scalar, checksum_copy_scalar };
+#ifdef CHECKSUM_X86
+        if (cpu_has_avx2()) {
+            ChecksumKernel avx2 = { "avx2", checksum_partial_avx2, checksum_copy_avx2 };
+            k = avx2;
+        } else if (cpu_has_sse2()) {
+            ChecksumKernel sse2 = { "sse2", checksum_partial_sse2, checksum_copy_sse2 };
+            k = sse2;
+        }
+#endif
+        return k;
+    }();
+    return kernel;
+}
+
+// ==================== 对外接口 ====================
+
+// 功能: 把一段数据按16位大端字累加到反码求和的累加器中
+// 说明: 每段都从字边界开始，奇数长度的最后一个字节作为高8位(与头部、数据、SACK分段计算的方式一致)
+inline uint32_t checksum_add(uint32_t sum, const uint8_t* ptr, size_t length) {
+    if (length == 0) return sum;
+    // 很短的段(头部、SACK块)直接用标量，省去间接调用
+    sum += length < 64 ? checksum_partial_scalar(ptr, length) : checksum_kernel().partial(ptr, length);
+    return (sum & 0xFFFF) + (sum >> 16);
+}
+
+// 功能: 把src复制到dst的同时累加校验和，数据只读一遍(用于组包或把数据移入缓冲区)
+inline uint32_t checksum_copy(uint32_t sum, uint8_t* dst, const uint8_t* src, size_t length) {
+    if (length == 0) return sum;
+    sum += checksum_kernel().copy(dst, src, length);
+    return (sum & 0xFFFF) + (sum >> 16);
+}
+
+// 功能: 折叠进位并取反，得到16位校验和
+inline uint16_t checksum_finish(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return static_cast<uint16_t>(~sum);
+}
+
+// 功能: 报文中一个16位字从old_word改为new_word时增量更新校验和(RFC 1624 式3: HC' = ~(~HC + ~m + m'))
+// 参数: checksum-原校验和, old_word/new_word-该字修改前后的值(均为大端字序的数值，与checksum_finish的结果一致)
+inline uint16_t checksum_update(uint16_t checksum, uint16_t old_word, uint16_t new_word) {
+    uint32_t sum = static_cast<uint16_t>(~checksum);
+    sum += static_cast<uint16_t>(~old_word);
+    sum += new_word;
+    return checksum_finish(sum);
+}
+
+// 当前使用的内核名称(统计信息中显示)
+inline const char* checksum_kernel_name() {
+    return checksum_kernel().name;
+}
+
+#endif // CHECKSUM_H
@@ -0,0 +1,204 @@
+// compress.h
+// 文件说明: 分块压缩(发送端压缩、接收端解压)
+// 功能: 握手协商后，发送端的工作线程把数据按 COMPRESS_BLOCK_SIZE 分块压缩，压缩后的块依次拼接成传输的数据流；
+//       接收端按序收到数据后由工作线程解压，写入输出文件中该块对应的位置
+// 格式: 每块为 BlockFrame + 存储的数据；stored_length 小于 raw_length 时为LZ4块格式的压缩数据，
+//       等于时为原样存储(压缩后节省不到1/16的块，如jpg，不压缩，接收端也不必解压)
+// 说明: 编码器实现LZ4的块格式(贪心匹配，哈希表查找4字节前缀)，不依赖外部库
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+// ==================== 压缩常量 ====================
+const uint32_t COMPRESS_BLOCK_SIZE = 256 * 1024;    // 每块的原始数据大小(字节)，最后一块可以不足
+const uint32_t COMPRESS_MAX_THREADS = 8;            // 压缩/解压的最大工作线程数
+const uint32_t COMPRESS_GIVE_UP = 4;                // 连续这么多块压缩无效后，先试压每块开头的一小段
+const size_t COMPRESS_PROBE_BYTES = 16 * 1024;      // 试压的字节数，这一段有效时才压缩整块，数据变得可压缩时立即恢复
+const uint32_t LZ4_HASH_LOG = 14;                   // 编码器哈希表的大小(2的幂)
+
+#pragma pack(push, 1)
+struct BlockFrame {
+    uint32_t raw_length;        // 原始数据长度
+    uint32_t stored_length;     // 之后存储的数据长度
+};
+#pragma pack(pop)
+
+// 工作线程数: 留一个核给收发线程
+inline unsigned codec_threads() {
+    unsigned cores = std::thread::hardware_concurrency();
+    unsigned n = cores > 1 ? cores - 1 : 1;
+    return (std::min)(n, COMPRESS_MAX_THREADS);
+}
+
+// 压缩结果的最大长度(不可压缩的数据每255字节多出1字节)
+inline size_t lz4_bound(size_t n) { return n + n / 255 + 16; }
+
+// ==================== LZ4 编码器 ====================
+// 说明: 序列为 token(高4位字面量长度、低4位匹配长度-4) + [长度扩展] + 字面量 + 2字节偏移 + [长度扩展]；
+//       最后5字节必须是字面量，最后一个匹配至少在结尾12字节之前开始
+class Lz4Encoder {
+public:
+    Lz4Encoder() : table(static_cast<size_t>(1) << LZ4_HASH_LOG) {}
+
+    // 功能: 压缩src中的n字节到dst(容量cap)
+    // 返回: 压缩后的长度，0-放不下(调用方按原样存储)
+    size_t compress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap) {
+        const size_t MIN_MATCH = 4, LAST_LITERALS = 5, MF_LIMIT = 12;
+        uint8_t* op = dst;
+        uint8_t* const oend = dst + cap;
+        const uint8_t* anchor = src;
+        const uint8_t* const iend = src + n;
+
+        if (n > MF_LIMIT) {
+            std::fill(table.begin(), table.end(), 0u);
+            const uint8_t* const mflimit = iend - MF_LIMIT;
+            const uint8_t* const matchlimit = iend - LAST_LITERALS;
+            const uint8_t* ip = src + 1;
+            while (ip < mflimit) {
+                // 1. 查找匹配: 没有匹配时步长随未匹配的字面量增多而增大
+                const uint8_t* ref = NULL;
+                size_t attempts = 0;
+                while (ip < mflimit) {
+                    uint32_t seq = read32(ip);
+                    uint32_t& slot = table[hash(seq)];
+                    ref = src + slot;
+                    slot = static_cast<uint32_t>(ip - src);
+                    if (ref < ip && ip - ref <= 65535 && read32(ref) == seq) break;
+                    ip += 1 + (attempts++ >> 6);
+                }
+                if (ip >= mflimit) break;
+
+                // 2. 向前扩展匹配
+                while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                    --ip;
+                    --ref;
+                }
+
+                // 3. 字面量
+                size_t literals = static_cast<size_t>(ip - anchor);
+                if (op + 1 + literals + literals / 255 + 1 + 2 > oend) return 0;
+                uint8_t* token = op++;
+                *token = 0;
+                op = write_length(op, token, literals, 4);
+                memcpy(op, anchor, literals);
+                op += literals;
+
+                // 4. 偏移和匹配长度
+                uint16_t offset = static_cast<uint16_t>(ip - ref);
+                *op++ = static_cast<uint8_t>(offset);
+                *op++ = static_cast<uint8_t>(offset >> 8);
+                const uint8_t* match_start = ip;
+                ip += MIN_MATCH;
+                ref += MIN_MATCH;
+                while (ip < matchlimit && *ip == *ref) {
+                    ++ip;
+                    ++ref;
+                }
+                size_t match = static_cast<size_t>(ip - match_start) - MIN_MATCH;
+                if (op + match / 255 + 1 > oend) return 0;
+                op = write_length(op, token, match, 0);
+                anchor = ip;
+                if (ip < mflimit) table[hash(read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - src);
+            }
+        }
+
+        // 5. 剩余的字面量
+        size_t literals = static_cast<size_t>(iend - anchor);
+        if (op + 1 + literals + literals / 255 + 1 > oend) return 0;
+        uint8_t* token = op++;
+        *token = 0;
+        op = write_length(op, token, literals, 4);
+        memcpy(op, anchor, literals);
+        op += literals;
+        return static_cast<size_t>(op - dst);
+    }
+
+private:
+    std::vector<uint32_t> table;    // 4字节前缀的哈希 -> 最近出现的位置
+
+    static uint32_t read32(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    static uint32_t hash(uint32_t seq) { return (seq * 2654435761u) >> (32 - LZ4_HASH_LOG); }
+
+    // token的4位放不下时用0xFF扩展字节
+    static uint8_t* write_length(uint8_t* op, uint8_t* token, size_t len, int shift) {
+        if (len < 15) {
+            *token |= static_cast<uint8_t>(len << shift);
+            return op;
+        }
+        *token |= static_cast<uint8_t>(15 << shift);
+        len -= 15;
+        while (len >= 255) {
+            *op++ = 255;
+            len -= 255;
+        }
+        *op++ = static_cast<uint8_t>(len);
+        return op;
+    }
+};
+
+// ==================== LZ4 解码 ====================
+// 功能: 把n字节LZ4块格式的数据解压到dst，解压后必须正好raw_length字节
+// 返回: false-数据损坏(每一步都检查边界，损坏的数据不会越界读写)
+inline bool lz4_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t raw_length) {
+    const uint8_t* ip = src;
+    const uint8_t* const iend = src + n;
+    uint8_t* op = dst;
+    uint8_t* const oend = dst + raw_length;
+
+    while (ip < iend) {
+        // 1. 字面量
+        uint8_t token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return false;
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > static_cast<size_t>(iend - ip) || literals > static_cast<size_t>(oend - op)) return false;
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+        if (ip == iend) break;      // 最后一个序列只有字面量
+
+        // 2. 匹配
+        if (iend - ip < 2) return false;
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)) return false;
+        size_t match = token & 15;
+        if (match == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return false;
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += 4;
+        if (match > static_cast<size_t>(oend - op)) return false;
+        const uint8_t* ref = op - offset;
+        if (offset >= match) {
+            memcpy(op, ref, match);
+            op += match;
+        } else {
+            while (match--) *op++ = *ref++;     // 重叠的匹配(重复的短模式)逐字节复制
+        }
+    }
+    return op == oend;
+}
+
+#endif // COMPRESS_H
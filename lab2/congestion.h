@@ -0,0 +1,429 @@
+// congestion.h
+// 文件说明: 发送端的拥塞控制算法
+// 功能: 统一的拥塞控制接口(ACK / 丢包 / 超时事件，输出拥塞窗口和发送速率)，每次传输选择一种实现
+// 包含: TCP Reno(原有算法)、CUBIC(RFC 8312)、基于瓶颈带宽和最小RTT模型的BBR
+
+#ifndef CONGESTION_H
+#define CONGESTION_H
+
+#include "protocol.h"
+#include <cmath>
+#include <string>
+#include <memory>
+#include <deque>
+#include <utility>
+
+// ==================== 拥塞控制常量 ====================
+const double CUBIC_C = 0.4;                   // CUBIC窗口增长系数
+const double CUBIC_BETA = 0.7;                // CUBIC丢包后的窗口保留比例
+const double BBR_HIGH_GAIN = 2.885;           // BBR启动阶段的增益(2/ln2)，每轮发送速率翻倍
+const double BBR_CWND_GAIN = 2.0;             // BBR拥塞窗口 = 增益 * 带宽时延积
+const uint32_t BBR_BW_WINDOW_ROUNDS = 10;     // 瓶颈带宽取最近多少轮的最大值
+const int64_t BBR_MIN_RTT_WINDOW_US = 10000000;  // 最小RTT的有效期(微秒)，过期后进入PROBE_RTT
+const int64_t BBR_PROBE_RTT_US = 200000;      // PROBE_RTT阶段的持续时间(微秒)
+const uint32_t BBR_MIN_CWND = 4;              // BBR的最小拥塞窗口(数据包个数)
+
+// ==================== ACK事件 ====================
+// 发送端每处理一个ACK(包括重复ACK)就生成一次
+struct AckEvent {
+    std::chrono::steady_clock::time_point now;
+    uint32_t newly_acked;       // 本次新确认的包数(累计确认和SACK)
+    bool cumulative_advanced;   // 累计确认点是否前移(false即重复ACK)
+    uint32_t in_flight;         // 确认后仍在途的包数
+    int64_t rtt_us;             // 本次的RTT样本(微秒)，-1表示没有样本(Karn算法)
+    int64_t srtt_us;            // 当前平滑RTT(微秒)，尚无样本时为0
+    double delivery_rate;       // 投递速率样本(包/秒)，0表示没有样本
+    uint64_t delivered;         // 至今累计投递的包数
+    uint64_t prior_delivered;   // 产生速率样本的那个包发送时的累计投递数，用于划分往返轮次
+};
+
+// ==================== 拥塞控制状态 ====================
+// 各算法的内部状态统一编号，供诊断轨迹记录
+enum CongestionPhase {
+    PHASE_SLOW_START,
+    PHASE_CONGESTION_AVOIDANCE,
+    PHASE_FAST_RECOVERY,
+    PHASE_STARTUP,          // BBR
+    PHASE_DRAIN,
+    PHASE_PROBE_BW,
+    PHASE_PROBE_RTT
+};
+
+inline const char* congestion_phase_name(int phase) {
+    static const char* names[] = { "slow_start", "congestion_avoidance", "fast_recovery", "startup", "drain",
+                                   "probe_bw", "probe_rtt" };
+    return phase >= 0 && phase <= PHASE_PROBE_RTT ? names[phase] : "unknown";
+}
+
+// ==================== 拥塞控制接口 ====================
+class CongestionControl {
+public:
+    virtual ~CongestionControl() {}
+
+    virtual const char* name() const = 0;
+
+    // 握手完成后调用: 慢启动阈值的初始值(接收端窗口)
+    virtual void set_initial_ssthresh(uint32_t packets) { (void)packets; }
+
+    // 收到ACK(新确认或重复ACK)
+    virtual void on_ack(const AckEvent& ev) = 0;
+
+    // 重复ACK触发快速重传；发送端保证同一窗口内的丢包只通知一次
+    virtual void on_loss(std::chrono::steady_clock::time_point now, uint32_t in_flight) = 0;
+
+    // 重传超时；一轮超时只通知一次
+    virtual void on_timeout(std::chrono::steady_clock::time_point now) = 0;
+
+    // 拥塞窗口(数据包个数)，至少为1
+    virtual uint32_t cwnd() const = 0;
+
+    // 建议的发送速率(包/秒)，0表示不限速、完全由ACK驱动
+    virtual double pacing_rate() const { return 0; }
+
+    // 是否处于慢启动(窗口每RTT翻倍)，按窗口计算节奏速率时据此选择增益
+    virtual bool slow_start() const { return false; }
+
+    // 慢启动阈值(数据包个数)，0表示算法不使用阈值
+    virtual uint32_t ssthresh() const { return 0; }
+
+    // 当前状态，诊断轨迹记录的是它的变化
+    virtual CongestionPhase phase() const = 0;
+
+    // 按名称创建算法实现(reno / cubic / bbr)，名称无法识别时返回空指针
+    static std::unique_ptr<CongestionControl> create(const std::string& name);
+};
+
+// ==================== TCP Reno ====================
+// 慢启动每确认一个包cwnd加1，拥塞避免每个RTT加1，
+// 快速重传后cwnd减半并进入快速恢复(每个重复ACK膨胀1)，超时后回到cwnd = 1的慢启动
+class RenoCongestion : public CongestionControl {
+public:
+    RenoCongestion() : state(SLOW_START), window(1.0), threshold(WINDOW_SIZE) {}
+
+    const char* name() const override { return "reno"; }
+
+    void set_initial_ssthresh(uint32_t packets) override { threshold = (std::max)(packets, 2u); }
+
+    void on_ack(const AckEvent& ev) override {
+        if (!ev.cumulative_advanced) {
+            // 快速恢复期间，每个额外的重复ACK表示又有一个包离开网络
+            if (state == FAST_RECOVERY) window += 1.0;
+            return;
+        }
+        if (state == FAST_RECOVERY) {
+            // 新数据被确认: 收缩膨胀的窗口，回到拥塞避免
+            window = threshold;
+            state = CONGESTION_AVOIDANCE;
+            return;
+        }
+        for (uint32_t i = 0; i < ev.newly_acked; ++i) {
+            if (state == SLOW_START) {
+                window += 1.0;
+                if (window >= threshold) state = CONGESTION_AVOIDANCE;
+            } else {
+                window += 1.0 / window;
+            }
+        }
+    }
+
+    void on_loss(std::chrono::steady_clock::time_point, uint32_t) override {
+        threshold = (std::max)(static_cast<uint32_t>(window / 2), 2u);
+        window = threshold + 3;
+        state = FAST_RECOVERY;
+    }
+
+    void on_timeout(std::chrono::steady_clock::time_point) override {
+        threshold = (std::max)(static_cast<uint32_t>(window / 2), 2u);
+        window = 1.0;
+        state = SLOW_START;
+    }
+
+    uint32_t cwnd() const override { return (std::max)(static_cast<uint32_t>(window), 1u); }
+    bool slow_start() const override { return state == SLOW_START; }
+    uint32_t ssthresh() const override { return threshold; }
+
+    CongestionPhase phase() const override {
+        return state == SLOW_START ? PHASE_SLOW_START :
+               state == FAST_RECOVERY ? PHASE_FAST_RECOVERY : PHASE_CONGESTION_AVOIDANCE;
+    }
+
+private:
+    CongestionState state;
+    double window;          // 拥塞窗口(数据包)
+    uint32_t threshold;     // 慢启动阈值
+};
+
+// ==================== CUBIC ====================
+// 拥塞避免阶段窗口按距上次丢包的时间t的三次函数增长: W(t) = C*(t-K)^3 + W_max，
+// 远离W_max时增长很快，接近W_max时趋于平缓；增长速度与RTT无关，适合长肥管道
+// 同时维护按Reno速度增长的估计值W_est，窗口不低于它(TCP友好区域)
+class CubicCongestion : public CongestionControl {
+public:
+    CubicCongestion()
+        : window(1.0), threshold(WINDOW_SIZE), w_max(0), w_last_max(0), k(0), origin(0), w_est(0),
+          epoch_started(false) {}
+
+    const char* name() const override { return "cubic"; }
+
+    void set_initial_ssthresh(uint32_t packets) override { threshold = (std::max)(packets, 2u); }
+
+    void on_ack(const AckEvent& ev) override {
+        if (!ev.cumulative_advanced && ev.newly_acked == 0) return;
+        uint32_t acked = ev.newly_acked;
+
+        // 1. 慢启动
+        if (window < threshold) {
+            window += acked;
+            return;
+        }
+
+        // 2. 新的拥塞避免周期: 以本次ACK的时间为起点计算K
+        if (!epoch_started) {
+            epoch_started = true;
+            epoch_start = ev.now;
+            if (window < w_max) {
+                k = std::cbrt((w_max - window) / CUBIC_C);
+                origin = w_max;
+            } else {
+                k = 0;
+                origin = window;
+            }
+            w_est = window;
+        }
+
+        // 3. 目标窗口取一个RTT之后的三次函数值，每个ACK向目标靠近
+        double t = std::chrono::duration<double>(ev.now - epoch_start).count() + ev.srtt_us / 1e6;
+        double target = origin + CUBIC_C * (t - k) * (t - k) * (t - k);
+        if (target > window) {
+            window += (target - window) / window * acked;
+        } else {
+            window += 0.01 * acked / window;     // 在W_max附近以极小的速度探测
+        }
+
+        // 4. TCP友好区域: 不比同样条件下的Reno慢
+        w_est += 3.0 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) * acked / window;
+        if (w_est > window) window = w_est;
+    }
+
+    void on_loss(std::chrono::steady_clock::time_point, uint32_t) override {
+        reduce();
+        window = threshold;
+    }
+
+    void on_timeout(std::chrono::steady_clock::time_point) override {
+        reduce();
+        window = 1.0;
+    }
+
+    uint32_t cwnd() const override { return (std::max)(static_cast<uint32_t>(window), 1u); }
+    bool slow_start() const override { return window < threshold; }
+    uint32_t ssthresh() const override { return threshold; }
+    CongestionPhase phase() const override { return slow_start() ? PHASE_SLOW_START : PHASE_CONGESTION_AVOIDANCE; }
+
+private:
+    double window;          // 拥塞窗口(数据包)
+    uint32_t threshold;     // 慢启动阈值
+    double w_max;           // 上次丢包前的窗口
+    double w_last_max;      // 再上一次丢包前的窗口(快速收敛)
+    double k;               // 三次函数回到W_max所需的时间(秒)
+    double origin;          // 三次函数的平台高度
+    double w_est;           // 按Reno速度估计的窗口
+    bool epoch_started;
+    std::chrono::steady_clock::time_point epoch_start;
+
+    // 丢包: 记录W_max，窗口乘以beta；若W_max比上次还小，说明有新流加入，主动让出带宽(快速收敛)
+    void reduce() {
+        if (window < w_last_max) {
+            w_max = window * (1 + CUBIC_BETA) / 2;
+        } else {
+            w_max = window;
+        }
+        w_last_max = window;
+        threshold = (std::max)(static_cast<uint32_t>(window * CUBIC_BETA), 2u);
+        epoch_started = false;
+    }
+};
+
+// ==================== BBR ====================
+// 不把丢包当作拥塞信号，而是测量瓶颈带宽(最近10轮投递速率的最大值)和最小RTT(最近10秒)，
+// 按 带宽 * 增益 发送，拥塞窗口为带宽时延积的两倍:
+//   STARTUP:    增益2.885，带宽连续3轮增长不足25%即认为管道已满
+//   DRAIN:      增益取倒数，排空启动阶段在瓶颈积压的队列
+//   PROBE_BW:   增益按 1.25, 0.75, 1, 1, 1, 1, 1, 1 循环，每个最小RTT切换一次，探测新增的带宽
+//   PROBE_RTT:  最小RTT过期时把窗口降到4个包并维持200ms，重新测量不含排队的RTT
+class BbrCongestion : public CongestionControl {
+public:
+    BbrCongestion()
+        : mode(STARTUP), min_rtt_us(-1), round_count(0), next_round_delivered(0), round_start(false),
+          full_bw(0), full_bw_rounds(0), filled_pipe(false), cycle_index(0), pacing_gain(BBR_HIGH_GAIN),
+          cwnd_gain(BBR_HIGH_GAIN), window(BBR_MIN_CWND), in_flight(0), probe_rtt_done_set(false) {}
+
+    const char* name() const override { return "bbr"; }
+
+    void on_ack(const AckEvent& ev) override {
+        in_flight = ev.in_flight;
+
+        // 1. 往返轮次: 产生速率样本的包是在上一轮开始之后发送的，说明过了一个RTT
+        round_start = false;
+        if (ev.delivery_rate > 0 && ev.prior_delivered >= next_round_delivered) {
+            next_round_delivered = ev.delivered;
+            round_count++;
+            round_start = true;
+        }
+
+        // 2. 更新模型: 瓶颈带宽(窗口最大值)和最小RTT
+        if (ev.delivery_rate > 0) update_bw(ev.delivery_rate);
+        bool min_rtt_expired = min_rtt_us >= 0 && ev.now - min_rtt_stamp > std::chrono::microseconds(BBR_MIN_RTT_WINDOW_US);
+        if (ev.rtt_us >= 0 && (min_rtt_us < 0 || ev.rtt_us <= min_rtt_us || min_rtt_expired)) {
+            min_rtt_us = ev.rtt_us;
+            min_rtt_stamp = ev.now;
+        }
+
+        // 3. 状态机
+        check_full_pipe();
+        if (mode == STARTUP && filled_pipe) enter(DRAIN, ev.now);
+        if (mode == DRAIN && in_flight <= target_window(1.0)) enter(PROBE_BW, ev.now);
+        if (mode == PROBE_BW) advance_cycle(ev.now);
+        if (mode != PROBE_RTT && min_rtt_expired) enter(PROBE_RTT, ev.now);
+        if (mode == PROBE_RTT) handle_probe_rtt(ev.now);
+
+        // 4. 拥塞窗口: 有带宽样本前按确认的包数增长(与慢启动相同)
+        if (mode == PROBE_RTT) {
+            window = BBR_MIN_CWND;
+        } else if (btl_bw() > 0 && min_rtt_us >= 0) {
+            uint32_t target = target_window(cwnd_gain);
+            if (filled_pipe) {
+                window = (std::min)(window + ev.newly_acked, target);
+            } else if (window < target || window < BBR_MIN_CWND) {
+                window += ev.newly_acked;
+            }
+        } else {
+            window += ev.newly_acked;
+        }
+        window = (std::max)(window, BBR_MIN_CWND);
+    }
+
+    // 丢包不改变模型，重传由发送端负责
+    void on_loss(std::chrono::steady_clock::time_point, uint32_t) override {}
+
+    // 超时: 在途数据全部视为丢失，窗口降到最小值，下一个ACK起按模型恢复
+    void on_timeout(std::chrono::steady_clock::time_point) override {
+        window = BBR_MIN_CWND;
+    }
+
+    uint32_t cwnd() const override { return window; }
+
+    double pacing_rate() const override {
+        double bw = btl_bw();
+        return bw > 0 ? pacing_gain * bw : 0;
+    }
+
+    CongestionPhase phase() const override {
+        static const CongestionPhase phases[] = { PHASE_STARTUP, PHASE_DRAIN, PHASE_PROBE_BW, PHASE_PROBE_RTT };
+        return phases[mode];
+    }
+
+private:
+    enum Mode { STARTUP, DRAIN, PROBE_BW, PROBE_RTT };
+
+    Mode mode;
+    int64_t min_rtt_us;                                 // 最小RTT(微秒)，-1表示尚无样本
+    std::chrono::steady_clock::time_point min_rtt_stamp;
+    uint64_t round_count;                               // 已经过的往返轮数
+    uint64_t next_round_delivered;                      // 累计投递数超过它时进入下一轮
+    bool round_start;
+    std::deque<std::pair<uint64_t, double> > bw_samples;  // (轮次, 速率)，速率单调递减，队首即窗口最大值
+    double full_bw;                                     // 启动阶段记录的带宽
+    uint32_t full_bw_rounds;                            // 带宽没有明显增长的轮数
+    bool filled_pipe;
+    uint32_t cycle_index;                               // PROBE_BW的增益循环位置
+    std::chrono::steady_clock::time_point cycle_stamp;
+    double pacing_gain;
+    double cwnd_gain;
+    uint32_t window;                                    // 拥塞窗口(数据包)
+    uint32_t in_flight;
+    std::chrono::steady_clock::time_point probe_rtt_done;
+    bool probe_rtt_done_set;
+
+    double btl_bw() const { return bw_samples.empty() ? 0 : bw_samples.front().second; }
+
+    // 窗口最大值滤波: 单调队列，新样本淘汰比它小的旧样本，超出窗口的轮次从队首移除
+    void update_bw(double rate) {
+        while (!bw_samples.empty() && bw_samples.back().second <= rate) bw_samples.pop_back();
+        bw_samples.push_back(std::make_pair(round_count, rate));
+        while (bw_samples.front().first + BBR_BW_WINDOW_ROUNDS <= round_count) bw_samples.pop_front();
+    }
+
+    // 带宽时延积乘以增益(数据包)
+    uint32_t target_window(double gain) const {
+        if (min_rtt_us < 0) return BBR_MIN_CWND;
+        double bdp = btl_bw() * min_rtt_us / 1e6;
+        return (std::max)(static_cast<uint32_t>(gain * bdp + 0.5), BBR_MIN_CWND);
+    }
+
+    // 启动阶段: 每轮检查一次带宽是否还在增长
+    void check_full_pipe() {
+        if (filled_pipe || !round_start) return;
+        if (btl_bw() >= full_bw * 1.25) {
+            full_bw = btl_bw();
+            full_bw_rounds = 0;
+            return;
+        }
+        if (++full_bw_rounds >= 3) filled_pipe = true;
+    }
+
+    void enter(Mode m, std::chrono::steady_clock::time_point now) {
+        mode = m;
+        switch (m) {
+        case STARTUP:
+            pacing_gain = cwnd_gain = BBR_HIGH_GAIN;
+            break;
+        case DRAIN:
+            pacing_gain = 1.0 / BBR_HIGH_GAIN;
+            cwnd_gain = BBR_HIGH_GAIN;
+            break;
+        case PROBE_BW:
+            cycle_index = 0;
+            cycle_stamp = now;
+            pacing_gain = 1.25;
+            cwnd_gain = BBR_CWND_GAIN;
+            break;
+        case PROBE_RTT:
+            pacing_gain = cwnd_gain = 1.0;
+            probe_rtt_done_set = false;
+            break;
+        }
+    }
+
+    void advance_cycle(std::chrono::steady_clock::time_point now) {
+        static const double gains[8] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+        if (min_rtt_us < 0 || now - cycle_stamp < std::chrono::microseconds(min_rtt_us)) return;
+        cycle_index = (cycle_index + 1) % 8;
+        cycle_stamp = now;
+        pacing_gain = gains[cycle_index];
+    }
+
+    // 在途数据降到4个包后计时200ms，期间测到的RTT即不含排队的最小RTT
+    void handle_probe_rtt(std::chrono::steady_clock::time_point now) {
+        if (!probe_rtt_done_set) {
+            if (in_flight <= BBR_MIN_CWND) {
+                probe_rtt_done = now + std::chrono::microseconds(BBR_PROBE_RTT_US);
+                probe_rtt_done_set = true;
+            }
+            return;
+        }
+        if (now >= probe_rtt_done) {
+            min_rtt_stamp = now;
+            enter(filled_pipe ? PROBE_BW : STARTUP, now);
+        }
+    }
+};
+
+inline std::unique_ptr<CongestionControl> CongestionControl::create(const std::string& name) {
+    if (name == "reno") return std::unique_ptr<CongestionControl>(new RenoCongestion());
+    if (name == "cubic") return std::unique_ptr<CongestionControl>(new CubicCongestion());
+    if (name == "bbr") return std::unique_ptr<CongestionControl>(new BbrCongestion());
+    return std::unique_ptr<CongestionControl>();
+}
+
+#endif // CONGESTION_H
@@ -0,0 +1,425 @@
+// datagram_io.h
+// 文件说明: 批量收发数据报的UDP套接字
+// 功能: Windows 8起使用RIO(Registered I/O): 发送请求先延迟排队，一批只提交一次；
+//       接收缓冲区预先投递，完成队列在用户态直接取出，不再每个数据报调用一次recvfrom
+// 说明: 系统不支持RIO时回退到普通的sendto/WSASendTo/recvfrom，接口不变；统计系统调用次数供传输统计显示
+//       RIO模式下等待同时挂在完成通知事件和一个高精度可等待定时器上，超时精确到微秒级(发送节奏控制需要)，
+//       不受WaitForSingleObject毫秒粒度和系统时钟中断间隔的限制
+// 线程: 发送(reserve/commit/send_gather/flush)和接收(receive/wait_receive)两侧的状态互不共享，
+//       可以由两个线程分别使用(多会话服务端: 收包线程接收，各分片线程在发送锁内发送)；同一侧的调用必须串行
+
+#ifndef DATAGRAM_IO_H
+#define DATAGRAM_IO_H
+
+#include "protocol.h"
+#include <mswsock.h>      // RIO扩展函数表
+#include <atomic>
+
+// ==================== 批量I/O常量 ====================
+const uint32_t IO_SEND_SLOTS = 512;     // RIO注册的发送槽位数(同时在途的发送请求上限)
+const uint32_t IO_RECV_SLOTS = 512;     // RIO预先投递的接收请求数
+const uint32_t IO_BATCH = 64;           // 延迟的请求攒够该数量即提交一次；一次从完成队列取出的最大数量
+// 每个槽位能放下最大的数据包(含SACK块)，按缓存行对齐
+const size_t IO_SLOT_SIZE = (MAX_PACKET_SIZE + 64 * sizeof(SACKBlock) + 63) / 64 * 64;
+
+class DatagramSocket {
+public:
+    DatagramSocket()
+        : sock(INVALID_SOCKET), rio_enabled(false), region(NULL), buffer_id(RIO_INVALID_BUFFERID),
+          send_cq(RIO_INVALID_CQ), recv_cq(RIO_INVALID_CQ), rq(RIO_INVALID_RQ), notify_event(NULL),
+          send_event(NULL), wait_timer(NULL), notify_armed(false), send_notify_armed(false), deferred_sends(0),
+          deferred_receives(0), held_slot(-1), result_pos(0), result_count(0), syscall_count(0), datagram_count(0),
+          send_failure_count(0) {}
+
+    ~DatagramSocket() { close(); }
+
+    // 功能: 创建非阻塞UDP套接字并放大收发缓冲区
+    // 说明: 优先带 WSA_FLAG_REGISTERED_IO 创建，系统不支持该标志时创建普通套接字
+    // 返回: false-创建失败(错误码见WSAGetLastError)
+    bool create() {
+        sock = WSASocket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, WSA_FLAG_REGISTERED_IO);
+        if (sock == INVALID_SOCKET) sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == INVALID_SOCKET) return false;
+        u_long mode = 1;
+        ioctlsocket(sock, FIONBIO, &mode);
+        set_socket_buffers(sock);
+        // 高精度定时器需要Windows 10 1803起，不支持时使用普通的可等待定时器
+        wait_timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (!wait_timer) wait_timer = CreateWaitableTimerA(NULL, FALSE, NULL);
+        return true;
+    }
+
+    // 功能: 绑定本地地址，然后尝试启用RIO(失败时使用普通调用)
+    // 返回: false-绑定失败(错误码见WSAGetLastError)
+    bool bind(const sockaddr_in& local) {
+        if (::bind(sock, (const struct sockaddr*)&local, sizeof(local)) == SOCKET_ERROR) return false;
+        rio_enabled = setup_rio();
+        if (!rio_enabled) {
+            release_rio();
+            tx_buffer.resize(IO_SLOT_SIZE);
+            rx_buffer.resize(IO_SLOT_SIZE);
+        }
+        return true;
+    }
+
+    void close() {
+        if (sock != INVALID_SOCKET) {
+            flush();
+            closesocket(sock);      // 请求队列随套接字一起释放
+            sock = INVALID_SOCKET;
+        }
+        release_rio();
+        if (wait_timer) CloseHandle(wait_timer);
+        wait_timer = NULL;
+    }
+
+    // 是否使用RIO: 使用时发送的数据必须先放进注册的槽位
+    bool registered() const { return rio_enabled; }
+    const char* mode_name() const { return rio_enabled ? "RIO" : "sendto/recvfrom"; }
+
+    // ==================== 发送 ====================
+
+    // 功能: 取得一个发送缓冲区，调用方在其中组装数据报后调用commit
+    // 参数: capacity-返回缓冲区大小
+    uint8_t* reserve(size_t& capacity) {
+        capacity = IO_SLOT_SIZE;
+        if (!rio_enabled) return tx_buffer.data();
+        if (free_sends.empty()) reclaim_sends(true);
+        return slot_data(free_sends.back());
+    }
+
+    // 功能: 发送reserve取得的缓冲区中的length字节
+    // 返回: false-数据报未能交给协议栈(发送缓冲区满、请求队列满等)，已计入send_failures，由调用方安排重发
+    // 说明: RIO下请求只排队不提交，攒够IO_BATCH个、调用flush或wait时一次提交
+    bool commit(size_t length, const sockaddr_in& to) {
+        datagram_count++;
+        if (!rio_enabled) {
+            syscall_count++;
+            if (sendto(sock, reinterpret_cast<const char*>(tx_buffer.data()), static_cast<int>(length), 0,
+                       (const struct sockaddr*)&to, sizeof(to)) == SOCKET_ERROR) {
+                send_failure_count++;
+                return false;
+            }
+            return true;
+        }
+        uint32_t slot = free_sends.back();
+        free_sends.pop_back();
+        SOCKADDR_INET* addr = slot_addr(slot);
+        memset(addr, 0, sizeof(SOCKADDR_INET));
+        memcpy(addr, &to, sizeof(to));
+        RIO_BUF data_buf = rio_buf(slot_data(slot), length);
+        RIO_BUF addr_buf = rio_buf(addr, sizeof(SOCKADDR_INET));
+        if (!rio.RIOSendEx(rq, &data_buf, 1, NULL, &addr_buf, NULL, NULL, RIO_MSG_DEFER,
+                           reinterpret_cast<PVOID>(static_cast<uintptr_t>(slot)))) {
+            free_sends.push_back(slot);
+            send_failure_count++;
+            return false;
+        }
+        if (++deferred_sends >= IO_BATCH) flush();
+        return true;
+    }
+
+    // 功能: 把多段数据拼接成一个数据报发送
+    // 返回: 同commit
+    // 说明: 普通调用下直接聚集发送，数据不复制；RIO下复制到注册的槽位
+    bool send_gather(const WSABUF* bufs, DWORD count, const sockaddr_in& to) {
+        if (!rio_enabled) {
+            DWORD sent = 0;
+            syscall_count++;
+            datagram_count++;
+            if (WSASendTo(sock, const_cast<LPWSABUF>(bufs), count, &sent, 0,
+                          (const struct sockaddr*)&to, sizeof(to), NULL, NULL) == SOCKET_ERROR) {
+                send_failure_count++;
+                return false;
+            }
+            return true;
+        }
+        size_t capacity = 0;
+        uint8_t* out = reserve(capacity);
+        size_t total = 0;
+        for (DWORD i = 0; i < count; ++i) total += bufs[i].len;
+        if (total > capacity) {
+            // 放不进一个槽位时不能截断后发出，与普通调用下发送失败一样交给调用方处理
+            datagram_count++;
+            send_failure_count++;
+            return false;
+        }
+        size_t length = 0;
+        for (DWORD i = 0; i < count; ++i) {
+            memcpy(out + length, bufs[i].buf, bufs[i].len);
+            length += bufs[i].len;
+        }
+        return commit(length, to);
+    }
+
+    // 功能: 提交所有延迟的发送请求(一次系统调用)
+    void flush() {
+        if (!rio_enabled || deferred_sends == 0) return;
+        syscall_count++;
+        rio.RIOSendEx(rq, NULL, 0, NULL, NULL, NULL, NULL, RIO_MSG_COMMIT_ONLY, NULL);
+        deferred_sends = 0;
+    }
+
+    // ==================== 接收 ====================
+
+    // 功能: 取出一个已到达的数据报，不阻塞
+    // 参数: data/length-数据报内容(下一次receive之前有效), from-发送方地址
+    // 返回: false-当前没有数据报
+    bool receive(const uint8_t*& data, size_t& length, sockaddr_in& from) {
+        if (!rio_enabled) {
+            int from_len = sizeof(from);
+            syscall_count++;
+            int n = recvfrom(sock, reinterpret_cast<char*>(rx_buffer.data()), static_cast<int>(rx_buffer.size()),
+                             0, (struct sockaddr*)&from, &from_len);
+            if (n <= 0) return false;
+            datagram_count++;
+            data = rx_buffer.data();
+            length = static_cast<size_t>(n);
+            return true;
+        }
+
+        // 上一次返回的数据报已处理完，把它的槽位重新投递
+        if (held_slot >= 0) {
+            post_receive(static_cast<uint32_t>(held_slot));
+            held_slot = -1;
+        }
+        while (true) {
+            if (result_pos == result_count && !dequeue_receives()) {
+                commit_receives();
+                return false;
+            }
+            const RIORESULT& r = results[result_pos++];
+            uint32_t slot = static_cast<uint32_t>(r.RequestContext);
+            if (r.Status != 0 || r.BytesTransferred == 0) {
+                post_receive(slot);     // 出错的接收(如对端端口不可达)不交给调用方
+                continue;
+            }
+            datagram_count++;
+            data = slot_data(slot);
+            length = r.BytesTransferred;
+            memcpy(&from, slot_addr(slot), sizeof(from));
+            held_slot = static_cast<int32_t>(slot);
+            return true;
+        }
+    }
+
+    // 功能: 提交积压的发送，然后等待数据报到达或超时
+    // 参数: timeout_us-最长等待时间(微秒)，负数表示一直等待
+    // 返回: true-有数据报可取，false-超时
+    bool wait(int64_t timeout_us) {
+        flush();
+        return wait_receive(timeout_us);
+    }
+
+    // 功能: 只等待数据报到达，不提交发送(发送由其他线程负责时使用)
+    bool wait_receive(int64_t timeout_us) {
+        if (!rio_enabled) {
+            syscall_count++;
+            return wait_readable(sock, timeout_us);
+        }
+
+        commit_receives();
+        if (result_pos < result_count || dequeue_receives()) return true;
+        if (timeout_us == 0) return false;
+
+        // 完成队列为空: 请求一次事件通知后阻塞等待(通知触发前不重复请求)
+        if (!notify_armed) {
+            syscall_count++;
+            rio.RIONotify(recv_cq);
+            notify_armed = true;
+        }
+        if (!wait_notify(timeout_us)) return false;
+        notify_armed = false;
+        return true;
+    }
+
+    // 功能: 等待数据报到达，最晚到deadline返回(deadline已过时只检查一次)
+    bool wait_until(std::chrono::steady_clock::time_point deadline) {
+        auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        return wait(left > 0 ? left : 0);
+    }
+
+    // ==================== 统计 ====================
+    uint64_t syscalls() const { return syscall_count; }        // 收发与等待所用的系统调用次数
+    uint64_t datagrams() const { return datagram_count; }      // 收发的数据报总数
+    uint64_t send_failures() const { return send_failure_count; }  // 未能交给协议栈的发送
+
+private:
+    SOCKET sock;
+    bool rio_enabled;
+
+    // RIO: 一块注册内存依次存放 发送槽位、接收槽位、发送地址、接收地址
+    RIO_EXTENSION_FUNCTION_TABLE rio;
+    char* region;
+    RIO_BUFFERID buffer_id;
+    RIO_CQ send_cq;                         // 发送完成队列(轮询，槽位用尽时才等待通知)
+    RIO_CQ recv_cq;                         // 接收完成队列(事件通知)
+    RIO_RQ rq;
+    HANDLE notify_event;
+    HANDLE send_event;                      // 发送完成队列的通知事件
+    HANDLE wait_timer;                      // 有限时长的等待由它唤醒(自动复位)
+    bool notify_armed;                      // 已调用RIONotify且通知尚未触发
+    bool send_notify_armed;                 // 同上，发送完成队列
+    std::vector<uint32_t> free_sends;       // 空闲的发送槽位
+    uint32_t deferred_sends;                // 已排队未提交的发送请求数
+    uint32_t deferred_receives;             // 已排队未提交的接收请求数
+    int32_t held_slot;                      // 最近一次交给调用方的接收槽位，下次receive时重新投递
+    RIORESULT results[IO_BATCH];            // 从接收完成队列取出、尚未交给调用方的结果
+    uint32_t result_pos;
+    uint32_t result_count;
+
+    // 回退模式的收发缓冲区
+    std::vector<uint8_t> tx_buffer;
+    std::vector<uint8_t> rx_buffer;
+
+    std::atomic<uint64_t> syscall_count;    // 收发两侧都会计数
+    std::atomic<uint64_t> datagram_count;
+    std::atomic<uint64_t> send_failure_count;
+
+    uint8_t* slot_data(uint32_t slot) const {
+        return reinterpret_cast<uint8_t*>(region) + static_cast<size_t>(slot) * IO_SLOT_SIZE;
+    }
+    SOCKADDR_INET* slot_addr(uint32_t slot) const {
+        size_t base = static_cast<size_t>(IO_SEND_SLOTS + IO_RECV_SLOTS) * IO_SLOT_SIZE;
+        return reinterpret_cast<SOCKADDR_INET*>(region + base) + slot;
+    }
+    RIO_BUF rio_buf(const void* ptr, size_t length) const {
+        RIO_BUF buf;
+        buf.BufferId = buffer_id;
+        buf.Offset = static_cast<ULONG>(static_cast<const char*>(ptr) - region);
+        buf.Length = static_cast<ULONG>(length);
+        return buf;
+    }
+
+    // 功能: 取得RIO函数表，注册内存，创建完成队列和请求队列，投递全部接收请求
+    // 返回: false-不支持RIO或资源创建失败，由调用方释放已创建的部分
+    bool setup_rio() {
+        GUID id = WSAID_MULTIPLE_RIO;
+        DWORD bytes = 0;
+        memset(&rio, 0, sizeof(rio));
+        rio.cbSize = sizeof(rio);
+        if (WSAIoctl(sock, SIO_GET_MULTIPLE_EXTENSION_FUNCTION_POINTER, &id, sizeof(id),
+                     &rio, sizeof(rio), &bytes, NULL, NULL) != 0) {
+            return false;
+        }
+
+        uint32_t slots = IO_SEND_SLOTS + IO_RECV_SLOTS;
+        size_t size = slots * IO_SLOT_SIZE + slots * sizeof(SOCKADDR_INET);
+        region = static_cast<char*>(VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+        if (!region) return false;
+        buffer_id = rio.RIORegisterBuffer(region, static_cast<DWORD>(size));
+        if (buffer_id == RIO_INVALID_BUFFERID) return false;
+
+        notify_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+        send_event = CreateEventA(NULL, FALSE, FALSE, NULL);
+        if (!notify_event || !send_event) return false;
+        RIO_NOTIFICATION_COMPLETION notify;
+        memset(&notify, 0, sizeof(notify));
+        notify.Type = RIO_EVENT_COMPLETION;
+        notify.Event.EventHandle = notify_event;
+        notify.Event.NotifyReset = TRUE;
+        recv_cq = rio.RIOCreateCompletionQueue(IO_RECV_SLOTS, &notify);
+        notify.Event.EventHandle = send_event;
+        send_cq = rio.RIOCreateCompletionQueue(IO_SEND_SLOTS, &notify);
+        if (recv_cq == RIO_INVALID_CQ || send_cq == RIO_INVALID_CQ) return false;
+        rq = rio.RIOCreateRequestQueue(sock, IO_RECV_SLOTS, 1, IO_SEND_SLOTS, 1, recv_cq, send_cq, NULL);
+        if (rq == RIO_INVALID_RQ) return false;
+
+        free_sends.reserve(IO_SEND_SLOTS);
+        for (uint32_t i = IO_SEND_SLOTS; i-- > 0;) free_sends.push_back(i);
+        for (uint32_t i = 0; i < IO_RECV_SLOTS; ++i) post_receive(IO_SEND_SLOTS + i);
+        commit_receives();
+        return true;
+    }
+
+    void release_rio() {
+        if (recv_cq != RIO_INVALID_CQ) rio.RIOCloseCompletionQueue(recv_cq);
+        if (send_cq != RIO_INVALID_CQ) rio.RIOCloseCompletionQueue(send_cq);
+        if (buffer_id != RIO_INVALID_BUFFERID) rio.RIODeregisterBuffer(buffer_id);
+        if (region) VirtualFree(region, 0, MEM_RELEASE);
+        if (notify_event) CloseHandle(notify_event);
+        if (send_event) CloseHandle(send_event);
+        recv_cq = send_cq = RIO_INVALID_CQ;
+        rq = RIO_INVALID_RQ;
+        buffer_id = RIO_INVALID_BUFFERID;
+        region = NULL;
+        notify_event = NULL;
+        send_event = NULL;
+        rio_enabled = false;
+    }
+
+    // 功能: 等待接收完成通知，最长timeout_us微秒(负数表示一直等待)
+    // 返回: true-通知已触发
+    // 说明: 定时器以100ns为单位设置相对到期时间，重新设置时清除上一次遗留的触发状态
+    bool wait_notify(int64_t timeout_us) {
+        if (timeout_us >= 0 && wait_timer) {
+            LARGE_INTEGER due;
+            due.QuadPart = -timeout_us * 10;
+            syscall_count++;
+            if (SetWaitableTimer(wait_timer, &due, 0, NULL, NULL, FALSE)) {
+                HANDLE handles[2] = { notify_event, wait_timer };
+                syscall_count++;
+                return WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0;
+            }
+        }
+        DWORD ms = timeout_us < 0 ? INFINITE : static_cast<DWORD>((timeout_us + 999) / 1000);
+        syscall_count++;
+        return WaitForSingleObject(notify_event, ms) == WAIT_OBJECT_0;
+    }
+
+    // 延迟投递一个接收请求，攒够一批再提交
+    void post_receive(uint32_t slot) {
+        RIO_BUF data_buf = rio_buf(slot_data(slot), IO_SLOT_SIZE);
+        RIO_BUF addr_buf = rio_buf(slot_addr(slot), sizeof(SOCKADDR_INET));
+        rio.RIOReceiveEx(rq, &data_buf, 1, NULL, &addr_buf, NULL, NULL, RIO_MSG_DEFER,
+                         reinterpret_cast<PVOID>(static_cast<uintptr_t>(slot)));
+        if (++deferred_receives >= IO_BATCH) commit_receives();
+    }
+
+    void commit_receives() {
+        if (deferred_receives == 0) return;
+        syscall_count++;
+        rio.RIOReceiveEx(rq, NULL, 0, NULL, NULL, NULL, NULL, RIO_MSG_COMMIT_ONLY, NULL);
+        deferred_receives = 0;
+    }
+
+    // 从接收完成队列取一批结果(用户态操作，不进入内核)
+    bool dequeue_receives() {
+        ULONG n = rio.RIODequeueCompletion(recv_cq, results, IO_BATCH);
+        if (n == 0 || n == RIO_CORRUPT_CQ) {
+            result_pos = result_count = 0;
+            return false;
+        }
+        result_pos = 0;
+        result_count = n;
+        return true;
+    }
+
+    // 回收已发送完成的槽位；block为true时一直等到至少有一个空闲槽位
+    // 说明: 槽位全部在途时先提交积压的请求，再阻塞在发送完成通知上；
+    //       等待最长1ms，通知因故未触发时也会回到出队检查，不会一直卡住
+    void reclaim_sends(bool block) {
+        RIORESULT done[IO_BATCH];
+        while (true) {
+            ULONG n = rio.RIODequeueCompletion(send_cq, done, IO_BATCH);
+            if (n != RIO_CORRUPT_CQ) {
+                for (ULONG i = 0; i < n; ++i) free_sends.push_back(static_cast<uint32_t>(done[i].RequestContext));
+            }
+            if (!block || !free_sends.empty()) return;
+            flush();
+            if (!send_notify_armed) {
+                syscall_count++;
+                rio.RIONotify(send_cq);     // 队列中已有完成结果时立即触发
+                send_notify_armed = true;
+            }
+            syscall_count++;
+            if (WaitForSingleObject(send_event, 1) == WAIT_OBJECT_0) send_notify_armed = false;
+        }
+    }
+
+    DatagramSocket(const DatagramSocket&);
+    DatagramSocket& operator=(const DatagramSocket&);
+};
+
+#endif // DATAGRAM_IO_H
@@ -0,0 +1,117 @@
+// fec.h
+// 文件说明: 前向纠错(FEC)
+// 功能: 发送端把连续首次发送的DATA包按块分组，每块发送一个XOR修复包；接收端在块中只缺一个包时用修复包恢复它，
+//       不必等一个RTT的重传。块的大小随估计的丢包率调整，没有丢包时不发送修复包
+// 修复包(FEC_REPAIR): seq_num 为块中第一个包的序列号，ack_num 为块中的包数，
+//                     数据为块中各包负载的按位异或(较短的包补0，长度为块中最长的包)
+
+#ifndef FEC_H
+#define FEC_H
+
+#include "protocol.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// ==================== FEC常量 ====================
+const uint32_t FEC_MIN_GROUP = 4;           // 块中最少的包数(修复包开销不超过1/4)
+const uint32_t FEC_MAX_GROUP = 32;          // 块中最多的包数
+const double FEC_MIN_LOSS = 0.005;          // 估计丢包率低于该值时不发送修复包
+const uint32_t FEC_LOSS_INTERVAL = 256;     // 每发送这么多个新包更新一次丢包率估计
+const double FEC_LOSS_GAIN = 0.25;          // 丢包率估计的EWMA增益
+
+// 功能: dst ^= src，按64位字处理
+inline void fec_xor(uint8_t* dst, const uint8_t* src, size_t len) {
+    while (len >= 8) {
+        uint64_t a, b;
+        memcpy(&a, dst, 8);
+        memcpy(&b, src, 8);
+        a ^= b;
+        memcpy(dst, &a, 8);
+        dst += 8;
+        src += 8;
+        len -= 8;
+    }
+    while (len--) *dst++ ^= *src++;
+}
+
+// ==================== FEC编码器(发送端) ====================
+// 丢包率估计: 每 FEC_LOSS_INTERVAL 个新包统计期间判定丢失的包数(快速重传、超时重传、接收端报告的FEC恢复)，
+// 按EWMA平滑；块大小取平均每4块出现一个丢包，单个修复包足以恢复绝大多数块
+class FecEncoder {
+public:
+    FecEncoder()
+        : group(0), first_seq(0), count(0), length(0), parity(MAX_DATA_SIZE),
+          interval_sent(0), interval_lost(0), loss_rate(0), repairs_sent(0) {}
+
+    // 功能: 把一个首次发送的包加入当前块
+    // 返回: true-块已满，调用方应发送修复包(build_repair)
+    bool add(uint32_t seq, const uint8_t* data, uint16_t len) {
+        if (++interval_sent >= FEC_LOSS_INTERVAL) update_loss_rate();
+        if (count == 0) {
+            group = group_for(loss_rate);   // 块大小在块开始时确定
+            if (group == 0) return false;
+            first_seq = seq;
+            length = 0;
+        }
+        if (len > length) {
+            memset(parity.data() + length, 0, len - length);
+            length = len;
+        }
+        fec_xor(parity.data(), data, len);
+        return ++count >= group;
+    }
+
+    // 是否有尚未发送修复包的部分块(数据源结束时补发，尾部丢包也能恢复)
+    bool pending() const { return count > 0; }
+
+    // 功能: 生成当前块的修复包并开始新块(需在计算校验和之前调用)
+    void build_repair(Packet& packet) {
+        packet.header.type = FEC_REPAIR;
+        packet.header.seq_num = first_seq;
+        packet.header.ack_num = count;
+        packet.header.data_length = length;
+        memcpy(packet.data, parity.data(), length);
+        count = 0;
+        repairs_sent++;
+    }
+
+    // 判定丢失(或被接收端用修复包恢复)了一个包
+    void on_loss() { interval_lost++; }
+
+    double loss() const { return loss_rate; }
+    uint32_t group_size() const { return group_for(loss_rate); }
+    uint64_t repairs() const { return repairs_sent; }
+
+    // 功能: 按丢包率确定块大小
+    // 返回: 0-不发送修复包
+    static uint32_t group_for(double loss) {
+        if (loss < FEC_MIN_LOSS) return 0;
+        double g = 1.0 / (4.0 * loss);
+        if (g < FEC_MIN_GROUP) return FEC_MIN_GROUP;
+        if (g > FEC_MAX_GROUP) return FEC_MAX_GROUP;
+        return static_cast<uint32_t>(g);
+    }
+
+private:
+    void update_loss_rate() {
+        double sample = static_cast<double>(interval_lost) / interval_sent;
+        if (sample > 1.0) sample = 1.0;
+        loss_rate += FEC_LOSS_GAIN * (sample - loss_rate);
+        interval_sent = 0;
+        interval_lost = 0;
+    }
+
+    uint32_t group;             // 当前块的大小
+    uint32_t first_seq;         // 当前块第一个包的序列号
+    uint32_t count;             // 当前块已加入的包数
+    uint16_t length;            // 当前块中最长的包的长度
+    std::vector<uint8_t> parity;    // 当前块的异或结果
+
+    uint32_t interval_sent;     // 本统计周期发送的新包数
+    uint32_t interval_lost;     // 本统计周期判定丢失的包数
+    double loss_rate;           // 平滑后的丢包率估计
+    uint64_t repairs_sent;      // 发送的修复包数
+};
+
+#endif // FEC_H
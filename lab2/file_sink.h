@@ -0,0 +1,456 @@
+// file_sink.h
+// 文件说明: 接收端的输出文件
+// 功能: 已知文件大小时按大小预分配并映射输出文件，每个包的数据直接复制到 seq * payload_size 对应的位置，
+//       乱序到达的包不再经过乱序缓冲和二次复制；不知道大小时(流式输入、旧版本发送端)按顺序写出
+// 包含: 内存映射输出(按窗口映射可写视图，并行传输的各个流共享同一映射)、顺序写出(文件流)、
+//       分块解压输出(按序收到的压缩块交给工作线程解压，写入各块在文件中的位置)
+// 续传时保留已有的输出文件，只调整到新的大小，已有内容交给续传清单比较(见 manifest.h)
+
+#ifndef FILE_SINK_H
+#define FILE_SINK_H
+
+#include <windows.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+#include "mapped_views.h"
+#include "manifest.h"
+#include "compress.h"
+
+// ==================== 输出常量 ====================
+const size_t DECOMPRESS_MAX_PENDING = 256;      // 等待解压的块数上限(约64MB)，队列占满时接收端把通告窗口关到0
+
+// ==================== 输出文件接口 ====================
+class FileSink {
+public:
+    virtual ~FileSink() {}
+
+    // 是否支持按偏移直接写入(已预分配，reserve可用)；否则只能用append顺序写出
+    virtual bool random_access() const = 0;
+
+    // 预分配的文件大小(仅random_access时有意义)
+    virtual uint64_t size() const { return 0; }
+
+    // 打开时保留下来的原有内容的字节数(从文件开头起；新建或截断的文件为0)
+    virtual uint64_t preserved_size() const { return 0; }
+
+    // 功能: 计算 [offset, offset+length) 中前count块的哈希(续传清单，多线程)
+    // 返回: false-不支持或读取失败
+    virtual bool hash_chunks(uint64_t offset, uint64_t length, uint32_t chunk_size, size_t count,
+                             std::vector<uint64_t>& hashes) {
+        (void)offset;
+        (void)length;
+        (void)chunk_size;
+        (void)count;
+        (void)hashes;
+        return false;
+    }
+
+    // 功能: 取得文件中 [offset, offset+len) 对应的可写内存，数据复制进去即写入文件
+    // 返回: NULL-不支持或映射失败
+    // 说明: 返回的指针在下一次调用reserve之前有效；调用方保证范围不超过文件大小
+    virtual uint8_t* reserve(uint64_t offset, size_t len) {
+        (void)offset;
+        (void)len;
+        return NULL;
+    }
+
+    // 功能: 在文件末尾顺序追加数据
+    virtual bool append(const uint8_t* data, size_t len) {
+        (void)data;
+        (void)len;
+        return false;
+    }
+
+    // 功能: 关闭文件(析构时也会关闭)
+    virtual void close() = 0;
+
+    // 写入的数据是否有误(如压缩块损坏)，close之后调用
+    virtual bool failed() const { return false; }
+
+    // 功能: 输出在不积压的前提下还能接收多少字节(如解压队列的剩余空间)，接收端据此缩小通告窗口
+    // 返回: SIZE_MAX-不限制
+    virtual size_t accept_capacity() const { return SIZE_MAX; }
+
+    // 功能: 输出自己的统计(如解压的块数)，显示在接收端的统计中
+    virtual void describe(std::ostream& os) const { (void)os; }
+
+    // 功能: 为另一个流创建写入同一文件的输出(并行传输时每个接收流一个)
+    // 返回: NULL-不支持(顺序写出只能有一个写入者)
+    virtual std::unique_ptr<FileSink> share() const { return std::unique_ptr<FileSink>(); }
+
+    // 功能: 创建输出文件，已知大小时优先使用内存映射，映射失败时退回顺序写出
+    // 参数: keep_existing-已知大小时保留同名的已有文件(续传)，否则截断
+    // 返回: NULL-无法创建文件
+    static std::unique_ptr<FileSink> create(const std::string& path, bool size_known, uint64_t size,
+                                            bool keep_existing = false);
+};
+
+// ==================== 内存映射输出 ====================
+// 创建文件映射时指定大小即把文件扩展到该大小(预分配)，之后按 MAP_VIEW_SIZE 分窗口映射可写视图
+// 接收窗口覆盖的数据量小于一个视图，窗口跨越视图边界时两个视图同时保留
+
+// 文件句柄和映射对象，由写入同一文件的各个输出共同持有，最后一个关闭时释放
+struct FileMapping {
+    HANDLE file;
+    HANDLE mapping;
+    uint64_t size;
+    uint64_t preserved;     // 保留的原有内容字节数
+
+    FileMapping(HANDLE file, uint64_t size, uint64_t preserved = 0)
+        : file(file), mapping(NULL), size(size), preserved(preserved) {
+        if (size > 0) {
+            mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE,
+                static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xFFFFFFFF), NULL);
+        }
+    }
+
+    ~FileMapping() {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+    }
+
+private:
+    FileMapping(const FileMapping&);
+    FileMapping& operator=(const FileMapping&);
+};
+
+// 共享同一映射的各个输出使用各自的视图缓存(视图缓存不是线程安全的)，写入的范围互不重叠，不需要加锁
+class MappedFileSink : public FileSink {
+public:
+    explicit MappedFileSink(std::shared_ptr<FileMapping> file) : file(file) {
+        if (file->mapping) views.reset(new MappedViews(file->mapping, file->size, true));
+    }
+
+    ~MappedFileSink() override { close(); }
+
+    // 空文件不需要映射；非空文件映射失败(如磁盘空间不足)时由create退回顺序写出
+    bool valid() const { return file && (file->size == 0 || file->mapping != NULL); }
+
+    bool random_access() const override { return true; }
+    uint64_t size() const override { return file ? file->size : 0; }
+    uint64_t preserved_size() const override { return file ? file->preserved : 0; }
+
+    bool hash_chunks(uint64_t offset, uint64_t length, uint32_t chunk_size, size_t count,
+                     std::vector<uint64_t>& hashes) override {
+        if (!file) return false;
+        return hash_mapped_chunks(file->mapping, file->size, offset, length, chunk_size, count, hashes);
+    }
+
+    uint8_t* reserve(uint64_t offset, size_t len) override {
+        return views ? views->map(offset, len) : NULL;
+    }
+
+    // 解除映射后脏页由系统写回文件
+    void close() override {
+        views.reset();
+        file.reset();
+    }
+
+    std::unique_ptr<FileSink> share() const override {
+        if (!file) return std::unique_ptr<FileSink>();
+        return std::unique_ptr<FileSink>(new MappedFileSink(file));
+    }
+
+private:
+    std::shared_ptr<FileMapping> file;
+    std::unique_ptr<MappedViews> views;
+};
+
+// ==================== 顺序写出 ====================
+class StreamFileSink : public FileSink {
+public:
+    explicit StreamFileSink(const std::string& path) : out(path, std::ios::binary) {}
+
+    bool valid() const { return out.is_open(); }
+
+    bool random_access() const override { return false; }
+
+    bool append(const uint8_t* data, size_t len) override {
+        out.write(reinterpret_cast<const char*>(data), len);
+        return out.good();
+    }
+
+    void close() override {
+        if (out.is_open()) out.close();
+    }
+
+private:
+    std::ofstream out;
+};
+
+// ==================== 分块解压输出 ====================
+// 接收线程按序append压缩后的数据流，在这里拆成完整的块(BlockFrame + 数据，可跨包)放入队列；
+// 工作线程各自通过share()持有输出文件的视图，解压后直接写入该块在文件中的位置，接收线程不做解压
+// 块在拼接后的原始数据中的偏移经ChunkMap换算到本流范围内(续传时)，跨续传块边界时先解压到临时缓冲再分段复制
+// 输出文件不支持按偏移写入(映射失败)时只用一个工作线程，按队列顺序解压并顺序写出
+// append从不等待工作线程: 队列的剩余空间经accept_capacity交给接收端缩小通告窗口，由发送端放慢
+class DecompressingSink : public FileSink {
+public:
+    // 参数: inner-解压后的输出文件, base_offset-本流范围在文件中的偏移, chunks-续传块(引用，不复制),
+    //       raw_limit-解压后应得到的字节数, threads-解压线程数
+    DecompressingSink(std::unique_ptr<FileSink> inner, uint64_t base_offset, const ChunkMap& chunks,
+                      uint64_t raw_limit, unsigned threads)
+        : inner(std::move(inner)), base_offset(base_offset), chunks(chunks), raw_limit(raw_limit),
+          raw_offset(0), header_got(0), wire_bytes(0), submitted_blocks(0), decode_failed(false), stopping(false),
+          closed(false), compressed_blocks(0), stored_blocks(0), thread_count(0), sequential(false) {
+        memset(&frame, 0, sizeof(frame));
+        threads = (std::max)(1u, (std::min)(threads, COMPRESS_MAX_THREADS));
+        sequential = !this->inner->random_access();
+        for (unsigned i = 0; i < threads && !sequential; ++i) {
+            std::unique_ptr<FileSink> view = this->inner->share();
+            if (!view) break;
+            workers.push_back(std::thread(&DecompressingSink::decompress_loop, this, std::shared_ptr<FileSink>(std::move(view))));
+        }
+        // 不能按偏移写入(或共享视图失败): 一个工作线程独占inner写出
+        if (workers.empty()) workers.push_back(std::thread(&DecompressingSink::decompress_loop, this, std::shared_ptr<FileSink>()));
+        thread_count = workers.size();
+    }
+
+    ~DecompressingSink() override { close(); }
+
+    bool random_access() const override { return false; }
+
+    // 拆出完整的块；数据格式有误时返回false，之后的数据全部丢弃
+    bool append(const uint8_t* data, size_t len) override {
+        wire_bytes += len;
+        while (len > 0 && !decode_failed) {
+            // 1. 块头部(可能被包边界分开)
+            if (header_got < sizeof(BlockFrame)) {
+                size_t n = (std::min)(len, sizeof(BlockFrame) - header_got);
+                memcpy(reinterpret_cast<uint8_t*>(&frame) + header_got, data, n);
+                header_got += n;
+                data += n;
+                len -= n;
+                if (header_got < sizeof(BlockFrame)) break;
+                // 解压缓冲按块的 raw_length 扩容，这里把 raw_length 限制在 COMPRESS_BLOCK_SIZE 以内，恶意头部撑不大缓冲
+                if (frame.raw_length == 0 || frame.raw_length > COMPRESS_BLOCK_SIZE ||
+                    frame.stored_length > frame.raw_length || raw_offset + frame.raw_length > raw_limit) {
+                    decode_failed = true;
+                    break;
+                }
+                current = take_buffer();
+                current.reserve(frame.stored_length);
+            }
+
+            // 2. 块数据，收齐后交给工作线程
+            size_t n = (std::min)(len, static_cast<size_t>(frame.stored_length) - current.size());
+            current.insert(current.end(), data, data + n);
+            data += n;
+            len -= n;
+            if (current.size() == frame.stored_length) {
+                Block block;
+                block.raw_offset = raw_offset;
+                block.raw_length = frame.raw_length;
+                block.data.swap(current);
+                raw_offset += frame.raw_length;
+                header_got = 0;
+                submitted_blocks++;
+                submit(block);
+            }
+        }
+        return !decode_failed;
+    }
+
+    // 等待所有块解压完成
+    void close() override {
+        if (closed) return;
+        {
+            std::unique_lock<std::mutex> lk(mtx);
+            stopping = true;
+        }
+        queue_cv.notify_all();
+        for (auto& t : workers) t.join();
+        workers.clear();
+        inner->close();
+        closed = true;
+    }
+
+    // 块损坏，或收到的块少于应有的数据
+    bool failed() const override { return decode_failed || raw_offset != raw_limit || header_got != 0; }
+
+    // 队列剩余的块数 x 已收到的块的平均大小，减去正在接收的块已到的部分；队列占满时为0
+    size_t accept_capacity() const override {
+        size_t pending;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            pending = queue.size();
+        }
+        if (pending >= DECOMPRESS_MAX_PENDING) return 0;
+        uint64_t average = submitted_blocks ? wire_bytes / submitted_blocks : COMPRESS_BLOCK_SIZE;
+        uint64_t room = (DECOMPRESS_MAX_PENDING - pending) * average;
+        return room > current.size() ? static_cast<size_t>(room - current.size()) : 0;
+    }
+
+    void describe(std::ostream& os) const override {
+        os << "  分块解压:    " << wire_bytes << " -> " << raw_offset << " 字节 (" << std::fixed << std::setprecision(1)
+           << (raw_offset ? wire_bytes * 100.0 / raw_offset : 100.0) << "%), 解压 " << compressed_blocks
+           << " 块, 原样 " << stored_blocks << " 块, " << thread_count << " 个线程";
+        if (sequential) os << "(顺序写出)";
+        os << std::endl;
+    }
+
+private:
+    struct Block {
+        uint64_t raw_offset;            // 在拼接后的原始数据中的偏移
+        uint32_t raw_length;
+        std::vector<uint8_t> data;      // 压缩后(或原样)的数据
+    };
+
+    std::unique_ptr<FileSink> inner;
+    uint64_t base_offset;
+    const ChunkMap& chunks;
+    uint64_t raw_limit;
+    uint64_t raw_offset;                // 已拆出的块的原始数据总字节数
+    BlockFrame frame;                   // 正在接收的块的头部
+    size_t header_got;
+    std::vector<uint8_t> current;       // 正在接收的块的数据
+    uint64_t wire_bytes;
+    uint64_t submitted_blocks;          // 已拆出交给工作线程的块数(只由接收线程访问)
+    std::atomic<bool> decode_failed;
+    bool stopping;
+    bool closed;
+    uint64_t compressed_blocks;
+    uint64_t stored_blocks;
+    std::deque<Block> queue;
+    std::vector<std::vector<uint8_t>> spare;    // 用过的块缓冲，重复使用
+    mutable std::mutex mtx;
+    std::condition_variable queue_cv;   // 队列非空或关闭
+    std::vector<std::thread> workers;
+    size_t thread_count;
+    bool sequential;                    // inner只能顺序追加，唯一的工作线程按队列顺序写出
+
+    std::vector<uint8_t> take_buffer() {
+        std::lock_guard<std::mutex> lk(mtx);
+        std::vector<uint8_t> buf;
+        if (!spare.empty()) {
+            buf.swap(spare.back());
+            spare.pop_back();
+        }
+        buf.clear();
+        return buf;
+    }
+
+    // 放入队列后立即返回；队列长度由接收端的通告窗口限制，这里不等待
+    void submit(Block& block) {
+        std::unique_lock<std::mutex> lk(mtx);
+        queue.push_back(Block());
+        queue.back().raw_offset = block.raw_offset;
+        queue.back().raw_length = block.raw_length;
+        queue.back().data.swap(block.data);
+        lk.unlock();
+        queue_cv.notify_one();
+    }
+
+    // 功能: 解压(或复制)一个块的原始数据到dst，并计数
+    bool decode(const Block& block, uint8_t* dst) {
+        bool stored = block.data.size() == block.raw_length;
+        bool ok = true;
+        if (stored) {
+            memcpy(dst, block.data.data(), block.raw_length);
+        } else {
+            ok = lz4_decompress(block.data.data(), block.data.size(), dst, block.raw_length);
+        }
+        std::lock_guard<std::mutex> lk(mtx);
+        if (stored) {
+            stored_blocks++;
+        } else {
+            compressed_blocks++;
+        }
+        return ok;
+    }
+
+    // 工作线程: 取出块，解压到它在文件中的位置；view为空时只有这一个工作线程，直接写inner
+    void decompress_loop(std::shared_ptr<FileSink> view) {
+        FileSink* out = view ? view.get() : inner.get();
+        std::vector<uint8_t> scratch;
+        while (true) {
+            Block block;
+            {
+                std::unique_lock<std::mutex> lk(mtx);
+                queue_cv.wait(lk, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) break;       // 关闭且已处理完
+                block.raw_offset = queue.front().raw_offset;
+                block.raw_length = queue.front().raw_length;
+                block.data.swap(queue.front().data);
+                queue.pop_front();
+            }
+
+            // 块完整落在一个续传块内时直接解压到文件，否则经临时缓冲分段复制
+            bool ok;
+            uint64_t at = base_offset + chunks.to_range(block.raw_offset);
+            if (sequential) {
+                if (scratch.size() < block.raw_length) scratch.resize(block.raw_length);
+                ok = decode(block, scratch.data()) && out->append(scratch.data(), block.raw_length);
+            } else if (chunks.chunk_remaining(block.raw_offset) >= block.raw_length) {
+                uint8_t* dst = out->reserve(at, block.raw_length);
+                ok = dst && decode(block, dst);
+            } else {
+                if (scratch.size() < block.raw_length) scratch.resize(block.raw_length);
+                ok = decode(block, scratch.data());
+                for (uint64_t done = 0; ok && done < block.raw_length;) {
+                    uint64_t off = block.raw_offset + done;
+                    size_t n = static_cast<size_t>((std::min)(chunks.chunk_remaining(off), block.raw_length - done));
+                    uint8_t* dst = out->reserve(base_offset + chunks.to_range(off), n);
+                    if (!dst) {
+                        ok = false;
+                        break;
+                    }
+                    memcpy(dst, scratch.data() + done, n);
+                    done += n;
+                }
+            }
+
+            std::lock_guard<std::mutex> lk(mtx);
+            if (!ok) decode_failed = true;
+            spare.push_back(std::vector<uint8_t>());
+            spare.back().swap(block.data);
+        }
+        if (view) view->close();
+    }
+};
+
+inline std::unique_ptr<FileSink> FileSink::create(const std::string& path, bool size_known, uint64_t size,
+                                                  bool keep_existing) {
+    // 1. 已知大小: 创建文件并映射(CREATE_ALWAYS 截断同名的旧文件；续传时 OPEN_ALWAYS 保留，超出新大小的部分截掉)
+    if (size_known) {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                                  keep_existing ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return std::unique_ptr<FileSink>();
+        uint64_t preserved = 0;
+        LARGE_INTEGER old_size;
+        if (keep_existing && GetFileSizeEx(file, &old_size)) {
+            preserved = (std::min)(static_cast<uint64_t>(old_size.QuadPart), size);
+            LARGE_INTEGER end;
+            end.QuadPart = static_cast<LONGLONG>(size);
+            if (static_cast<uint64_t>(old_size.QuadPart) > size &&
+                (!SetFilePointerEx(file, end, NULL, FILE_BEGIN) || !SetEndOfFile(file))) {
+                CloseHandle(file);
+                return std::unique_ptr<FileSink>();
+            }
+        }
+        MappedFileSink* mapped = new MappedFileSink(std::make_shared<FileMapping>(file, size, preserved));
+        std::unique_ptr<FileSink> sink(mapped);
+        if (mapped->valid()) return sink;
+        sink.reset();       // 映射失败，关闭文件后改为顺序写出
+    }
+
+    // 2. 顺序写出
+    StreamFileSink* stream = new StreamFileSink(path);
+    std::unique_ptr<FileSink> sink(stream);
+    if (!stream->valid()) sink.reset();
+    return sink;
+}
+
+#endif // FILE_SINK_H
@@ -0,0 +1,555 @@
+// file_source.h
+// 文件说明: 发送端的文件数据源
+// 功能: 不再把整个文件读入内存，按需提供 [offset, offset+len) 的数据
+// 包含: 内存映射数据源(普通文件，按窗口映射视图)、流式预读数据源(管道等不可定位的输入)、分段数据源(并行传输)、
+//       按块拼接的数据源(续传时只发送接收端需要的块)、分块压缩的数据源(工作线程在发送窗口之前压缩)
+
+#ifndef FILE_SOURCE_H
+#define FILE_SOURCE_H
+
+#include <windows.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <iomanip>
+#include <algorithm>
+#include "mapped_views.h"
+#include "manifest.h"
+#include "compress.h"
+
+// ==================== 数据源常量 ====================
+const size_t STREAM_BUFFER_SIZE = 32 * 1024 * 1024;     // 流式数据源的缓冲区大小(字节)，发送窗口覆盖的数据量不超过其一半
+const DWORD STREAM_CHUNK_SIZE = 64 * 1024;              // 预读线程每次ReadFile的大小(字节)
+
+// ==================== 数据源读取结果 ====================
+enum SourceStatus {
+    SOURCE_OK,        // 返回了数据(只有到达文件末尾时才会少于请求的长度)
+    SOURCE_PENDING,   // 流式输入的数据尚未到达，稍后再试
+    SOURCE_EOF,       // offset 已到达文件末尾
+    SOURCE_ERROR      // 读取或映射失败
+};
+
+// ==================== 数据源接口 ====================
+class FileSource {
+public:
+    virtual ~FileSource() {}
+
+    // 是否预先知道文件大小(流式输入读到末尾之前不知道)
+    virtual bool size_known() const = 0;
+    virtual uint64_t size() const = 0;
+
+    // 数据源对应的原始数据字节数(压缩时为压缩前的)，用于统计有效吞吐率；传输结束时调用
+    virtual uint64_t raw_size() const { return size(); }
+
+    // 功能: 取得从offset开始最多len字节的数据指针，不阻塞
+    // 说明: 返回的指针在下一次调用view或release_before之前有效
+    virtual SourceStatus view(uint64_t offset, size_t len, const uint8_t*& ptr, size_t& got) = 0;
+
+    // 功能: offset之前的数据已被累计确认，不会再重传，流式数据源可以回收这部分缓冲区
+    virtual void release_before(uint64_t offset) { (void)offset; }
+
+    // 在途数据(从累计确认点起)最多能覆盖的字节数，发送窗口不能超过它
+    virtual uint64_t max_window_bytes() const { return UINT64_MAX; }
+
+    // 功能: 计算 [offset, offset+length) 中各块的哈希(续传清单，多线程)
+    // 返回: false-不支持(流式输入)或读取失败
+    virtual bool hash_chunks(uint64_t offset, uint64_t length, uint32_t chunk_size, std::vector<uint64_t>& hashes) {
+        (void)offset;
+        (void)length;
+        (void)chunk_size;
+        (void)hashes;
+        return false;
+    }
+
+    // 功能: 输出数据源自己的统计(如压缩率)，显示在发送端的传输统计中
+    virtual void describe(std::ostream& os) const { (void)os; }
+
+    // 最近一次返回SOURCE_ERROR的原因(含系统错误码)，没有失败时为空；发送端据此报告读取失败的原因
+    virtual std::string error() const { return std::string(); }
+
+    // 打开数据源: 普通磁盘文件使用内存映射，命名管道(\\.\pipe\...)等不可定位的输入使用流式预读
+    static std::unique_ptr<FileSource> open(const char* path);
+
+    // 打开文件中 [offset, offset+length) 的一段作为数据源(并行传输时每个流各打开一个)
+    // 只支持可以内存映射的磁盘文件，各流使用各自的文件句柄和视图，互不加锁
+    static std::unique_ptr<FileSource> open_range(const char* path, uint64_t offset, uint64_t length);
+};
+
+// ==================== 内存映射数据源 ====================
+// 按 MAP_VIEW_SIZE 分窗口只读映射文件(视图缓存见 mapped_views.h)
+class MappedFileSource : public FileSource {
+public:
+    MappedFileSource(HANDLE file, uint64_t file_size)
+        : file(file), mapping(NULL), file_size(file_size) {
+        if (file_size > 0) {
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        }
+        if (mapping) views.reset(new MappedViews(mapping, file_size, false));
+    }
+
+    ~MappedFileSource() override {
+        views.reset();
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+    }
+
+    // 空文件不需要映射；非空文件映射失败时由open回退到流式读取
+    bool valid() const { return file_size == 0 || mapping != NULL; }
+
+    bool size_known() const override { return true; }
+    uint64_t size() const override { return file_size; }
+
+    SourceStatus view(uint64_t offset, size_t len, const uint8_t*& ptr, size_t& got) override {
+        if (offset >= file_size) return SOURCE_EOF;
+        if (len > file_size - offset) len = static_cast<size_t>(file_size - offset);
+        const uint8_t* p = views->map(offset, len);
+        if (!p) {
+            last_error = "映射文件视图失败(偏移 " + std::to_string(offset) + ")，错误码 " + std::to_string(GetLastError());
+            return SOURCE_ERROR;
+        }
+        ptr = p;
+        got = len;
+        return SOURCE_OK;
+    }
+
+    bool hash_chunks(uint64_t offset, uint64_t length, uint32_t chunk_size, std::vector<uint64_t>& hashes) override {
+        return hash_mapped_chunks(mapping, file_size, offset, length, chunk_size,
+                                  resume_chunk_count(length, chunk_size), hashes);
+    }
+
+    std::string error() const override { return last_error; }
+
+private:
+    HANDLE file;
+    HANDLE mapping;
+    uint64_t file_size;
+    std::unique_ptr<MappedViews> views;
+    std::string last_error;
+};
+
+// ==================== 流式预读数据源 ====================
+// 后台线程持续ReadFile填充固定大小的缓冲区，发送线程只从缓冲区取数据，不被慢速输入阻塞
+// 缓冲区保存 [base, base + filled) 的数据: 已确认的前缀由release_before回收，内存占用恒定
+class StreamFileSource : public FileSource {
+public:
+    StreamFileSource(HANDLE input, bool owns_handle)
+        : input(input), owns_handle(owns_handle), buffer(STREAM_BUFFER_SIZE),
+          base(0), filled(0), eof(false), failed(false), stopping(false) {
+        reader = CreateThread(NULL, 0, &StreamFileSource::thread_proc, this, 0, NULL);
+        if (reader == NULL) {
+            failed = true;
+            last_error = "无法创建预读线程，错误码 " + std::to_string(GetLastError());
+        }
+    }
+
+    ~StreamFileSource() override {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        if (reader) {
+            CancelSynchronousIo(reader);    // 使阻塞在ReadFile中的预读线程返回
+            WaitForSingleObject(reader, INFINITE);
+            CloseHandle(reader);
+        }
+        if (owns_handle) CloseHandle(input);
+    }
+
+    bool size_known() const override {
+        std::lock_guard<std::mutex> lk(mtx);
+        return eof;
+    }
+
+    uint64_t size() const override {
+        std::lock_guard<std::mutex> lk(mtx);
+        return base + filled;
+    }
+
+    SourceStatus view(uint64_t offset, size_t len, const uint8_t*& ptr, size_t& got) override {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (offset < base) {                        // 已经回收的数据
+            last_error = "偏移 " + std::to_string(offset) + " 的数据已被回收";
+            return SOURCE_ERROR;
+        }
+        uint64_t end = base + filled;
+        if (offset >= end) {
+            if (eof) return SOURCE_EOF;
+            return failed ? SOURCE_ERROR : SOURCE_PENDING;
+        }
+        // 只有到达末尾时才返回不完整的数据包
+        if (offset + len > end) {
+            if (!eof) return failed ? SOURCE_ERROR : SOURCE_PENDING;
+            len = static_cast<size_t>(end - offset);
+        }
+        ptr = buffer.data() + (offset - base);
+        got = len;
+        return SOURCE_OK;
+    }
+
+    // 缓冲区前移前最多保留四分之一已确认的数据，窗口取一半留出余量
+    uint64_t max_window_bytes() const override { return STREAM_BUFFER_SIZE / 2; }
+
+    std::string error() const override {
+        std::lock_guard<std::mutex> lk(mtx);
+        return last_error;
+    }
+
+    void release_before(uint64_t offset) override {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            if (offset <= base) return;
+            size_t drop = static_cast<size_t>((std::min)(offset - base, static_cast<uint64_t>(filled)));
+            // 回收的前缀超过四分之一时才整体前移，摊销memmove的开销
+            if (drop < buffer.size() / 4) return;
+            memmove(buffer.data(), buffer.data() + drop, filled - drop);
+            filled -= drop;
+            base += drop;
+        }
+        cv.notify_all();
+    }
+
+private:
+    HANDLE input;
+    bool owns_handle;
+    std::vector<uint8_t> buffer;    // 固定大小，不会重新分配，view返回的指针只在前移时失效
+    uint64_t base;                  // buffer[0]对应的数据偏移
+    size_t filled;                  // 缓冲区中的有效字节数
+    bool eof;
+    bool failed;
+    bool stopping;
+    std::string last_error;         // failed或回收后读取的原因，受mtx保护
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    HANDLE reader;                  // 预读线程(使用Windows线程句柄，析构时可以取消阻塞的ReadFile)
+
+    static DWORD WINAPI thread_proc(LPVOID self) {
+        static_cast<StreamFileSource*>(self)->read_loop();
+        return 0;
+    }
+
+    // 预读线程: 缓冲区有空间时读取一块追加到末尾
+    void read_loop() {
+        std::vector<uint8_t> chunk(STREAM_CHUNK_SIZE);
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lk(mtx);
+                cv.wait(lk, [this] { return stopping || filled + STREAM_CHUNK_SIZE <= buffer.size(); });
+                if (stopping) return;
+            }
+            DWORD got = 0;
+            BOOL ok = ReadFile(input, chunk.data(), STREAM_CHUNK_SIZE, &got, NULL);
+            std::lock_guard<std::mutex> lk(mtx);
+            if (stopping) return;
+            if (!ok && GetLastError() != ERROR_BROKEN_PIPE) {
+                failed = true;
+                last_error = "ReadFile失败(偏移 " + std::to_string(base + filled) + ")，错误码 " +
+                             std::to_string(GetLastError());
+                return;
+            }
+            if (!ok || got == 0) {
+                // 管道写端关闭时ReadFile返回ERROR_BROKEN_PIPE，同样视为输入结束
+                eof = true;
+                return;
+            }
+            memcpy(buffer.data() + filled, chunk.data(), got);
+            filled += got;
+        }
+    }
+};
+
+// ==================== 分段数据源 ====================
+// 把另一个数据源中的一段当作完整的文件，偏移从0开始
+class RangeFileSource : public FileSource {
+public:
+    RangeFileSource(std::unique_ptr<FileSource> inner, uint64_t offset, uint64_t length)
+        : inner(std::move(inner)), offset(offset), length(length) {}
+
+    bool size_known() const override { return true; }
+    uint64_t size() const override { return length; }
+
+    SourceStatus view(uint64_t off, size_t len, const uint8_t*& ptr, size_t& got) override {
+        if (off >= length) return SOURCE_EOF;
+        if (len > length - off) len = static_cast<size_t>(length - off);
+        return inner->view(offset + off, len, ptr, got);
+    }
+
+    void release_before(uint64_t off) override { inner->release_before(offset + off); }
+    uint64_t max_window_bytes() const override { return inner->max_window_bytes(); }
+    std::string error() const override { return inner->error(); }
+
+    bool hash_chunks(uint64_t off, uint64_t len, uint32_t chunk_size, std::vector<uint64_t>& hashes) override {
+        if (off > length || len > length - off) return false;
+        return inner->hash_chunks(offset + off, len, chunk_size, hashes);
+    }
+
+private:
+    std::unique_ptr<FileSource> inner;
+    uint64_t offset;
+    uint64_t length;
+};
+
+// ==================== 按块拼接的数据源 ====================
+// 续传时把接收端需要的块依次拼接成一个文件，偏移按ChunkMap换算；块大小是负载大小的整数倍，一个包不会跨块
+// 只用于大小已知的数据源(内存映射)，不引用外部数据源的所有权
+class ChunkFileSource : public FileSource {
+public:
+    ChunkFileSource(FileSource& inner, const ChunkMap& chunks) : inner(inner), chunks(chunks) {}
+
+    bool size_known() const override { return true; }
+    uint64_t size() const override { return chunks.transfer_length(inner.size()); }
+
+    SourceStatus view(uint64_t off, size_t len, const uint8_t*& ptr, size_t& got) override {
+        if (off >= size()) return SOURCE_EOF;
+        len = static_cast<size_t>((std::min)(static_cast<uint64_t>(len), chunks.chunk_remaining(off)));
+        return inner.view(chunks.to_range(off), len, ptr, got);
+    }
+
+    uint64_t max_window_bytes() const override { return inner.max_window_bytes(); }
+    std::string error() const override { return inner.error(); }
+
+private:
+    FileSource& inner;
+    const ChunkMap& chunks;
+};
+
+// ==================== 分块压缩的数据源 ====================
+// 把大小已知的数据源按 COMPRESS_BLOCK_SIZE 分块，工作线程各自领取块号、读出并压缩，按块号顺序把
+// BlockFrame + 数据追加到固定大小的缓冲区；发送线程像流式数据源一样从缓冲区取数据，压缩跟不上时
+// 返回SOURCE_PENDING，不会在发送循环中等待压缩。压缩无效的块原样存储，连续多块无效(如jpg)后
+// 每块先试压开头的 COMPRESS_PROBE_BYTES，CPU开销降到约1/16
+// 不引用外部数据源的所有权；读取外部数据源(视图缓存不是线程安全的)时加锁，压缩在锁外进行
+class CompressedFileSource : public FileSource {
+public:
+    CompressedFileSource(FileSource& inner, unsigned threads)
+        : inner(inner), raw_length(inner.size()), block_count(0), buffer(STREAM_BUFFER_SIZE),
+          base(0), filled(0), appended(0), failed(false), stopping(false), next_block(0),
+          incompressible_run(0), compressed_blocks(0), stored_blocks(0) {
+        block_count = (raw_length + COMPRESS_BLOCK_SIZE - 1) / COMPRESS_BLOCK_SIZE;
+        threads = (std::max)(1u, (std::min)(threads, COMPRESS_MAX_THREADS));
+        if (block_count < threads) threads = static_cast<unsigned>((std::max)(block_count, static_cast<uint64_t>(1)));
+        for (unsigned i = 0; i < threads && block_count > 0; ++i) {
+            workers.push_back(std::thread(&CompressedFileSource::compress_loop, this));
+        }
+    }
+
+    ~CompressedFileSource() override {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    // 所有块都追加到缓冲区后才知道压缩后的大小
+    bool size_known() const override {
+        std::lock_guard<std::mutex> lk(mtx);
+        return appended == block_count;
+    }
+
+    uint64_t size() const override {
+        std::lock_guard<std::mutex> lk(mtx);
+        return base + filled;
+    }
+
+    uint64_t raw_size() const override { return raw_length; }
+
+    SourceStatus view(uint64_t offset, size_t len, const uint8_t*& ptr, size_t& got) override {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (offset < base) {                        // 已经回收的数据
+            last_error = "偏移 " + std::to_string(offset) + " 的数据已被回收";
+            return SOURCE_ERROR;
+        }
+        bool done = appended == block_count;
+        uint64_t end = base + filled;
+        if (offset >= end) {
+            if (done) return SOURCE_EOF;
+            return failed ? SOURCE_ERROR : SOURCE_PENDING;
+        }
+        // 只有全部块都已压缩时才返回不完整的数据包
+        if (offset + len > end) {
+            if (!done) return failed ? SOURCE_ERROR : SOURCE_PENDING;
+            len = static_cast<size_t>(end - offset);
+        }
+        ptr = buffer.data() + (offset - base);
+        got = len;
+        return SOURCE_OK;
+    }
+
+    uint64_t max_window_bytes() const override { return STREAM_BUFFER_SIZE / 2; }
+
+    void release_before(uint64_t offset) override {
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            if (offset <= base) return;
+            size_t drop = static_cast<size_t>((std::min)(offset - base, static_cast<uint64_t>(filled)));
+            if (drop < buffer.size() / 4) return;
+            memmove(buffer.data(), buffer.data() + drop, filled - drop);
+            filled -= drop;
+            base += drop;
+        }
+        cv.notify_all();
+    }
+
+    std::string error() const override {
+        std::lock_guard<std::mutex> lk(mtx);
+        return last_error;
+    }
+
+    void describe(std::ostream& os) const override {
+        std::lock_guard<std::mutex> lk(mtx);
+        uint64_t wire = base + filled;
+        os << "  分块压缩:    " << raw_length << " -> " << wire << " 字节 (" << std::fixed << std::setprecision(1)
+           << (raw_length ? wire * 100.0 / raw_length : 100.0) << "%), 压缩 " << compressed_blocks
+           << " 块, 原样 " << stored_blocks << " 块, " << workers.size() << " 个线程" << std::endl;
+    }
+
+private:
+    FileSource& inner;
+    uint64_t raw_length;            // 压缩前的字节数
+    uint64_t block_count;
+    std::vector<uint8_t> buffer;    // 压缩后的数据，固定大小，view返回的指针只在前移时失效
+    uint64_t base;                  // buffer[0]对应的压缩后偏移
+    size_t filled;
+    uint64_t appended;              // 已追加到缓冲区的块数(块按顺序追加)
+    bool failed;
+    bool stopping;
+    std::string last_error;         // 压缩线程失败或回收后读取的原因，受mtx保护
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    std::mutex read_mtx;            // 串行读取外部数据源
+    std::atomic<uint64_t> next_block;               // 下一个待领取的块号
+    std::atomic<uint32_t> incompressible_run;       // 连续压缩无效的块数
+    uint64_t compressed_blocks;
+    uint64_t stored_blocks;
+    std::vector<std::thread> workers;
+
+    // 功能: 把外部数据源中 [offset, offset+len) 复制到dst(按块拼接的数据源一次可能只返回一部分)
+    // 参数: why-失败时的原因
+    bool read_raw(uint64_t offset, size_t len, uint8_t* dst, std::string& why) {
+        std::lock_guard<std::mutex> lk(read_mtx);
+        while (len > 0) {
+            const uint8_t* ptr = NULL;
+            size_t got = 0;
+            SourceStatus st = inner.view(offset, len, ptr, got);
+            if (st != SOURCE_OK || got == 0) {
+                why = st == SOURCE_ERROR ? inner.error()
+                                         : "数据源在偏移 " + std::to_string(offset) + " 处提前结束";
+                return false;
+            }
+            memcpy(dst, ptr, got);
+            dst += got;
+            offset += got;
+            len -= got;
+        }
+        return true;
+    }
+
+    // 工作线程: 领取块号 -> 读出 -> 压缩(或原样存储) -> 轮到该块且缓冲区有空间时追加
+    void compress_loop() {
+        Lz4Encoder encoder;
+        std::vector<uint8_t> raw(COMPRESS_BLOCK_SIZE);
+        std::vector<uint8_t> frame(sizeof(BlockFrame) + lz4_bound(COMPRESS_BLOCK_SIZE));
+        while (true) {
+            uint64_t index = next_block++;
+            if (index >= block_count) return;
+            uint64_t offset = index * COMPRESS_BLOCK_SIZE;
+            size_t len = static_cast<size_t>((std::min)(static_cast<uint64_t>(COMPRESS_BLOCK_SIZE), raw_length - offset));
+
+            // 1. 读出原始数据并压缩；连续多块无效后先试压开头一段，节省不到1/16时整块原样存储
+            std::string why;
+            bool ok = read_raw(offset, len, raw.data(), why);
+            size_t packed = 0;
+            bool attempt = ok;
+            if (ok && incompressible_run >= COMPRESS_GIVE_UP && len > COMPRESS_PROBE_BYTES) {
+                size_t sample = COMPRESS_PROBE_BYTES;
+                attempt = encoder.compress(raw.data(), sample, frame.data() + sizeof(BlockFrame), sample - sample / 16) > 0;
+            }
+            if (attempt) {
+                packed = encoder.compress(raw.data(), len, frame.data() + sizeof(BlockFrame), len - len / 16);
+                if (packed > 0) {
+                    incompressible_run = 0;
+                } else {
+                    incompressible_run++;
+                }
+            }
+            BlockFrame header;
+            header.raw_length = static_cast<uint32_t>(len);
+            header.stored_length = static_cast<uint32_t>(packed > 0 ? packed : len);
+            if (packed == 0) memcpy(frame.data() + sizeof(BlockFrame), raw.data(), len);
+            memcpy(frame.data(), &header, sizeof(header));
+            size_t frame_len = sizeof(BlockFrame) + header.stored_length;
+
+            // 2. 按块号顺序追加(块号较大的线程等待前面的块)
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait(lk, [&] { return stopping || (appended == index && filled + frame_len <= buffer.size()); });
+            if (stopping) return;
+            if (!ok) {
+                failed = true;
+                last_error = "压缩线程读取第 " + std::to_string(index) + " 块失败: " + why;
+                stopping = true;        // 之后的块不再追加，发送端读到SOURCE_ERROR时结束
+                cv.notify_all();
+                return;
+            }
+            memcpy(buffer.data() + filled, frame.data(), frame_len);
+            filled += frame_len;
+            appended++;
+            if (packed > 0) {
+                compressed_blocks++;
+            } else {
+                stored_blocks++;
+            }
+            lk.unlock();
+            cv.notify_all();
+        }
+    }
+};
+
+inline std::unique_ptr<FileSource> FileSource::open(const char* path) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return std::unique_ptr<FileSource>();
+
+    // 1. 磁盘文件: 内存映射
+    LARGE_INTEGER size;
+    if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &size)) {
+        MappedFileSource* mapped = new MappedFileSource(file, static_cast<uint64_t>(size.QuadPart));
+        if (mapped->valid()) return std::unique_ptr<FileSource>(mapped);
+        // 映射失败: 释放映射对象但保留文件句柄，改为流式读取
+        HANDLE dup = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                 FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        delete mapped;      // 同时关闭了原文件句柄
+        if (dup == INVALID_HANDLE_VALUE) return std::unique_ptr<FileSource>();
+        file = dup;
+    }
+
+    // 2. 命名管道等不可定位的输入: 流式预读
+    return std::unique_ptr<FileSource>(new StreamFileSource(file, true));
+}
+
+inline std::unique_ptr<FileSource> FileSource::open_range(const char* path, uint64_t offset, uint64_t length) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return std::unique_ptr<FileSource>();
+
+    LARGE_INTEGER size;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) ||
+        offset > static_cast<uint64_t>(size.QuadPart) || length > static_cast<uint64_t>(size.QuadPart) - offset) {
+        CloseHandle(file);
+        return std::unique_ptr<FileSource>();
+    }
+    MappedFileSource* mapped = new MappedFileSource(file, static_cast<uint64_t>(size.QuadPart));
+    std::unique_ptr<FileSource> whole(mapped);
+    if (!mapped->valid()) return std::unique_ptr<FileSource>();
+    return std::unique_ptr<FileSource>(new RangeFileSource(std::move(whole), offset, length));
+}
+
+#endif // FILE_SOURCE_H
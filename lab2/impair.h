@@ -0,0 +1,323 @@
+// impair.h
+// 文件说明: 进程内的网络损伤模拟代理(代替Router.exe)
+// 功能: 在发送端和接收端之间转发数据报，按配置加入时延、抖动、丢包、乱序、重复和带宽限制
+// 结构: 代理在一个端口上接收，来自上游(接收端)的数据报转发给最近一次发来数据的客户端(发送端)，
+//       其余的转发给上游；每个方向各有一条模拟链路，数据报按 带宽排队 -> 传播时延 的顺序到达对端
+// 说明: 配置写成 "delay=20,jitter=2,loss=0.01" 的形式，也可以使用预设名(见 IMPAIRMENT_PRESETS)；
+//       两个方向使用相同的配置，delay 为单向时延(往返时间为它的两倍)；随机数种子固定，同一配置的结果可重复；
+//       一个代理只记住一个客户端，并行传输时每个流使用一个代理
+
+#ifndef IMPAIR_H
+#define IMPAIR_H
+
+#include "protocol.h"
+#include "datagram_io.h"
+#include "options.h"
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ==================== 损伤配置 ====================
+struct ImpairmentProfile {
+    std::string name;           // 配置名(结果中显示)
+    double delay_ms;            // 单向传播时延
+    double jitter_ms;           // 时延的随机抖动(均匀分布在 ±jitter_ms 内，抖动大于包间隔时会造成乱序)
+    double loss;                // 丢包率
+    double reorder;             // 乱序率: 该比例的数据报额外延迟 reorder_ms，被后面的数据报超过
+    double reorder_ms;          // 乱序数据报的额外时延
+    double duplicate;           // 重复率: 该比例的数据报多送达一份
+    double rate_mbps;           // 每个方向的带宽(Mbps)，0表示不限
+    double queue_ms;            // 瓶颈队列的长度(按带宽换算成排队时间)，队列满时丢弃(尾部丢弃)
+
+    ImpairmentProfile() : delay_ms(0), jitter_ms(0), loss(0), reorder(0), reorder_ms(10), duplicate(0),
+                          rate_mbps(0), queue_ms(50) {}
+
+    // 功能: 解析预设名或 "键=值,键=值" 形式的配置；以预设名开头时后面的键值覆盖预设
+    // 返回: false-未知的预设名或键，或值不是非负数(丢包、乱序、重复率还不能超过1)
+    bool parse(const std::string& text);
+
+    // 功能: 写成可以再次解析的 "键=值" 形式
+    std::string describe() const;
+};
+
+// 预设: 名称和对应的配置
+struct ImpairmentPreset {
+    const char* name;
+    const char* spec;
+};
+
+const ImpairmentPreset IMPAIRMENT_PRESETS[] = {
+    { "lan",     "delay=0" },                                           // 直连，不加损伤
+    { "wan",     "delay=20,jitter=1,rate=100,queue=50" },               // 100Mbps、往返40ms
+    { "lossy",   "delay=10,loss=0.02" },                                // 2%随机丢包(如无线链路)
+    { "reorder", "delay=5,jitter=2,reorder=0.05,reorder_ms=8" },        // 多路径造成的乱序
+    { "dup",     "delay=5,duplicate=0.02" },                            // 重复送达
+    { "bottleneck", "delay=25,rate=20,queue=100" },                     // 低速长队列(缓冲膨胀)
+    { "hostile", "delay=40,jitter=5,loss=0.03,reorder=0.02,duplicate=0.01,rate=50,queue=60" },
+};
+const size_t IMPAIRMENT_PRESET_COUNT = sizeof(IMPAIRMENT_PRESETS) / sizeof(IMPAIRMENT_PRESETS[0]);
+
+inline bool ImpairmentProfile::parse(const std::string& text) {
+    std::vector<std::string> items = CommandLine::split_list(text);
+    *this = ImpairmentProfile();
+    name = text;
+    for (size_t i = 0; i < items.size(); ++i) {
+        size_t eq = items[i].find('=');
+        if (eq == std::string::npos) {
+            // 预设名只能出现在开头
+            bool found = false;
+            for (size_t k = 0; i == 0 && k < IMPAIRMENT_PRESET_COUNT; ++k) {
+                if (items[i] == IMPAIRMENT_PRESETS[k].name) {
+                    parse(IMPAIRMENT_PRESETS[k].spec);
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) return false;
+            continue;
+        }
+        std::string key = items[i].substr(0, eq);
+        // 整个值都必须是数字: atof会把 loss=abc 当成0，测量就在不加损伤的链路上悄悄进行
+        const char* text_value = items[i].c_str() + eq + 1;
+        char* end = NULL;
+        double value = strtod(text_value, &end);
+        if (end == text_value || *end != '\0' || !(value >= 0) || value > 1e9) return false;
+        bool probability = key == "loss" || key == "reorder" || key == "duplicate" || key == "dup";
+        if (probability && value > 1) return false;
+        if (key == "delay") delay_ms = value;
+        else if (key == "jitter") jitter_ms = value;
+        else if (key == "loss") loss = value;
+        else if (key == "reorder") reorder = value;
+        else if (key == "reorder_ms") reorder_ms = value;
+        else if (key == "duplicate" || key == "dup") duplicate = value;
+        else if (key == "rate") rate_mbps = value;
+        else if (key == "queue") queue_ms = value;
+        else return false;
+    }
+    name = text;
+    return true;
+}
+
+inline std::string ImpairmentProfile::describe() const {
+    std::ostringstream out;
+    out << "delay=" << delay_ms << ",jitter=" << jitter_ms << ",loss=" << loss << ",reorder=" << reorder
+        << ",reorder_ms=" << reorder_ms << ",duplicate=" << duplicate << ",rate=" << rate_mbps << ",queue=" << queue_ms;
+    return out.str();
+}
+
+// ==================== 代理统计 ====================
+struct ImpairmentStats {
+    uint64_t received;          // 代理收到的数据报数
+    uint64_t delivered;         // 转发出去的数据报数(含重复的副本)
+    uint64_t lost;              // 按丢包率丢弃的数据报数
+    uint64_t queue_drops;       // 瓶颈队列满时丢弃的数据报数
+    uint64_t reordered;         // 额外延迟造成乱序的数据报数
+    uint64_t duplicated;        // 多送达一份的数据报数
+
+    ImpairmentStats() : received(0), delivered(0), lost(0), queue_drops(0), reordered(0), duplicated(0) {}
+
+    void add(const ImpairmentStats& other) {
+        received += other.received;
+        delivered += other.delivered;
+        lost += other.lost;
+        queue_drops += other.queue_drops;
+        reordered += other.reordered;
+        duplicated += other.duplicated;
+    }
+};
+
+// ==================== 损伤代理 ====================
+// 功能: 在自己的线程中运行，start后转发到stop为止
+class ImpairmentProxy {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // 参数: listen-代理绑定的地址(发送端把它当作接收端), upstream-真正的接收端, seed-随机数种子
+    ImpairmentProxy(const sockaddr_in& listen, const sockaddr_in& upstream, const ImpairmentProfile& profile,
+                    uint32_t seed = 1)
+        : listen_addr(listen), upstream_addr(upstream), profile(profile), random(seed), has_client(false),
+          stopping(false), next_order(0) {
+        memset(&client_addr, 0, sizeof(client_addr));
+    }
+
+    ~ImpairmentProxy() { stop(); }
+
+    // 功能: 创建套接字并启动转发线程
+    // 返回: false-创建或绑定失败
+    bool start() {
+        if (!udp.create() || !udp.bind(listen_addr)) return false;
+        stopping = false;
+        worker = std::thread(&ImpairmentProxy::run, this);
+        return true;
+    }
+
+    // 功能: 停止转发线程，队列中尚未送达的数据报丢弃
+    void stop() {
+        stopping = true;
+        if (worker.joinable()) worker.join();
+        udp.close();
+    }
+
+    // 停止后读取
+    const ImpairmentStats& impairment_stats() const { return stats; }
+
+private:
+    // 模拟链路上等待送达的数据报
+    struct InFlight {
+        Clock::time_point due;      // 送达时间
+        uint64_t order;             // 时间相同时按进入的顺序送达
+        uint32_t buffer;            // buffers中的下标
+        uint32_t length;
+        bool to_upstream;           // 方向: 发往接收端，或发回发送端
+
+        bool operator>(const InFlight& other) const {
+            return due != other.due ? due > other.due : order > other.order;
+        }
+    };
+
+    // 一个方向的瓶颈链路: 数据报按带宽依次发出，free_at之前链路被占用
+    struct Link {
+        Clock::time_point free_at;
+    };
+
+    sockaddr_in listen_addr;
+    sockaddr_in upstream_addr;
+    sockaddr_in client_addr;
+    ImpairmentProfile profile;
+    std::mt19937 random;
+    bool has_client;
+    DatagramSocket udp;
+    std::thread worker;
+    std::atomic<bool> stopping;
+    ImpairmentStats stats;
+
+    std::priority_queue<InFlight, std::vector<InFlight>, std::greater<InFlight> > in_flight;
+    std::vector<std::vector<uint8_t> > buffers;     // 数据报副本(重复使用)
+    std::vector<uint32_t> free_buffers;
+    uint64_t next_order;
+    Link links[2];                                  // [0]-发往接收端, [1]-发回发送端
+
+    double uniform() { return std::uniform_real_distribution<double>(0.0, 1.0)(random); }
+
+    static Clock::duration from_ms(double ms) {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(ms));
+    }
+
+    // ==================== 转发循环 ====================
+    void run() {
+        next_order = 0;
+        links[0].free_at = links[1].free_at = Clock::now();
+        while (!stopping) {
+            // 1. 等到最早一个数据报的送达时间，最多等10ms以便检查是否停止
+            int64_t timeout_us = 10000;
+            if (!in_flight.empty()) {
+                int64_t until = std::chrono::duration_cast<std::chrono::microseconds>(
+                    in_flight.top().due - Clock::now()).count();
+                timeout_us = (std::max)(static_cast<int64_t>(0), (std::min)(timeout_us, until));
+            }
+            if (timeout_us > 0) udp.wait(timeout_us);
+
+            // 2. 收下所有到达的数据报，送上各自方向的模拟链路
+            const uint8_t* data = NULL;
+            size_t length = 0;
+            sockaddr_in from;
+            while (udp.receive(data, length, from)) {
+                bool to_upstream = !(from.sin_addr.s_addr == upstream_addr.sin_addr.s_addr &&
+                                     from.sin_port == upstream_addr.sin_port);
+                if (to_upstream) {
+                    client_addr = from;
+                    has_client = true;
+                } else if (!has_client) {
+                    continue;       // 还不知道发回给谁
+                }
+                stats.received++;
+                impair(data, length, to_upstream);
+            }
+
+            // 3. 送达到期的数据报
+            Clock::time_point now = Clock::now();
+            while (!in_flight.empty() && in_flight.top().due <= now) {
+                InFlight packet = in_flight.top();
+                in_flight.pop();
+                size_t capacity = 0;
+                uint8_t* out = udp.reserve(capacity);
+                size_t n = (std::min)(static_cast<size_t>(packet.length), capacity);
+                memcpy(out, buffers[packet.buffer].data(), n);
+                udp.commit(n, packet.to_upstream ? upstream_addr : client_addr);
+                free_buffers.push_back(packet.buffer);
+                stats.delivered++;
+            }
+            udp.flush();
+        }
+    }
+
+    // ==================== 损伤 ====================
+    // 功能: 按配置决定数据报是否丢弃、何时送达、是否重复
+    void impair(const uint8_t* data, size_t length, bool to_upstream) {
+        // 1. 随机丢包
+        if (profile.loss > 0 && uniform() < profile.loss) {
+            stats.lost++;
+            return;
+        }
+
+        // 2. 带宽: 数据报在链路空闲后才开始发出，排队时间超过队列长度时尾部丢弃
+        Clock::time_point now = Clock::now();
+        Link& link = links[to_upstream ? 0 : 1];
+        Clock::time_point leave = now;
+        if (profile.rate_mbps > 0) {
+            Clock::time_point start = (std::max)(now, link.free_at);
+            if (start - now > from_ms(profile.queue_ms)) {
+                stats.queue_drops++;
+                return;
+            }
+            double serialize_ms = length * 8.0 / (profile.rate_mbps * 1000.0);
+            link.free_at = start + from_ms(serialize_ms);
+            leave = link.free_at;
+        }
+
+        // 3. 传播时延、抖动和乱序
+        double delay = profile.delay_ms;
+        if (profile.jitter_ms > 0) delay += (uniform() * 2.0 - 1.0) * profile.jitter_ms;
+        if (profile.reorder > 0 && uniform() < profile.reorder) {
+            delay += profile.reorder_ms;
+            stats.reordered++;
+        }
+        Clock::time_point due = leave + from_ms((std::max)(0.0, delay));
+        schedule(data, length, to_upstream, due);
+
+        // 4. 重复: 副本紧跟原数据报送达
+        if (profile.duplicate > 0 && uniform() < profile.duplicate) {
+            schedule(data, length, to_upstream, due);
+            stats.duplicated++;
+        }
+    }
+
+    void schedule(const uint8_t* data, size_t length, bool to_upstream, Clock::time_point due) {
+        uint32_t index;
+        if (free_buffers.empty()) {
+            index = static_cast<uint32_t>(buffers.size());
+            buffers.push_back(std::vector<uint8_t>(IO_SLOT_SIZE));
+        } else {
+            index = free_buffers.back();
+            free_buffers.pop_back();
+        }
+        memcpy(buffers[index].data(), data, (std::min)(length, IO_SLOT_SIZE));
+        InFlight packet;
+        packet.due = due;
+        packet.order = next_order++;
+        packet.buffer = index;
+        packet.length = static_cast<uint32_t>((std::min)(length, IO_SLOT_SIZE));
+        packet.to_upstream = to_upstream;
+        in_flight.push(packet);
+    }
+
+    ImpairmentProxy(const ImpairmentProxy&);
+    ImpairmentProxy& operator=(const ImpairmentProxy&);
+};
+
+#endif // IMPAIR_H
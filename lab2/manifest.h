@@ -0,0 +1,223 @@
+// manifest.h
+// 文件说明: 续传清单(断点续传和增量传输)
+// 功能: 把本流负责的范围按固定大小分块，发送端在文件名包中附带各块的64位哈希(XXH64)，
+//       接收端对已有的输出文件计算同样的哈希并回复需要传输的块，之后只发送缺少或内容不同的块
+// 说明: 要传输的块依次拼接成一段连续的数据，序列号按这段数据编号(ChunkMap负责换算到文件偏移)，
+//       发送窗口、SACK、FEC都无需改动；哈希按块分给多个线程计算，各线程使用各自的映射视图
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <windows.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "mapped_views.h"
+
+// ==================== 续传常量 ====================
+const uint32_t RESUME_MIN_CHUNK = 1024 * 1024;      // 块的最小大小(字节)，实际大小为负载大小的整数倍
+const uint64_t RESUME_MAX_CHUNK = MAP_VIEW_SIZE;    // 块的最大大小，文件过大、一个文件名包放不下清单时不续传
+const uint32_t RESUME_MAX_THREADS = 16;             // 计算哈希的最大线程数
+
+// ==================== XXH64 ====================
+// 与 xxHash 的 XXH64 算法一致(种子为0)，每核每秒数GB，远快于网络
+const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ull;
+const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ull;
+const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t xxh_rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t xxh_read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint32_t xxh_read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = xxh_rotl(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+inline uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+inline uint64_t xxh64(const uint8_t* p, size_t len, uint64_t seed = 0) {
+    const uint8_t* end = p + len;
+    uint64_t h;
+    // 1. 每32字节四路并行累加
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = xxh_round(v1, xxh_read64(p));
+            v2 = xxh_round(v2, xxh_read64(p + 8));
+            v3 = xxh_round(v3, xxh_read64(p + 16));
+            v4 = xxh_round(v4, xxh_read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) + xxh_rotl(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += static_cast<uint64_t>(len);
+
+    // 2. 剩余不足32字节的部分
+    while (p + 8 <= end) {
+        h ^= xxh_round(0, xxh_read64(p));
+        h = xxh_rotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(xxh_read32(p)) * XXH_PRIME64_1;
+        h = xxh_rotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p++) * XXH_PRIME64_5;
+        h = xxh_rotl(h, 11) * XXH_PRIME64_1;
+    }
+
+    // 3. 雪崩
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+// ==================== 并行计算块哈希 ====================
+// 功能: 计算文件映射中 [offset, offset+length) 的前count块(块大小chunk_size，最后一块可以不足)的哈希
+// 参数: mapping-文件映射对象, file_size-映射的文件大小
+// 返回: false-映射视图失败
+// 说明: 块按连续的区段分给各线程，每个线程使用自己的视图缓存(视图缓存不是线程安全的)
+inline bool hash_mapped_chunks(HANDLE mapping, uint64_t file_size, uint64_t offset, uint64_t length,
+                               uint32_t chunk_size, size_t count, std::vector<uint64_t>& hashes) {
+    hashes.assign(count, 0);
+    if (count == 0) return true;
+    if (!mapping || chunk_size == 0 || offset > file_size || length > file_size - offset) return false;
+
+    unsigned cores = std::thread::hardware_concurrency();
+    size_t workers = (std::min)(count, static_cast<size_t>((std::min)(cores ? cores : 1u, RESUME_MAX_THREADS)));
+    std::atomic<bool> failed(false);
+    auto work = [&](size_t first, size_t last) {
+        MappedViews views(mapping, file_size, false);
+        for (size_t i = first; i < last && !failed; ++i) {
+            uint64_t start = static_cast<uint64_t>(i) * chunk_size;
+            size_t len = static_cast<size_t>((std::min)(static_cast<uint64_t>(chunk_size), length - start));
+            const uint8_t* p = views.map(offset + start, len);
+            if (!p) {
+                failed = true;
+                return;
+            }
+            hashes[i] = xxh64(p, len);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    size_t per = (count + workers - 1) / workers;
+    for (size_t first = per; first < count; first += per) {
+        threads.push_back(std::thread(work, first, (std::min)(count, first + per)));
+    }
+    work(0, (std::min)(count, per));     // 第一段在当前线程计算
+    for (auto& t : threads) t.join();
+    return !failed;
+}
+
+// ==================== 块大小 ====================
+// 功能: 选择块大小: 至少RESUME_MIN_CHUNK，且块数不超过max_chunks(文件名包的剩余空间)，向上取整为负载大小的整数倍
+// 返回: 0-范围为空或块会超过RESUME_MAX_CHUNK，不使用续传
+inline uint32_t resume_chunk_size(uint64_t length, uint16_t payload_size, size_t max_chunks) {
+    if (length == 0 || max_chunks == 0 || payload_size == 0) return 0;
+    uint64_t chunk = (std::max)(static_cast<uint64_t>(RESUME_MIN_CHUNK), (length + max_chunks - 1) / max_chunks);
+    chunk = (chunk + payload_size - 1) / payload_size * payload_size;
+    return chunk > RESUME_MAX_CHUNK ? 0 : static_cast<uint32_t>(chunk);
+}
+
+inline size_t resume_chunk_count(uint64_t length, uint32_t chunk_size) {
+    return chunk_size ? static_cast<size_t>((length + chunk_size - 1) / chunk_size) : 0;
+}
+
+// ==================== 需要传输的块 ====================
+// 接收端回复的位图: 第i位(第i/8字节的第i%8位)为1表示第i块需要传输；位图不足的部分视为需要传输
+// 要传输的块按顺序拼接，除了范围末尾的块之外都是完整的块，所以拼接后的偏移可以直接按块大小换算
+class ChunkMap {
+public:
+    ChunkMap() : chunk_size(0), chunk_total(0), total_length(0), mapped_length(0) {}
+
+    // 功能: 按位图确定要传输的块
+    // 参数: length-本流负责的字节数, chunk-块大小, bitmap/bitmap_len-接收端回复的位图
+    void assign(uint64_t length, uint32_t chunk, const uint8_t* bitmap, size_t bitmap_len) {
+        chunk_size = chunk;
+        chunk_total = resume_chunk_count(length, chunk);
+        total_length = length;
+        mapped_length = 0;
+        needed.clear();
+        for (size_t i = 0; i < chunk_total; ++i) {
+            bool want = i / 8 >= bitmap_len || (bitmap[i / 8] >> (i % 8) & 1) != 0;
+            if (!want) continue;
+            needed.push_back(static_cast<uint32_t>(i));
+            mapped_length += (std::min)(static_cast<uint64_t>(chunk), length - static_cast<uint64_t>(i) * chunk);
+        }
+    }
+
+    void clear() {
+        chunk_size = 0;
+        chunk_total = 0;
+        needed.clear();
+    }
+
+    // 是否只传输部分块(否则偏移不需要换算)
+    bool active() const { return chunk_size > 0; }
+
+    // 功能: 要传输的字节数；未启用时为本流负责的字节数range_length
+    uint64_t transfer_length(uint64_t range_length) const { return active() ? mapped_length : range_length; }
+
+    // 功能: 把拼接后的偏移换算成本流范围内的偏移(调用方保证offset小于要传输的字节数)
+    uint64_t to_range(uint64_t offset) const {
+        if (!active()) return offset;
+        return static_cast<uint64_t>(needed[static_cast<size_t>(offset / chunk_size)]) * chunk_size + offset % chunk_size;
+    }
+
+    // 功能: 从拼接后的offset起到所在块结束还有多少字节(一次取数据不能跨块)
+    uint64_t chunk_remaining(uint64_t offset) const {
+        if (!active()) return UINT64_MAX;
+        uint64_t range_off = to_range(offset);
+        uint64_t chunk_end = (std::min)(total_length, (range_off / chunk_size + 1) * chunk_size);
+        return chunk_end - range_off;
+    }
+
+    uint32_t chunk() const { return chunk_size; }
+    size_t total_chunks() const { return chunk_total; }
+    size_t needed_chunks() const { return needed.size(); }
+
+private:
+    uint32_t chunk_size;
+    size_t chunk_total;
+    uint64_t total_length;          // 本流负责的字节数
+    uint64_t mapped_length;         // 要传输的块的总字节数
+    std::vector<uint32_t> needed;   // 要传输的块号(递增)
+};
+
+#endif // MANIFEST_H
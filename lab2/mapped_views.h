@@ -0,0 +1,91 @@
+// mapped_views.h
+// 文件说明: 文件映射的视图缓存(发送端数据源和接收端输出文件共用)
+// 功能: 按 MAP_VIEW_SIZE 分窗口映射文件，同时保留两个视图；
+//       在途窗口跨越视图边界时，访问两侧的数据不会来回重新映射
+
+#ifndef MAPPED_VIEWS_H
+#define MAPPED_VIEWS_H
+
+#include <windows.h>
+#include <cstdint>
+#include <algorithm>
+
+const uint64_t MAP_VIEW_SIZE = 64ull * 1024 * 1024;     // 内存映射的视图大小(字节)，大文件分窗口映射
+
+class MappedViews {
+public:
+    // 参数: mapping-文件映射对象(由调用方创建和关闭), file_size-文件大小, writable-是否以可写方式映射
+    MappedViews(HANDLE mapping, uint64_t file_size, bool writable)
+        : mapping(mapping), file_size(file_size), writable(writable), use_counter(0) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        granularity = si.dwAllocationGranularity ? si.dwAllocationGranularity : 65536;
+        for (auto& v : views) {
+            v.base = NULL;
+            v.offset = 0;
+            v.length = 0;
+            v.last_use = 0;
+        }
+    }
+
+    ~MappedViews() { unmap_all(); }
+
+    // 功能: 取得覆盖 [offset, offset+len) 的映射地址(调用方保证范围不超过文件大小)
+    // 返回: NULL-映射失败
+    // 说明: 返回的指针在下一次调用map之前有效
+    uint8_t* map(uint64_t offset, size_t len) {
+        // 1. 查找已映射且完整覆盖该范围的视图
+        View* hit = NULL;
+        for (auto& v : views) {
+            if (v.base && offset >= v.offset && offset + len <= v.offset + v.length) {
+                hit = &v;
+                break;
+            }
+        }
+
+        // 2. 未命中: 替换最久未使用的视图，起点按分配粒度对齐
+        if (!hit) {
+            hit = views[0].last_use <= views[1].last_use ? &views[0] : &views[1];
+            if (hit->base) UnmapViewOfFile(hit->base);
+            uint64_t start = offset / granularity * granularity;
+            uint64_t length = (std::max)(MAP_VIEW_SIZE, offset + len - start);
+            if (length > file_size - start) length = file_size - start;
+            hit->base = static_cast<uint8_t*>(MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+                static_cast<DWORD>(start >> 32), static_cast<DWORD>(start & 0xFFFFFFFF),
+                static_cast<SIZE_T>(length)));
+            if (!hit->base) return NULL;
+            hit->offset = start;
+            hit->length = length;
+        }
+
+        hit->last_use = ++use_counter;
+        return hit->base + (offset - hit->offset);
+    }
+
+    void unmap_all() {
+        for (auto& v : views) {
+            if (v.base) UnmapViewOfFile(v.base);
+            v.base = NULL;
+        }
+    }
+
+private:
+    struct View {
+        uint8_t* base;          // 视图起始地址
+        uint64_t offset;        // 视图对应的文件偏移
+        uint64_t length;        // 视图长度
+        uint64_t last_use;      // 最近使用序号(LRU替换)
+    };
+
+    HANDLE mapping;
+    uint64_t file_size;
+    bool writable;
+    uint64_t granularity;       // 映射起点必须按分配粒度对齐
+    View views[2];
+    uint64_t use_counter;
+
+    MappedViews(const MappedViews&);
+    MappedViews& operator=(const MappedViews&);
+};
+
+#endif // MAPPED_VIEWS_H
@@ -0,0 +1,94 @@
+// options.h
+// 文件说明: 命令行参数解析
+// 功能: 发送端、接收端和测试程序用 --名称 值 的形式传入配置，不带参数运行时仍然在控制台逐项询问
+// 说明: 地址写成 IP:端口 的形式；不带值的参数(如 --quiet)视为开关
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+
+// ==================== 命令行参数 ====================
+class CommandLine {
+public:
+    CommandLine(int argc, char* argv[]) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+                std::string name = arg.substr(2);
+                // 下一项不是参数名时作为本参数的值
+                if (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0) {
+                    values[name] = argv[++i];
+                } else {
+                    values[name] = std::string();
+                }
+            } else {
+                positional.push_back(arg);
+            }
+        }
+    }
+
+    // 是否传入了任何参数(没有时按原来的方式在控制台询问)
+    bool empty() const { return values.empty() && positional.empty(); }
+
+    bool has(const std::string& name) const { return values.count(name) > 0; }
+
+    std::string get(const std::string& name, const std::string& fallback = std::string()) const {
+        std::map<std::string, std::string>::const_iterator it = values.find(name);
+        return it == values.end() || it->second.empty() ? fallback : it->second;
+    }
+
+    // 功能: 取整数参数
+    // 返回: 没有该参数或不是整数时返回fallback
+    long number(const std::string& name, long fallback) const {
+        std::string text = get(name);
+        if (text.empty()) return fallback;
+        char* end = NULL;
+        long v = strtol(text.c_str(), &end, 10);
+        return *end == '\0' ? v : fallback;
+    }
+
+    // 功能: 取 IP:端口 形式的地址参数
+    // 返回: false-没有该参数或格式有误
+    bool endpoint(const std::string& name, std::string& ip, uint16_t& port) const {
+        return split_endpoint(get(name), ip, port);
+    }
+
+    // 没有参数名的参数(按出现的顺序)
+    const std::vector<std::string>& arguments() const { return positional; }
+
+    // 功能: 拆分 IP:端口
+    static bool split_endpoint(const std::string& text, std::string& ip, uint16_t& port) {
+        size_t colon = text.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 >= text.size()) return false;
+        char* end = NULL;
+        long v = strtol(text.c_str() + colon + 1, &end, 10);
+        if (*end != '\0' || v <= 0 || v > 65535) return false;
+        ip = text.substr(0, colon);
+        port = static_cast<uint16_t>(v);
+        return true;
+    }
+
+    // 功能: 按分隔符拆分列表参数(如 --sizes 1M,16M)
+    static std::vector<std::string> split_list(const std::string& text, char separator = ',') {
+        std::vector<std::string> items;
+        size_t start = 0;
+        while (start <= text.size()) {
+            size_t end = text.find(separator, start);
+            if (end == std::string::npos) end = text.size();
+            if (end > start) items.push_back(text.substr(start, end - start));
+            start = end + 1;
+        }
+        return items;
+    }
+
+private:
+    std::map<std::string, std::string> values;
+    std::vector<std::string> positional;
+};
+
+#endif // OPTIONS_H
@@ -0,0 +1,96 @@
+// pacer.h
+// 文件说明: 发送端的发送节奏控制(pacing)
+// 功能: 把一个拥塞窗口的新数据分散到一个RTT内发出，而不是每收到一批ACK就把空出的窗口一次性突发出去，
+//       减少瓶颈队列的瞬时堆积和由突发引起的丢包
+// 说明: 速率优先取拥塞控制算法给出的速率(BBR)，没有时按 增益 * cwnd / SRTT 计算；
+//       令牌桶攒够一批(约64KB，相当于一个GSO大包)才放行，一批数据报仍在一次批量提交中发出，
+//       不会退化为每个包一次系统调用；计时使用QueryPerformanceCounter
+
+#ifndef PACER_H
+#define PACER_H
+
+#include <windows.h>
+#include <cstdint>
+#include <algorithm>
+
+// ==================== 节奏控制常量 ====================
+const double PACING_GAIN_SLOW_START = 2.0;      // 慢启动时窗口每RTT翻倍，速率取2倍才不拖慢窗口增长
+const double PACING_GAIN = 1.25;                // 拥塞避免时的增益，留出余量吸收ACK间隔的抖动
+const size_t PACING_BURST_BYTES = 64 * 1024;    // 每批放行的数据量(字节)
+const uint32_t PACING_MIN_BURST = 2;            // 每批至少的包数
+const uint32_t PACING_MAX_BURSTS = 2;           // 令牌最多积攒的批数，唤醒略晚时不损失速率，也不形成大突发
+
+class Pacer {
+public:
+    Pacer() : rate(0), tokens(0), burst(PACING_MIN_BURST), last_tick(0), paced_waits(0) {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        frequency = f.QuadPart > 0 ? f.QuadPart : 1;
+    }
+
+    // 功能: 开始一次传输，按负载大小确定每批的包数；令牌装满一批，第一批立即发出
+    void reset(uint16_t payload_size) {
+        burst = (std::max)(PACING_MIN_BURST, static_cast<uint32_t>(PACING_BURST_BYTES / payload_size));
+        tokens = burst;
+        rate = 0;
+        last_tick = now_ticks();
+        paced_waits = 0;
+    }
+
+    // 功能: 设置发送速率(包/秒)，0表示不限速
+    void set_rate(double packets_per_sec) {
+        refill();
+        rate = packets_per_sec;
+    }
+
+    // 功能: 现在可以发送的新包数；令牌不足一批时为0，攒够后成批放行
+    uint32_t allowance() {
+        if (rate <= 0) return UINT32_MAX;
+        refill();
+        return tokens >= burst ? static_cast<uint32_t>(tokens) : 0;
+    }
+
+    // 发送了一个新包
+    void on_sent() {
+        if (rate > 0 && tokens >= 1) tokens -= 1;
+    }
+
+    // 功能: 令牌不足时计算距下一批可以放行还有多久，并计入一次节奏等待
+    // 返回: 微秒数，至少为1
+    int64_t next_burst_us() {
+        refill();
+        paced_waits++;
+        if (rate <= 0 || tokens >= burst) return 1;
+        return static_cast<int64_t>((burst - tokens) * 1000000.0 / rate) + 1;
+    }
+
+    double rate_pps() const { return rate; }
+    uint32_t burst_packets() const { return burst; }
+    uint64_t waits() const { return paced_waits; }     // 因速率限制而等待的次数
+
+private:
+    double rate;            // 发送速率(包/秒)
+    double tokens;          // 可发送的包数
+    uint32_t burst;         // 每批的包数
+    int64_t frequency;      // 性能计数器频率
+    int64_t last_tick;      // 上次补充令牌时的计数值
+    uint64_t paced_waits;
+
+    int64_t now_ticks() const {
+        LARGE_INTEGER t;
+        QueryPerformanceCounter(&t);
+        return t.QuadPart;
+    }
+
+    // 按经过的时间补充令牌
+    void refill() {
+        int64_t now = now_ticks();
+        if (rate > 0) {
+            double cap = static_cast<double>(burst) * PACING_MAX_BURSTS;
+            tokens = (std::min)(cap, tokens + static_cast<double>(now - last_tick) * rate / frequency);
+        }
+        last_tick = now;
+    }
+};
+
+#endif // PACER_H
@@ -12,15 +12,40 @@
 #include <cstdint>        // 标准整型定义
 #include <cstring>        // C字符串操作
 #include <vector>         // STL向量容器
+#include <string>         // 文件名
 #include <iostream>       // 标准输入输出流
+#include <chrono>         // 计时(RTT估计)
+#include <algorithm>      // std::min / std::max
+#include "checksum.h"     // 校验和计算内核
 
 // ==================== 协议常量定义 ====================
 // 这些常量定义了协议的基本参数
-const uint16_t MAX_DATA_SIZE = 1024;           // 单个数据包的最大数据负载大小(字节)
+const uint16_t MAX_DATA_SIZE = 8952;           // 单个数据包的最大数据负载大小(字节)，9000字节巨帧 - IP/UDP头 - 协议头
+const uint16_t DEFAULT_DATA_SIZE = 1024;       // 对端未协商时使用的数据负载大小(字节)
 const uint16_t HEADER_SIZE = 20;               // 数据包头部固定大小(字节)
 const uint16_t MAX_PACKET_SIZE = MAX_DATA_SIZE + HEADER_SIZE;  // 完整数据包最大大小
-const uint32_t WINDOW_SIZE = 16;               // 滑动窗口大小(数据包个数)
-const uint32_t TIMEOUT_MS = 1000;              // 超时重传时间(毫秒)
+const uint32_t WINDOW_SIZE = 16;               // 对端未协商时使用的窗口大小(数据包个数)
+const uint32_t RECV_WINDOW_CAPACITY = 4096;    // 接收端缓冲区容量(数据包个数)，按空闲空间通告窗口
+const uint32_t SEND_WINDOW_CAPACITY = 4096;    // 发送端环形窗口容量(数据包个数)，在途包数的硬上限
+const uint32_t MAX_SACK_BLOCKS = 3;            // 每个ACK最多携带的SACK块数
+const uint32_t DELAYED_ACK_PACKETS = 2;        // 没有空洞时按序到达的包每攒够这么多确认一次
+const int64_t DELAYED_ACK_US = 1000;           // 延迟确认的最长等待时间(微秒)，远小于最小RTO
+const uint32_t DUP_THRESH = 3;                 // 其后已有这么多包被SACK确认的在途包判定为丢失(RFC 6675)
+const uint32_t TIMEOUT_MS = 1000;              // 初始超时重传时间(毫秒)，尚无RTT样本时使用
+const uint32_t MIN_RTO_MS = 50;                // RTO下限(毫秒)，高于Sleep的调度粒度，避免伪重传
+const uint32_t MAX_RTO_MS = 60000;             // RTO上限(毫秒)，指数退避不超过该值
+const int UDP_SOCKET_BUFFER = 8 * 1024 * 1024;  // 套接字收发缓冲区大小(字节)
+const int64_t SOURCE_POLL_US = 1000;           // 流式输入暂无数据时发送端的检查间隔(微秒)
+const uint32_t SPINNER_INTERVAL_MS = 100;      // 进度动画的刷新间隔(毫秒)
+const uint16_t MAX_PARALLEL_FLOWS = 16;        // 并行传输的最大流数，第i个流使用两端配置的端口号 + i
+const int FILE_NAME_RETRIES = 5;               // 文件名包的最大重传次数
+const int RESUME_NAME_RETRIES = 10;            // 携带续传清单时的最大重传次数(接收端要先计算已有文件的哈希)
+const uint32_t SERVER_MAX_SESSIONS = 1024;     // 多会话服务端同时保持的最大会话数，超过时不再接受新的SYN
+const uint32_t SESSION_IDLE_TIMEOUT_MS = 30000; // 会话超过该时间没有收到任何包时关闭(发送端已退出或断网)
+const uint32_t SESSION_LINGER_MS = 2000;       // 会话收到FIN后保留的时间，FIN_ACK丢失时再次确认重传的FIN
+const uint32_t SESSION_SWEEP_MS = 100;         // 分片线程检查超时会话的间隔(毫秒)
+const uint32_t SERVER_MAX_SHARDS = 16;         // 多会话服务端的最大分片线程数(默认每个核一个)
+const size_t SERVER_SHARD_BACKLOG = 4096;      // 分片线程积压的最大数据报数，超过时丢弃(与网络丢包同样由重传处理)
 
 // ==================== 数据包类型枚举 ====================
 // 定义了协议中使用的所有数据包类型
@@ -32,7 +57,8 @@ enum PacketType : uint8_t {
     FIN = 0x05,           // 结束包，请求关闭连接
     FIN_ACK = 0x06,       // 结束确认包，确认关闭请求
     FILE_NAME = 0x07,     // 文件名包，传输文件名信息
-    FILE_NAME_ACK = 0x08  // 文件名确认包，确认接收到文件名
+    FILE_NAME_ACK = 0x08, // 文件名确认包，确认接收到文件名
+    FEC_REPAIR = 0x09     // 前向纠错修复包，一个块中各DATA包负载的异或(见 fec.h)
 };
 
 // ==================== 协议数据包头部结构 ====================
@@ -40,11 +66,11 @@ enum PacketType : uint8_t {
 #pragma pack(push, 1)  // 设置1字节对齐，确保结构体紧凑存储
 struct PacketHeader {
     uint8_t type;         // 数据包类型(SYN/ACK/DATA等)
-    uint8_t flags;        // 标志位(预留字段，可用于扩展功能)
+    uint8_t flags;        // 标志位(见下方 FLAG_* 定义)
     uint16_t checksum;    // 校验和，用于检测数据传输错误
     uint32_t seq_num;     // 序列号，标识数据包的顺序
     uint32_t ack_num;     // 确认号，表示期望接收的下一个序列号
-    uint16_t window_size; // 接收窗口大小，流量控制使用
+    uint16_t window_size; // 接收窗口大小，流量控制使用(ACK)；发送端发出的包中为连接ID(见 new_connection_id)
     uint16_t data_length; // 数据部分的实际长度(字节)
     uint32_t sack_count;  // SACK块的数量(选择性确认)
 
@@ -55,6 +81,33 @@ struct PacketHeader {
 };
 #pragma pack(pop)
 
+// ==================== 头部标志位 ====================
+// DATA包: 该包是重传的副本。重传时只改动头部的这一位，校验和按RFC 1624增量更新，不再对负载重新求和
+const uint8_t FLAG_RETRANSMIT = 0x01;
+// ACK包: 触发本次确认的包是接收端用修复包恢复的，发送端据此把它计入丢包率估计
+const uint8_t FLAG_FEC_RECOVERED = 0x02;
+// FILE_NAME包: 本流的数据按块压缩传输(格式见 compress.h)，文件名包中的大小和范围仍是压缩前的
+const uint8_t FLAG_COMPRESSED = 0x04;
+
+// 头部前两个字节(type, flags)组成的大端16位字，增量更新校验和时使用
+inline uint16_t header_type_word(uint8_t type, uint8_t flags) {
+    return static_cast<uint16_t>((type << 8) | flags);
+}
+
+// ==================== 连接ID ====================
+// 发送端每次启动时随机选取一个非0值，写入它发出的所有包的 window_size 字段(发送端发出的包不通告窗口)；
+// 多会话服务端按 (地址, 端口, 连接ID) 区分会话，复用同一端口重新启动的发送端也是新的会话。旧版本发送端为0
+inline uint16_t new_connection_id() {
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    uint64_t x = static_cast<uint64_t>(t.QuadPart) ^ (static_cast<uint64_t>(GetCurrentProcessId()) << 32);
+    x ^= x >> 33;       // 混合高低位(splitmix64的终结步骤)
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    uint16_t id = static_cast<uint16_t>(x ^ (x >> 16) ^ (x >> 32) ^ (x >> 48));
+    return id ? id : 1;
+}
+
 // ==================== SACK块结构 ====================
 // 选择性确认(Selective Acknowledgment)块，用于告知发送方哪些数据已接收
 #pragma pack(push, 1)
@@ -71,52 +124,23 @@ struct Packet {
     uint8_t data[MAX_DATA_SIZE];         // 数据负载区域
     std::vector<SACKBlock> sack_blocks;  // SACK块列表，用于选择性确认
 
-    // 构造函数: 初始化数据区域为0
-    Packet() {
-        memset(data, 0, MAX_DATA_SIZE);
-    }
+    // 构造函数: 数据区域只有前 data_length 字节有效，不再整体清零(负载上限较大时清零开销明显)
+    Packet() {}
 
     // ==================== 校验和计算方法 ====================
     // 功能: 计算数据包的校验和，使用反码求和算法(类似TCP/IP校验和)
     // 返回: 16位校验和值
     // 说明: 包括头部、数据部分和SACK块
     uint16_t calculate_checksum() const {
-        uint32_t sum = 0;  // 使用32位累加器防止溢出
-        const uint8_t* ptr = reinterpret_cast<const uint8_t*>(&header);
-
-        // 1. 计算头部校验和
-        for (size_t i = 0; i < sizeof(PacketHeader); i += 2) {
-            if (i + 1 < sizeof(PacketHeader)) {
-                sum += (ptr[i] << 8) | ptr[i + 1];  // 按16位字累加
-            } else {
-                sum += ptr[i] << 8;  // 处理奇数字节
-            }
-        }
-
-        // 2. 计算数据部分校验和
-        for (uint16_t i = 0; i < header.data_length; i += 2) {
-            if (i + 1 < header.data_length) {
-                sum += (data[i] << 8) | data[i + 1];  // 按16位字累加
-            } else {
-                sum += data[i] << 8;  // 处理最后一个奇数字节
-            }
-        }
-
-        // 3. 计算SACK块校验和
+        // 1. 头部  2. 数据部分  3. SACK块，各段分别从字边界开始累加
+        uint32_t sum = checksum_add(0, reinterpret_cast<const uint8_t*>(&header), sizeof(PacketHeader));
+        sum = checksum_add(sum, data, header.data_length);
         for (const auto& sack : sack_blocks) {
-            const uint8_t* sack_ptr = reinterpret_cast<const uint8_t*>(&sack);
-            for (size_t i = 0; i < sizeof(SACKBlock); i += 2) {
-                sum += (sack_ptr[i] << 8) | sack_ptr[i + 1];
-            }
+            sum = checksum_add(sum, reinterpret_cast<const uint8_t*>(&sack), sizeof(SACKBlock));
         }
 
-        // 4. 处理进位，将高16位加到低16位(反码求和的关键步骤)
-        while (sum >> 16) {
-            sum = (sum & 0xFFFF) + (sum >> 16);
-        }
-
-        // 5. 返回反码(按位取反)
-        return static_cast<uint16_t>(~sum);
+        // 4. 处理进位并返回反码(按位取反)
+        return checksum_finish(sum);
     }
 
     // ==================== 校验和验证方法 ====================
@@ -131,22 +155,30 @@ struct Packet {
     // 功能: 将数据包结构转换为字节流，用于网络传输
     // 返回: 包含完整数据包的字节数组
     std::vector<uint8_t> serialize() const {
-        std::vector<uint8_t> buffer;
-
-        // 1. 添加头部数据
-        const uint8_t* header_ptr = reinterpret_cast<const uint8_t*>(&header);
-        buffer.insert(buffer.end(), header_ptr, header_ptr + sizeof(PacketHeader));
-
-        // 2. 添加数据负载(只添加有效数据)
-        buffer.insert(buffer.end(), data, data + header.data_length);
+        std::vector<uint8_t> buffer(wire_size());
+        serialize_to(buffer.data(), buffer.size());
+        return buffer;
+    }
 
-        // 3. 添加SACK块
-        for (const auto& sack : sack_blocks) {
-            const uint8_t* sack_ptr = reinterpret_cast<const uint8_t*>(&sack);
-            buffer.insert(buffer.end(), sack_ptr, sack_ptr + sizeof(SACKBlock));
+    // 功能: 序列化到调用方提供的缓冲区，不分配内存
+    // 返回: 写入的字节数，缓冲区不够时返回0
+    size_t serialize_to(uint8_t* out, size_t capacity) const {
+        size_t total = wire_size();
+        if (total > capacity) return 0;
+
+        // 1. 头部  2. 数据负载(只写有效数据)  3. SACK块
+        memcpy(out, &header, sizeof(PacketHeader));
+        memcpy(out + sizeof(PacketHeader), data, header.data_length);
+        if (!sack_blocks.empty()) {
+            memcpy(out + sizeof(PacketHeader) + header.data_length, sack_blocks.data(),
+                   sack_blocks.size() * sizeof(SACKBlock));
         }
+        return total;
+    }
 
-        return buffer;
+    // 序列化后的字节数
+    size_t wire_size() const {
+        return sizeof(PacketHeader) + header.data_length + sack_blocks.size() * sizeof(SACKBlock);
     }
 
     // ==================== 数据包反序列化方法 ====================
@@ -186,6 +218,310 @@ struct Packet {
     }
 };
 
+// ==================== 数据包视图 ====================
+// 直接在接收缓冲区上解析数据报，不复制数据、不分配内存
+// 头部复制一份(20字节，避免对未对齐地址的字段访问)，数据和SACK块指向原缓冲区
+// 视图只在缓冲区被下一个数据报覆盖之前有效
+struct PacketView {
+    PacketHeader header;        // 头部副本
+    const uint8_t* data;        // 数据部分，长度为 header.data_length
+    const uint8_t* sack_ptr;    // SACK块数组起始位置(未对齐，用sack()读取)
+    uint32_t sack_count;        // 缓冲区中实际完整存在的SACK块数量
+
+    PacketView() : data(NULL), sack_ptr(NULL), sack_count(0) {}
+
+    // 功能: 解析长度为length的数据报
+    // 返回: false-长度不足以包含头部和声明的数据部分
+    bool parse(const uint8_t* buffer, size_t length) {
+        if (length < sizeof(PacketHeader)) return false;
+        memcpy(&header, buffer, sizeof(PacketHeader));
+        size_t offset = sizeof(PacketHeader);
+        if (offset + header.data_length > length) return false;
+        data = buffer + offset;
+        offset += header.data_length;
+        sack_ptr = buffer + offset;
+        size_t available = (length - offset) / sizeof(SACKBlock);
+        sack_count = header.sack_count < available ? header.sack_count : static_cast<uint32_t>(available);
+        return true;
+    }
+
+    SACKBlock sack(uint32_t i) const {
+        SACKBlock block;
+        memcpy(&block, sack_ptr + i * sizeof(SACKBlock), sizeof(SACKBlock));
+        return block;
+    }
+
+    // 头部和SACK块部分的校验和累加值(不含数据部分)
+    // 调用方可以用 checksum_copy 在复制数据的同时累加剩余部分，数据只读一遍
+    uint32_t header_sum() const {
+        uint32_t sum = checksum_add(0, reinterpret_cast<const uint8_t*>(&header), sizeof(PacketHeader));
+        for (uint32_t i = 0; i < sack_count; ++i) {
+            sum = checksum_add(sum, sack_ptr + i * sizeof(SACKBlock), sizeof(SACKBlock));
+        }
+        return sum;
+    }
+
+    // 与 Packet::verify_checksum 计算方式相同: 头部、数据、每个SACK块分段累加
+    bool verify_checksum() const {
+        return checksum_finish(checksum_add(header_sum(), data, header.data_length)) == 0x0000;
+    }
+};
+
+// 功能: 由头部、数据和SACK块直接组装数据报到调用方的缓冲区，并填写data_length、sack_count和校验和
+// 返回: 写入的字节数，缓冲区不够时返回0
+inline size_t write_packet(uint8_t* out, size_t capacity, PacketHeader header,
+                           const uint8_t* data, uint16_t data_length,
+                           const SACKBlock* sacks, uint32_t sack_count) {
+    size_t sack_bytes = sack_count * sizeof(SACKBlock);
+    size_t total = sizeof(PacketHeader) + data_length + sack_bytes;
+    if (total > capacity) return 0;
+
+    header.data_length = data_length;
+    header.sack_count = sack_count;
+    header.checksum = 0;
+    // 数据部分边复制边累加，头部写在最后(校验和要等全部累加完)
+    uint32_t sum = checksum_add(0, reinterpret_cast<const uint8_t*>(&header), sizeof(PacketHeader));
+    sum = checksum_copy(sum, out + sizeof(PacketHeader), data, data_length);
+    for (uint32_t i = 0; i < sack_count; ++i) {
+        sum = checksum_add(sum, reinterpret_cast<const uint8_t*>(&sacks[i]), sizeof(SACKBlock));
+    }
+    header.checksum = htons(checksum_finish(sum));
+
+    memcpy(out, &header, sizeof(PacketHeader));
+    if (sack_bytes) memcpy(out + sizeof(PacketHeader) + data_length, sacks, sack_bytes);
+    return total;
+}
+
+// 功能: 为数据放在调用方内存中(如文件映射页面)的数据包填写头部校验和，发送时用WSABUF把头部和数据拼接，数据不复制
+inline void seal_header(PacketHeader& header, const uint8_t* data, uint16_t data_length) {
+    header.data_length = data_length;
+    header.sack_count = 0;
+    header.checksum = 0;
+    uint32_t sum = checksum_add(0, reinterpret_cast<const uint8_t*>(&header), sizeof(PacketHeader));
+    sum = checksum_add(sum, data, data_length);
+    header.checksum = htons(checksum_finish(sum));
+}
+
+// ==================== 握手协商参数 ====================
+// SYN 和 SYN_ACK 的数据部分携带该结构(与头部一样使用主机字节序):
+//   SYN:     发送端按本地路径MTU提出的负载大小，以及发送端窗口容量
+//   SYN_ACK: 接收端确定的负载大小(不超过双方的上限)，以及接收端缓冲区容量
+// 数据部分为空的旧版本对端使用 DEFAULT_DATA_SIZE / WINDOW_SIZE
+// flags: SYN中是发送端支持的功能，SYN_ACK中是接收端同意启用的功能(旧版本对端为0)
+#pragma pack(push, 1)
+struct HandshakeOptions {
+    uint16_t payload_size;  // 数据包负载大小(字节)
+    uint16_t flags;         // 功能标志(HANDSHAKE_*)
+    uint32_t window;        // 窗口大小(数据包个数)
+};
+#pragma pack(pop)
+
+const uint16_t HANDSHAKE_FEC = 0x0001;         // 前向纠错修复包(FEC_REPAIR)
+const uint16_t HANDSHAKE_RESUME = 0x0002;      // 续传清单(文件名包携带块哈希，确认中回复需要传输的块)
+const uint16_t HANDSHAKE_COMPRESS = 0x0004;    // 分块压缩(文件名包带FLAG_COMPRESSED时数据为压缩块)
+
+// 功能: 把协商参数写入SYN/SYN_ACK的数据部分(需在计算校验和之前调用)
+inline void write_handshake_options(Packet& packet, const HandshakeOptions& opts) {
+    memcpy(packet.data, &opts, sizeof(opts));
+    packet.header.data_length = sizeof(opts);
+}
+
+// 功能: 读取协商参数，对端未携带时填入默认值
+// 返回: true-对端携带了协商参数
+inline bool read_handshake_options(const uint8_t* data, uint16_t data_length, HandshakeOptions& opts) {
+    if (data_length < sizeof(opts)) {
+        opts.payload_size = DEFAULT_DATA_SIZE;
+        opts.flags = 0;
+        opts.window = WINDOW_SIZE;
+        return false;
+    }
+    memcpy(&opts, data, sizeof(opts));
+    if (opts.payload_size == 0 || opts.payload_size > MAX_DATA_SIZE) opts.payload_size = DEFAULT_DATA_SIZE;
+    if (opts.window == 0) opts.window = WINDOW_SIZE;
+    return true;
+}
+
+inline bool read_handshake_options(const PacketView& packet, HandshakeOptions& opts) {
+    return read_handshake_options(packet.data, packet.header.data_length, opts);
+}
+
+// ==================== 文件名包 ====================
+// FILE_NAME 的数据部分: 文件名；已知文件大小时之后再跟一个0字节和8字节文件大小(主机字节序)
+// 并行传输时再跟一个 FileRange，说明本流负责的范围；没有时即整个文件由一个流传输
+// 流式输入(管道)和旧版本对端只发送文件名，接收端按顺序写出
+// 协商了续传时FileRange之后再跟 ManifestHeader 和 chunk_count 个8字节块哈希(此时单个流也携带FileRange)，
+// 接收端在 FILE_NAME_ACK 的数据部分回复需要传输的块的位图(见 manifest.h)
+#pragma pack(push, 1)
+struct FileRange {
+    uint64_t offset;        // 本流传输的数据在文件中的起始偏移
+    uint64_t length;        // 本流传输的字节数
+    uint16_t flow_index;    // 本流的编号(从0开始)
+    uint16_t flow_count;    // 并行流的总数
+};
+
+struct ManifestHeader {
+    uint32_t chunk_size;    // 块大小(字节，负载大小的整数倍)
+    uint32_t chunk_count;   // 块数，覆盖本流负责的整个范围
+};
+#pragma pack(pop)
+
+const uint16_t FILE_SIZE_FIELD = 1 + sizeof(uint64_t);
+
+// 文件名包携带的信息
+struct FileInfo {
+    std::string name;       // 文件名
+    bool size_known;        // 是否携带了文件大小
+    uint64_t size;          // 文件总大小
+    FileRange range;        // 本流负责的范围(单个流时为整个文件)
+    uint32_t chunk_size;    // 续传清单的块大小，0表示没有携带清单
+    std::vector<uint64_t> chunk_hashes;     // 范围内各块的哈希
+
+    FileInfo() : size_known(false), size(0), chunk_size(0) {
+        range.offset = 0;
+        range.length = 0;
+        range.flow_index = 0;
+        range.flow_count = 1;
+    }
+};
+
+// 功能: 写入FILE_NAME的数据部分(需在计算校验和之前调用)，整个数据部分超过budget(协商的负载大小)时截断文件名
+// 说明: 只有一个流且没有续传清单时不写FileRange，与不支持并行传输的接收端兼容；
+//       清单的大小由调用方按 file_name_manifest_capacity 用同一个budget控制
+inline void write_file_name(Packet& packet, const FileInfo& info, size_t budget) {
+    bool with_manifest = info.size_known && info.chunk_size > 0;
+    bool with_range = info.size_known && (info.range.flow_count > 1 || with_manifest);
+    size_t manifest_bytes = with_manifest ? sizeof(ManifestHeader) + info.chunk_hashes.size() * sizeof(uint64_t) : 0;
+    if (budget > MAX_DATA_SIZE) budget = MAX_DATA_SIZE;
+    size_t fixed = (info.size_known ? FILE_SIZE_FIELD : 0) + (with_range ? sizeof(FileRange) : 0) + manifest_bytes;
+    size_t len = info.name.size();
+    size_t limit = budget > fixed ? budget - fixed : 0;
+    if (len > limit) len = limit;
+    memcpy(packet.data, info.name.data(), len);
+    if (info.size_known) {
+        packet.data[len] = 0;
+        memcpy(packet.data + len + 1, &info.size, sizeof(info.size));
+        len += FILE_SIZE_FIELD;
+    }
+    if (with_range) {
+        memcpy(packet.data + len, &info.range, sizeof(info.range));
+        len += sizeof(info.range);
+    }
+    if (with_manifest) {
+        ManifestHeader mh;
+        mh.chunk_size = info.chunk_size;
+        mh.chunk_count = static_cast<uint32_t>(info.chunk_hashes.size());
+        memcpy(packet.data + len, &mh, sizeof(mh));
+        len += sizeof(mh);
+        memcpy(packet.data + len, info.chunk_hashes.data(), info.chunk_hashes.size() * sizeof(uint64_t));
+        len += info.chunk_hashes.size() * sizeof(uint64_t);
+    }
+    packet.header.data_length = static_cast<uint16_t>(len);
+}
+
+// 功能: 文件名包在budget字节内(负载大小)还能放下多少个块哈希
+inline size_t file_name_manifest_capacity(const std::string& name, size_t budget) {
+    size_t fixed = name.size() + FILE_SIZE_FIELD + sizeof(FileRange) + sizeof(ManifestHeader);
+    if (budget > MAX_DATA_SIZE) budget = MAX_DATA_SIZE;
+    return budget > fixed ? (budget - fixed) / sizeof(uint64_t) : 0;
+}
+
+// 功能: 解析FILE_NAME的数据部分，没有携带范围时范围为整个文件
+// 返回: false-携带的范围超出文件大小，或续传清单与范围不符
+inline bool read_file_name(const uint8_t* data, uint16_t data_length, FileInfo& info) {
+    info = FileInfo();
+    const uint8_t* end = static_cast<const uint8_t*>(memchr(data, 0, data_length));
+    size_t tail = end ? static_cast<size_t>(data + data_length - end) : 0;
+    if (tail != FILE_SIZE_FIELD && tail < FILE_SIZE_FIELD + sizeof(FileRange)) {
+        info.name.assign(reinterpret_cast<const char*>(data), data_length);
+        return true;
+    }
+    info.name.assign(reinterpret_cast<const char*>(data), end - data);
+    info.size_known = true;
+    memcpy(&info.size, end + 1, sizeof(info.size));
+    info.range.length = info.size;
+    if (tail == FILE_SIZE_FIELD) return true;
+    memcpy(&info.range, end + FILE_SIZE_FIELD, sizeof(info.range));
+    if (info.range.flow_count == 0 || info.range.flow_index >= info.range.flow_count ||
+        info.range.offset > info.size || info.range.length > info.size - info.range.offset) {
+        return false;
+    }
+
+    // 续传清单: 块数必须正好覆盖范围
+    size_t rest = tail - FILE_SIZE_FIELD - sizeof(FileRange);
+    if (rest == 0) return true;
+    ManifestHeader mh;
+    if (rest < sizeof(mh)) return false;
+    memcpy(&mh, end + FILE_SIZE_FIELD + sizeof(FileRange), sizeof(mh));
+    if (mh.chunk_size == 0 || rest != sizeof(mh) + static_cast<size_t>(mh.chunk_count) * sizeof(uint64_t) ||
+        mh.chunk_count != (info.range.length + mh.chunk_size - 1) / mh.chunk_size) {
+        return false;
+    }
+    info.chunk_size = mh.chunk_size;
+    info.chunk_hashes.resize(mh.chunk_count);
+    memcpy(info.chunk_hashes.data(), end + FILE_SIZE_FIELD + sizeof(FileRange) + sizeof(mh),
+           mh.chunk_count * sizeof(uint64_t));
+    return true;
+}
+
+// 功能: 按到对端的本地路径MTU计算能放进一个IP包的最大负载
+// 说明: 用临时UDP套接字connect到对端后查询IP_MTU(Windows 10 1703起支持)，
+//       不支持时按以太网MTU 1500计算；结果限制在 [DEFAULT_DATA_SIZE, MAX_DATA_SIZE]
+inline uint16_t path_payload_size(const sockaddr_in& peer) {
+    int mtu = 1500;
+#ifdef IP_MTU
+    SOCKET probe = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (probe != INVALID_SOCKET) {
+        DWORD value = 0;
+        int len = sizeof(value);
+        if (connect(probe, (const sockaddr*)&peer, sizeof(peer)) == 0 &&
+            getsockopt(probe, IPPROTO_IP, IP_MTU, (char*)&value, &len) == 0 && value >= 576) {
+            mtu = static_cast<int>(value);
+        }
+        closesocket(probe);
+    }
+#else
+    (void)peer;
+#endif
+    int payload = mtu - 20 - 8 - HEADER_SIZE;      // IP头20字节 + UDP头8字节 + 协议头
+    if (payload < DEFAULT_DATA_SIZE) payload = DEFAULT_DATA_SIZE;
+    if (payload > MAX_DATA_SIZE) payload = MAX_DATA_SIZE;
+    return static_cast<uint16_t>(payload);
+}
+
+// ==================== 套接字等待 ====================
+// 功能: 阻塞等待套接字可读(有数据报到达)或超时，代替 Sleep 轮询
+// 参数: timeout_us-最长等待时间(微秒)，负数表示一直等待
+// 返回: true-有数据可读，false-超时或出错
+// 说明: 数据报到达时select立即返回，不受Sleep的15.6ms调度粒度影响
+inline bool wait_readable(SOCKET sock, int64_t timeout_us) {
+    fd_set rd;
+    FD_ZERO(&rd);
+    FD_SET(sock, &rd);
+    timeval tv;
+    timeval* ptv = NULL;
+    if (timeout_us >= 0) {
+        tv.tv_sec = static_cast<long>(timeout_us / 1000000);
+        tv.tv_usec = static_cast<long>(timeout_us % 1000000);
+        ptv = &tv;
+    }
+    return select(0, &rd, NULL, NULL, ptv) > 0;
+}
+
+// 功能: 等待套接字可读，最晚到deadline返回(deadline已过时只检查一次)
+inline bool wait_readable_until(SOCKET sock, std::chrono::steady_clock::time_point deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    return wait_readable(sock, left > 0 ? left : 0);
+}
+
+// 功能: 放大套接字收发缓冲区，发送端和接收端都在一次唤醒中成批处理数据报，
+//       两次唤醒之间到达的突发数据不会因系统默认的小缓冲区被丢弃
+inline void set_socket_buffers(SOCKET sock) {
+    int size = UDP_SOCKET_BUFFER;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*)&size, sizeof(size));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (const char*)&size, sizeof(size));
+}
+
 // ==================== 连接状态枚举 ====================
 // 定义了连接生命周期中的各个状态(类似TCP状态机)
 enum ConnectionState {
@@ -205,6 +541,62 @@ enum CongestionState {
     FAST_RECOVERY         // 快速恢复阶段: 检测到丢包后的恢复
 };
 
+// ==================== RTT估计器 ====================
+// 按RFC 6298估计往返时间并计算重传超时(RTO):
+//   首个样本R:   SRTT = R, RTTVAR = R/2
+//   之后的样本:  RTTVAR = 3/4*RTTVAR + 1/4*|SRTT-R|, SRTT = 7/8*SRTT + 1/8*R
+//   RTO = SRTT + max(G, 4*RTTVAR)，限制在 [MIN_RTO_MS, MAX_RTO_MS]
+// 超时后RTO加倍(指数退避)，收到新样本后恢复为计算值
+// 调用方只能用未重传过的包计算样本(Karn算法)，否则无法区分确认的是哪一次发送
+class RttEstimator {
+public:
+    RttEstimator() : srtt_us(0), rttvar_us(0), base_rto_us(TIMEOUT_MS * 1000LL),
+                     backoff_count(0), has_sample(false) {}
+
+    // 功能: 加入一个RTT样本
+    void sample(std::chrono::steady_clock::duration rtt) {
+        int64_t r = std::chrono::duration_cast<std::chrono::microseconds>(rtt).count();
+        if (r < 0) return;
+        if (!has_sample) {
+            srtt_us = r;
+            rttvar_us = r / 2;
+            has_sample = true;
+        } else {
+            int64_t err = srtt_us > r ? srtt_us - r : r - srtt_us;
+            rttvar_us = (3 * rttvar_us + err) / 4;
+            srtt_us = (7 * srtt_us + r) / 8;
+        }
+        const int64_t granularity_us = 1000;    // 时钟粒度G: 1ms
+        base_rto_us = srtt_us + (std::max)(granularity_us, 4 * rttvar_us);
+        backoff_count = 0;
+    }
+
+    // 功能: 发生超时，RTO加倍
+    void backoff() {
+        if (rto_us() < MAX_RTO_MS * 1000LL) backoff_count++;
+    }
+
+    // 当前RTO(微秒)，包含退避
+    int64_t rto_us() const {
+        int64_t rto = (std::max)(base_rto_us, static_cast<int64_t>(MIN_RTO_MS) * 1000);
+        for (uint32_t i = 0; i < backoff_count && rto < MAX_RTO_MS * 1000LL; ++i) rto *= 2;
+        return (std::min)(rto, static_cast<int64_t>(MAX_RTO_MS) * 1000);
+    }
+
+    std::chrono::microseconds rto() const { return std::chrono::microseconds(rto_us()); }
+    int64_t rto_ms() const { return rto_us() / 1000; }
+    std::chrono::microseconds srtt() const { return std::chrono::microseconds(srtt_us); }
+    int64_t srtt_ms() const { return srtt_us / 1000; }
+    bool sampled() const { return has_sample; }
+
+private:
+    int64_t srtt_us;        // 平滑RTT(微秒)
+    int64_t rttvar_us;      // RTT偏差(微秒)
+    int64_t base_rto_us;    // 由最近样本计算的RTO(微秒)，不含退避
+    uint32_t backoff_count; // 连续超时次数
+    bool has_sample;
+};
+
 // ==================== Windows Socket初始化类 ====================
 // RAII封装: 自动管理Winsock库的初始化和清理
 // 使用方法: 在main函数开始处创建对象，程序结束时自动清理
@@ -3,58 +3,210 @@
 // 功能: 接收文件数据，实现乱序重组、去重、选择性确认等
 
 #include "protocol.h"
+#include "datagram_io.h"
+#include "file_sink.h"
+#include "manifest.h"
+#include "fec.h"
+#include "options.h"
+#include "telemetry.h"
+#include "../common/async_log.h"
 #include <iostream>
-#include <fstream>
-#include <map>
-#include <set>
 #include <algorithm>
 #include <string>
 #include <iomanip>
 #include <cstdio>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// 每包都可能触发的错误提示经异步输出并限流，坏包密集时不会让接收循环卡在控制台上
+LogRateLimit checksum_log_limit;
+LogRateLimit range_log_limit;
+LogRateLimit not_established_log_limit;
+LogRateLimit no_file_name_log_limit;
+
+// ==================== 多会话服务端的输出文件名 ====================
+// 服务端按发送端IP和文件名命名输出文件，同一发送端换了源端口重新连接时仍能找到上次的文件续传；
+// 同一IP同时发送同名文件时，后来的会话改用带源端口的名字，两个会话不会写同一个文件
+class ActiveOutputs {
+public:
+    // 返回: true-名字未被占用，已登记
+    bool claim(const std::string& name) {
+        std::lock_guard<std::mutex> lk(mtx);
+        return names.insert(name).second;
+    }
+
+    void release(const std::string& name) {
+        std::lock_guard<std::mutex> lk(mtx);
+        names.erase(name);
+    }
+
+private:
+    std::mutex mtx;
+    std::unordered_set<std::string> names;
+};
+
+ActiveOutputs active_outputs;
+
+// ==================== 乱序缓冲槽位 ====================
+// 序列号seq落在槽位 seq % RECV_WINDOW_CAPACITY，接收窗口保证缓冲中的序列号互不冲突
+// 数据区在槽位第一次使用时按负载大小分配，之后重复使用，稳定状态下接收不分配内存
+// 槽位是否缓存着数据由 ReceiveScoreboard 记录；输出文件可按偏移直接写入时不使用槽位
+struct RecvSlot {
+    uint16_t length;            // 数据长度
+    std::vector<uint8_t> data;  // 数据副本
+    RecvSlot() : length(0) {}
+};
+
+// ==================== 接收记分板 ====================
+// 接收窗口上的位图: 第 seq % capacity 位表示该序列号的数据已缓存在乱序缓冲区
+// 查找连续区间按64位字跳跃扫描，生成SACK块的代价只与窗口大小有关，内存在整个传输中不变
+class ReceiveScoreboard {
+public:
+    // capacity需为64的整数倍且为2的幂，窗口回绕时正好落在字边界上
+    explicit ReceiveScoreboard(uint32_t capacity) : bits(capacity / 64, 0), mask(capacity - 1) {}
+
+    bool test(uint32_t seq) const { return (bits[(seq & mask) >> 6] >> (seq & 63)) & 1; }
+    void set(uint32_t seq) { bits[(seq & mask) >> 6] |= 1ull << (seq & 63); }
+    void clear(uint32_t seq) { bits[(seq & mask) >> 6] &= ~(1ull << (seq & 63)); }
+    void reset() { std::fill(bits.begin(), bits.end(), 0ull); }
+
+    // 功能: 在 [from, limit) 中查找第一个位值为value的序列号
+    // 返回: 找不到时返回limit
+    uint32_t find(uint32_t from, uint32_t limit, bool value) const {
+        uint32_t seq = from;
+        while (seq < limit) {
+            uint32_t bit = seq & 63;
+            uint64_t word = bits[(seq & mask) >> 6];
+            if (!value) word = ~word;
+            word &= ~0ull << bit;
+            if (word) {
+                uint32_t found = seq + (lowest_bit(word) - bit);
+                return found < limit ? found : limit;
+            }
+            seq += 64 - bit;
+        }
+        return limit;
+    }
+
+private:
+    std::vector<uint64_t> bits;
+    uint32_t mask;
+
+    static uint32_t lowest_bit(uint64_t word) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanForward(&index, static_cast<unsigned long>(word))) return index;
+        _BitScanForward(&index, static_cast<unsigned long>(word >> 32));
+        return index + 32;
+#else
+        return static_cast<uint32_t>(__builtin_ctzll(word));
+#endif
+    }
+};
+
+// ==================== 并行传输的共享输出 ====================
+// 并行传输时每个流各自收到文件名: 第一个流创建输出文件，其余流通过share()写入同一个映射
+struct SharedOutput {
+    std::mutex lock;                    // 保护file的创建
+    std::unique_ptr<FileSink> file;     // 第一个流创建的输出文件
+};
+
+// ==================== 接收统计 ====================
+struct ReceiveStats {
+    uint64_t bytes;             // 接收的文件数据字节数
+    uint64_t packets;           // 接收的总包数
+    uint64_t retransmits;       // 收到的重传包数
+    uint64_t acks;              // 发送的ACK数
+    uint64_t fec_recovered;     // 用FEC修复包恢复的包数
+    uint64_t resumed_bytes;     // 续传时已有、未重新传输的字节数
+    uint64_t syscalls;          // 收发用到的系统调用次数
+    uint64_t datagrams;         // 收发的数据报个数
+    CounterSnapshot counters;   // 诊断计数(重复包、乱序、校验和错误等)
+    HistogramSnapshot ack_interval;     // 相邻ACK发出间隔的分布
+
+    ReceiveStats() : bytes(0), packets(0), retransmits(0), acks(0), fec_recovered(0), resumed_bytes(0),
+                     syscalls(0), datagrams(0) {}
+};
 
 // ==================== 接收端类 ====================
 // 功能: 接收并保存发送端传输的文件，处理乱序数据包
 class Receiver {
 private:
     // ==================== 网络通信相关 ====================
-    SOCKET sockfd;                      // UDP套接字描述符
+    DatagramSocket own_udp;             // 单独运行时本端的UDP套接字(RIO批量收发，不支持时回退普通调用)
+    DatagramSocket& udp;                // 收发使用的套接字: 单独运行时为own_udp，多会话服务端中为共享的套接字
+    std::mutex* send_lock;              // 多会话服务端中各分片线程共享套接字的发送锁，单独运行时为NULL
+    std::string claimed_output;         // 多会话服务端中本会话在 active_outputs 登记的输出文件名
     struct sockaddr_in local_addr;      // 本地绑定地址
     struct sockaddr_in sender_addr;     // 发送端地址信息
-    int sender_addr_len;                // 发送端地址长度
     ConnectionState state;              // 当前连接状态
 
     // ==================== 接收缓冲管理 ====================
     uint32_t expected_seq;                           // 期望接收的下一个序列号
-    std::map<uint32_t, Packet> recv_buffer;          // 接收缓冲区(存储乱序到达的包)
-    std::set<uint32_t> received_seqs;                // 已接收序列号集合(用于去重和SACK)
+    std::vector<RecvSlot> reorder;                   // 乱序缓冲区(环形，存储乱序到达的包)
+    ReceiveScoreboard present;                       // 窗口内哪些乱序序列号已收到(在乱序缓冲区或已直接写入文件)，用于去重和SACK
+    uint32_t buffered;                               // 乱序缓冲区中的包数
+    uint32_t highest_seq;                            // 已缓存的最大序列号 + 1，SACK只扫描到这里
+    uint16_t payload_size;                           // 握手协商的数据包负载大小(字节)
+
+    // ==================== 延迟确认 ====================
+    uint32_t unacked_packets;                        // 按序到达、尚未确认的包数
+    std::chrono::steady_clock::time_point ack_deadline;  // 最早一个未确认包的确认期限
 
     // ==================== 输出文件和统计 ====================
-    std::ofstream output_file;          // 输出文件流
+    std::unique_ptr<FileSink> output;   // 输出文件
+    std::string output_path;            // 输出文件名
+    bool direct_write;                  // 输出文件已按大小预分配，数据直接写入 range.offset + (seq - data_base_seq) * payload_size
+    uint32_t data_base_seq;             // 第一个数据包的序列号(收到FILE_NAME时的期望序列号)
+    FileRange range;                    // 本流负责的文件范围(单个流时为整个文件)
+    ChunkMap chunks;                    // 续传时要传输的块，序列号对应的偏移经它换算到范围内
+    uint64_t stream_length;             // 本流实际传输的字节数(续传时只有需要的块)
+    std::vector<uint8_t> manifest_reply;    // 续传时FILE_NAME_ACK回复的位图(文件名包重传时原样回复)
+    SharedOutput* shared;               // 并行传输时各流共享的输出文件，单个流时为NULL
+    uint16_t flow_count;                // 本端配置的并行流数，必须与发送端一致
     uint64_t total_bytes_received;      // 总接收字节数
     uint64_t total_packets_received;    // 总接收包数
+    uint64_t retransmits_received;      // 收到的重传包数(头部带FLAG_RETRANSMIT)
+    uint64_t acks_sent;                 // 发送的ACK数
+    uint64_t fec_recovered;             // 用FEC修复包恢复的包数
+    std::vector<uint8_t> fec_scratch;   // 恢复缺失包时的异或缓冲区
+
+    // ==================== 诊断 ====================
+    TransferCounters counters;          // 重复包、乱序、校验和错误等事件的计数
+    LatencyHistogram ack_interval;      // 相邻两个ACK的发出间隔
+    std::chrono::steady_clock::time_point last_ack_time;    // 上一个ACK的发出时间
+    bool ack_sent_before;               // 本会话是否已发出过ACK
 
     // ==================== 连接管理 ====================
     bool client_locked;                 // 是否已锁定客户端(防止从其他地址接收数据)
     sockaddr_in client_addr;            // 锁定的客户端地址
 
-    int transfer_counter;               // 传输计数器(用于控制动画显示)
+    // ==================== 控制台输出 ====================
+    std::ostream* out;                  // 进度信息的输出位置(并行传输时每个流写入各自的缓冲，避免交错)
+    ReceiveStats stats;                 // 连接关闭时的统计
 
 public:
     // ==================== 构造函数 ====================
     // 功能: 初始化接收端，创建套接字并绑定端口
-    // 参数: bind_ip-绑定的IP地址, port-监听端口
-    Receiver(const char* bind_ip, uint16_t port) {
-        // 1. 创建 UDP 套接字
-        sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-        if (sockfd == INVALID_SOCKET) {
+    // 参数: bind_ip-绑定的IP地址, port-监听端口, shared-并行传输时各流共享的输出文件, flows-并行流数
+    Receiver(const char* bind_ip, uint16_t port, SharedOutput* shared = NULL, uint16_t flows = 1,
+             std::ostream& console_out = std::cout)
+        : udp(own_udp), send_lock(NULL), reorder(RECV_WINDOW_CAPACITY), present(RECV_WINDOW_CAPACITY),
+          shared(shared), flow_count(flows), out(&console_out) {
+        // 1. 创建 UDP 套接字(非阻塞，由udp.wait阻塞等待；收发缓冲区已放大)
+        if (!udp.create()) {
             std::cerr << "创建套接字失败，错误码: " << WSAGetLastError() << std::endl;
             exit(1);
         }
 
-        // 2. 设置为非阻塞模式
-        u_long mode = 1;
-        ioctlsocket(sockfd, FIONBIO, &mode);
-
         // 3. 配置本地地址信息
         memset(&local_addr, 0, sizeof(local_addr));
         local_addr.sin_family = AF_INET;
@@ -67,104 +219,217 @@ public:
         }
 
         // 4. 绑定套接字到本地地址
-        if (bind(sockfd, (struct sockaddr*)&local_addr, sizeof(local_addr)) == SOCKET_ERROR) {
+        if (!udp.bind(local_addr)) {
             std::cerr << "绑定失败，错误码: " << WSAGetLastError() << std::endl;
             exit(1);
         }
 
-        // 5. 初始化连接状态和序列号
-        sender_addr_len = sizeof(sender_addr);
+        // 5. 初始化连接状态、序列号和统计信息
+        reset_session();
+
+        console() << "\n════════ 接收端已启动 ════════" << std::endl;
+        console() << "监听端口: " << port << std::endl;
+        console() << "等待连接中..." << std::endl;
+    }
+
+    // 功能: 多会话服务端中的一个会话，使用服务端共享的套接字，不创建、不绑定套接字
+    // 参数: socket-共享的套接字(只用发送侧，接收由服务端的收包线程完成), lock-共享套接字的发送锁,
+    //       console_out-会话的进度信息
+    Receiver(DatagramSocket& socket, std::mutex& lock, std::ostream& console_out)
+        : udp(socket), send_lock(&lock), reorder(RECV_WINDOW_CAPACITY), present(RECV_WINDOW_CAPACITY),
+          shared(NULL), flow_count(1), out(&console_out) {
+        reset_session();
+    }
+
+    // ==================== 重置会话状态 ====================
+    // 功能: 回到等待SYN的初始状态，关闭上一个会话的输出文件
+    // 说明: 乱序缓冲槽位已分配的数据区保留下来，多会话服务端从会话池中取出的会话不再分配内存
+    void reset_session() {
+        if (output) output->close();
+        output.reset();
+        output_path.clear();
+        release_output_name();
         state = CLOSED;
         expected_seq = 0;
+        present.reset();
+        buffered = 0;
+        highest_seq = 0;
+        payload_size = DEFAULT_DATA_SIZE;
+        unacked_packets = 0;
+        direct_write = false;
+        data_base_seq = 0;
+        memset(&range, 0, sizeof(range));
+        chunks.clear();
+        stream_length = 0;
+        manifest_reply.clear();
 
-        // 6. 初始化统计信息
         total_bytes_received = 0;
         total_packets_received = 0;
+        retransmits_received = 0;
+        acks_sent = 0;
+        fec_recovered = 0;
+        stats = ReceiveStats();
+        counters.reset();
+        ack_interval.reset();
+        ack_sent_before = false;
 
-        // 7. 初始化连接管理
         client_locked = false;
         memset(&client_addr, 0, sizeof(client_addr));
-
-        transfer_counter = 0;
-
-        std::cout << "\n════════ 接收端已启动 ════════" << std::endl;
-        std::cout << "监听端口: " << port << std::endl;
-        std::cout << "等待连接中..." << std::endl;
+        memset(&sender_addr, 0, sizeof(sender_addr));
     }
 
     // ==================== 析构函数 ====================
     // 功能: 清理资源，关闭套接字和文件
     ~Receiver() {
-        if (sockfd != INVALID_SOCKET) {
-            closesocket(sockfd);
-        }
-        if (output_file.is_open()) {
-            output_file.close();
-        }
+        own_udp.close();
+        if (output) output->close();
+        release_output_name();
     }
 
     // ==================== 主运行循环 ====================
     // 功能: 接收并处理数据包，直到连接关闭
+    // 说明: 阻塞等待数据报到达，每次唤醒后读完套接字中的所有数据报
     void run() {
-        while (true) {
-            Packet packet;
-            // 1. 尝试接收数据包
-            if (receive_packet(packet)) {
-                // 2. 验证数据包校验和
-                if (!packet.verify_checksum()) {
-                    std::cerr << "校验和错误，丢弃数据包" << std::endl;
-                    continue;
-                }
+        auto next_spin = std::chrono::steady_clock::now();
+        while (state != CLOSED || !client_locked) {
+            // 1. 提交上一轮排队的ACK，等待数据报到达；有延迟的确认时最多等到确认期限
+            bool ready = unacked_packets > 0 ? udp.wait_until(ack_deadline) : udp.wait(-1);
+            if (!ready) {
+                if (unacked_packets > 0 && std::chrono::steady_clock::now() >= ack_deadline) send_ack();
+                continue;
+            }
 
-                // 3. 根据包类型分发处理
-                handle_packet(packet);
+            PacketView packet;
+            while (receive_packet(packet)) {
+                // 2. 验证校验和并按包类型分发处理
+                dispatch(packet);
 
-                // 4. 检查是否关闭连接
-                if (state == CLOSED) {
+                // 3. 检查是否关闭连接(收到FIN)
+                if (finished()) {
                     break;
                 }
+            }
 
-                // 5. 定期显示进度动画
-                if (++transfer_counter % 10 == 0 && state == ESTABLISHED) {
-                    show_spinner();
-                }
+            // 延迟确认期限已到(持续有数据到达时不会走到超时分支)
+            if (unacked_packets > 0 && std::chrono::steady_clock::now() >= ack_deadline) send_ack();
+
+            // 4. 定期显示进度动画
+            auto now = std::chrono::steady_clock::now();
+            if (state == ESTABLISHED && now >= next_spin && out == &std::cout) {
+                show_spinner();
+                next_spin = now + std::chrono::milliseconds(SPINNER_INTERVAL_MS);
             }
+        }
 
-            Sleep(1);  // 避免CPU占用过高
+        // 5. 清除进度动画
+        if (out == &std::cout) {
+            async_log().raw("\r \r");
+            async_log().flush();        // 之后的统计直接写 std::cout，先等动画写完
+        }
+        collect_stats();
+
+        // 6. 显示最终统计信息
+        console() << "\n════════ 接收完成 ════════" << std::endl;
+        console() << "──────────────────────────────" << std::endl;
+        console() << "  总接收字节:  " << total_bytes_received << std::endl;
+        console() << "  总接收包数:  " << total_packets_received << std::endl;
+        console() << "  重传包数:    " << retransmits_received << std::endl;
+        console() << "  发送ACK数:   " << acks_sent << std::endl;
+        console() << "  FEC恢复包数: " << fec_recovered << std::endl;
+        if (output) output->describe(console());
+        if (chunks.active()) {
+            console() << "  续传:        " << (chunks.total_chunks() - chunks.needed_chunks()) << "/"
+                      << chunks.total_chunks() << " 块已有, 未重传 " << stats.resumed_bytes << " 字节" << std::endl;
         }
+        console() << "  校验和内核:  " << checksum_kernel_name() << std::endl;
+        console() << "  系统调用:    " << udp.syscalls() << " 次, 每包 " << std::fixed << std::setprecision(3)
+                  << (udp.datagrams() ? static_cast<double>(udp.syscalls()) / udp.datagrams() : 0.0)
+                  << " (" << udp.mode_name() << ")" << std::endl;
+        console() << "  ACK间隔:     ";
+        stats.ack_interval.describe(console());
+        console() << std::endl << "  诊断计数:" << std::endl;
+        stats.counters.describe(console());
+        console() << "──────────────────────────────" << std::endl;
+    }
+
+    // 连接关闭时的统计
+    const ReceiveStats& receive_stats() const {
+        return stats;
+    }
+
+    // 功能: 汇总本会话的统计(多会话服务端中收发计数是共享套接字的总数)
+    void collect_stats() {
+        stats.bytes = total_bytes_received;
+        stats.packets = total_packets_received;
+        stats.retransmits = retransmits_received;
+        stats.acks = acks_sent;
+        stats.fec_recovered = fec_recovered;
+        stats.resumed_bytes = range.length - stream_length;
+        stats.syscalls = udp.syscalls();
+        stats.datagrams = udp.datagrams();
+        stats.counters = counters.snapshot();
+        stats.ack_interval = ack_interval.snapshot();
+    }
+
+    // ==================== 多会话服务端接口 ====================
+    // 说明: 以下由服务端持有该会话的分片线程调用，同一会话的调用总在同一个线程中
+
+    // 功能: 处理收包线程按 (地址, 端口, 连接ID) 分给本会话的一个数据包
+    // 参数: packet-已解析的数据包, from-发送端地址
+    void deliver(const PacketView& packet, const sockaddr_in& from) {
+        sender_addr = from;
+        total_packets_received++;
+        dispatch(packet);
+    }
+
+    // 是否有延迟的按序确认，以及它的确认期限
+    bool ack_pending() const { return unacked_packets > 0; }
+    std::chrono::steady_clock::time_point ack_due() const { return ack_deadline; }
 
-        // 6. 清除进度动画
-        printf("\r \r");
-        fflush(stdout);
+    // 功能: 确认期限已到时发送延迟的确认
+    void flush_ack(std::chrono::steady_clock::time_point now) {
+        if (unacked_packets > 0 && now >= ack_deadline) send_ack();
+    }
+
+    // 会话是否已收到FIN而关闭
+    bool finished() const { return state == CLOSED && client_locked; }
 
-        // 7. 显示最终统计信息
-        std::cout << "\n════════ 接收完成 ════════" << std::endl;
-        std::cout << "──────────────────────────────" << std::endl;
-        std::cout << "  总接收字节:  " << total_bytes_received << std::endl;
-        std::cout << "  总接收包数:  " << total_packets_received << std::endl;
-        std::cout << "──────────────────────────────" << std::endl;
+    // 功能: 会话超时未完成时放弃，关闭输出文件(已收到的数据留在文件中，发送端可以续传)
+    void abort_session() {
+        if (output) output->close();
     }
 
+    const std::string& output_name() const { return output_path; }
+
+    // 会话结束时注销登记的输出文件名，之后同一发送端可以重新用它续传
+    void release_output_name() {
+        if (claimed_output.empty()) return;
+        active_outputs.release(claimed_output);
+        claimed_output.clear();
+    }
+    bool output_failed() const { return output && output->failed(); }
+    const sockaddr_in& client() const { return client_addr; }
+
 private:
+    std::ostream& console() {
+        return *out;
+    }
+
     // ==================== 接收数据包方法 ====================
     // 功能: 从套接字接收数据包
-    // 参数: packet-存储接收到的数据包
+    // 参数: packet-指向接收缓冲区的数据包视图(下一次接收前有效)
     // 返回: true-成功接收，false-无数据
-    bool receive_packet(Packet& packet) {
-        uint8_t buffer[MAX_PACKET_SIZE * 2];
-
-        int recv_len = recvfrom(sockfd, reinterpret_cast<char*>(buffer),
-                                sizeof(buffer), 0,
-                                (struct sockaddr*)&sender_addr,
-                                &sender_addr_len);
-
-        if (recv_len > 0) {
+    bool receive_packet(PacketView& packet) {
+        const uint8_t* data = NULL;
+        size_t length = 0;
+        if (udp.receive(data, length, sender_addr)) {
             // 检查是否来自锁定的客户端(安全特性)
             if (client_locked && !same_endpoint(sender_addr, client_addr)) {
                 return false;  // 忽略来自其他地址的数据
             }
 
-            packet = Packet::deserialize(buffer, recv_len);  // 反序列化
+            // 在接收缓冲区上原地解析，长度不足的数据报丢弃
+            if (!packet.parse(data, length)) return false;
             total_packets_received++;
             return true;
         }
@@ -172,14 +437,32 @@ private:
         return false;  // 无数据可读(非阻塞模式)
     }
 
+    // ==================== 分发数据包方法 ====================
+    // 功能: 验证数据包校验和(DATA包在handle_data中验证，乱序数据在复制到槽位的同时求和)，再按类型处理
+    void dispatch(const PacketView& packet) {
+        if (packet.header.type != DATA && !packet.verify_checksum()) {
+            async_log().line(checksum_log_limit, LOG_COLOR_KEEP, "校验和错误，丢弃数据包", LOG_STDERR);
+            counters.add(COUNTER_CHECKSUM_FAILURES);
+            return;
+        }
+        handle_packet(packet);
+    }
+
+    // 多会话服务端中发送前取得共享套接字的发送锁，单独运行时不加锁
+    std::unique_lock<std::mutex> send_guard() {
+        return send_lock ? std::unique_lock<std::mutex>(*send_lock) : std::unique_lock<std::mutex>();
+    }
+
     // ==================== 发送数据包方法 ====================
     // 功能: 发送响应包(如ACK/SYN_ACK/FIN_ACK)
     // 参数: packet-要发送的数据包
     void send_packet(const Packet& packet) {
-        std::vector<uint8_t> buffer = packet.serialize();  // 序列化为字节流
-        sendto(sockfd, reinterpret_cast<const char*>(buffer.data()),
-               static_cast<int>(buffer.size()), 0,
-               (struct sockaddr*)&sender_addr, sender_addr_len);
+        std::unique_lock<std::mutex> guard = send_guard();
+        size_t capacity = 0;
+        uint8_t* out = udp.reserve(capacity);
+        size_t length = packet.serialize_to(out, capacity);  // 直接序列化到发送槽位
+        udp.commit(length, sender_addr);
+        udp.flush();    // 控制包立即提交
     }
 
     // ==================== 进度动画显示方法 ====================
@@ -187,15 +470,14 @@ private:
     void show_spinner() {
         static int spin_state = 0;
         const char spinners[] = { '|', '/', '-', '\\' };  // 四种状态的旋转符号
-        printf("\r%c", spinners[spin_state % 4]);
-        fflush(stdout);
+        async_log().raw(std::string("\r") + spinners[spin_state % 4]);    // 由输出线程写终端，不在收发循环里 flush
         spin_state++;
     }
 
     // ==================== 数据包分发处理方法 ====================
     // 功能: 根据数据包类型调用相应的处理函数
     // 参数: packet-接收到的数据包
-    void handle_packet(const Packet& packet) {
+    void handle_packet(const PacketView& packet) {
         switch (packet.header.type) {
             case SYN:        // 握手包
                 handle_syn(packet);
@@ -212,6 +494,9 @@ private:
             case FIN:        // 结束包
                 handle_fin(packet);
                 break;
+            case FEC_REPAIR: // 前向纠错修复包
+                handle_repair(packet);
+                break;
             default:
                 break;
         }
@@ -220,15 +505,15 @@ private:
     // ==================== 处理第三次握手ACK方法 ====================
     // 功能: 处理第三次握手的ACK包，完成连接建立
     // 参数: ack_packet-接收到的ACK包
-    void handle_ack_handshake(const Packet& ack_packet) {
+    void handle_ack_handshake(const PacketView& ack_packet) {
         // 只在SYN_RECEIVED状态下处理握手ACK
         if (state == SYN_RECEIVED) {
             // 验证ACK序列号是否正确
             if (ack_packet.header.ack_num == 1) {  // 期望确认服务端的序列号0+1
                 state = ESTABLISHED;
-                std::cout << "[✓] 收到第三次握手ACK，连接正式建立！" << std::endl;
+                console() << "[✓] 收到第三次握手ACK，连接正式建立！" << std::endl;
             } else {
-                std::cout << "[!] 收到无效的握手ACK，序列号不匹配" << std::endl;
+                console() << "[!] 收到无效的握手ACK，序列号不匹配" << std::endl;
             }
         }
         // 如果已经是ESTABLISHED状态，这个ACK可能是数据传输的ACK，这里不处理
@@ -237,28 +522,41 @@ private:
     // ==================== 处理SYN包方法 ====================
     // 功能: 处理连接建立请求，响应SYN_ACK
     // 参数: syn_packet-接收到的SYN包
-    void handle_syn(const Packet& syn_packet) {
+    void handle_syn(const PacketView& syn_packet) {
         // 1. 首次接收到SYN包时，锁定客户端地址
         if (!client_locked) {
             client_addr = sender_addr;
             client_locked = true;
-            std::cout << "\n========== 连接建立 ==========" << std::endl;
-            std::cout << "[✓] 已锁定客户端: " << inet_ntoa(client_addr.sin_addr)
+            console() << "\n========== 连接建立 ==========" << std::endl;
+            console() << "[✓] 已锁定客户端: " << inet_ntoa(client_addr.sin_addr)
                       << ":" << ntohs(client_addr.sin_port) << std::endl;
         }
 
-        std::cout << "[✓] 收到SYN，建立连接" << std::endl;
-
-        // 2. 构造并发送 SYN_ACK 响应
+        console() << "[✓] 收到SYN，建立连接" << std::endl;
+
+        // 2. 协商参数: 负载取发送端提议与本端路径MTU允许值的较小者，窗口为本端缓冲区容量
+        HandshakeOptions proposal;
+        bool negotiated = read_handshake_options(syn_packet, proposal);
+        HandshakeOptions accepted;
+        accepted.payload_size = negotiated ?
+            (std::min)(proposal.payload_size, path_payload_size(sender_addr)) : DEFAULT_DATA_SIZE;
+        accepted.flags = proposal.flags & (HANDSHAKE_FEC | HANDSHAKE_RESUME | HANDSHAKE_COMPRESS);   // 是否使用由文件名包决定
+        accepted.window = RECV_WINDOW_CAPACITY;
+        payload_size = accepted.payload_size;
+        console() << "[✓] 协商结果: 负载 " << payload_size << " 字节, 接收窗口 "
+                  << accepted.window << " 包" << std::endl;
+
+        // 3. 构造并发送 SYN_ACK 响应(旧版本发送端不携带协商参数，也不读取)
         Packet syn_ack;
         syn_ack.header.type = SYN_ACK;
         syn_ack.header.seq_num = 0;  // 服务端的初始序列号
         syn_ack.header.ack_num = syn_packet.header.seq_num + 1;
+        if (negotiated) write_handshake_options(syn_ack, accepted);
         syn_ack.header.checksum = htons(syn_ack.calculate_checksum());
 
         send_packet(syn_ack);
 
-        // 3. 更新状态和序列号，等待第三次握手
+        // 4. 更新状态和序列号，等待第三次握手
         expected_seq = syn_packet.header.seq_num + 1;
         state = SYN_RECEIVED;  // 进入SYN_RECEIVED状态，等待ACK
     }
@@ -266,42 +564,192 @@ private:
     // ==================== 处理数据包方法 ====================
     // 功能: 接收数据包，实现乱序重组和去重
     // 参数: data_packet-接收到的数据包
-    void handle_data(const Packet& data_packet) {
+    void handle_data(const PacketView& data_packet) {
         // 确保连接已建立才处理数据包
         if (state != ESTABLISHED) {
-            std::cout << "[!] 连接未建立，忽略数据包" << std::endl;
+            async_log().line(not_established_log_limit, LOG_COLOR_KEEP, "[!] 连接未建立，忽略数据包");
             return;
         }
         
         uint32_t seq = data_packet.header.seq_num;
+        uint16_t length = data_packet.header.data_length;
+
+        if (!output) {
+            async_log().line(no_file_name_log_limit, LOG_COLOR_KEEP, "[!] 尚未收到文件名，忽略数据包");
+            return;
+        }
+
+        // 1. 新数据(落在接收窗口内且尚未收到)边复制到目标位置边验证校验和，数据只读一遍:
+        //    直接写入模式复制到输出文件中的对应位置；否则乱序数据复制到乱序缓冲槽位，按序数据在验证后写出
+        //    其余情况(重复包、超出窗口的包)直接验证
+        bool fresh = seq >= expected_seq && seq < expected_seq + RECV_WINDOW_CAPACITY && !present.test(seq);
+        bool in_order = seq == expected_seq;
+        uint8_t* target = NULL;
+        if (fresh && direct_write) {
+            target = file_target(seq, length);
+            if (!target) {
+                async_log().line(range_log_limit, LOG_COLOR_KEEP, "[!] 数据包超出文件范围，丢弃 seq=" + std::to_string(seq), LOG_STDERR);
+                return;
+            }
+        } else if (fresh && !in_order) {
+            RecvSlot& slot = reorder[seq % RECV_WINDOW_CAPACITY];
+            if (slot.data.size() < length) slot.data.resize((std::max)(length, payload_size));
+            slot.length = length;
+            target = slot.data.data();
+        }
+        if (target) {
+            // 校验失败的数据留在目标位置也无妨: 该序列号没有标记为已收到，重传的副本会覆盖它
+            uint32_t sum = checksum_copy(data_packet.header_sum(), target, data_packet.data, length);
+            if (checksum_finish(sum) != 0x0000) {
+                async_log().line(checksum_log_limit, LOG_COLOR_KEEP, "校验和错误，丢弃数据包", LOG_STDERR);
+                counters.add(COUNTER_CHECKSUM_FAILURES);
+                return;
+            }
+        } else if (!data_packet.verify_checksum()) {
+            async_log().line(checksum_log_limit, LOG_COLOR_KEEP, "校验和错误，丢弃数据包", LOG_STDERR);
+            counters.add(COUNTER_CHECKSUM_FAILURES);
+            return;
+        }
+        bool retransmitted = (data_packet.header.flags & FLAG_RETRANSMIT) != 0;
+        if (retransmitted) retransmits_received++;
 
-        // 1. 检查是否为重复数据(去重)
-        if (received_seqs.find(seq) == received_seqs.end()) {
-            // 2. 存储新接收的数据包
-            recv_buffer[seq] = data_packet;
-            received_seqs.insert(seq);
-            total_bytes_received += data_packet.header.data_length;
+        // 超出接收窗口的数据没有缓冲空间，丢弃(发送端遵守通告窗口时不会出现)
+        if (seq >= expected_seq + RECV_WINDOW_CAPACITY) {
+            counters.add(COUNTER_BEYOND_WINDOW);
+            send_ack(seq);
+            return;
         }
 
-        // 3. 乱序重组: 将连续的数据写入文件
-        while (recv_buffer.find(expected_seq) != recv_buffer.end()) {
-            const Packet& pkt = recv_buffer[expected_seq];
-            output_file.write(reinterpret_cast<const char*>(pkt.data),
-                            pkt.header.data_length);
-            recv_buffer.erase(expected_seq);  // 移除已处理的包
+        // 已有的数据又到了一份: 重传的副本说明原来的包没有丢，这次重传是多余的
+        if (!fresh) {
+            counters.add(COUNTER_DUPLICATE_PACKETS);
+            if (retransmitted) counters.add(COUNTER_SPURIOUS_RETRANSMITS);
+        } else if (!in_order) {
+            counters.add(COUNTER_OUT_OF_ORDER);
+        }
+
+        // 2. 登记新数据并乱序重组；已收到的旧数据是重复包，只需重新确认
+        bool had_gap = buffered > 0;
+        if (fresh) accept(seq, length, data_packet.data);
+
+        // 3. 发送ACK确认: 没有空洞时按序数据延迟确认(每DELAYED_ACK_PACKETS个或DELAYED_ACK_US后一次)；
+        //    乱序、重复、填补空洞的包立即确认，发送端尽快得到SACK信息
+        if (!in_order || had_gap) {
+            send_ack(seq);
+            return;
+        }
+        if (unacked_packets++ == 0) {
+            ack_deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(DELAYED_ACK_US);
+        }
+        if (unacked_packets >= DELAYED_ACK_PACKETS) send_ack();
+    }
+
+    // ==================== 登记新数据方法 ====================
+    // 功能: 新数据已复制到文件或乱序缓冲槽位后登记为已收到，再把接续的数据交给输出文件
+    // 参数: data-按序到达且不是直接写入时，要顺序写出的数据
+    void accept(uint32_t seq, uint16_t length, const uint8_t* data) {
+        total_bytes_received += length;
+        if (seq == expected_seq) {
+            // 1. 按序到达: 直接写入模式下数据已在文件中；否则直接从接收缓冲区写出，不经过乱序缓冲
+            if (!direct_write) output->append(data, length);
+            expected_seq++;
+        } else {
+            // 2. 乱序到达: 数据已复制到文件或槽位，标记为已收到
+            present.set(seq);
+            buffered++;
+            if (seq + 1 > highest_seq) highest_seq = seq + 1;
+        }
+
+        // 3. 乱序重组: 接续的数据已在文件中时只需推进期望序列号，否则从槽位写出
+        while (buffered > 0 && present.test(expected_seq)) {
+            if (!direct_write) {
+                RecvSlot& slot = reorder[expected_seq % RECV_WINDOW_CAPACITY];
+                output->append(slot.data.data(), slot.length);
+            }
+            present.clear(expected_seq);  // 位图(和槽位)留给以后的包
+            buffered--;
             expected_seq++;  // 更新期望序列号
         }
+    }
 
-        // 4. 发送ACK确认
-        send_ack();
+    // ==================== 处理修复包方法 ====================
+    // 功能: 块中只缺一个包时，用修复包和块中其余的包(已在输出文件中)异或出缺失的包
+    // 参数: repair-FEC修复包(seq_num为块的第一个序列号，ack_num为块中的包数)
+    // 说明: 只在按偏移直接写入时恢复(其余的包必须仍然可读)；缺两个及以上时丢弃，交给重传。
+    //       恢复的包与收到的包同样登记，立即发送带FLAG_FEC_RECOVERED的ACK，发送端不必再重传它
+    void handle_repair(const PacketView& repair) {
+        if (state != ESTABLISHED || !output || !direct_write) return;
+        uint32_t first = repair.header.seq_num;
+        uint32_t count = repair.header.ack_num;
+        if (count == 0 || count > FEC_MAX_GROUP || first < data_base_seq) return;
+        uint32_t end = first + count;
+        if (end <= expected_seq || end > expected_seq + RECV_WINDOW_CAPACITY) return;  // 已全部收到或超出窗口
+
+        // 1. 找出块中缺失的包(期望序列号之前的都已收到)
+        uint32_t missing = 0;
+        uint32_t missing_count = 0;
+        for (uint32_t seq = (std::max)(first, expected_seq); seq < end && missing_count < 2; ++seq) {
+            if (!present.test(seq)) {
+                missing = seq;
+                missing_count++;
+            }
+        }
+        if (missing_count != 1) return;
+
+        // 2. 缺失包的长度由它在文件中的位置确定，修复包的长度是块中最长的包
+        uint16_t length = packet_length(missing);
+        if (length == 0 || length > repair.header.data_length) return;
+
+        // 3. 修复包异或块中其余的包，得到缺失包的数据(只需前length字节)
+        if (fec_scratch.size() < length) fec_scratch.resize(payload_size);
+        memcpy(fec_scratch.data(), repair.data, length);
+        for (uint32_t seq = first; seq < end; ++seq) {
+            if (seq == missing) continue;
+            uint16_t other = packet_length(seq);
+            const uint8_t* p = file_target(seq, other);
+            if (!p) return;
+            fec_xor(fec_scratch.data(), p, (std::min)(other, length));
+        }
+        uint8_t* target = file_target(missing, length);
+        if (!target) return;
+        memcpy(target, fec_scratch.data(), length);
+
+        // 4. 登记并立即确认
+        fec_recovered++;
+        accept(missing, length, target);
+        send_ack(missing, FLAG_FEC_RECOVERED);
+    }
+
+    // 功能: 直接写入模式下序列号seq的包应有的长度(只有范围内的最后一个包可以短于负载大小)
+    // 返回: 0-超出本流负责的范围
+    uint16_t packet_length(uint32_t seq) const {
+        uint64_t offset = static_cast<uint64_t>(seq - data_base_seq) * payload_size;
+        if (offset >= stream_length) return 0;
+        return static_cast<uint16_t>((std::min)(static_cast<uint64_t>(payload_size), stream_length - offset));
+    }
+
+    // ==================== 直接写入位置 ====================
+    // 功能: 计算数据包在输出文件中的位置并取得该处的可写内存
+    // 返回: NULL-超出本流负责的范围，或长度与位置不符(只有范围内的最后一个包可以短于负载大小)
+    // 说明: 续传时序列号按要传输的块拼接后编号，块大小是负载大小的整数倍，一个包不会跨块
+    uint8_t* file_target(uint32_t seq, uint16_t length) {
+        uint64_t offset = static_cast<uint64_t>(seq - data_base_seq) * payload_size;
+        uint64_t size = stream_length;
+        if (offset > size || length > size - offset) return NULL;
+        if (length != payload_size && offset + length != size) return NULL;
+        uint64_t at = offset < size ? chunks.to_range(offset) : range.length;
+        return output->reserve(range.offset + at, length);
     }
 
     // ==================== 处理FIN包方法 ====================
     // 功能: 处理连接关闭请求，响应FIN_ACK
     // 参数: fin_packet-接收到的FIN包
-    void handle_fin(const Packet& fin_packet) {
-        std::cout << "\n========== 连接关闭 ==========" << std::endl;
-        std::cout << "[✓] 收到FIN，关闭连接" << std::endl;
+    void handle_fin(const PacketView& fin_packet) {
+        bool repeated = finished();     // FIN_ACK丢失，发送端重传了FIN: 只需再次确认
+        if (!repeated) {
+            console() << "\n========== 连接关闭 ==========" << std::endl;
+            console() << "[✓] 收到FIN，关闭连接" << std::endl;
+        }
 
         // 1. 构造并发送 FIN_ACK 响应
         Packet fin_ack;
@@ -310,111 +758,240 @@ private:
         fin_ack.header.checksum = htons(fin_ack.calculate_checksum());
 
         send_packet(fin_ack);
+        if (repeated) return;
 
-        // 2. 关闭连接和文件
+        // 2. 关闭连接和文件(压缩传输时等待剩余的块解压完成)
         state = CLOSED;
-        output_file.close();
+        if (output) {
+            output->close();
+            if (output->failed()) async_log().line("[✗] 压缩数据不完整或已损坏，输出文件有误", LOG_STDERR);
+        }
 
-        std::cout << "[✓] 连接已安全关闭！" << std::endl;
+        console() << "[✓] 连接已安全关闭！" << std::endl;
     }
 
     // ==================== 处理文件名包方法 ====================
     // 功能: 接收文件名并创建输出文件
     // 参数: name_packet-包含文件名的数据包
-    void handle_file_name(const Packet& name_packet) {
+    void handle_file_name(const PacketView& name_packet) {
+        // 发送端收到SYN_ACK后才会发文件名，第三次握手ACK丢失时以文件名包作为握手完成
+        if (state == SYN_RECEIVED) {
+            state = ESTABLISHED;
+            console() << "[✓] 握手ACK未到达，收到文件名包，连接建立" << std::endl;
+        }
         // 确保连接已建立才处理文件名包
         if (state != ESTABLISHED) {
-            std::cout << "[!] 连接未建立，忽略文件名包" << std::endl;
+            console() << "[!] 连接未建立，忽略文件名包" << std::endl;
             return;
         }
         
-        if (name_packet.header.data_length > 0) {
-            // 1. 提取文件名
-            uint16_t len = name_packet.header.data_length;
-            if (len > MAX_DATA_SIZE) len = MAX_DATA_SIZE;
-            std::string orig(reinterpret_cast<const char*>(name_packet.data), len);
+        // FILE_NAME_ACK丢失时发送端会重传文件名，输出文件已创建时只需再次确认
+        if (!output) {
+            // 1. 提取文件名、文件大小(发送端知道大小时携带)和本流负责的范围
+            FileInfo info;
+            if (!read_file_name(name_packet.data, name_packet.header.data_length, info)) {
+                async_log().line("[✗] 文件名包中的分段范围无效", LOG_STDERR);
+                return;
+            }
+            if (info.range.flow_count != flow_count) {
+                async_log().line("[✗] 发送端使用 " + std::to_string(info.range.flow_count) + " 个流，本端配置为 " +
+                                 std::to_string(flow_count) + " 个，不接收该文件", LOG_STDERR);
+                return;
+            }
+            const std::string& orig = info.name;
 
             // 2. 提取文件基名(移除路径)
             size_t slash_pos = orig.find_last_of("/\\");
             std::string basename = (slash_pos != std::string::npos) ? 
                                    orig.substr(slash_pos + 1) : orig;
 
-            // 3. 拆分文件名和扩展名
-            std::string name_only, ext;
-            size_t dot_pos = basename.find_last_of('.');
-            if (dot_pos != std::string::npos) {
-                name_only = basename.substr(0, dot_pos);
-                ext = basename.substr(dot_pos);
+            // 3. 构造输出文件名(添加"_output"后缀)，没有文件名时使用默认名
+            std::string output_name;
+            console() << "\n========== 数据接收 ==========" << std::endl;
+            if (basename.empty()) {
+                console() << "[!] 收到空的文件名，使用默认 output 文件名" << std::endl;
+                output_name = "output";
             } else {
-                name_only = basename;
-                ext = std::string();
+                // 拆分文件名和扩展名
+                std::string name_only, ext;
+                size_t dot_pos = basename.find_last_of('.');
+                if (dot_pos != std::string::npos) {
+                    name_only = basename.substr(0, dot_pos);
+                    ext = basename.substr(dot_pos);
+                } else {
+                    name_only = basename;
+                    ext = std::string();
+                }
+                output_name = name_only + "_output" + ext;
+            }
+            // 多会话服务端: 加上发送端的IP，不同发送端的同名文件互不覆盖；源端口每次连接都会变，
+            // 不放进名字里，同一发送端重新连接时才能找到上次的文件和清单续传
+            // 创建失败后发送端重传文件名时沿用已登记的名字
+            if (send_lock) {
+                if (claimed_output.empty()) {
+                    std::string by_ip = std::string(inet_ntoa(client_addr.sin_addr)) + "_" + output_name;
+                    if (active_outputs.claim(by_ip)) {
+                        claimed_output = by_ip;
+                    } else {
+                        // 同一IP的另一个会话正在写同名文件，本会话不能续传，改用带端口的名字
+                        std::ostringstream prefix;
+                        prefix << inet_ntoa(client_addr.sin_addr) << "_" << ntohs(client_addr.sin_port) << "_";
+                        claimed_output = prefix.str() + output_name;
+                        active_outputs.claim(claimed_output);
+                    }
+                }
+                output_name = claimed_output;
             }
 
-            // 4. 构造输出文件名(添加"_output"后缀)
-            std::string output_name = name_only + "_output" + ext;
-            std::cout << "\n========== 数据接收 ==========" << std::endl;
-            output_file.open(output_name, std::ios::binary);
-            if (!output_file.is_open()) {
-                std::cerr << "[✗] 无法创建输出文件: " << output_name << std::endl;
+            // 4. 创建输出文件: 已知大小时预分配并直接按偏移写入；并行传输时第一个收到文件名的流创建，其余流共享
+            // 携带续传清单时保留已有的同名输出文件；创建失败时不确认，发送端重传文件名时再次尝试，重试耗尽后报告失败
+            bool resume = info.chunk_size > 0;
+            if (shared) {
+                std::lock_guard<std::mutex> guard(shared->lock);
+                if (!shared->file) shared->file = FileSink::create(output_name, info.size_known, info.size, resume);
+                if (shared->file) output = shared->file->share();
             } else {
-                std::cout << "[✓] 输出文件已创建: " << output_name << std::endl;
+                output = FileSink::create(output_name, info.size_known, info.size, resume);
+            }
+            if (!output) {
+                async_log().line("[✗] 无法创建输出文件: " + output_name, LOG_STDERR);
+                return;
+            }
+            output_path = output_name;
+            direct_write = output->random_access();
+            data_base_seq = expected_seq;
+            range = info.range;
+            stream_length = range.length;
+            if (resume) compare_manifest(info);
+
+            // 5. 压缩传输: 按序收到的数据拆成块，由工作线程解压到文件中的位置(并行时各流平分线程)
+            bool compressed = (name_packet.header.flags & FLAG_COMPRESSED) != 0 && info.size_known;
+            if (compressed) {
+                unsigned threads = (std::max)(1u, codec_threads() / (std::max)(static_cast<unsigned>(flow_count), 1u));
+                output.reset(new DecompressingSink(std::move(output), range.offset, chunks, stream_length, threads));
+                direct_write = false;
+            }
+            console() << "[✓] 输出文件已创建: " << output_name;
+            if (compressed) {
+                console() << " (预分配 " << info.size << " 字节，分块解压后写入)";
+            } else if (direct_write && flow_count > 1) {
+                console() << " (流 " << range.flow_index << ": 偏移 " << range.offset << ", " << range.length << " 字节)";
+            } else if (direct_write) {
+                console() << " (预分配 " << info.size << " 字节，按偏移直接写入)";
+            } else {
+                console() << " (大小未知，顺序写出)";
+            }
+            console() << std::endl;
+            if (chunks.active()) {
+                console() << "[✓] 续传: 已有 " << (chunks.total_chunks() - chunks.needed_chunks()) << "/"
+                          << chunks.total_chunks() << " 块 (块大小 " << chunks.chunk() << " 字节)，需要传输 "
+                          << stream_length << " 字节" << std::endl;
             }
-        } else {
-            // 5. 如果没有文件名，使用默认名
-            std::cout << "\n========== 数据接收 ==========" << std::endl;
-            std::cout << "[!] 收到空的文件名，使用默认 output 文件名" << std::endl;
-            output_file.open("output", std::ios::binary);
         }
 
-        // 6. 发送文件名确认
+        // 6. 发送文件名确认(续传时携带需要传输的块的位图)
         Packet file_name_ack;
         file_name_ack.header.type = FILE_NAME_ACK;
         file_name_ack.header.ack_num = name_packet.header.seq_num + 1;
+        file_name_ack.header.data_length = static_cast<uint16_t>(manifest_reply.size());
+        if (!manifest_reply.empty()) memcpy(file_name_ack.data, manifest_reply.data(), manifest_reply.size());
         file_name_ack.header.checksum = htons(file_name_ack.calculate_checksum());
         send_packet(file_name_ack);
-        std::cout << "[✓] 已发送FILE_NAME确认" << std::endl;
+        console() << "[✓] 已发送FILE_NAME确认" << std::endl;
     }
 
-    // ==================== 发送ACK确认方法 ====================
-    // 功能: 发送带SACK信息的ACK确认包
-    // 特点: 支持选择性确认(SACK)，告知发送方哪些乱序包已接收
-    void send_ack() {
-        Packet ack_packet;
-        ack_packet.header.type = ACK;
-        ack_packet.header.ack_num = expected_seq;  // 期望接收的下一个序列号
-        ack_packet.header.window_size = WINDOW_SIZE;
-
-        std::vector<SACKBlock> sack_blocks;
-
-        // 构造SACK块: 找出所有乱序到达的连续区间
-        auto it = received_seqs.upper_bound(expected_seq);  // 找到第一个大于expected_seq的序列号
-        while (it != received_seqs.end() && sack_blocks.size() < 3) {  // 最多3个SACK块
-            uint32_t left = *it;
-            uint32_t right = left + 1;
-
-            // 找到连续区间的右边界
-            auto next_it = it;
-            ++next_it;
-            while (next_it != received_seqs.end() && *next_it == right) {
-                right++;
-                ++next_it;
+    // ==================== 比较续传清单 ====================
+    // 功能: 对已有输出文件中完整保留下来的块计算哈希，与发送端的清单比较，得出需要传输的块
+    // 说明: 按顺序写出时(映射失败)已有内容被截断，全部块都需要传输；位图中需要传输的块为1
+    void compare_manifest(const FileInfo& info) {
+        size_t count = info.chunk_hashes.size();
+        uint32_t chunk = info.chunk_size;
+
+        // 1. 范围内完整落在保留内容中的块(保留内容从文件开头起，所以是一段前缀)
+        size_t hashable = 0;
+        uint64_t preserved = direct_write ? output->preserved_size() : 0;
+        if (preserved > range.offset) {
+            uint64_t have = (std::min)(preserved - range.offset, range.length);
+            hashable = have == range.length ? count : static_cast<size_t>(have / chunk);
+        }
+        std::vector<uint64_t> local;
+        if (hashable > 0 && !output->hash_chunks(range.offset, range.length, chunk, hashable, local)) hashable = 0;
+
+        // 2. 位图: 没有保留或哈希不同的块需要传输
+        manifest_reply.assign((count + 7) / 8, 0);
+        for (size_t i = 0; i < count; ++i) {
+            if (i >= hashable || local[i] != info.chunk_hashes[i]) {
+                manifest_reply[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
             }
+        }
+        chunks.assign(range.length, chunk, manifest_reply.data(), manifest_reply.size());
+        stream_length = chunks.transfer_length(range.length);
+    }
 
-            // 添加SACK块
-            SACKBlock sack;
-            sack.left_edge = left;
-            sack.right_edge = right;
-            sack_blocks.push_back(sack);
-
-            it = next_it;
+    // ==================== 发送ACK确认方法 ====================
+    // 功能: 发送带SACK信息的ACK确认包，同时确认所有延迟的按序数据
+    // 参数: latest-触发本次确认的包的序列号, flags-ACK头部的标志位(FLAG_FEC_RECOVERED)
+    // 特点: 按RFC 2018，第一个SACK块是包含最近到达的包的区间，其余按序列号从小到大；
+    //       区间由记分板按字扫描得到，代价与窗口大小有关而与文件大小无关
+    void send_ack(uint32_t latest = 0, uint8_t flags = 0) {
+        PacketHeader header;
+        header.type = ACK;
+        header.flags = flags;
+        header.ack_num = expected_seq;  // 期望接收的下一个序列号
+        header.window_size = static_cast<uint16_t>(advertised_window());
+
+        // 构造SACK块(最多MAX_SACK_BLOCKS个)
+        SACKBlock sack_blocks[MAX_SACK_BLOCKS];
+        uint32_t sack_count = 0;
+        uint32_t latest_left = 0;
+        if (buffered > 0 && latest > expected_seq && latest < highest_seq && present.test(latest)) {
+            // 1. 包含最近到达的包的区间
+            latest_left = latest;
+            while (latest_left - 1 > expected_seq && present.test(latest_left - 1)) latest_left--;
+            sack_blocks[0].left_edge = latest_left;
+            sack_blocks[0].right_edge = present.find(latest, highest_seq, false);
+            sack_count = 1;
+        }
+        // 2. 其余区间从小到大
+        uint32_t seq = expected_seq + 1;
+        while (buffered > 0 && sack_count < MAX_SACK_BLOCKS) {
+            uint32_t left = present.find(seq, highest_seq, true);
+            if (left >= highest_seq) break;
+            uint32_t right = present.find(left, highest_seq, false);
+            seq = right;
+            if (left == latest_left) continue;
+            sack_blocks[sack_count].left_edge = left;
+            sack_blocks[sack_count].right_edge = right;
+            sack_count++;
         }
 
-        // 设置SACK信息并计算校验和
-        ack_packet.sack_blocks = sack_blocks;
-        ack_packet.header.sack_count = static_cast<uint32_t>(sack_blocks.size());
-        ack_packet.header.checksum = htons(ack_packet.calculate_checksum());
+        // 直接在发送槽位中组装ACK并计算校验和；一次唤醒中产生的ACK在下次等待前一起提交
+        std::unique_lock<std::mutex> guard = send_guard();
+        size_t capacity = 0;
+        uint8_t* out = udp.reserve(capacity);
+        size_t length = write_packet(out, capacity, header, NULL, 0, sack_blocks, sack_count);
+        udp.commit(length, sender_addr);
+        unacked_packets = 0;
+        acks_sent++;
+
+        auto now = std::chrono::steady_clock::now();
+        if (ack_sent_before) ack_interval.record(now - last_ack_time);
+        last_ack_time = now;
+        ack_sent_before = true;
+    }
 
-        send_packet(ack_packet);
+    // ==================== 通告窗口方法 ====================
+    // 功能: 按缓冲区的实际空闲空间计算通告窗口(数据包个数)
+    // 说明: 乱序到达、等待前面的包补齐的数据占用缓冲区，按序数据立即写入文件不占用；
+    //       输出跟不上时(如解压队列将满)再按它还能接收的字节数缩小，队列占满时窗口为0，发送端只发窗口探测
+    uint32_t advertised_window() const {
+        uint32_t used = buffered;
+        uint32_t free_slots = used < RECV_WINDOW_CAPACITY ? RECV_WINDOW_CAPACITY - used : 0;
+        if (output) {
+            size_t room = output->accept_capacity();
+            if (room != SIZE_MAX) free_slots = static_cast<uint32_t>((std::min)(static_cast<size_t>(free_slots), room / payload_size));
+        }
+        return (std::min)(free_slots, 65535u);  // window_size 字段为16位
     }
 
     // ==================== 比较地址方法 ====================
@@ -426,21 +1003,428 @@ private:
     }
 };
 
+// ==================== 多会话服务端 ====================
+// 功能: 在一个端口上同时接收多个发送端的传输，每个传输完成后继续服务
+// 结构: 收包线程从共享套接字读出数据报，按 (地址, 端口, 连接ID) 的哈希分给分片线程；
+//       每个分片线程独占自己的会话表，会话状态(Receiver)只在一个线程中访问，不需要加锁；
+//       发送时各分片线程在发送锁内使用套接字的发送侧，每批数据报处理完后提交一次
+// 说明: 会话由SYN创建，从分片的会话池中取出，释放时重置后放回；收到FIN后保留SESSION_LINGER_MS
+//       以便再次确认重传的FIN，超过SESSION_IDLE_TIMEOUT_MS没有收到包的会话关闭；并行多流传输不在此模式中支持
+
+// 会话标识: 发送端地址、端口和连接ID(发送端包头的window_size字段)
+struct SessionKey {
+    uint32_t addr;
+    uint16_t port;
+    uint16_t id;
+
+    bool operator==(const SessionKey& other) const {
+        return addr == other.addr && port == other.port && id == other.id;
+    }
+};
+
+struct SessionKeyHash {
+    size_t operator()(const SessionKey& key) const {
+        uint64_t x = (static_cast<uint64_t>(key.addr) << 32) | (static_cast<uint64_t>(key.port) << 16) | key.id;
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDull;
+        x ^= x >> 33;
+        return static_cast<size_t>(x);
+    }
+};
+
+// 收包线程复制给分片线程的数据报(缓冲区在分片中重复使用)
+struct InboundDatagram {
+    SessionKey key;
+    sockaddr_in from;
+    size_t length;
+    uint8_t data[IO_SLOT_SIZE];
+};
+
+// 一个会话: 会话状态和它的进度信息(不显示，会话结束时只显示一行摘要)
+struct Session {
+    std::ostringstream log;
+    std::unique_ptr<Receiver> receiver;
+    SessionKey key;
+    bool ack_queued;                                    // 是否已在分片的延迟确认列表中
+    std::chrono::steady_clock::time_point started;      // 收到SYN的时间
+    std::chrono::steady_clock::time_point last_activity;    // 最近一次收到包的时间
+
+    Session(DatagramSocket& udp, std::mutex& send_lock) : ack_queued(false) {
+        memset(&key, 0, sizeof(key));
+        receiver.reset(new Receiver(udp, send_lock, log));
+    }
+};
+
+class SessionServer {
+public:
+    // 功能: 创建并绑定共享的套接字
+    // 参数: bind_ip-绑定的IP地址, port-监听端口, shard_count-分片线程数
+    SessionServer(const char* bind_ip, uint16_t port, unsigned shard_count)
+        : shards(shard_count), active_sessions(0), completed_sessions(0) {
+        if (!udp.create()) {
+            std::cerr << "创建套接字失败，错误码: " << WSAGetLastError() << std::endl;
+            exit(1);
+        }
+        sockaddr_in local_addr;
+        memset(&local_addr, 0, sizeof(local_addr));
+        local_addr.sin_family = AF_INET;
+        local_addr.sin_port = htons(port);
+        local_addr.sin_addr.s_addr = inet_addr(bind_ip);
+        if (local_addr.sin_addr.s_addr == INADDR_NONE) {
+            std::cerr << "非法的服务器IP地址" << std::endl;
+            exit(1);
+        }
+        if (!udp.bind(local_addr)) {
+            std::cerr << "绑定失败，错误码: " << WSAGetLastError() << std::endl;
+            exit(1);
+        }
+        for (auto& shard : shards) shard.reset(new Shard);
+
+        std::cout << "\n════════ 多会话服务端已启动 ════════" << std::endl;
+        std::cout << "监听端口: " << port << " (" << udp.mode_name() << ", " << shard_count << " 个分片线程, 最多 "
+                  << SERVER_MAX_SESSIONS << " 个会话)" << std::endl;
+        std::cout << "等待连接中... (Ctrl+C 退出)" << std::endl;
+    }
+
+    // 功能: 启动分片线程，在当前线程收包，一直运行到进程退出
+    void run() {
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            workers.emplace_back([this, i]() { serve(*shards[i]); });
+        }
+        receive_loop();
+        for (auto& t : workers) t.join();
+    }
+
+private:
+    // 分片: 收包线程与分片线程之间的队列，以及分片线程独占的会话表和会话池
+    struct Shard {
+        std::mutex lock;                                        // 保护inbox和spare
+        std::condition_variable ready;
+        std::vector<std::unique_ptr<InboundDatagram>> inbox;    // 待处理的数据报
+        std::vector<std::unique_ptr<InboundDatagram>> spare;    // 空闲的数据报缓冲
+        uint64_t dropped;                                       // 积压过多时丢弃的数据报数
+
+        std::unordered_map<SessionKey, Session*, SessionKeyHash> sessions;  // 以下只由分片线程访问
+        std::vector<std::unique_ptr<Session>> owned;            // 分片创建过的全部会话
+        std::vector<Session*> pool;                             // 已释放、可重复使用的会话
+        std::vector<Session*> pending_acks;                     // 有延迟确认的会话
+
+        Shard() : dropped(0) {}
+    };
+
+    DatagramSocket udp;                         // 共享的套接字: 收包线程接收，分片线程在send_lock内发送
+    std::mutex send_lock;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<uint32_t> active_sessions;      // 所有分片中的会话数，不超过SERVER_MAX_SESSIONS
+    std::atomic<uint64_t> completed_sessions;   // 已完成的会话数
+
+    // ==================== 收包线程 ====================
+    // 功能: 读出套接字中的所有数据报，复制到对应分片的队列；每个分片每批只唤醒一次
+    void receive_loop() {
+        std::vector<bool> touched(shards.size(), false);
+        while (true) {
+            if (!udp.wait_receive(-1)) continue;
+            const uint8_t* data = NULL;
+            size_t length = 0;
+            sockaddr_in from;
+            while (udp.receive(data, length, from)) {
+                // 1. 长度不足一个包头的数据报没有连接ID，丢弃
+                PacketView packet;
+                if (length > IO_SLOT_SIZE || !packet.parse(data, length)) continue;
+                SessionKey key;
+                key.addr = from.sin_addr.s_addr;
+                key.port = from.sin_port;
+                key.id = packet.header.window_size;
+                size_t index = SessionKeyHash()(key) % shards.size();
+                Shard& shard = *shards[index];
+
+                // 2. 复制到分片的空闲缓冲并排队
+                std::lock_guard<std::mutex> guard(shard.lock);
+                if (shard.inbox.size() >= SERVER_SHARD_BACKLOG) {
+                    shard.dropped++;
+                    continue;
+                }
+                std::unique_ptr<InboundDatagram> datagram;
+                if (shard.spare.empty()) {
+                    datagram.reset(new InboundDatagram);
+                } else {
+                    datagram = std::move(shard.spare.back());
+                    shard.spare.pop_back();
+                }
+                datagram->key = key;
+                datagram->from = from;
+                datagram->length = length;
+                memcpy(datagram->data, data, length);
+                shard.inbox.push_back(std::move(datagram));
+                touched[index] = true;
+            }
+            for (size_t i = 0; i < shards.size(); ++i) {
+                if (!touched[i]) continue;
+                shards[i]->ready.notify_one();
+                touched[i] = false;
+            }
+        }
+    }
+
+    // ==================== 分片线程 ====================
+    // 功能: 处理分给本分片的数据报，按期发送延迟的确认、清理结束和超时的会话
+    void serve(Shard& shard) {
+        std::vector<std::unique_ptr<InboundDatagram>> batch;
+        auto next_sweep = std::chrono::steady_clock::now() + std::chrono::milliseconds(SESSION_SWEEP_MS);
+        while (true) {
+            // 1. 归还上一批的缓冲，等待新的数据报，最多等到最早的确认期限或下一次清理
+            {
+                std::unique_lock<std::mutex> guard(shard.lock);
+                for (auto& datagram : batch) {
+                    if (shard.spare.size() < IO_RECV_SLOTS) shard.spare.push_back(std::move(datagram));
+                }
+                batch.clear();
+                auto deadline = next_sweep;
+                for (Session* session : shard.pending_acks) {
+                    if (session->receiver->ack_due() < deadline) deadline = session->receiver->ack_due();
+                }
+                if (shard.inbox.empty()) shard.ready.wait_until(guard, deadline);
+                batch.swap(shard.inbox);
+            }
+
+            // 2. 交给各自的会话
+            auto now = std::chrono::steady_clock::now();
+            for (auto& datagram : batch) deliver(shard, *datagram, now);
+
+            // 3. 期限已到的延迟确认
+            now = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < shard.pending_acks.size();) {
+                Session* session = shard.pending_acks[i];
+                session->receiver->flush_ack(now);
+                if (session->receiver->ack_pending()) {
+                    ++i;
+                    continue;
+                }
+                session->ack_queued = false;
+                shard.pending_acks[i] = shard.pending_acks.back();
+                shard.pending_acks.pop_back();
+            }
+
+            // 4. 定期清理结束和超时的会话
+            if (now >= next_sweep) {
+                sweep(shard, now);
+                next_sweep = now + std::chrono::milliseconds(SESSION_SWEEP_MS);
+            }
+
+            // 5. 提交本批产生的确认
+            std::lock_guard<std::mutex> guard(send_lock);
+            udp.flush();
+        }
+    }
+
+    // 功能: 把一个数据报交给它所属的会话；只有SYN可以创建会话
+    void deliver(Shard& shard, const InboundDatagram& datagram, std::chrono::steady_clock::time_point now) {
+        PacketView packet;
+        if (!packet.parse(datagram.data, datagram.length)) return;
+        auto it = shard.sessions.find(datagram.key);
+        Session* session = it == shard.sessions.end() ? NULL : it->second;
+        if (packet.header.type == SYN) {
+            // 同一连接ID上已结束的会话再次握手: 发送端重新开始，结束旧会话
+            if (session && session->receiver->finished()) {
+                release(shard, session, NULL);
+                session = NULL;
+            }
+            if (!session) session = open(shard, datagram.key, now);
+        }
+        if (!session) return;   // 不属于任何会话(已超时关闭，或会话数已满)
+
+        session->last_activity = now;
+        session->receiver->deliver(packet, datagram.from);
+        if (session->receiver->ack_pending() && !session->ack_queued) {
+            session->ack_queued = true;
+            shard.pending_acks.push_back(session);
+        }
+    }
+
+    // 功能: 从会话池取出(池空时创建)一个会话
+    // 返回: NULL-会话数已满
+    Session* open(Shard& shard, const SessionKey& key, std::chrono::steady_clock::time_point now) {
+        if (active_sessions.fetch_add(1) >= SERVER_MAX_SESSIONS) {
+            active_sessions--;
+            return NULL;
+        }
+        Session* session;
+        if (shard.pool.empty()) {
+            shard.owned.emplace_back(new Session(udp, send_lock));
+            session = shard.owned.back().get();
+        } else {
+            session = shard.pool.back();
+            shard.pool.pop_back();
+        }
+        session->key = key;
+        session->started = now;
+        session->last_activity = now;
+        shard.sessions[key] = session;
+        return session;
+    }
+
+    // 功能: 结束一个会话，显示一行摘要，重置后放回会话池
+    // 参数: outcome-会话未收到FIN时的结果说明
+    void release(Shard& shard, Session* session, const char* outcome) {
+        Receiver& receiver = *session->receiver;
+        bool done = receiver.finished();
+        if (done) outcome = receiver.output_failed() ? "数据有误" : "完成";
+        receiver.collect_stats();
+        const ReceiveStats& stats = receiver.receive_stats();
+        double seconds = std::chrono::duration<double>(session->last_activity - session->started).count();
+        in_addr addr;
+        addr.s_addr = session->key.addr;
+        // 摘要经异步输出，分片线程不会在控制台上互相等待
+        uint64_t completed = done ? ++completed_sessions : completed_sessions.load();
+        std::ostringstream line;
+        line << "[" << outcome << "] " << inet_ntoa(addr) << ":"
+             << ntohs(session->key.port) << " #" << session->key.id << "  "
+             << (receiver.output_name().empty() ? "(未收到文件名)" : receiver.output_name()) << "  "
+             << stats.bytes << " 字节, " << stats.packets << " 包, 重传 " << stats.retransmits
+             << ", 用时 " << std::fixed << std::setprecision(2) << seconds << " 秒"
+             << "  (活动会话 " << (active_sessions.load() - 1) << ", 已完成 " << completed << ")";
+        async_log().line(line.str());
+
+        if (session->ack_queued) {
+            shard.pending_acks.erase(std::find(shard.pending_acks.begin(), shard.pending_acks.end(), session));
+            session->ack_queued = false;
+        }
+        shard.sessions.erase(session->key);
+        receiver.reset_session();
+        session->log.str(std::string());
+        session->log.clear();
+        shard.pool.push_back(session);
+        active_sessions--;
+    }
+
+    // 功能: 释放FIN后保留期已过的会话，关闭空闲超时的会话
+    void sweep(Shard& shard, std::chrono::steady_clock::time_point now) {
+        std::vector<Session*> expired;
+        for (auto& entry : shard.sessions) {
+            Session* session = entry.second;
+            auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(now - session->last_activity).count();
+            if (session->receiver->finished() ? idle >= SESSION_LINGER_MS : idle >= SESSION_IDLE_TIMEOUT_MS) {
+                expired.push_back(session);
+            }
+        }
+        for (Session* session : expired) {
+            if (!session->receiver->finished()) session->receiver->abort_session();
+            release(shard, session, "超时");
+        }
+    }
+
+    SessionServer(const SessionServer&);
+    SessionServer& operator=(const SessionServer&);
+};
+
+// ==================== 并行接收统计 ====================
+// 功能: 逐个流列出统计结果，再给出汇总
+void print_parallel_stats(const std::vector<ReceiveStats>& flows, uint16_t first_port) {
+    ReceiveStats total;
+    std::cout << "\n════════ 并行接收完成 ════════" << std::endl;
+    std::cout << "  流  端口   数据字节      接收包数  重传包数  ACK数" << std::endl;
+    for (size_t i = 0; i < flows.size(); ++i) {
+        const ReceiveStats& f = flows[i];
+        std::cout << "  " << std::setw(2) << i << "  " << std::setw(5) << (first_port + i)
+                  << "  " << std::setw(12) << f.bytes << "  " << std::setw(8) << f.packets
+                  << "  " << std::setw(8) << f.retransmits << "  " << std::setw(8) << f.acks << std::endl;
+        total.bytes += f.bytes;
+        total.packets += f.packets;
+        total.retransmits += f.retransmits;
+        total.acks += f.acks;
+        total.fec_recovered += f.fec_recovered;
+        total.syscalls += f.syscalls;
+        total.datagrams += f.datagrams;
+        total.counters.add(f.counters);
+        total.ack_interval.add(f.ack_interval);
+    }
+    std::cout << "──────────────────────────────" << std::endl;
+    std::cout << "  并行流数:    " << flows.size() << std::endl;
+    std::cout << "  总接收字节:  " << total.bytes << std::endl;
+    std::cout << "  总接收包数:  " << total.packets << std::endl;
+    std::cout << "  重传包数:    " << total.retransmits << std::endl;
+    std::cout << "  发送ACK数:   " << total.acks << std::endl;
+    std::cout << "  FEC恢复包数: " << total.fec_recovered << std::endl;
+    std::cout << "  系统调用:    " << total.syscalls << " 次, 每包 " << std::fixed << std::setprecision(3)
+              << (total.datagrams ? static_cast<double>(total.syscalls) / total.datagrams : 0.0) << std::endl;
+    std::cout << "  ACK间隔:     ";
+    total.ack_interval.describe(std::cout);
+    std::cout << std::endl << "  诊断计数:" << std::endl;
+    total.counters.describe(std::cout);
+    std::cout << "──────────────────────────────" << std::endl;
+}
+
+// 用法: receiver.exe --listen IP:端口 [--flows N]   (N为0时作为多会话服务端运行)
+//       不带参数时在控制台逐项询问
 int main(int argc, char* argv[]) {
     WinsockInitializer winsock;
 
     std::string bind_ip;
-    uint16_t port;
+    uint16_t port = 0;
+    int flow_count = 1;
+
+    CommandLine args(argc, argv);
+    bool interactive = args.empty();
+    if (!interactive) {
+        if (!args.endpoint("listen", bind_ip, port)) {
+            std::cerr << "用法: receiver.exe --listen IP:端口 [--flows N]" << std::endl;
+            return 1;
+        }
+        flow_count = static_cast<int>(args.number("flows", 1));
+    } else {
+        std::cout << "\n══════════ 接收端配置 ══════════" << std::endl;
+        std::cout << "请输入绑定IP地址: ";
+        std::cin >> bind_ip;
+        std::cout << "请输入端口号: ";
+        std::cin >> port;
+
+        // 并行传输: 第i个流在 端口号+i 上接收，各流写入同一个输出文件，所有流都收到FIN后传输才结束
+        // 输入0时作为多会话服务端运行: 同时接收多个单流发送端的传输，一直运行到Ctrl+C
+        std::cout << "请输入并行流数 (1-" << MAX_PARALLEL_FLOWS << "，与发送端一致；0-多会话服务端): ";
+        std::cin >> flow_count;
+    }
+    if (flow_count < 0 || flow_count > MAX_PARALLEL_FLOWS) {
+        std::cout << "并行流数超出范围，使用单个流" << std::endl;
+        flow_count = 1;
+    }
 
-    std::cout << "\n══════════ 接收端配置 ══════════" << std::endl;
-    std::cout << "请输入绑定IP地址: ";
-    std::cin >> bind_ip;
-    std::cout << "请输入端口号: ";
-    std::cin >> port;
+    if (flow_count == 0) {
+        // 每个核一个分片线程(收包线程大部分时间在等待)
+        unsigned shard_count = std::thread::hardware_concurrency();
+        shard_count = (std::max)(1u, (std::min)(shard_count, SERVER_MAX_SHARDS));
+        SessionServer server(bind_ip.c_str(), port, shard_count);
+        server.run();
+    } else if (flow_count == 1) {
+        Receiver receiver(bind_ip.c_str(), port);
+        receiver.run();
+    } else {
+        // 各流的进度信息写入各自的缓冲，结束后只显示汇总
+        SharedOutput shared;
+        std::vector<std::unique_ptr<std::ostringstream>> logs;
+        std::vector<std::unique_ptr<Receiver>> receivers;
+        for (int i = 0; i < flow_count; ++i) {
+            logs.emplace_back(new std::ostringstream);
+            receivers.emplace_back(new Receiver(bind_ip.c_str(), static_cast<uint16_t>(port + i), &shared,
+                                                static_cast<uint16_t>(flow_count), *logs[i]));
+        }
+        std::cout << "\n════════ 接收端已启动 ════════" << std::endl;
+        std::cout << "监听端口: " << port << " - " << (port + flow_count - 1) << " (" << flow_count << " 个流)" << std::endl;
+        std::cout << "等待连接中..." << std::endl;
 
-    Receiver receiver(bind_ip.c_str(), port);
-    receiver.run();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < flow_count; ++i) {
+            threads.emplace_back([&receivers, i]() { receivers[i]->run(); });
+        }
+        for (auto& t : threads) t.join();
+        shared.file.reset();    // 所有流都已关闭，释放映射
+
+        std::vector<ReceiveStats> flow_stats;
+        for (auto& receiver : receivers) flow_stats.push_back(receiver->receive_stats());
+        print_parallel_stats(flow_stats, port);
+    }
 
+    if (!interactive) return 0;
     std::cout << "按任意键退出..." << std::endl;
     std::cin.ignore();
     std::cin.get();
@@ -3,21 +3,194 @@
 // 功能: 实现文件的可靠传输，包括连接管理、数据发送、拥塞控制等
 
 #include "protocol.h"
+#include "datagram_io.h"
+#include "file_source.h"
+#include "congestion.h"
+#include "fec.h"
+#include "pacer.h"
+#include "manifest.h"
+#include "options.h"
+#include "telemetry.h"
+#include "../common/async_log.h"
 #include <iostream>
 #include <fstream>
-#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
 #include <chrono>
 #include <algorithm>
 #include <string>
 #include <iomanip>
 #include <cstdio>
 
+// ==================== 发送窗口 ====================
+// 在途数据包的状态: 只记录发送时间、重传次数和数据在文件中的位置，不缓存数据包副本，
+// 重传时从文件数据重新组包
+struct SendSlot {
+    uint32_t seq;           // 占用该槽位的序列号
+    bool in_flight;         // 已发送且尚未被累计确认或SACK确认
+    uint32_t retransmits;   // 该包的重传次数
+    bool lost;              // 已按重复ACK或SACK判定丢失并快速重传过(每个包至多一次，之后交给超时重传)
+    std::chrono::steady_clock::time_point send_time;  // 最近一次发送时间
+    std::chrono::steady_clock::time_point deadline;   // 当前重传定时器的到期时间
+    size_t offset;          // 数据在文件中的偏移
+    uint16_t length;        // 数据长度
+    uint16_t checksum;      // 首次发送时的头部校验和(与头部中的存放方式相同)，重传时据此增量更新
+    uint64_t delivered;     // 发送时发送端的累计投递包数(投递速率采样)
+    std::chrono::steady_clock::time_point delivered_time;  // 发送时最近一次投递的时间
+};
+
+// 固定容量的环形发送窗口: 序列号seq落在槽位 seq % capacity
+// 只要在途序列号范围 [base, next_seq_num) 不超过容量，各序列号的槽位互不冲突，
+// 登记、确认、查找都是O(1)且不分配内存
+class SendWindow {
+public:
+    // capacity向上取整为2的幂，用位与代替取模
+    explicit SendWindow(uint32_t capacity) {
+        uint32_t cap = 1;
+        while (cap < capacity) cap <<= 1;
+        slots.resize(cap);
+        mask = cap - 1;
+        for (auto& s : slots) {
+            s.seq = 0;
+            s.in_flight = false;
+            s.retransmits = 0;
+            s.lost = false;
+            s.offset = 0;
+            s.length = 0;
+            s.checksum = 0;
+            s.delivered = 0;
+        }
+    }
+
+    uint32_t capacity() const { return mask + 1; }
+
+    // 登记一个首次发送的数据包
+    void on_sent(uint32_t seq, size_t offset, uint16_t length, uint16_t checksum,
+                 std::chrono::steady_clock::time_point now) {
+        SendSlot& s = slots[seq & mask];
+        s.seq = seq;
+        s.in_flight = true;
+        s.retransmits = 0;
+        s.lost = false;
+        s.send_time = now;
+        s.offset = offset;
+        s.length = length;
+        s.checksum = checksum;
+    }
+
+    // 序列号是否仍在途(已发送未确认)
+    bool in_flight(uint32_t seq) const {
+        const SendSlot& s = slots[seq & mask];
+        return s.in_flight && s.seq == seq;
+    }
+
+    // 调用前需用in_flight确认该序列号仍占用槽位
+    SendSlot& slot(uint32_t seq) { return slots[seq & mask]; }
+
+    // 标记确认(累计确认或SACK)，重复确认无影响
+    void acknowledge(uint32_t seq) {
+        SendSlot& s = slots[seq & mask];
+        if (s.seq == seq) s.in_flight = false;
+    }
+
+private:
+    std::vector<SendSlot> slots;
+    uint32_t mask;
+};
+
+// ==================== 重传定时器 ====================
+// 按到期时间排列的最小堆，检查超时只需看堆顶，代价为O(到期数)而不是O(在途数)
+// 包被确认或重新计时后旧的定时项不删除: 弹出时与槽位中的到期时间比对，不一致即作废(惰性删除)
+class RetransmitTimers {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    void arm(uint32_t seq, TimePoint deadline) {
+        Entry e;
+        e.deadline = deadline;
+        e.seq = seq;
+        heap.push_back(e);
+        std::push_heap(heap.begin(), heap.end(), later);
+    }
+
+    // 功能: 弹出一个到期时间不晚于now的定时项
+    // 返回: false-没有到期的定时项
+    bool pop_expired(TimePoint now, uint32_t& seq, TimePoint& deadline) {
+        if (heap.empty() || heap.front().deadline > now) return false;
+        std::pop_heap(heap.begin(), heap.end(), later);
+        seq = heap.back().seq;
+        deadline = heap.back().deadline;
+        heap.pop_back();
+        return true;
+    }
+
+    // 功能: 作废的定时项过多时重建堆，valid判断定时项是否仍有效
+    template <class Valid>
+    void compact(size_t limit, Valid valid) {
+        if (heap.size() <= limit) return;
+        size_t kept = 0;
+        for (size_t i = 0; i < heap.size(); ++i) {
+            if (valid(heap[i].seq, heap[i].deadline)) heap[kept++] = heap[i];
+        }
+        heap.resize(kept);
+        std::make_heap(heap.begin(), heap.end(), later);
+    }
+
+    // 功能: 取得最早的到期时间(可能属于已作废的定时项，提前醒来没有副作用)
+    // 返回: false-没有定时项
+    bool next_deadline(TimePoint& deadline) const {
+        if (heap.empty()) return false;
+        deadline = heap.front().deadline;
+        return true;
+    }
+
+    size_t size() const { return heap.size(); }
+
+private:
+    struct Entry {
+        TimePoint deadline;
+        uint32_t seq;
+    };
+    static bool later(const Entry& a, const Entry& b) { return a.deadline > b.deadline; }
+    std::vector<Entry> heap;
+};
+
+// ==================== 传输统计 ====================
+// 一次文件传输的统计结果，并行传输时按流汇总
+struct TransferStats {
+    int64_t duration_ms;        // 传输时间(毫秒)
+    uint64_t file_bytes;        // 传输的文件数据字节数
+    uint64_t bytes_sent;        // 发送的总字节数(含头部、控制包和重传)
+    uint64_t packets_sent;      // 发送的总包数
+    uint64_t retransmissions;   // 重传次数
+    int64_t srtt_ms;            // 结束时的平滑RTT(毫秒)
+    uint64_t syscalls;          // 收发用到的系统调用次数
+    uint64_t datagrams;         // 收发的数据报个数
+    CounterSnapshot counters;   // 诊断计数(超时、快速重传、重复ACK等)
+    HistogramSnapshot rtt;      // RTT样本的分布
+    HistogramSnapshot ack_interval;     // 相邻ACK到达间隔的分布
+
+    TransferStats() : duration_ms(0), file_bytes(0), bytes_sent(0), packets_sent(0),
+                      retransmissions(0), srtt_ms(0), syscalls(0), datagrams(0) {}
+
+    // 吞吐率(Mbps): 按文件数据计算(有效吞吐率)
+    double throughput_mbps() const {
+        return duration_ms > 0 ? (file_bytes * 8.0) / (duration_ms / 1000.0) / 1024.0 / 1024.0 : 0.0;
+    }
+
+    // 链路上的发送速率(Mbps): 按发送的总字节数计算，含头部、控制包和重传
+    double wire_mbps() const {
+        return duration_ms > 0 ? (bytes_sent * 8.0) / (duration_ms / 1000.0) / 1024.0 / 1024.0 : 0.0;
+    }
+};
+
 // ==================== 发送端类 ====================
 // 功能: 负责文件的可靠传输，实现滑动窗口、拥塞控制和重传机制
 class Sender {
 private:
     // ==================== 网络通信相关 ====================
-    SOCKET sockfd;                      // UDP套接字描述符
+    DatagramSocket udp;                 // UDP套接字(RIO批量收发，不支持时回退普通调用)
     struct sockaddr_in receiver_addr;   // 接收端地址信息
     ConnectionState state;              // 当前连接状态
 
@@ -27,8 +200,11 @@ private:
     uint32_t next_seq_num;   // 下一个要发送的序列号
 
     // ==================== 已发送包管理 ====================
-    std::map<uint32_t, Packet> sent_packets;  // 已发送但未确认的数据包缓存
-    std::map<uint32_t, std::chrono::steady_clock::time_point> send_times;  // 每个包的发送时间
+    SendWindow window;                  // 在途数据包的环形窗口
+    RetransmitTimers timers;            // 在途数据包的重传定时器
+    RttEstimator rtt;                   // RTT估计与RTO计算(数据包和SYN/FILE_NAME/FIN共用)
+    FileSource* source;                 // 正在发送的文件数据源(重传时从这里重新组包)
+    std::string source_error;           // 数据源读取失败的原因，传输中止时显示
 
     // ==================== SYN/FIN重传管理 ====================
     Packet syn_packet; 
@@ -38,12 +214,16 @@ private:
     int syn_retries;    // SYN包重传次数
     int fin_retries;    // FIN包重传次数
 
-    // ==================== 拥塞控制(TCP Reno算法) ====================
-    CongestionState cong_state;  // 当前拥塞控制状态
-    double cwnd;                 // 拥塞窗口大小(单位:数据包)
-    uint32_t ssthresh;           // 慢启动阈值
+    // ==================== 拥塞控制 ====================
+    std::unique_ptr<CongestionControl> cc;  // 本次传输使用的拥塞控制算法(默认Reno)
     uint32_t duplicate_acks;     // 重复 ACK 计数器
     uint32_t last_acked;         // 最后一次确认的序列号
+    uint32_t recovery_end;       // 上次通知丢包时的next_seq_num，累计确认越过它之前不再通知(每个窗口只减一次)
+    uint32_t highest_sacked;     // SACK确认过的最大序列号 + 1
+    uint32_t hole_scan;          // 判定空洞时下一个要检查的序列号，之前的都已检查过
+    std::vector<uint32_t> resend_queue;  // 未能交给协议栈的DATA包，下一轮发送前先重发
+    uint64_t delivered;          // 累计投递(被累计确认或SACK确认)的包数
+    std::chrono::steady_clock::time_point delivered_time;  // 最近一次投递的时间
 
     // ==================== 统计信息 ====================
     uint64_t total_bytes_sent;    // 总发送字节数
@@ -55,25 +235,54 @@ private:
     bool server_locked;       // 是否已锁定服务器(防止从其他地址接收数据)
     sockaddr_in server_addr;  // 锁定的服务器地址
 
-    uint32_t receiver_window;  // 接收端窗口大小
+    // ==================== 握手协商结果 ====================
+    uint16_t connection_id;    // 本端选取的连接ID，写入发出的每个包的window_size字段(多会话服务端据此区分会话)
+    uint16_t payload_size;     // 协商的数据包负载大小(字节)
+    uint32_t receiver_window;  // 接收端通告的窗口大小(数据包个数)，随每个ACK更新
+
+    // ==================== 前向纠错 ====================
+    FecEncoder fec;            // 按块生成修复包，块大小随丢包率调整
+    bool fec_negotiated;       // 接收端同意接收修复包
+    bool fec_enabled;          // 本次传输发送修复包(接收端能按偏移直接写入时才能恢复，即文件大小已知)
+
+    // ==================== 续传 ====================
+    bool resume_negotiated;    // 接收端同意比较续传清单
+    Packet repair_packet;      // 修复包(重复使用，避免每块构造一个大的Packet)
+
+    // ==================== 分块压缩 ====================
+    bool compress_negotiated;  // 接收端同意接收压缩块
+    bool compress_data;        // 本次传输的数据按块压缩(文件名包带FLAG_COMPRESSED)
+
+    // ==================== 发送节奏 ====================
+    Pacer pacer;               // 新数据按速率成批放行(重传不受限制，尽快补上空洞)
+
+    // ==================== 诊断 ====================
+    TransferCounters counters;             // 超时、快速重传、重复ACK等事件的计数
+    LatencyHistogram rtt_histogram;        // RTT样本
+    LatencyHistogram ack_interval;         // 相邻两个ACK的到达间隔
+    std::chrono::steady_clock::time_point last_ack_time;   // 上一个ACK的到达时间
+    bool ack_seen;                         // 是否已收到过ACK
+    int64_t min_rtt_us;                    // 最小RTT样本(微秒)，据此判断重传是否多余，0-尚无样本
+    TraceRing trace;                       // 拥塞控制轨迹(默认关闭)
+    CongestionPhase traced_phase;          // 轨迹中最近记录的拥塞控制状态
+
+    // ==================== 控制台输出 ====================
+    std::ostream* out;         // 进度信息的输出位置(并行传输时每个流写入各自的缓冲，避免交错)
+    TransferStats stats;       // 最近一次传输的统计
 
 public:
     // ==================== 构造函数 ====================
     // 功能: 初始化发送端，创建套接字并配置网络参数
     // 参数: sender_ip-本地IP, sender_port-本地端口, receiver_ip-接收端IP, receiver_port-接收端端口
     Sender(const char* sender_ip, uint16_t sender_port,
-           const char* receiver_ip, uint16_t receiver_port) {
-        // 1. 创建 UDP 套接字
-        sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-        if (sockfd == INVALID_SOCKET) {
+           const char* receiver_ip, uint16_t receiver_port)
+        : window(SEND_WINDOW_CAPACITY), source(nullptr), out(&std::cout) {
+        // 1. 创建 UDP 套接字(非阻塞，由udp.wait阻塞等待；收发缓冲区已放大)
+        if (!udp.create()) {
             std::cerr << "创建套接字失败，错误码: " << WSAGetLastError() << std::endl;
             exit(1);
         }
 
-        // 2. 设置为非阻塞模式
-        u_long mode = 1;
-        ioctlsocket(sockfd, FIONBIO, &mode);
-
         // 3. 配置接收端地址信息
         memset(&receiver_addr, 0, sizeof(receiver_addr));
         receiver_addr.sin_family = AF_INET;
@@ -91,8 +300,8 @@ public:
             exit(1);
         }
 
-        // 5. 绑定本地地址(允许接收响应)
-        if (bind(sockfd, (struct sockaddr*)&local_addr, sizeof(local_addr)) == SOCKET_ERROR) {
+        // 5. 绑定本地地址(允许接收响应)，并尽量启用RIO批量收发
+        if (!udp.bind(local_addr)) {
             std::cerr << "sender bind 失败: " << WSAGetLastError() << std::endl;
             exit(1);
         }
@@ -103,12 +312,15 @@ public:
         base = 0;
         next_seq_num = 0;
 
-        // 7. 初始化拥塞控制参数
-        cong_state = SLOW_START;  // 从慢启动开始
-        cwnd = 1.0;               // 初始拥塞窗口为1
-        ssthresh = WINDOW_SIZE;   // 阈值设为最大窗口大小
+        // 7. 初始化拥塞控制参数(握手后把慢启动阈值设为接收端窗口)
+        cc = CongestionControl::create("reno");
         duplicate_acks = 0;
         last_acked = 0;
+        recovery_end = 0;
+        highest_sacked = 0;
+        hole_scan = 0;
+        resend_queue.clear();
+        delivered = 0;
 
         // 8. 初始化统计信息
         total_bytes_sent = 0;
@@ -120,6 +332,69 @@ public:
         memset(&server_addr, 0, sizeof(server_addr));
         syn_retries = 0;
         fin_retries = 0;
+
+        // 10. 协商前使用默认值；连接ID在整个连接中不变
+        connection_id = new_connection_id();
+        repair_packet.header.window_size = connection_id;
+        payload_size = DEFAULT_DATA_SIZE;
+        receiver_window = WINDOW_SIZE;
+        fec_negotiated = false;
+        fec_enabled = false;
+        resume_negotiated = false;
+        compress_negotiated = false;
+        compress_data = false;
+
+        // 11. 诊断
+        ack_seen = false;
+        min_rtt_us = 0;
+        traced_phase = PHASE_SLOW_START;
+    }
+
+    // ==================== 选择拥塞控制算法 ====================
+    // 功能: 在连接之前选择本次传输的拥塞控制算法
+    // 参数: name-算法名称(reno / cubic / bbr)
+    // 返回: false-名称无法识别，保持原来的算法
+    bool set_congestion_control(const std::string& name) {
+        std::unique_ptr<CongestionControl> created = CongestionControl::create(name);
+        if (!created) return false;
+        cc = std::move(created);
+        return true;
+    }
+
+    // ==================== 设置输出位置 ====================
+    // 功能: 进度信息改为写入stream；不是控制台时不显示进度动画
+    void set_console(std::ostream& stream) {
+        out = &stream;
+    }
+
+    // 最近一次传输的统计
+    const TransferStats& transfer_stats() const {
+        return stats;
+    }
+
+    // 最近一次发送的文件名约定了按块压缩数据
+    bool compressing() const {
+        return compress_data;
+    }
+
+    // ==================== 拥塞控制轨迹 ====================
+    // 功能: 在传输之前开启轨迹，只保留最后records条记录；0-关闭
+    void enable_trace(size_t records) {
+        trace.enable(records);
+    }
+
+    // 功能: 把轨迹按时间顺序导出到文件(.json结尾为JSON数组，否则为CSV)
+    // 返回: false-没有开启轨迹或无法写入
+    // 说明: 在传输线程结束后由主线程调用，结果直接显示在控制台
+    bool dump_trace(const std::string& path) {
+        if (!trace.enabled()) return false;
+        if (!trace.dump(path, congestion_phase_name)) {
+            std::cerr << "[!] 无法写入轨迹文件: " << path << std::endl;
+            return false;
+        }
+        std::cout << "[✓] 拥塞控制轨迹: " << trace.size() << " 条 (共记录 " << trace.written() << " 条) -> "
+                  << path << std::endl;
+        return true;
     }
 
     // ==================== 发送控制包方法 ====================
@@ -129,12 +404,60 @@ public:
         send_packet(packet);
     }
 
+    // ==================== 发送文件名方法 ====================
+    // 功能: 发送文件名包并等待确认；双方支持续传且大小已知时附带各块的哈希，
+    //       按接收端回复的位图确定要传输的块；双方支持压缩且大小已知时约定按块压缩数据
+    // 参数: source-数据源(本流负责的范围), info-文件名包携带的信息, chunks-返回要传输的块(不续传时为空)
+    // 返回: false-确认超时
+    bool send_file_name(FileSource& source, FileInfo info, ChunkMap& chunks) {
+        chunks.clear();
+
+        // 1. 续传清单: 块数受文件名包大小限制，哈希由多个线程计算
+        if (resume_negotiated && info.size_known) {
+            size_t capacity = file_name_manifest_capacity(info.name, payload_size);
+            uint32_t chunk = resume_chunk_size(info.range.length, payload_size, capacity);
+            auto hash_start = std::chrono::steady_clock::now();
+            if (chunk > 0 && source.hash_chunks(0, info.range.length, chunk, info.chunk_hashes)) {
+                info.chunk_size = chunk;
+                console() << "[✓] 续传清单: " << info.chunk_hashes.size() << " 块 (块大小 " << chunk
+                          << " 字节)，计算哈希用时 " << std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 std::chrono::steady_clock::now() - hash_start).count() << " ms" << std::endl;
+            } else {
+                info.chunk_hashes.clear();
+            }
+        }
+
+        // 2. 发送文件名包并等待确认(接收端要先计算已有文件的哈希，携带清单时多等几次)
+        Packet name_pkt;
+        name_pkt.header.type = FILE_NAME;
+        name_pkt.header.window_size = connection_id;
+        compress_data = compress_negotiated && info.size_known && info.range.length > 0;
+        if (compress_data) name_pkt.header.flags = FLAG_COMPRESSED;
+        write_file_name(name_pkt, info, payload_size);
+        name_pkt.header.checksum = htons(name_pkt.calculate_checksum());
+        send_packet(name_pkt);
+        std::vector<uint8_t> reply;
+        if (!wait_for_file_name_ack(name_pkt, info.chunk_size > 0 ? RESUME_NAME_RETRIES : FILE_NAME_RETRIES, &reply)) {
+            return false;
+        }
+
+        // 3. 要传输的块
+        if (info.chunk_size > 0) {
+            chunks.assign(info.range.length, info.chunk_size, reply.data(), reply.size());
+            console() << "[✓] 接收端已有 " << (chunks.total_chunks() - chunks.needed_chunks()) << "/"
+                      << chunks.total_chunks() << " 块，需要传输 " << chunks.transfer_length(info.range.length)
+                      << " 字节" << std::endl;
+        }
+        return true;
+    }
+
     // ==================== 等待文件名确认方法 ====================
     // 功能: 发送文件名后等待接收端确认，超时重传
-    // 参数: file_name_pkt-文件名数据包
+    // 参数: file_name_pkt-文件名数据包, max_retries-最大重传次数, reply-返回确认包的数据部分(续传位图)
     // 返回: true-成功接收确认，false-超时失败
-    bool wait_for_file_name_ack(const Packet& file_name_pkt) {
-        std::cout << "正在等待文件名确认..." << std::endl;
+    bool wait_for_file_name_ack(const Packet& file_name_pkt, int max_retries = FILE_NAME_RETRIES,
+                                std::vector<uint8_t>* reply = NULL) {
+        console() << "正在等待文件名确认..." << std::endl;
         auto send_time = std::chrono::steady_clock::now();
         int retries = 0;
 
@@ -142,41 +465,42 @@ public:
             auto now = std::chrono::steady_clock::now();
 
             // 检查是否超过最大重试次数
-            if (retries >= 5) {
+            if (retries >= max_retries) {
                 std::cerr << "[✗] 文件名确认超时（已重试" << retries << "次）" << std::endl;
                 return false;
             }
 
             // 检查是否超时，需要重传
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now - send_time).count();
-            if (elapsed > TIMEOUT_MS && retries < 5) {
-                std::cout << "文件名确认超时，进行第" << (retries + 1) << "次重传" << std::endl;
+            if (now - send_time >= rtt.rto()) {
+                console() << "文件名确认超时，进行第" << (retries + 1) << "次重传" << std::endl;
+                rtt.backoff();
                 send_packet(file_name_pkt);  // 重传FILE_NAME包
                 retries++;
                 send_time = now;
             }
 
             // 尝试接收确认包
-            Packet ack_packet;
+            PacketView ack_packet;
             sockaddr_in from;
             if (receive_packet(ack_packet, from)) {
                 if (ack_packet.header.type == FILE_NAME_ACK && ack_packet.verify_checksum()) {
-                    std::cout << "[✓] 收到文件名确认，开始传输数据" << std::endl;
+                    if (retries == 0) rtt.sample(std::chrono::steady_clock::now() - send_time);
+                    if (reply) reply->assign(ack_packet.data, ack_packet.data + ack_packet.header.data_length);
+                    console() << "[✓] 收到文件名确认，开始传输数据" << std::endl;
                     return true;
                 }
+                continue;   // 可能还有数据报，先读完再等待
             }
 
-            Sleep(10);  // 短暂等待后再次检查
+            // 等待数据报到达或重传定时器到期
+            udp.wait_until(send_time + rtt.rto());
         }
     }
 
     // ==================== 析构函数 ====================
     // 功能: 清理资源，关闭套接字
     ~Sender() {
-        if (sockfd != INVALID_SOCKET) {
-            closesocket(sockfd);
-        }
+        udp.close();
     }
 
     // ==================== 建立连接方法 ====================
@@ -184,13 +508,18 @@ public:
     // 返回: true-连接成功，false-连接失败
     // 流程: 1.发送SYN  2.等待SYN_ACK  3.发送ACK 4.连接建立
     bool connect() {
-        std::cout << "\n========== 连接阶段 ==========" << std::endl;
-        std::cout << "正在建立连接..." << std::endl;
-
-        // 1. 构造并发送 SYN 包
+        console() << "\n========== 连接阶段 ==========" << std::endl;
+        console() << "正在建立连接..." << std::endl;
+
+        // 1. 构造并发送 SYN 包，携带按路径MTU提出的负载大小和本端窗口容量
+        HandshakeOptions proposal;
+        proposal.payload_size = path_payload_size(receiver_addr);
+        proposal.flags = HANDSHAKE_FEC | HANDSHAKE_RESUME | HANDSHAKE_COMPRESS;
+        proposal.window = window.capacity();
         syn_packet.header.type = SYN;
+        syn_packet.header.window_size = connection_id;
         syn_packet.header.seq_num = seq_num;
-        syn_packet.header.data_length = 0;
+        write_handshake_options(syn_packet, proposal);
         syn_packet.header.checksum = htons(syn_packet.calculate_checksum());
 
         send_packet(syn_packet);
@@ -209,32 +538,48 @@ public:
             }
 
             // 检查 SYN 包是否超时，需要重传
-            auto syn_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now - syn_send_time).count();
-            if (syn_elapsed > TIMEOUT_MS) {
-                std::cout << "SYN包超时，进行第" << (syn_retries + 1) << "次重传" << std::endl;
+            if (now - syn_send_time >= rtt.rto()) {
+                console() << "SYN包超时，进行第" << (syn_retries + 1) << "次重传" << std::endl;
+                rtt.backoff();
                 send_packet(syn_packet);
                 syn_send_time = now;
                 syn_retries++;
             }
 
             // 尝试接收 SYN_ACK
-            Packet recv_packet;
+            PacketView recv_packet;
             sockaddr_in from;
             if (receive_packet(recv_packet, from)) {
                 // 首次接收到响应时锁定服务器地址
                 if (!server_locked) {
                     server_addr = from;
                     server_locked = true;
-                    std::cout << "[✓] 已锁定服务器: " << inet_ntoa(server_addr.sin_addr)
+                    console() << "[✓] 已锁定服务器: " << inet_ntoa(server_addr.sin_addr)
                               << ":" << ntohs(server_addr.sin_port) << std::endl;
                 }
 
                 // 验证 SYN_ACK 包
                 if (recv_packet.header.type == SYN_ACK && recv_packet.verify_checksum()) {
+                    // 未重传过的SYN得到第一个RTT样本，数据传输一开始就使用测得的RTO
+                    if (syn_retries == 0) rtt.sample(std::chrono::steady_clock::now() - syn_send_time);
+
+                    // 采用接收端确定的负载大小和窗口
+                    HandshakeOptions accepted;
+                    read_handshake_options(recv_packet, accepted);
+                    payload_size = (std::min)(accepted.payload_size, proposal.payload_size);
+                    receiver_window = accepted.window;
+                    fec_negotiated = (accepted.flags & HANDSHAKE_FEC) != 0;
+                    resume_negotiated = (accepted.flags & HANDSHAKE_RESUME) != 0;
+                    compress_negotiated = (accepted.flags & HANDSHAKE_COMPRESS) != 0;
+                    cc->set_initial_ssthresh(receiver_window);
+                    console() << "[✓] 协商结果: 负载 " << payload_size << " 字节, 接收窗口 "
+                              << receiver_window << " 包" << (fec_negotiated ? ", 支持FEC" : "")
+                              << (resume_negotiated ? ", 支持续传" : "")
+                              << (compress_negotiated ? ", 支持压缩" : "") << std::endl;
                     // 发送第三次握手的ACK
                     Packet ack_packet;
                     ack_packet.header.type = ACK;
+                    ack_packet.header.window_size = connection_id;
                     ack_packet.header.seq_num = seq_num + 1;
                     ack_packet.header.ack_num = recv_packet.header.seq_num + 1;
                     ack_packet.header.data_length = 0;
@@ -246,122 +591,233 @@ public:
                     seq_num++;         // 序列号递增
                     base = seq_num;
                     next_seq_num = seq_num;
-                    std::cout << "[✓] 已发送第三次握手ACK" << std::endl;
-                    std::cout << "[✓] 连接建立成功！" << std::endl;
+                    console() << "[✓] 已发送第三次握手ACK" << std::endl;
+                    console() << "[✓] 连接建立成功！" << std::endl;
                     return true;
                 }
+                continue;   // 可能还有数据报，先读完再等待
             }
 
-            Sleep(10);  // 短暂等待后再次检查
+            // 等待数据报到达或重传定时器到期
+            udp.wait_until(syn_send_time + rtt.rto());
         }
     }
 
     // ==================== 发送文件方法 ====================
     // 功能: 使用滑动窗口协议发送文件数据
-    // 参数: filename-要发送的文件路径
+    // 参数: file-已打开的文件数据源(磁盘文件或命名管道)
     // 返回: true-发送成功，false-发送失败
     // 特点: 支持拥塞控制、自动重传、SACK选择性确认
-    bool send_file(const char* filename) {
-        // 1. 打开文件并读取内容
-        std::ifstream file(filename, std::ios::binary);
-        if (!file.is_open()) {
-            std::cerr << "[✗] 无法打开文件: " << filename << std::endl;
-            return false;
+    //       数据直接从内存映射的页面(或流式预读缓冲区)组包，内存占用与文件大小无关，打开后立即开始发送
+    bool send_file(FileSource& file) {
+        // 1. 使用文件数据源
+        source = &file;
+        source_error.clear();
+        // 压缩块的大小要压缩完才知道，接收端不能按偏移写入，也就不能用修复包恢复
+        fec_enabled = fec_negotiated && source->size_known() && !compress_data;
+        pacer.reset(payload_size);
+
+        console() << "\n========== 数据传输阶段 ==========" << std::endl;
+        if (compress_data) {
+            console() << "文件大小: " << source->raw_size() << " 字节 (分块压缩传输)" << std::endl;
+        } else if (source->size_known()) {
+            console() << "文件大小: " << source->size() << " 字节" << std::endl;
+        } else {
+            console() << "文件大小: 未知(流式输入)" << std::endl;
         }
 
-        // 计算文件大小
-        file.seekg(0, std::ios::end);
-        size_t file_size = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        std::cout << "\n========== 数据传输阶段 ==========" << std::endl;
-        std::cout << "文件大小: " << file_size << " 字节" << std::endl;
-
         auto start_time = std::chrono::steady_clock::now();
+        delivered_time = start_time;
+        if (trace.enabled()) {
+            trace.start(start_time);
+            traced_phase = cc->phase();
+        }
 
-        // 读取文件内容到内存
-        std::vector<uint8_t> file_data(file_size);
-        file.read(reinterpret_cast<char*>(file_data.data()), file_size);
-        file.close();
+        // 数据源结束后才知道总包数: end_seq为最后一个包之后的序列号
+        bool source_done = false;
+        uint32_t end_seq = 0;
+        bool failed = false;
 
-        // 计算需要发送的总包数
-        uint32_t total_packets = (file_size + MAX_DATA_SIZE - 1) / MAX_DATA_SIZE;
+        // 流式数据源只保留有限的数据，窗口不能覆盖超过它的范围
+        uint64_t source_window = source->max_window_bytes() / payload_size;
 
-        int transfer_counter = 0;
-        // 2. 滑动窗口协议主循环
-        while (base < seq_num + total_packets) {
-            // 计算当前窗口限制(取拥塞窗口和流量控制窗口的最小值)
+        auto next_spin = start_time;
+        // 2. 滑动窗口协议主循环: 发送 -> 阻塞等待ACK或定时器 -> 读完所有ACK -> 处理超时
+        while (!source_done || base < end_seq) {
+            // 计算当前窗口限制(取拥塞窗口和接收端通告窗口的最小值，且不超过环形窗口容量和数据源可保留的范围)
+            // 至少为1: 通告窗口为0时仍允许一个包在途，作为窗口探测
             uint32_t window_limit = std::min<uint32_t>(
-                static_cast<uint32_t>(cwnd),
-                static_cast<uint32_t>(WINDOW_SIZE)
+                cc->cwnd(),
+                receiver_window
             );
+            window_limit = std::min<uint32_t>(window_limit, window.capacity());
+            window_limit = static_cast<uint32_t>(std::min<uint64_t>(window_limit, source_window));
+            window_limit = (std::max)(window_limit, 1u);
+
+            // 3. 先重发上一轮未能交给协议栈的包，再在窗口和发送节奏允许的范围内发送数据包
+            if (!resend_failed()) {
+                failed = true;
+                break;
+            }
+            pacer.set_rate(pacing_rate());
+            uint32_t allowance = pacer.allowance();
+            bool source_pending = false;
+            bool paced = false;
+            while (!source_done && next_seq_num < base + window_limit) {
+                if (allowance == 0) {               // 本批已发完，等待下一批的令牌
+                    paced = true;
+                    break;
+                }
+                // 计算当前包的数据位置，从数据源取出数据(最后一个包可能不足payload_size)
+                uint64_t pkt_offset = static_cast<uint64_t>(next_seq_num - seq_num) * payload_size;
+                const uint8_t* ptr = nullptr;
+                size_t got = 0;
+                SourceStatus st = source->view(pkt_offset, payload_size, ptr, got);
+                if (st == SOURCE_PENDING) {         // 流式输入暂时没有完整的包，先处理ACK
+                    source_pending = true;
+                    break;
+                }
+                if (st == SOURCE_EOF) {
+                    source_done = true;
+                    end_seq = next_seq_num;
+                    if (fec_enabled && fec.pending()) send_repair();    // 最后一个不完整的块
+                    break;
+                }
+                if (st == SOURCE_ERROR) {
+                    source_error = source->error();
+                    failed = true;
+                    break;
+                }
 
-            // 3. 在窗口允许的范围内发送数据包
-            while (next_seq_num < base + window_limit &&
-                   next_seq_num < seq_num + total_packets) {
-                Packet packet;
-                packet.header.type = DATA;
-                packet.header.seq_num = next_seq_num;
-
-                // 计算当前包的数据位置和大小
-                size_t pkt_offset = (next_seq_num - seq_num) * MAX_DATA_SIZE;
-                size_t pkt_size = std::min<size_t>(
-                    static_cast<size_t>(MAX_DATA_SIZE),
-                    static_cast<size_t>(file_size - pkt_offset)
-                );
-
-                // 填充数据并计算校验和
-                memcpy(packet.data, file_data.data() + pkt_offset, pkt_size);
-                packet.header.data_length = static_cast<uint16_t>(pkt_size);
-                packet.header.checksum = htons(packet.calculate_checksum());
-
-                // 发送包并记录发送信息
-                send_packet(packet);
-                sent_packets[next_seq_num] = packet;
-                send_times[next_seq_num] = std::chrono::steady_clock::now();
+                // 发送包并在窗口中登记(只记录位置，不保存副本)
+                uint16_t pkt_size = static_cast<uint16_t>(got);
+                uint16_t checksum = send_data_packet(next_seq_num, ptr, pkt_size);
+                window.on_sent(next_seq_num, pkt_offset, pkt_size, checksum, std::chrono::steady_clock::now());
+                record_delivery_state(next_seq_num);
+                arm_timer(next_seq_num);
+                if (fec_enabled && fec.add(next_seq_num, ptr, pkt_size)) send_repair();
 
                 next_seq_num++;
+                allowance--;
+                pacer.on_sent();
+            }
+            if (failed) break;
+
+            // 本轮停下的原因: 窗口用完时区分拥塞窗口和接收端通告窗口，数据源暂无数据说明读取或压缩跟不上
+            if (source_pending) {
+                counters.add(COUNTER_SOURCE_STALLS);
+            } else if (!source_done && !paced && next_seq_num >= base + window_limit) {
+                if (window_limit == cc->cwnd()) counters.add(COUNTER_CWND_LIMITED);
+                else if (window_limit == (std::max)(receiver_window, 1u)) counters.add(COUNTER_RWND_LIMITED);
             }
 
-            // 4. 接收并处理 ACK
-            Packet ack_packet;
+            // 4. 阻塞等待ACK到达或最早的重传定时器到期；流式输入暂无数据时最多等待SOURCE_POLL_US
+            auto wake = std::chrono::steady_clock::now() + rtt.rto();
+            RetransmitTimers::TimePoint earliest;
+            if (timers.next_deadline(earliest) && earliest < wake) wake = earliest;
+            if (source_pending) {
+                wake = (std::min)(wake, std::chrono::steady_clock::now() + std::chrono::microseconds(SOURCE_POLL_US));
+            }
+            if (paced) {
+                wake = (std::min)(wake, std::chrono::steady_clock::now() + std::chrono::microseconds(pacer.next_burst_us()));
+            }
+            if (!resend_queue.empty()) {
+                wake = (std::min)(wake, std::chrono::steady_clock::now() + std::chrono::microseconds(SOURCE_POLL_US));
+            }
+            if (!source_done || base < end_seq) udp.wait_until(wake);     // 等待前提交本轮排队的整批发送
+
+            // 5. 接收并处理已到达的所有ACK
+            PacketView ack_packet;
             sockaddr_in from;
-            if (receive_packet(ack_packet, from)) {
+            while (receive_packet(ack_packet, from)) {
                 if (ack_packet.header.type == ACK && ack_packet.verify_checksum()) {
-                    handle_ack(ack_packet);
+                    if (!handle_ack(ack_packet)) {
+                        failed = true;
+                        break;
+                    }
+                } else if (ack_packet.header.type == ACK) {
+                    counters.add(COUNTER_CHECKSUM_FAILURES);
                 }
             }
+            if (failed) break;
 
-            // 5. 检查超时并重传
-            check_timeout();
+            // 6. 检查超时并重传
+            if (!check_timeout()) {
+                failed = true;
+                break;
+            }
 
-            // 6. 显示进度动画
-            if (++transfer_counter % 10 == 0) {
+            // 7. 显示进度动画
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next_spin && out == &std::cout) {
                 show_spinner();
+                next_spin = now + std::chrono::milliseconds(SPINNER_INTERVAL_MS);
             }
+        }
 
-            Sleep(1);  // 避免CPU占用过高
+        if (out == &std::cout) {
+            async_log().raw("\r \r");
+            async_log().flush();        // 之后的统计直接写 std::cout，先等动画写完
         }
+        source = nullptr;
 
-        printf("\r \r");
-        fflush(stdout);
+        if (failed) {
+            std::cerr << "[✗] 读取文件数据失败: " << (source_error.empty() ? "原因未知" : source_error) << std::endl;
+            return false;
+        }
 
-        // 7. 计算并显示传输统计信息
+        // 8. 计算并显示传输统计信息
         auto end_time = std::chrono::steady_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
-            end_time - start_time).count();
-
-        double throughput = (file_size * 8.0) / (duration / 1000.0) / 1024.0 / 1024.0;
-
-        std::cout << "\n========== 传输统计 ==========" << std::endl;
-        std::cout << "[✓] 传输完成！" << std::endl;
-        std::cout << "──────────────────────────────" << std::endl;
-        std::cout << "  传输时间:    " << duration << " ms" << std::endl;
-        std::cout << "  吞吐率:      " << std::fixed << std::setprecision(2) << throughput << " Mbps" << std::endl;
-        std::cout << "  总字节数:    " << total_bytes_sent << std::endl;
-        std::cout << "  总包数:      " << total_packets_sent << std::endl;
-        std::cout << "  重传次数:    " << retransmissions << std::endl;
-        std::cout << "──────────────────────────────" << std::endl;
+        stats.duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
+        stats.file_bytes = file.raw_size();      // 压缩时按压缩前的字节数计算有效吞吐率
+        stats.bytes_sent = total_bytes_sent;
+        stats.packets_sent = total_packets_sent;
+        stats.retransmissions = retransmissions;
+        stats.srtt_ms = rtt.srtt_ms();
+        stats.syscalls = udp.syscalls();
+        stats.datagrams = udp.datagrams();
+        stats.counters = counters.snapshot();
+        stats.rtt = rtt_histogram.snapshot();
+        stats.ack_interval = ack_interval.snapshot();
+
+        console() << "\n========== 传输统计 ==========" << std::endl;
+        console() << "[✓] 传输完成！" << std::endl;
+        console() << "──────────────────────────────" << std::endl;
+        console() << "  传输时间:    " << stats.duration_ms << " ms" << std::endl;
+        console() << "  吞吐率:      " << std::fixed << std::setprecision(2) << stats.throughput_mbps() << " Mbps" << std::endl;
+        console() << "  总字节数:    " << total_bytes_sent << std::endl;
+        console() << "  总包数:      " << total_packets_sent << std::endl;
+        console() << "  重传次数:    " << retransmissions << std::endl;
+        console() << "  平滑RTT:     " << rtt.srtt_ms() << " ms (RTO " << rtt.rto_ms() << " ms)" << std::endl;
+        console() << "  拥塞控制:    " << cc->name() << " (cwnd " << cc->cwnd() << " 包";
+        if (cc->pacing_rate() > 0) {
+            console() << ", 速率 " << std::setprecision(2)
+                      << cc->pacing_rate() * payload_size * 8 / 1024 / 1024 << " Mbps";
+        }
+        console() << ")" << std::endl;
+        if (pacer.rate_pps() > 0) {
+            console() << "  发送节奏:    " << std::setprecision(2)
+                      << pacer.rate_pps() * payload_size * 8 / 1024 / 1024 << " Mbps, 每批 "
+                      << pacer.burst_packets() << " 包, 等待 " << pacer.waits() << " 次" << std::endl;
+        }
+        if (fec_enabled) {
+            console() << "  前向纠错:    修复包 " << fec.repairs() << " 个, 估计丢包率 " << std::setprecision(2)
+                      << fec.loss() * 100 << "% (分组 " << fec.group_size() << ")" << std::endl;
+        }
+        file.describe(console());
+        console() << "  校验和内核:  " << checksum_kernel_name() << std::endl;
+        console() << "  系统调用:    " << udp.syscalls() << " 次, 每包 " << std::setprecision(3)
+                  << (udp.datagrams() ? static_cast<double>(udp.syscalls()) / udp.datagrams() : 0.0)
+                  << " (" << udp.mode_name() << ")";
+        if (udp.send_failures() > 0) console() << ", 发送失败 " << udp.send_failures() << " 次";
+        console() << std::endl;
+        console() << "  RTT分布:     ";
+        stats.rtt.describe(console());
+        console() << std::endl << "  ACK间隔:     ";
+        stats.ack_interval.describe(console());
+        console() << std::endl << "  诊断计数:" << std::endl;
+        stats.counters.describe(console());
+        console() << "──────────────────────────────" << std::endl;
 
         return true;
     }
@@ -370,11 +826,12 @@ public:
     // 功能: 与接收端断开连接(类似TCP四次挥手)
     // 流程: 1.发送FIN  2.等待FIN_ACK  3.连接关闭
     void disconnect() {
-        std::cout << "\n========== 连接关闭阶段 ==========" << std::endl;
-        std::cout << "正在关闭连接..." << std::endl;
+        console() << "\n========== 连接关闭阶段 ==========" << std::endl;
+        console() << "正在关闭连接..." << std::endl;
 
         // 1. 构造并发送 FIN 包
         fin_packet.header.type = FIN;
+        fin_packet.header.window_size = connection_id;
         fin_packet.header.seq_num = next_seq_num;
         fin_packet.header.checksum = htons(fin_packet.calculate_checksum());
 
@@ -389,48 +846,199 @@ public:
 
             // 检查是否超过最大重试次数
             if (fin_retries >= 5) {
-                std::cout << "关闭连接超时（已重试" << fin_retries << "次）" << std::endl;
+                console() << "关闭连接超时（已重试" << fin_retries << "次）" << std::endl;
                 break;  // 即使超时也关闭连接
             }
 
             // 检查 FIN 包是否超时，需要重传
-            auto fin_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now - fin_send_time).count();
-            if (fin_elapsed > TIMEOUT_MS) {
-                std::cout << "FIN包超时，进行第" << (fin_retries + 1) << "次重传" << std::endl;
+            if (now - fin_send_time >= rtt.rto()) {
+                console() << "FIN包超时，进行第" << (fin_retries + 1) << "次重传" << std::endl;
+                rtt.backoff();
                 send_packet(fin_packet);
                 fin_send_time = now;
                 fin_retries++;
             }
 
             // 尝试接收 FIN_ACK
-            Packet recv_packet;
+            PacketView recv_packet;
             sockaddr_in from;
             if (receive_packet(recv_packet, from)) {
                 if (recv_packet.header.type == FIN_ACK && recv_packet.verify_checksum()) {
                     state = CLOSED;
-                    std::cout << "[✓] 连接已安全关闭！" << std::endl;
+                    console() << "[✓] 连接已安全关闭！" << std::endl;
                     break;
                 }
+                continue;   // 可能还有数据报，先读完再等待
             }
 
-            Sleep(10);  // 短暂等待后再次检查
+            // 等待数据报到达或重传定时器到期
+            udp.wait_until(fin_send_time + rtt.rto());
         }
     }
 
 private:
+    std::ostream& console() {
+        return *out;
+    }
+
+    // ==================== 发送节奏速率 ====================
+    // 功能: 拥塞控制算法给出速率时直接使用；否则把cwnd个包分布到一个SRTT内，按慢启动/拥塞避免乘以增益
+    // 返回: 包/秒，0-还没有RTT样本，不限速
+    double pacing_rate() const {
+        double rate = cc->pacing_rate();
+        if (rate > 0) return rate;
+        int64_t srtt_us = rtt.srtt().count();
+        if (!rtt.sampled() || srtt_us <= 0) return 0;
+        double gain = cc->slow_start() ? PACING_GAIN_SLOW_START : PACING_GAIN;
+        return gain * cc->cwnd() * 1000000.0 / srtt_us;
+    }
+
     // ==================== 发送数据包方法 ====================
     // 功能: 通过UDP套接字发送数据包
     // 参数: packet-要发送的数据包
     void send_packet(const Packet& packet) {
-        std::vector<uint8_t> buffer = packet.serialize();  // 序列化为字节流
-        sendto(sockfd, reinterpret_cast<const char*>(buffer.data()),
-               static_cast<int>(buffer.size()), 0,
-               (struct sockaddr*)&receiver_addr, sizeof(receiver_addr));
+        size_t capacity = 0;
+        uint8_t* out = udp.reserve(capacity);
+        size_t length = packet.serialize_to(out, capacity);  // 直接序列化到发送槽位
+        udp.commit(length, receiver_addr);
+        udp.flush();    // 控制包不等批量，立即提交
 
         // 更新统计信息
         total_packets_sent++;
-        total_bytes_sent += buffer.size();
+        total_bytes_sent += length;
+    }
+
+    // ==================== 发送数据包方法 ====================
+    // 功能: 首次发送一个DATA包
+    // 参数: seq-序列号, data-数据源中的数据(映射页面或预读缓冲区), length-数据长度
+    // 返回: 头部中的校验和，登记到发送窗口供重传使用
+    // 说明: 使用RIO时数据必须放进注册的发送槽位，复制的同时计算校验和；否则数据不复制，聚集发送
+    uint16_t send_data_packet(uint32_t seq, const uint8_t* data, uint16_t length) {
+        PacketHeader header;
+        header.type = DATA;
+        header.window_size = connection_id;
+        header.seq_num = seq;
+        if (udp.registered()) {
+            size_t capacity = 0;
+            uint8_t* out = udp.reserve(capacity);
+            size_t total = write_packet(out, capacity, header, data, length, NULL, 0);
+            if (!udp.commit(total, receiver_addr)) queue_resend(seq);
+            total_packets_sent++;
+            total_bytes_sent += total;
+            memcpy(&header, out, sizeof(PacketHeader));
+            return header.checksum;
+        }
+        seal_header(header, data, length);
+        transmit_data(header, data, length);
+        return header.checksum;
+    }
+
+    // 功能: 发送已填好校验和的DATA包头部和数据
+    // 说明: 头部和数据用两个WSABUF聚集发送，普通调用下数据直接从数据源的内存交给协议栈，不复制到中间缓冲区
+    void transmit_data(const PacketHeader& header, const uint8_t* data, uint16_t length) {
+        WSABUF bufs[2];
+        bufs[0].buf = reinterpret_cast<char*>(const_cast<PacketHeader*>(&header));
+        bufs[0].len = sizeof(PacketHeader);
+        bufs[1].buf = reinterpret_cast<char*>(const_cast<uint8_t*>(data));
+        bufs[1].len = length;
+        if (!udp.send_gather(bufs, 2, receiver_addr)) queue_resend(header.seq_num);
+
+        total_packets_sent++;
+        total_bytes_sent += sizeof(PacketHeader) + length;
+    }
+
+    // ==================== 发送失败重发方法 ====================
+    // 功能: 登记一个未能交给协议栈的DATA包，下一轮发送前重发
+    // 说明: 本地发送失败不是拥塞信号，不等重传定时器到期，也不通知拥塞控制
+    void queue_resend(uint32_t seq) {
+        resend_queue.push_back(seq);
+        counters.add(COUNTER_SEND_FAILURES);
+    }
+
+    // 功能: 重发登记的包(已被确认的跳过)，再次失败的重新登记到下一轮
+    // 返回: false-数据源读取失败
+    bool resend_failed() {
+        if (resend_queue.empty()) return true;
+        std::vector<uint32_t> pending;
+        pending.swap(resend_queue);
+        for (uint32_t seq : pending) {
+            if (window.in_flight(seq) && !retransmit(seq)) return false;
+        }
+        return true;
+    }
+
+    // ==================== 发送修复包方法 ====================
+    // 功能: 发送当前块的FEC修复包，与DATA包一起批量提交
+    // 说明: 修复包不占用序列号，不重传也不计入在途包数
+    void send_repair() {
+        fec.build_repair(repair_packet);
+        repair_packet.header.checksum = 0;
+        repair_packet.header.checksum = htons(repair_packet.calculate_checksum());
+        size_t capacity = 0;
+        uint8_t* out_slot = udp.reserve(capacity);
+        size_t length = repair_packet.serialize_to(out_slot, capacity);
+        udp.commit(length, receiver_addr);
+        total_packets_sent++;
+        total_bytes_sent += length;
+    }
+
+    // ==================== 重传数据包方法 ====================
+    // 功能: 重传窗口中仍在途的数据包，并更新其发送时间和重传次数
+    // 返回: false-数据源读取失败
+    // 说明: 重传包与首次发送只差FLAG_RETRANSMIT一位，头部校验和由首次发送的值按RFC 1624增量更新，
+    //       不再对负载重新求和(数据仍从数据源聚集发送)
+    bool retransmit(uint32_t seq) {
+        SendSlot& s = window.slot(seq);
+        const uint8_t* ptr = nullptr;
+        size_t got = 0;
+        SourceStatus st = source->view(s.offset, s.length, ptr, got);
+        if (st != SOURCE_OK || got != s.length) {
+            // 重传的数据首次发送时读到过，读不全说明数据源出错或已回收
+            if (st == SOURCE_ERROR) {
+                source_error = "重传 seq=" + std::to_string(seq) + " 时" + source->error();
+            } else {
+                source_error = "重传 seq=" + std::to_string(seq) + " 时只读到 " + std::to_string(st == SOURCE_OK ? got : 0) +
+                               "/" + std::to_string(s.length) + " 字节";
+            }
+            return false;
+        }
+        PacketHeader header;
+        header.type = DATA;
+        header.flags = FLAG_RETRANSMIT;
+        header.window_size = connection_id;     // 与首次发送相同，校验和只需按标志位更新
+        header.seq_num = seq;
+        header.data_length = s.length;
+        header.checksum = htons(checksum_update(ntohs(s.checksum),
+            header_type_word(DATA, 0), header_type_word(DATA, FLAG_RETRANSMIT)));
+        transmit_data(header, ptr, s.length);
+        s.send_time = std::chrono::steady_clock::now();
+        s.retransmits++;
+        retransmissions++;
+        record_delivery_state(seq);
+        arm_timer(seq);
+        return true;
+    }
+
+    // ==================== 记录投递状态方法 ====================
+    // 功能: 发送(或重传)时记录当时的累计投递数和投递时间，确认时据此计算投递速率
+    // 说明: 没有在途数据时从当前时刻起算，避免把空闲时间算进速率样本
+    void record_delivery_state(uint32_t seq) {
+        SendSlot& s = window.slot(seq);
+        if (base == next_seq_num) delivered_time = s.send_time;
+        s.delivered = delivered;
+        s.delivered_time = delivered_time;
+    }
+
+    // ==================== 设置重传定时器方法 ====================
+    // 功能: 按当前RTO为刚发送的包设置定时器，作废的定时项过多时顺便清理
+    void arm_timer(uint32_t seq) {
+        SendSlot& s = window.slot(seq);
+        s.deadline = s.send_time + rtt.rto();
+        timers.arm(seq, s.deadline);
+        timers.compact(4 * static_cast<size_t>(window.capacity()),
+            [this](uint32_t t_seq, RetransmitTimers::TimePoint t_deadline) {
+                return window.in_flight(t_seq) && window.slot(t_seq).deadline == t_deadline;
+            });
     }
 
     // ==================== 进度动画显示方法 ====================
@@ -438,136 +1046,243 @@ private:
     void show_spinner() {
         static int spin_state = 0;
         const char spinners[] = { '|', '/', '-', '\\' };  // 四种状态的旋转符号
-        printf("\r%c", spinners[spin_state % 4]);
-        fflush(stdout);
+        async_log().raw(std::string("\r") + spinners[spin_state % 4]);    // 由输出线程写终端，不在收发循环里 flush
         spin_state++;
     }
 
     // ==================== 接收数据包方法 ====================
     // 功能: 从套接字接收数据包
-    // 参数: packet-存储接收到的数据包, from_addr-发送方地址
+    // 参数: packet-指向接收缓冲区的数据包视图(下一次接收前有效), from_addr-发送方地址
     // 返回: true-成功接收，false-无数据
-    bool receive_packet(Packet& packet, sockaddr_in& from_addr) {
-        uint8_t buffer[MAX_PACKET_SIZE * 2];
-        int from_len = sizeof(from_addr);
-
-        int recv_len = recvfrom(sockfd,
-            reinterpret_cast<char*>(buffer),
-            sizeof(buffer), 0,
-            (struct sockaddr*)&from_addr, &from_len);
-
-        if (recv_len > 0) {
+    bool receive_packet(PacketView& packet, sockaddr_in& from_addr) {
+        const uint8_t* data = NULL;
+        size_t length = 0;
+        if (udp.receive(data, length, from_addr)) {
             // 检查是否来自锁定的服务器(安全特性)
             if (server_locked && !same_endpoint(from_addr, server_addr)) {
                 return false;  // 忽略来自其他地址的数据
             }
 
-            packet = Packet::deserialize(buffer, recv_len);  // 反序列化
-            return true;
+            // 在接收缓冲区上原地解析，长度不足的数据报丢弃
+            return packet.parse(data, length);
         }
 
         return false;  // 无数据可读(非阻塞模式)
     }
 
     // ==================== 处理ACK方法 ====================
-    // 功能: 处理接收到的ACK包，实现TCP Reno拥塞控制
+    // 功能: 处理接收到的ACK包: 移动窗口、检测丢包，并把确认情况交给拥塞控制算法
     // 参数: ack_packet-接收到的ACK数据包
-    // 特点: 支持快速重传、慢启动、拥塞避免、快速恢复
-    void handle_ack(const Packet& ack_packet) {
+    // 返回: false-快速重传时数据源读取失败
+    // 特点: 支持快速重传和SACK；每个ACK计算RTT样本和投递速率样本
+    bool handle_ack(const PacketView& ack_packet) {
         uint32_t ack_num = ack_packet.header.ack_num;
+        auto now = std::chrono::steady_clock::now();
+        if (ack_seen) ack_interval.record(now - last_ack_time);
+        last_ack_time = now;
+        ack_seen = true;
+
+        // 流量控制: 采用最新的接收端通告窗口(乱序到达的旧ACK不更新)
+        if (ack_num >= base) receiver_window = ack_packet.header.window_size;
+
+        // 接收端用修复包恢复了一个包: 链路上仍然丢了包，计入丢包率估计(否则FEC生效后估计偏低，修复包随之变少)
+        if (ack_packet.header.flags & FLAG_FEC_RECOVERED) fec.on_loss();
+
+        // RTT样本: 本次新确认的包中最近发送的、未重传过的那个(Karn算法)
+        // 速率样本: 本次新确认的包中最近发送的那个，从它发送到现在新投递的包数 / 经过的时间
+        bool have_sample = false;
+        std::chrono::steady_clock::time_point sample_time;
+        bool have_rate = false;
+        std::chrono::steady_clock::time_point rate_send_time;
+        uint64_t prior_delivered = 0;
+        std::chrono::steady_clock::time_point prior_time;
+        uint32_t newly_acked = 0;
+        auto deliver = [&](uint32_t seq) {
+            if (!window.in_flight(seq)) return;
+            const SendSlot& s = window.slot(seq);
+            // 重传后不到半个最小RTT就被确认: 确认的是原来的包，这次重传是多余的
+            if (s.retransmits > 0 && min_rtt_us > 0 && now - s.send_time < std::chrono::microseconds(min_rtt_us / 2)) {
+                counters.add(COUNTER_SPURIOUS_RETRANSMITS);
+            }
+            if (s.retransmits == 0 && (!have_sample || s.send_time > sample_time)) {
+                sample_time = s.send_time;
+                have_sample = true;
+            }
+            if (!have_rate || s.send_time > rate_send_time) {
+                rate_send_time = s.send_time;
+                prior_delivered = s.delivered;
+                prior_time = s.delivered_time;
+                have_rate = true;
+            }
+            window.acknowledge(seq);
+            newly_acked++;
+        };
 
         // 情况 1: 接收到新的ACK(确认了新数据)
+        bool advanced = false;
         if (ack_num > base) {
+            // 释放已累计确认的槽位，确认号不会超过已发送的范围
+            if (ack_num > next_seq_num) ack_num = next_seq_num;
+            for (uint32_t seq = base; seq < ack_num; ++seq) deliver(seq);
             base = ack_num;  // 移动窗口基序列号
+            // 累计确认之前的数据不会再重传，流式数据源可以回收
+            source->release_before(static_cast<uint64_t>(base - seq_num) * payload_size);
             duplicate_acks = 0;  // 重置重复ACK计数器
-
-            // 根据当前拥塞控制状态调整cwnd
-            if (cong_state == SLOW_START) {
-                // 慢启动: 指数增长
-                cwnd += 1.0;
-                if (cwnd >= ssthresh) {
-                    cong_state = CONGESTION_AVOIDANCE;  // 达到阈值，转为拥塞避免
-                }
-            } else if (cong_state == CONGESTION_AVOIDANCE) {
-                // 拥塞避免: 线性增长
-                cwnd += 1.0 / cwnd;
-            } else if (cong_state == FAST_RECOVERY) {
-                // 快速恢复: 恢复为拥塞避免状态
-                cwnd = ssthresh;
-                cong_state = CONGESTION_AVOIDANCE;
-            }
-
-            // 移除已确认的数据包
-            auto it = sent_packets.begin();
-            while (it != sent_packets.end() && it->first < base) {
-                send_times.erase(it->first);
-                it = sent_packets.erase(it);
-            }
-
             last_acked = ack_num;
+            advanced = true;
 
         } else if (ack_num == last_acked) {
             // 情况 2: 接收到重复ACK(可能丢包)
             duplicate_acks++;
+            counters.add(COUNTER_DUPLICATE_ACKS);
 
             // 快速重传: 接收到3个重复ACK
-            if (duplicate_acks == 2) {
-                if (sent_packets.find(ack_num) != sent_packets.end()) {
-                    send_packet(sent_packets[ack_num]);  // 重传丢失的包
-                    retransmissions++;
-                    // 调整拥塞参数
-                    ssthresh = (std::max)(static_cast<uint32_t>(cwnd / 2), 2u);
-                    cwnd = ssthresh + 3;
-                    cong_state = FAST_RECOVERY;
-                }
-            } else if (duplicate_acks > 2 && cong_state == FAST_RECOVERY) {
-                // 快速恢复期间，每个额外的重复ACK增加cwnd
-                cwnd += 1.0;
+            if (duplicate_acks == 2 && window.in_flight(ack_num) && !window.slot(ack_num).lost) {
+                if (!fast_retransmit(ack_num, now)) return false;  // 重传丢失的包
+            }
+        }
+
+        // 处理SACK块(选择性确认)，只处理落在在途范围内的部分
+        uint32_t cumulative_acked = newly_acked;
+        for (uint32_t i = 0; i < ack_packet.sack_count; ++i) {
+            SACKBlock sack = ack_packet.sack(i);
+            uint32_t left = (std::max)(sack.left_edge, base);
+            uint32_t right = (std::min)(sack.right_edge, next_seq_num);
+            for (uint32_t seq = left; seq < right; ++seq) {
+                deliver(seq);  // 已SACK确认的数据不再超时重传
             }
+            if (right > highest_sacked) highest_sacked = right;
+        }
+        if (newly_acked > cumulative_acked) counters.add(COUNTER_SACKED_PACKETS, newly_acked - cumulative_acked);
+
+        // 按SACK记分板判定空洞并定向重传，不等重复ACK计数或超时
+        if (!mark_lost_holes(now)) return false;
+
+        if (have_sample) {
+            int64_t sample_us = std::chrono::duration_cast<std::chrono::microseconds>(now - sample_time).count();
+            rtt.sample(now - sample_time);
+            rtt_histogram.record(sample_us);
+            if (min_rtt_us == 0 || sample_us < min_rtt_us) min_rtt_us = (std::max)(sample_us, static_cast<int64_t>(1));
         }
 
-        // 处理SACK块(选择性确认)
-        for (const auto& sack : ack_packet.sack_blocks) {
-            for (uint32_t seq = sack.left_edge; seq < sack.right_edge; ++seq) {
-                sent_packets.erase(seq);  // 移除已SACK确认的数据
-                send_times.erase(seq);
+        // 交给拥塞控制算法
+        AckEvent ev;
+        ev.now = now;
+        ev.newly_acked = newly_acked;
+        ev.cumulative_advanced = advanced;
+        ev.in_flight = next_seq_num - base;
+        ev.rtt_us = have_sample
+            ? std::chrono::duration_cast<std::chrono::microseconds>(now - sample_time).count() : -1;
+        ev.srtt_us = rtt.sampled() ? rtt.srtt().count() : 0;
+        ev.delivery_rate = 0;
+        ev.prior_delivered = 0;
+        if (newly_acked > 0) {
+            delivered += newly_acked;
+            delivered_time = now;
+            if (have_rate) {
+                double interval = std::chrono::duration<double>(now - prior_time).count();
+                if (interval > 0) ev.delivery_rate = (delivered - prior_delivered) / interval;
+                ev.prior_delivered = prior_delivered;
             }
         }
+        ev.delivered = delivered;
+        cc->on_ack(ev);
+        if (trace.enabled()) trace_point(TRACE_ACK, now);
+        return true;
     }
 
-    // ==================== 检查超时方法 ====================
-    // 功能: 检查是否有数据包超时未确认，并进行重传
-    // 特点: 超时重传会触发拥塞控制调整(返回慢启动)
-    void check_timeout() {
-        auto now = std::chrono::steady_clock::now();
+    // ==================== 快速重传方法 ====================
+    // 功能: 重传判定丢失的包并标记，同一窗口内的多个丢包只让拥塞控制减一次窗口
+    // 返回: false-数据源读取失败(与超时重传一样交给send_file中止传输)
+    bool fast_retransmit(uint32_t seq, std::chrono::steady_clock::time_point now) {
+        if (!retransmit(seq)) return false;
+        window.slot(seq).lost = true;
+        fec.on_loss();
+        counters.add(COUNTER_FAST_RETRANSMITS);
+        if (seq >= recovery_end) {
+            recovery_end = next_seq_num;
+            cc->on_loss(now, next_seq_num - base);
+            if (trace.enabled()) trace_point(TRACE_LOSS, now);
+        }
+        return true;
+    }
 
-        for (auto it = send_times.begin(); it != send_times.end(); ) {
-            // 计算已经过去的时间
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                now - it->second).count();
-
-            // 检查是否超过超时限制
-            if (elapsed > TIMEOUT_MS) {
-                uint32_t seq = it->first;
-
-                // 重传超时的数据包
-                if (sent_packets.find(seq) != sent_packets.end()) {
-                    send_packet(sent_packets[seq]);
-                    retransmissions++;
-                    it->second = now;  // 更新发送时间
-
-                    // 超时重传触发拥塞控制调整
-                    ssthresh = (std::max)(static_cast<uint32_t>(cwnd / 2), 2u);
-                    cwnd = 1.0;  // 重置拥塞窗口
-                    cong_state = SLOW_START;  // 返回慢启动状态
-                    duplicate_acks = 0;
-                }
+    // ==================== 记录轨迹方法 ====================
+    // 功能: 把当前的拥塞窗口、阈值、在途包数和RTT写入轨迹；状态改变时再记一条TRACE_PHASE
+    // 说明: 调用方先判断trace.enabled()，轨迹关闭时不读取任何状态
+    void trace_point(TraceEvent event, std::chrono::steady_clock::time_point now) {
+        CongestionPhase phase = cc->phase();
+        fill_trace(trace.next(now), event, phase);
+        if (phase != traced_phase) {
+            fill_trace(trace.next(now), TRACE_PHASE, phase);
+            traced_phase = phase;
+        }
+    }
 
-                ++it;
-            } else {
-                ++it;
+    void fill_trace(TraceRecord& r, TraceEvent event, CongestionPhase phase) {
+        r.event = static_cast<uint8_t>(event);
+        r.phase = static_cast<uint8_t>(phase);
+        r.base = base;
+        r.cwnd = cc->cwnd();
+        r.ssthresh = cc->ssthresh();
+        r.in_flight = next_seq_num - base;
+        r.rwnd = receiver_window;
+        r.srtt_us = static_cast<uint32_t>(rtt.srtt().count());
+        r.rto_us = static_cast<uint32_t>(rtt.rto_us());
+    }
+
+    // ==================== 标记空洞方法 ====================
+    // 功能: 其后已有DUP_THRESH个包被SACK确认的在途包判定为丢失(RFC 6675)，逐个快速重传
+    // 说明: 从最高的SACK边界往下数DUP_THRESH个已确认的包得到判定上限；
+    //       hole_scan只前进，每个序列号只检查一次，多个SACK块之间的空洞在一个ACK内全部补发
+    // 返回: false-重传时数据源读取失败
+    bool mark_lost_holes(std::chrono::steady_clock::time_point now) {
+        if (highest_sacked <= base) return true;
+        uint32_t limit = highest_sacked;
+        uint32_t sacked_above = 0;
+        while (limit > base && sacked_above < DUP_THRESH) {
+            limit--;
+            if (!window.in_flight(limit)) sacked_above++;
+        }
+        if (sacked_above < DUP_THRESH) return true;
+
+        for (uint32_t seq = (std::max)(hole_scan, base); seq < limit; ++seq) {
+            if (window.in_flight(seq) && !window.slot(seq).lost && !fast_retransmit(seq, now)) return false;
+        }
+        if (limit > hole_scan) hole_scan = limit;
+        return true;
+    }
+
+    // ==================== 检查超时方法 ====================
+    // 功能: 从定时器堆中取出到期的数据包并重传
+    // 特点: 一轮超时只退避一次RTO、通知一次拥塞控制，重传的包按退避后的RTO重新计时
+    // 返回: false-重传时数据源读取失败
+    bool check_timeout() {
+        auto now = std::chrono::steady_clock::now();
+        bool timed_out = false;
+
+        uint32_t seq;
+        RetransmitTimers::TimePoint deadline;
+        while (timers.pop_expired(now, seq, deadline)) {
+            // 已确认或已重新计时的包，定时项作废
+            if (!window.in_flight(seq) || window.slot(seq).deadline != deadline) continue;
+
+            if (!timed_out) {
+                timed_out = true;
+                rtt.backoff();
+                cc->on_timeout(now);
+                duplicate_acks = 0;
+                recovery_end = next_seq_num;    // 超时前已发送的包再触发快速重传时不再减窗
+                counters.add(COUNTER_TIMEOUTS);
+                if (trace.enabled()) trace_point(TRACE_TIMEOUT, now);
             }
+
+            // 重传超时的数据包(同时更新发送时间并重新计时)
+            if (!retransmit(seq)) return false;
+            fec.on_loss();
+            counters.add(COUNTER_TIMEOUT_RETRANSMITS);
         }
+        return true;
     }
 
     // ==================== 比较地址方法 ====================
@@ -579,38 +1294,216 @@ private:
     }
 };
 
+// ==================== 传输一个文件(或其中一段) ====================
+// 功能: 发送文件名(携带文件大小和本流负责的范围)，确认后传输数据并断开连接
+// 参数: source-本流发送的数据, info-文件名包的内容, log-错误信息的输出位置
+// 返回: true-传输成功
+bool transfer(Sender& sender, FileSource& source, const FileInfo& info, std::ostream& log) {
+    ChunkMap chunks;
+    if (!sender.send_file_name(source, info, chunks)) {
+        log << "[✗] 文件名确认失败" << std::endl;
+        return false;
+    }
+
+    // 续传时只发送接收端需要的块；约定压缩时由工作线程在发送之前压缩(并行时各流平分线程)
+    ChunkFileSource resumed(source, chunks);
+    FileSource& raw = chunks.active() ? static_cast<FileSource&>(resumed) : source;
+    std::unique_ptr<CompressedFileSource> compressed;
+    if (sender.compressing()) {
+        unsigned threads = (std::max)(1u, codec_threads() / (std::max)(static_cast<unsigned>(info.range.flow_count), 1u));
+        compressed.reset(new CompressedFileSource(raw, threads));
+    }
+    if (!sender.send_file(compressed ? static_cast<FileSource&>(*compressed) : raw)) {
+        log << "[✗] 发送文件失败" << std::endl;
+        return false;
+    }
+
+    sender.disconnect();
+    return true;
+}
+
+// ==================== 并行传输统计 ====================
+// 功能: 把各个流的统计合并为整个文件的统计(控制台汇总和结果JSON共用)
+// 参数: elapsed_ms-整体耗时，吞吐率按它计算；平滑RTT取各流中最大的
+TransferStats aggregate_flow_stats(const std::vector<TransferStats>& flows, int64_t elapsed_ms) {
+    TransferStats total;
+    total.duration_ms = elapsed_ms;
+    for (const TransferStats& f : flows) {
+        total.file_bytes += f.file_bytes;      // 续传时只计实际传输的数据
+        total.bytes_sent += f.bytes_sent;
+        total.packets_sent += f.packets_sent;
+        total.retransmissions += f.retransmissions;
+        total.syscalls += f.syscalls;
+        total.datagrams += f.datagrams;
+        total.srtt_ms = (std::max)(total.srtt_ms, f.srtt_ms);
+        total.counters.add(f.counters);
+        total.rtt.add(f.rtt);
+        total.ack_interval.add(f.ack_interval);
+    }
+    return total;
+}
+
+// 功能: 逐个流列出统计结果，再给出整个文件的汇总(total由aggregate_flow_stats得到)
+void print_parallel_stats(const std::vector<TransferStats>& flows, uint16_t first_port, const TransferStats& total) {
+    std::cout << "\n========== 并行传输统计 ==========" << std::endl;
+    std::cout << "  流  端口   数据字节      时间(ms)  吞吐率(Mbps)  重传    RTT(ms)" << std::endl;
+    for (size_t i = 0; i < flows.size(); ++i) {
+        const TransferStats& f = flows[i];
+        std::cout << "  " << std::setw(2) << i << "  " << std::setw(5) << (first_port + i)
+                  << "  " << std::setw(12) << f.file_bytes << "  " << std::setw(8) << f.duration_ms
+                  << "  " << std::setw(12) << std::fixed << std::setprecision(2) << f.throughput_mbps()
+                  << "  " << std::setw(6) << f.retransmissions << "  " << std::setw(6) << f.srtt_ms << std::endl;
+    }
+    std::cout << "──────────────────────────────" << std::endl;
+    std::cout << "  并行流数:    " << flows.size() << std::endl;
+    std::cout << "  传输时间:    " << total.duration_ms << " ms" << std::endl;
+    std::cout << "  吞吐率:      " << std::fixed << std::setprecision(2) << total.throughput_mbps() << " Mbps" << std::endl;
+    std::cout << "  总字节数:    " << total.bytes_sent << std::endl;
+    std::cout << "  总包数:      " << total.packets_sent << std::endl;
+    std::cout << "  重传次数:    " << total.retransmissions << std::endl;
+    std::cout << "  系统调用:    " << total.syscalls << " 次, 每包 " << std::setprecision(3)
+              << (total.datagrams ? static_cast<double>(total.syscalls) / total.datagrams : 0.0) << std::endl;
+    std::cout << "  RTT分布:     ";
+    total.rtt.describe(std::cout);
+    std::cout << std::endl << "  ACK间隔:     ";
+    total.ack_interval.describe(std::cout);
+    std::cout << std::endl << "  诊断计数:" << std::endl;
+    total.counters.describe(std::cout);
+    std::cout << "──────────────────────────────" << std::endl;
+}
+
+// 功能: 并行传输时第i个流的轨迹文件名，如 trace.csv -> trace_2.csv
+std::string trace_path(const std::string& path, int flow) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    std::ostringstream name;
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        name << path << "_" << flow;
+    } else {
+        name << path.substr(0, dot) << "_" << flow << path.substr(dot);
+    }
+    return name.str();
+}
+
+// ==================== 机器可读的结果 ====================
+// 功能: 传输成功后把结果追加为一行JSON，供测试程序(bench.exe)读取
+// 参数: path-结果文件, name-传输的文件名, cc_name-拥塞控制算法, total-整个文件的统计
+void write_result(const std::string& path, const std::string& name, const std::string& cc_name, int flows,
+                  const TransferStats& total) {
+    std::ofstream out(path.c_str(), std::ios::app);
+    if (!out) {
+        std::cerr << "[!] 无法写入结果文件: " << path << std::endl;
+        return;
+    }
+    std::string escaped;
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (name[i] == '"' || name[i] == '\\') escaped += '\\';
+        escaped += name[i];
+    }
+    out << std::fixed << std::setprecision(3)
+        << "{\"file\":\"" << escaped << "\",\"cc\":\"" << cc_name << "\",\"flows\":" << flows
+        << ",\"file_bytes\":" << total.file_bytes << ",\"transfer_ms\":" << total.duration_ms
+        << ",\"goodput_mbps\":" << total.throughput_mbps() << ",\"throughput_mbps\":" << total.wire_mbps()
+        << ",\"bytes_sent\":" << total.bytes_sent << ",\"packets_sent\":" << total.packets_sent
+        << ",\"retransmissions\":" << total.retransmissions << ",\"retransmit_ratio\":"
+        << (total.packets_sent ? static_cast<double>(total.retransmissions) / total.packets_sent : 0.0)
+        << ",\"srtt_ms\":" << total.srtt_ms << ",\"rtt_p50_ms\":" << total.rtt.percentile(50) / 1000.0
+        << ",\"rtt_p99_ms\":" << total.rtt.percentile(99) / 1000.0 << ",\"ack_interval_p50_ms\":"
+        << total.ack_interval.percentile(50) / 1000.0 << ",\"ack_interval_p99_ms\":"
+        << total.ack_interval.percentile(99) / 1000.0;
+    total.counters.write_json(out);
+    out << "}" << std::endl;
+}
+
+// 用法: sender.exe --local IP:端口 --remote IP:端口 --file 路径 [--cc reno|cubic|bbr] [--flows N] [--result 结果文件]
+//                  [--trace 轨迹文件(.csv/.json)] [--trace-size 条数]
+//       不带参数时在控制台逐项询问
 int main(int argc, char* argv[]) {
     WinsockInitializer winsock;
 
     std::string sender_ip, receiver_ip, filename;
-    uint16_t sender_port, receiver_port;
-
-    std::cout << "\n══════════ 发送端配置 ══════════" << std::endl;
-    std::cout << "请输入本机IP地址: ";
-    std::cin >> sender_ip;
-    std::cout << "请输入本机端口号: ";
-    std::cin >> sender_port;
-    std::cout << "请输入接收端IP地址: ";
-    std::cin >> receiver_ip;
-    std::cout << "请输入接收端端口号: ";
-    std::cin >> receiver_port;
-
-    Sender sender(sender_ip.c_str(), sender_port, receiver_ip.c_str(), receiver_port);
-
-    if (!sender.connect()) {
-        std::cerr << "[✗] 连接失败，程序退出" << std::endl;
-        return 1;
+    uint16_t sender_port = 0, receiver_port = 0;
+    std::string cc_name;
+    int flow_count = 1;
+
+    CommandLine args(argc, argv);
+    bool interactive = args.empty();
+    if (!interactive) {
+        if (!args.endpoint("local", sender_ip, sender_port) || !args.endpoint("remote", receiver_ip, receiver_port) ||
+            !args.has("file")) {
+            std::cerr << "用法: sender.exe --local IP:端口 --remote IP:端口 --file 路径 [--cc reno|cubic|bbr] "
+                         "[--flows N] [--result 结果文件] [--trace 轨迹文件] [--trace-size 条数]" << std::endl;
+            return 1;
+        }
+        filename = args.get("file");
+        cc_name = args.get("cc", "reno");
+        flow_count = static_cast<int>(args.number("flows", 1));
+    } else {
+        std::cout << "\n══════════ 发送端配置 ══════════" << std::endl;
+        std::cout << "请输入本机IP地址: ";
+        std::cin >> sender_ip;
+        std::cout << "请输入本机端口号: ";
+        std::cin >> sender_port;
+        std::cout << "请输入接收端IP地址: ";
+        std::cin >> receiver_ip;
+        std::cout << "请输入接收端端口号: ";
+        std::cin >> receiver_port;
+
+        std::cout << "请选择拥塞控制算法 (reno/cubic/bbr): ";
+        std::cin >> cc_name;
+
+        // 并行传输: 文件分成连续的几段，每段由一个流(独立的发送端、端口和线程)传输；接收端需配置相同的流数
+        std::cout << "请输入并行流数 (1-" << MAX_PARALLEL_FLOWS << "): ";
+        std::cin >> flow_count;
+    }
+    if (flow_count < 1 || flow_count > MAX_PARALLEL_FLOWS) {
+        std::cout << "并行流数超出范围，使用单个流" << std::endl;
+        flow_count = 1;
+    }
+    bool parallel = flow_count > 1;
+
+    // 第i个流使用 本机端口+i 和 接收端端口+i；并行时各流的进度信息写入各自的缓冲，失败时再显示
+    std::vector<std::unique_ptr<Sender>> senders;
+    std::vector<std::unique_ptr<std::ostringstream>> logs;
+    for (int i = 0; i < flow_count; ++i) {
+        senders.emplace_back(new Sender(sender_ip.c_str(), static_cast<uint16_t>(sender_port + i),
+                                        receiver_ip.c_str(), static_cast<uint16_t>(receiver_port + i)));
+        if (!senders[i]->set_congestion_control(cc_name) && i == 0) {
+            std::cout << "未知的拥塞控制算法 \"" << cc_name << "\"，使用 reno" << std::endl;
+        }
+        if (args.has("trace")) {
+            senders[i]->enable_trace(static_cast<size_t>((std::max)(args.number("trace-size", TRACE_DEFAULT_RECORDS), 1L)));
+        }
+        logs.emplace_back(new std::ostringstream);
+        if (parallel) senders[i]->set_console(*logs[i]);
     }
 
-    std::cout << "\n请输入要传输的文件路径: ";
-    std::cin >> filename;
+    for (int i = 0; i < flow_count; ++i) {
+        if (!senders[i]->connect()) {
+            if (parallel) std::cout << logs[i]->str();
+            std::cerr << "[✗] 连接失败，程序退出" << std::endl;
+            return 1;
+        }
+        if (parallel) std::cout << "[✓] 流 " << i << " 已连接 (端口 " << (sender_port + i) << ")" << std::endl;
+    }
+
+    if (interactive) {
+        std::cout << "\n请输入要传输的文件路径: ";
+        std::cin >> filename;
+    }
 
-    std::ifstream file_check(filename, std::ios::binary);
-    if (!file_check.is_open()) {
+    // 先打开数据源: 文件大小随FILE_NAME发给接收端，用于预分配输出文件
+    // 命名管道只能打开一次，打开后的数据源直接用于传输
+    std::unique_ptr<FileSource> source = FileSource::open(filename.c_str());
+    if (!source) {
         std::cerr << "[✗] 无法打开文件: " << filename << std::endl;
         return 1;
     }
-    file_check.close();
+    if (parallel && !source->size_known()) {
+        std::cerr << "[✗] 流式输入不知道文件大小，不能分段并行传输" << std::endl;
+        for (auto& sender : senders) sender->disconnect();
+        return 1;
+    }
 
     std::string basename;
     size_t slash_pos = filename.find_last_of("/\\");
@@ -620,30 +1513,68 @@ int main(int argc, char* argv[]) {
         basename = filename;
     }
 
-    Packet name_pkt;
-    name_pkt.header.type = FILE_NAME;
-    if (!basename.empty()) {
-        uint16_t len = static_cast<uint16_t>(basename.size());
-        if (len > MAX_DATA_SIZE) len = MAX_DATA_SIZE;
-        name_pkt.header.data_length = len;
-        memcpy(name_pkt.data, basename.data(), len);
+    FileInfo info;
+    info.name = basename;
+    info.size_known = source->size_known();
+    info.size = source->size();
+    info.range.length = info.size;
+
+    TransferStats total;
+    if (!parallel) {
+        bool ok = transfer(*senders[0], *source, info, std::cerr);
+        if (args.has("trace")) senders[0]->dump_trace(args.get("trace"));    // 失败时也导出，便于分析原因
+        if (!ok) return 1;
+        total = senders[0]->transfer_stats();
     } else {
-        name_pkt.header.data_length = 0;
-    }
-    name_pkt.header.checksum = htons(name_pkt.calculate_checksum());
-    sender.send_control_packet(name_pkt);
-
-    if (!sender.wait_for_file_name_ack(name_pkt)) {
-        std::cerr << "[✗] 文件名确认失败，程序退出" << std::endl;
-        return 1;
-    }
+        // 每个流按自己的范围打开文件(各自的句柄和映射视图)，各段大小相差不超过1字节
+        source.reset();
+        std::vector<char> succeeded(flow_count, 0);
+        std::vector<std::thread> threads;
+        std::cout << "\n========== 并行传输阶段 ==========" << std::endl;
+        std::cout << "文件大小: " << info.size << " 字节, " << flow_count << " 个流" << std::endl;
+        auto start_time = std::chrono::steady_clock::now();
+        for (int i = 0; i < flow_count; ++i) {
+            FileInfo part = info;
+            part.range.offset = info.size * i / flow_count;
+            part.range.length = info.size * (i + 1) / flow_count - part.range.offset;
+            part.range.flow_index = static_cast<uint16_t>(i);
+            part.range.flow_count = static_cast<uint16_t>(flow_count);
+            threads.emplace_back([&, i, part]() {
+                std::unique_ptr<FileSource> range = FileSource::open_range(filename.c_str(), part.range.offset, part.range.length);
+                if (!range) {
+                    *logs[i] << "[✗] 无法打开文件: " << filename << std::endl;
+                    return;
+                }
+                succeeded[i] = transfer(*senders[i], *range, part, *logs[i]);
+            });
+        }
+        for (auto& t : threads) t.join();
+        int64_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start_time).count();
+        if (args.has("trace")) {
+            for (int i = 0; i < flow_count; ++i) senders[i]->dump_trace(trace_path(args.get("trace"), i));
+        }
 
-    if (!sender.send_file(filename.c_str())) {
-        std::cerr << "[✗] 发送文件失败" << std::endl;
-        return 1;
+        bool all_ok = true;
+        std::vector<TransferStats> flow_stats;
+        for (int i = 0; i < flow_count; ++i) {
+            if (!succeeded[i]) {
+                std::cout << "\n---------- 流 " << i << " 的输出 ----------" << std::endl << logs[i]->str();
+                all_ok = false;
+            }
+            flow_stats.push_back(senders[i]->transfer_stats());
+        }
+        if (!all_ok) {
+            std::cerr << "[✗] 部分流传输失败" << std::endl;
+            return 1;
+        }
+        std::cout << "[✓] 传输完成！" << std::endl;
+        total = aggregate_flow_stats(flow_stats, elapsed_ms);
+        print_parallel_stats(flow_stats, sender_port, total);
     }
 
-    sender.disconnect();
+    if (args.has("result")) write_result(args.get("result"), basename, cc_name, flow_count, total);
+    if (!interactive) return 0;
 
     std::cout << "按任意键退出..." << std::endl;
     std::cin.ignore();
@@ -0,0 +1,327 @@
+// telemetry.h
+// 文件说明: 传输过程的诊断信息
+// 功能: 无锁计数器(超时、快速重传、不必要的重传、重复包、SACK、校验和错误等)、RTT和ACK间隔直方图，
+//       以及可选的拥塞控制轨迹(每个ACK记录一次cwnd/ssthresh/状态，写入固定大小的环形缓冲区，结束后导出CSV或JSON)
+// 说明: 计数器和直方图始终开启，每次更新是一次relaxed原子加法；轨迹未开启时只有一次分支判断
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <iomanip>
+
+// ==================== 计数器 ====================
+enum TelemetryCounter {
+    COUNTER_TIMEOUTS,               // 超时事件(一轮超时计一次)
+    COUNTER_TIMEOUT_RETRANSMITS,    // 超时重传的包数
+    COUNTER_FAST_RETRANSMITS,       // 快速重传的包数(重复ACK或SACK判定的空洞)
+    COUNTER_SPURIOUS_RETRANSMITS,   // 不必要的重传: 发送端按确认时间判断 / 接收端收到已有数据的重传包
+    COUNTER_DUPLICATE_ACKS,         // 收到的重复ACK
+    COUNTER_SACKED_PACKETS,         // 由SACK块确认的包数
+    COUNTER_DUPLICATE_PACKETS,      // 收到的已有数据的包
+    COUNTER_OUT_OF_ORDER,           // 乱序到达的新数据包
+    COUNTER_BEYOND_WINDOW,          // 超出接收窗口而丢弃的包
+    COUNTER_CHECKSUM_FAILURES,      // 校验和错误而丢弃的包
+    COUNTER_CWND_LIMITED,           // 发送轮次被拥塞窗口限制
+    COUNTER_RWND_LIMITED,           // 发送轮次被接收端通告窗口限制
+    COUNTER_SOURCE_STALLS,          // 发送轮次因数据源(流式输入或压缩线程)暂无数据而停下
+    COUNTER_SEND_FAILURES,          // 未能交给协议栈而排队重发的DATA包(发送缓冲区或RIO请求队列满)
+    COUNTER_COUNT
+};
+
+inline const char* telemetry_counter_name(int counter) {
+    static const char* names[COUNTER_COUNT] = {
+        "timeouts", "timeout_retransmits", "fast_retransmits", "spurious_retransmits", "duplicate_acks",
+        "sacked_packets", "duplicate_packets", "out_of_order", "beyond_window", "checksum_failures",
+        "cwnd_limited", "rwnd_limited", "source_stalls", "send_failures"
+    };
+    return counter >= 0 && counter < COUNTER_COUNT ? names[counter] : "unknown";
+}
+
+// 计数器的一份快照(可复制，并行传输时按流相加)
+struct CounterSnapshot {
+    uint64_t values[COUNTER_COUNT];
+
+    CounterSnapshot() {
+        for (int i = 0; i < COUNTER_COUNT; ++i) values[i] = 0;
+    }
+
+    uint64_t operator[](TelemetryCounter c) const { return values[c]; }
+
+    void add(const CounterSnapshot& other) {
+        for (int i = 0; i < COUNTER_COUNT; ++i) values[i] += other.values[i];
+    }
+
+    // 功能: 输出不为0的计数器，每行一个
+    void describe(std::ostream& os) const {
+        bool any = false;
+        for (int i = 0; i < COUNTER_COUNT; ++i) {
+            if (values[i] == 0) continue;
+            os << "    " << std::left << std::setw(22) << telemetry_counter_name(i) << std::right
+               << values[i] << std::endl;
+            any = true;
+        }
+        if (!any) os << "    (全部为0)" << std::endl;
+    }
+
+    // 功能: 输出为JSON对象中的若干字段(以逗号开头，接在已有字段之后)
+    void write_json(std::ostream& os) const {
+        for (int i = 0; i < COUNTER_COUNT; ++i) {
+            os << ",\"" << telemetry_counter_name(i) << "\":" << values[i];
+        }
+    }
+};
+
+// 一组计数器: 只由收发线程更新，其他线程可以随时读取(如传输过程中显示，或并行传输结束后汇总)
+class TransferCounters {
+public:
+    TransferCounters() { reset(); }
+
+    void add(TelemetryCounter c, uint64_t n = 1) { values[c].fetch_add(n, std::memory_order_relaxed); }
+
+    uint64_t get(TelemetryCounter c) const { return values[c].load(std::memory_order_relaxed); }
+
+    void reset() {
+        for (int i = 0; i < COUNTER_COUNT; ++i) values[i].store(0, std::memory_order_relaxed);
+    }
+
+    CounterSnapshot snapshot() const {
+        CounterSnapshot s;
+        for (int i = 0; i < COUNTER_COUNT; ++i) s.values[i] = values[i].load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    std::atomic<uint64_t> values[COUNTER_COUNT];
+
+    TransferCounters(const TransferCounters&);
+    TransferCounters& operator=(const TransferCounters&);
+};
+
+// ==================== 直方图 ====================
+// 以微秒为单位的对数直方图: 每个2的幂区间再均分为4个桶，相对误差不超过25%，
+// 覆盖1微秒到约2^40微秒(12天)，记录一次是一次位扫描和一次原子加法
+const int HISTOGRAM_SUB_BITS = 2;
+const int HISTOGRAM_BUCKETS = (41 << HISTOGRAM_SUB_BITS);
+
+inline int histogram_bucket(int64_t us) {
+    if (us < 0) us = 0;
+    uint64_t v = static_cast<uint64_t>(us);
+    if (v < (1u << HISTOGRAM_SUB_BITS)) return static_cast<int>(v);
+    int exponent = 63;
+    while (!(v >> exponent)) exponent--;
+    int bucket = ((exponent - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) +
+                 static_cast<int>((v >> (exponent - HISTOGRAM_SUB_BITS)) & ((1u << HISTOGRAM_SUB_BITS) - 1));
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+// 桶的上界(微秒，不含)
+inline int64_t histogram_bucket_limit(int bucket) {
+    if (bucket < (1 << HISTOGRAM_SUB_BITS)) return bucket + 1;
+    int exponent = (bucket >> HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS - 1;
+    int64_t sub = bucket & ((1 << HISTOGRAM_SUB_BITS) - 1);
+    return (static_cast<int64_t>((1 << HISTOGRAM_SUB_BITS) + sub + 1)) << (exponent - HISTOGRAM_SUB_BITS);
+}
+
+// 直方图的一份快照(可复制、可合并)
+struct HistogramSnapshot {
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    int64_t sum_us;
+    int64_t max_us;
+
+    HistogramSnapshot() : count(0), sum_us(0), max_us(0) {
+        for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) buckets[i] = 0;
+    }
+
+    void add(const HistogramSnapshot& other) {
+        for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) buckets[i] += other.buckets[i];
+        count += other.count;
+        sum_us += other.sum_us;
+        if (other.max_us > max_us) max_us = other.max_us;
+    }
+
+    // 功能: 取百分位数(0~100)
+    // 返回: 所在桶的上界(微秒)，不超过记录到的最大值；没有样本时返回0
+    int64_t percentile(double p) const {
+        if (count == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * count + 0.5);
+        if (rank < 1) rank = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                int64_t limit = histogram_bucket_limit(i);
+                return limit < max_us ? limit : max_us;
+            }
+        }
+        return max_us;
+    }
+
+    double mean_us() const { return count ? static_cast<double>(sum_us) / count : 0.0; }
+
+    // 功能: 输出一行摘要，如 "n=512 平均 1.20 ms, p50 1.02 / p90 1.54 / p99 3.07 / 最大 4.10 ms"
+    void describe(std::ostream& os) const {
+        os << "n=" << count;
+        if (count == 0) return;
+        os << std::fixed << std::setprecision(2) << " 平均 " << mean_us() / 1000.0 << " ms, p50 "
+           << percentile(50) / 1000.0 << " / p90 " << percentile(90) / 1000.0 << " / p99 "
+           << percentile(99) / 1000.0 << " / 最大 " << max_us / 1000.0 << " ms";
+    }
+};
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() { reset(); }
+
+    void record(int64_t us) {
+        if (us < 0) return;
+        buckets[histogram_bucket(us)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum_us.fetch_add(us, std::memory_order_relaxed);
+        int64_t seen = max_us.load(std::memory_order_relaxed);
+        while (us > seen && !max_us.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {}
+    }
+
+    void record(std::chrono::steady_clock::duration d) {
+        record(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    }
+
+    void reset() {
+        for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) buckets[i].store(0, std::memory_order_relaxed);
+        count.store(0, std::memory_order_relaxed);
+        sum_us.store(0, std::memory_order_relaxed);
+        max_us.store(0, std::memory_order_relaxed);
+    }
+
+    HistogramSnapshot snapshot() const {
+        HistogramSnapshot s;
+        for (int i = 0; i < HISTOGRAM_BUCKETS; ++i) s.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        s.count = count.load(std::memory_order_relaxed);
+        s.sum_us = sum_us.load(std::memory_order_relaxed);
+        s.max_us = max_us.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<int64_t> sum_us;
+    std::atomic<int64_t> max_us;
+
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+};
+
+// ==================== 拥塞控制轨迹 ====================
+const long TRACE_DEFAULT_RECORDS = 65536;     // 默认保留的轨迹条数(每条40字节，共2.5MB)
+
+enum TraceEvent {
+    TRACE_ACK,          // 处理完一个ACK(含重复ACK)
+    TRACE_LOSS,         // 快速重传使拥塞控制减窗(每个窗口一次)
+    TRACE_TIMEOUT,      // 重传超时
+    TRACE_PHASE         // 拥塞控制的状态改变(紧接在引起它的事件之后)
+};
+
+inline const char* trace_event_name(int event) {
+    static const char* names[] = { "ack", "loss", "timeout", "phase" };
+    return event >= 0 && event <= TRACE_PHASE ? names[event] : "unknown";
+}
+
+// 一条轨迹记录(40字节)，直接写入环形缓冲区，不做格式化
+struct TraceRecord {
+    int64_t time_us;        // 距传输开始的时间(微秒)
+    uint32_t base;          // 累计确认点(最小未确认序列号)
+    uint32_t cwnd;          // 拥塞窗口(包)
+    uint32_t ssthresh;      // 慢启动阈值(包)，算法没有阈值时为0
+    uint32_t in_flight;     // 在途包数
+    uint32_t rwnd;          // 接收端通告窗口(包)
+    uint32_t srtt_us;       // 平滑RTT(微秒)
+    uint32_t rto_us;        // 当前RTO(微秒)，含退避
+    uint8_t event;          // TraceEvent
+    uint8_t phase;          // 拥塞控制状态(CongestionPhase)
+    uint16_t reserved;
+};
+
+// 固定容量的环形缓冲区: 写满后覆盖最早的记录，只保留最后capacity条
+// 容量为0时不开启，调用方先用enabled()判断，关闭时不必准备记录的内容
+// 只由发送线程写入，传输结束后在同一线程导出
+class TraceRing {
+public:
+    TraceRing() : head(0), mask(0) {}
+
+    // 功能: 开启并分配缓冲区，capacity向上取整为2的幂；0-关闭
+    void enable(size_t capacity) {
+        records.clear();
+        head = 0;
+        mask = 0;
+        if (capacity == 0) return;
+        size_t cap = 1;
+        while (cap < capacity) cap <<= 1;
+        records.resize(cap);
+        mask = cap - 1;
+    }
+
+    bool enabled() const { return !records.empty(); }
+
+    // 功能: 设定时间零点并清空已有记录
+    void start(std::chrono::steady_clock::time_point now) {
+        origin = now;
+        head = 0;
+    }
+
+    // 功能: 取得下一条记录的位置(覆盖最早的记录)，时间已填好
+    TraceRecord& next(std::chrono::steady_clock::time_point now) {
+        TraceRecord& r = records[head & mask];
+        head++;
+        r.time_us = std::chrono::duration_cast<std::chrono::microseconds>(now - origin).count();
+        r.reserved = 0;
+        return r;
+    }
+
+    // 写入过的总条数，超过容量的部分已被覆盖
+    uint64_t written() const { return head; }
+    size_t size() const { return static_cast<size_t>(head < records.size() ? head : records.size()); }
+
+    // 功能: 按时间顺序导出保留的记录；文件名以 .json 结尾时写成JSON数组，否则写成CSV
+    // 参数: phase_name-把状态编号转换为名称
+    // 返回: false-无法写入文件
+    bool dump(const std::string& path, const char* (*phase_name)(int)) const {
+        std::ofstream out(path.c_str(), std::ios::trunc);
+        if (!out) return false;
+        bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+        uint64_t first = head - size();
+        if (json) out << "[\n";
+        else out << "time_us,event,phase,base,cwnd,ssthresh,in_flight,rwnd,srtt_us,rto_us\n";
+        for (uint64_t i = first; i < head; ++i) {
+            const TraceRecord& r = records[i & mask];
+            if (json) {
+                out << (i == first ? "" : ",\n") << "{\"time_us\":" << r.time_us << ",\"event\":\""
+                    << trace_event_name(r.event) << "\",\"phase\":\"" << phase_name(r.phase) << "\",\"base\":"
+                    << r.base << ",\"cwnd\":" << r.cwnd << ",\"ssthresh\":" << r.ssthresh << ",\"in_flight\":"
+                    << r.in_flight << ",\"rwnd\":" << r.rwnd << ",\"srtt_us\":" << r.srtt_us << ",\"rto_us\":"
+                    << r.rto_us << "}";
+            } else {
+                out << r.time_us << ',' << trace_event_name(r.event) << ',' << phase_name(r.phase) << ','
+                    << r.base << ',' << r.cwnd << ',' << r.ssthresh << ',' << r.in_flight << ',' << r.rwnd << ','
+                    << r.srtt_us << ',' << r.rto_us << '\n';
+            }
+        }
+        if (json) out << (head > first ? "\n" : "") << "]\n";
+        return static_cast<bool>(out);
+    }
+
+private:
+    std::vector<TraceRecord> records;
+    uint64_t head;          // 下一条记录的编号
+    size_t mask;
+    std::chrono::steady_clock::time_point origin;
+};
+
+#endif // TELEMETRY_H
@@ -0,0 +1,348 @@
+// http_bench.cpp
+//
+// MinGW:
+//   g++ -std=c++17 -O2 http_bench.cpp -lws2_32 -o http_bench.exe
+//
+// Requests-per-second benchmark for http_server.exe. Opens N keep-alive connections; each keeps D requests
+// in flight (D > 1 pipelines them) for the given paths in turn, and every response is timed from sending
+// its request to receiving its last byte. A connection closed by the server is reopened and counted.
+//
+// Usage: http_bench.exe [--host IP] [--port N] [--connections N] [--pipeline D] [--duration SEC]
+//                       [--path P]... [--gzip] [--range SPEC]
+//   --connections  concurrent keep-alive connections (default 64)
+//   --pipeline     requests in flight per connection (default 1)
+//   --duration     measuring time in seconds (default 10)
+//   --path         request path, repeat to rotate over several files (default /index.html)
+//   --gzip         send Accept-Encoding: gzip
+//   --range        send "Range: bytes=SPEC", e.g. --range 0-65535
+//
+// Report: requests/s, MB/s received, status code counts, p50/p99/p999/max latency (us).
+
+#include <winsock2.h>
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "http_request.h"
+
+const size_t BENCH_SELECT_GROUP = 64;       // 每个线程负责的连接数（Windows 默认 FD_SETSIZE）
+const size_t BENCH_RECV_BUF = 64 * 1024;
+const size_t BENCH_MAX_HEADER = 16 * 1024;  // 超过该长度还没有收到完整响应头时视为错误
+
+// 单调时钟，微秒
+int64_t now_us(){
+    static LARGE_INTEGER freq = []{ LARGE_INTEGER f; QueryPerformanceFrequency(&f); return f; }();
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return (int64_t)(t.QuadPart / freq.QuadPart * 1000000 + t.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+}
+
+// 一个保持连接及其响应解析状态
+struct BenchConn {
+    SOCKET sock = INVALID_SOCKET;
+    bool alive = false;
+    size_t next_path = 0;               // 下一个请求使用的路径下标
+    std::deque<int64_t> sent_at;        // 在途请求的发送时间，响应按顺序返回
+    std::string head;                   // 尚未完整的响应头
+    bool in_body = false;
+    uint64_t body_left = 0;
+    bool close_after = false;           // 当前响应带 "Connection: close"
+    int status = 0;                     // 当前响应的状态码，收完正文后计入统计
+};
+
+// 一个线程的统计，线程结束后由主线程合并
+struct BenchStats {
+    std::vector<uint32_t> latencies;    // 每个响应的延迟（微秒）
+    uint64_t completed = 0;
+    uint64_t bytes = 0;                 // 收到的字节数（响应头 + 正文）
+    uint64_t status[6] = {0};           // 按状态码的百位计数，下标 0 为无法解析的状态行
+    uint64_t reconnects = 0;            // 被服务器关闭后重新建立的连接数
+};
+
+std::atomic<bool> running(true);        // 测量期间为 true
+sockaddr_in server_addr;
+std::vector<std::string> requests;      // 每个路径预先拼好的完整请求
+
+bool iequals_prefix(const char* p, const char* prefix){
+    for (; *prefix; ++p, ++prefix) {
+        char a = *p, b = *prefix;
+        if (a >= 'A' && a <= 'Z') a = (char)(a - 'A' + 'a');
+        if (a != b) return false;
+    }
+    return true;
+}
+
+bool open_conn(BenchConn& c){
+    c = BenchConn();
+    c.sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (c.sock == INVALID_SOCKET) return false;
+    BOOL on = TRUE;
+    setsockopt(c.sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+    if (connect(c.sock, (sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR) {
+        closesocket(c.sock);
+        c.sock = INVALID_SOCKET;
+        return false;
+    }
+    c.alive = true;
+    return true;
+}
+
+// 发出 count 个请求（流水线时合并为一次 send），记录发送时间
+bool send_requests(BenchConn& c, size_t count){
+    std::string out;
+    for (size_t i = 0; i < count; ++i) {
+        out += requests[c.next_path];
+        c.next_path = (c.next_path + 1) % requests.size();
+    }
+    int64_t t = now_us();
+    for (size_t i = 0; i < count; ++i) c.sent_at.push_back(t);
+    size_t done = 0;
+    while (done < out.size()) {
+        int n = send(c.sock, out.data() + done, (int)(out.size() - done), 0);
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+// 解析完整的响应头：取出状态码、Content-Length 和 Connection: close
+bool parse_head(BenchConn& c){
+    const std::string& h = c.head;
+    int code = 0;
+    if (h.size() > 12 && h.compare(0, 7, "HTTP/1.") == 0) code = std::atoi(h.c_str() + 9);
+    c.status = code;
+    c.body_left = 0;
+    c.close_after = false;
+    size_t pos = h.find("\r\n");
+    while (pos != std::string::npos && pos + 2 < h.size()) {
+        size_t eol = h.find("\r\n", pos + 2);
+        const char* line = h.c_str() + pos + 2;
+        if (iequals_prefix(line, "content-length:")) {
+            c.body_left = std::strtoull(line + 15, nullptr, 10);
+        } else if (iequals_prefix(line, "connection:")) {
+            size_t close = h.find("close", pos + 2);
+            c.close_after = close != std::string::npos && close < eol;
+        }
+        pos = eol;
+    }
+    if (code == 304 || code == 204) c.body_left = 0;
+    return code != 0;
+}
+
+// 处理收到的 n 字节，返回完成的响应数；响应格式错误时返回 -1
+int feed(BenchConn& c, const char* p, size_t n, int64_t now, BenchStats& st){
+    int completed = 0;
+    st.bytes += n;
+    while (n > 0) {
+        if (c.in_body) {
+            size_t take = (size_t)(std::min)((uint64_t)n, c.body_left);
+            c.body_left -= take;
+            p += take;
+            n -= take;
+        } else {
+            // 先把数据追加到响应头缓冲区，找到空行后把多出的部分退回
+            size_t old = c.head.size();
+            c.head.append(p, n);
+            size_t end = c.head.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+            if (end == std::string::npos) {
+                if (c.head.size() > BENCH_MAX_HEADER) return -1;
+                return completed;
+            }
+            size_t used = end + 4 - old;
+            p += used;
+            n -= used;
+            c.head.resize(end + 4);
+            if (!parse_head(c)) return -1;
+            c.head.clear();
+            c.in_body = true;
+        }
+        if (c.in_body && c.body_left == 0) {
+            c.in_body = false;
+            if (c.sent_at.empty()) return -1;      // 收到了没有请求对应的响应
+            st.latencies.push_back((uint32_t)(now - c.sent_at.front()));
+            c.sent_at.pop_front();
+            st.status[c.status >= 100 && c.status < 600 ? c.status / 100 : 0]++;
+            st.completed++;
+            completed++;
+            if (c.close_after) return completed;    // 服务器将关闭连接，之后的数据不再属于本连接
+        }
+    }
+    return completed;
+}
+
+// 工作线程：用 select 同时等待一组连接，每完成一个响应就补发一个请求，保持 pipeline 个在途
+void bench_group(std::vector<BenchConn>* conns, size_t first, size_t last, size_t pipeline, BenchStats* st){
+    std::vector<char> buf(BENCH_RECV_BUF);
+    // 重新建立连接并补满在途请求，失败时该连接退出测量
+    auto restart = [&](BenchConn& c) {
+        if (c.sock != INVALID_SOCKET) closesocket(c.sock);
+        c.sock = INVALID_SOCKET;
+        c.alive = false;
+        if (!running) return;
+        st->reconnects++;
+        if (!open_conn(c) || !send_requests(c, pipeline)) c.alive = false;
+    };
+    for (size_t i = first; i < last; ++i) {
+        if (!send_requests((*conns)[i], pipeline)) restart((*conns)[i]);
+    }
+    while (running) {
+        fd_set rd;
+        FD_ZERO(&rd);
+        size_t watching = 0;
+        for (size_t i = first; i < last; ++i) {
+            if ((*conns)[i].alive) {
+                FD_SET((*conns)[i].sock, &rd);
+                watching++;
+            }
+        }
+        if (watching == 0) break;
+        timeval tv{0, 100 * 1000};      // 定期醒来检查 running
+        if (select(0, &rd, NULL, NULL, &tv) <= 0) continue;
+
+        for (size_t i = first; i < last && running; ++i) {
+            BenchConn& c = (*conns)[i];
+            if (!c.alive || !FD_ISSET(c.sock, &rd)) continue;
+            int n = recv(c.sock, buf.data(), (int)buf.size(), 0);
+            if (n <= 0) {
+                restart(c);
+                continue;
+            }
+            int done = feed(c, buf.data(), (size_t)n, now_us(), *st);
+            if (done < 0 || c.close_after) {
+                restart(c);
+                continue;
+            }
+            if (done > 0 && !send_requests(c, (size_t)done)) restart(c);
+        }
+    }
+}
+
+// 已排序数组的百分位数
+uint32_t percentile(const std::vector<uint32_t>& sorted, double p){
+    if (sorted.empty()) return 0;
+    size_t idx = (size_t)(p * (double)sorted.size());
+    if (idx >= sorted.size()) idx = sorted.size() - 1;
+    return sorted[idx];
+}
+
+int main(int argc, char* argv[]){
+    // 解析启动参数
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    size_t n_conns = 64, pipeline = 1;
+    double duration = 10;
+    std::vector<std::string> paths;
+    bool gzip = false;
+    std::string range;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--gzip") { gzip = true; continue; }
+        if (i + 1 >= argc) arg = "";    // 其余参数都需要一个值
+        // 数值参数不是合法的数或超出范围时同样打印用法，不让 std::sto* 抛出未捕获的异常
+        const char* text = arg.empty() ? "" : argv[i + 1];
+        uint64_t v = 0;
+        bool ok = true, known = true;
+        if (arg == "--host") host = text;
+        else if (arg == "--port") { ok = http_parse_decimal(text, v) && v >= 1 && v <= 65535; port = (int)v; }
+        else if (arg == "--connections") { ok = http_parse_decimal(text, v) && v <= 100000; n_conns = (size_t)v; }
+        else if (arg == "--pipeline") { ok = http_parse_decimal(text, v) && v <= 1024; pipeline = (size_t)v; }
+        else if (arg == "--duration") {
+            char* end = nullptr;
+            duration = std::strtod(text, &end);
+            ok = end != text && *end == '\0' && duration > 0 && duration < 1e6;
+        }
+        else if (arg == "--path") paths.push_back(text);
+        else if (arg == "--range") range = text;
+        else known = ok = false;
+        if (!ok) {
+            if (known) std::cerr << "Invalid value for " << arg << ": '" << text << "'\n";
+            std::cerr << "Usage: http_bench.exe [--host IP] [--port N] [--connections N] [--pipeline D] [--duration SEC]\n"
+                         "                      [--path P]... [--gzip] [--range SPEC]\n";
+            return 1;
+        }
+        ++i;
+    }
+    if (n_conns == 0) n_conns = 1;
+    if (pipeline == 0) pipeline = 1;
+    if (paths.empty()) paths.push_back("/index.html");
+    for (const auto& p : paths) {
+        std::string req = "GET " + p + " HTTP/1.1\r\nHost: " + host + "\r\n";
+        if (gzip) req += "Accept-Encoding: gzip\r\n";
+        if (!range.empty()) req += "Range: bytes=" + range + "\r\n";
+        requests.push_back(req + "\r\n");
+    }
+
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2,2), &wsa) != 0) {
+        std::cerr << "WSAStartup failed\n";
+        return 1;
+    }
+    server_addr = sockaddr_in{};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = inet_addr(host.c_str());
+    server_addr.sin_port = htons((u_short)port);
+
+    // 建立所有连接，不计入测量
+    std::vector<BenchConn> conns(n_conns);
+    size_t connected = 0;
+    for (auto& c : conns) connected += open_conn(c) ? 1 : 0;
+    if (connected < n_conns) {
+        std::cerr << "[ERROR] " << n_conns - connected << " connections failed, is http_server.exe running on "
+                  << host << ":" << port << "?\n";
+        for (auto& c : conns) if (c.sock != INVALID_SOCKET) closesocket(c.sock);
+        WSACleanup();
+        return 1;
+    }
+    std::cout << "Benchmark: " << n_conns << " connections x " << pipeline << " in flight, " << duration << " s, "
+              << paths.size() << " path(s)" << (gzip ? ", gzip" : "") << (range.empty() ? "" : ", range " + range)
+              << "\n";
+
+    // 每组连接一个线程
+    size_t groups = (n_conns + BENCH_SELECT_GROUP - 1) / BENCH_SELECT_GROUP;
+    std::vector<BenchStats> stats(groups);
+    std::vector<std::thread> workers;
+    int64_t t0 = now_us();
+    for (size_t g = 0; g < groups; ++g) {
+        size_t first = g * BENCH_SELECT_GROUP;
+        size_t last = (std::min)(first + BENCH_SELECT_GROUP, n_conns);
+        workers.emplace_back(bench_group, &conns, first, last, pipeline, &stats[g]);
+    }
+    Sleep((DWORD)(duration * 1000));
+    running = false;
+    double elapsed = (double)(now_us() - t0) / 1e6;
+    for (auto& t : workers) t.join();
+
+    // 合并统计
+    BenchStats total;
+    for (auto& st : stats) {
+        total.completed += st.completed;
+        total.bytes += st.bytes;
+        total.reconnects += st.reconnects;
+        for (int k = 0; k < 6; ++k) total.status[k] += st.status[k];
+        total.latencies.insert(total.latencies.end(), st.latencies.begin(), st.latencies.end());
+    }
+    std::sort(total.latencies.begin(), total.latencies.end());
+
+    std::cout << "Requests: " << total.completed << " in " << elapsed << " s (" << (double)total.completed / elapsed
+              << " req/s, " << (double)total.bytes / elapsed / (1024 * 1024) << " MB/s)\n"
+              << "Status: 2xx " << total.status[2] << ", 3xx " << total.status[3] << ", 4xx " << total.status[4]
+              << ", 5xx " << total.status[5];
+    if (total.status[0] || total.status[1]) std::cout << ", other " << total.status[0] + total.status[1];
+    std::cout << "\n";
+    if (total.reconnects) std::cout << "Reconnects: " << total.reconnects << "\n";
+    std::cout << "Latency (us): p50 " << percentile(total.latencies, 0.50)
+              << "  p99 " << percentile(total.latencies, 0.99)
+              << "  p999 " << percentile(total.latencies, 0.999)
+              << "  max " << (total.latencies.empty() ? 0 : total.latencies.back()) << "\n";
+
+    for (auto& c : conns) if (c.sock != INVALID_SOCKET) closesocket(c.sock);
+    WSACleanup();
+    return 0;
+}
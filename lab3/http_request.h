@@ -0,0 +1,298 @@
+// http_request.h
+//
+// HTTP/1.1 请求的增量解析器。
+// IOCP 引擎每次接收到的字节直接追加进来，next() 取出所有已完整到达的请求头（支持流水线），
+// 只解析静态文件服务用得到的字段；请求体按 Content-Length 跳过。
+
+#ifndef HTTP_REQUEST_H
+#define HTTP_REQUEST_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+const size_t HTTP_MAX_HEADER_BYTES = 8 * 1024;      // 请求行 + 请求头的上限，超过返回 431
+
+// next() 的返回结果
+enum HttpParseStatus {
+    HTTP_REQUEST_OK,        // 取出了一个完整的请求
+    HTTP_NEED_MORE,         // 请求头还没有完整到达
+    HTTP_BAD_REQUEST,       // 格式错误，应回复 400 并关闭连接
+    HTTP_HEADER_TOO_LARGE,  // 请求头超过 HTTP_MAX_HEADER_BYTES，应回复 431 并关闭连接
+};
+
+struct HttpRequest {
+    std::string method;
+    std::string target;             // 请求行中的原始目标，例如 "/index.html?x=1"
+    int minor_version = 1;          // HTTP/1.x 的 x
+    bool keep_alive = true;         // 1.1 默认保持连接，1.0 需要 "Connection: keep-alive"
+    bool accept_gzip = false;
+    std::string if_none_match;
+    std::string if_range;
+    std::string range;              // Range 头的原始值
+};
+
+// 不区分大小写比较 ASCII 字符串
+inline bool http_iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') x = (char)(x - 'A' + 'a');
+        if (y >= 'A' && y <= 'Z') y = (char)(y - 'A' + 'a');
+        if (x != y) return false;
+    }
+    return true;
+}
+
+inline std::string_view http_trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// 依次取出逗号分隔列表中的下一项（去掉首尾空白），列表取完时返回 false
+inline bool http_next_token(std::string_view& list, std::string_view& token) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        token = http_trim(list.substr(0, comma));
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+        if (!token.empty()) return true;
+    }
+    return false;
+}
+
+// Accept-Encoding 中是否接受 gzip（"gzip" 或 "*"，且 q 不为 0）
+inline bool http_accepts_gzip(std::string_view value) {
+    std::string_view token;
+    while (http_next_token(value, token)) {
+        size_t semi = token.find(';');
+        std::string_view name = http_trim(token.substr(0, semi));
+        if (!http_iequals(name, "gzip") && name != "*") continue;
+        if (semi == std::string_view::npos) return true;
+        std::string_view param = http_trim(token.substr(semi + 1));
+        if (param.size() < 2 || (param[0] != 'q' && param[0] != 'Q') || param[1] != '=') return true;
+        return std::strtod(std::string(param.substr(2)).c_str(), nullptr) > 0;
+    }
+    return false;
+}
+
+// If-None-Match 是否与 etag 匹配（弱比较：忽略 "W/" 前缀，"*" 匹配任何资源）
+inline bool http_etag_matches(std::string_view list, std::string_view etag) {
+    std::string_view token;
+    while (http_next_token(list, token)) {
+        if (token == "*") return true;
+        if (token.size() > 2 && token[0] == 'W' && token[1] == '/') token.remove_prefix(2);
+        if (token == etag) return true;
+    }
+    return false;
+}
+
+// http_parse_range 的结果
+enum HttpRangeStatus {
+    HTTP_RANGE_OK,              // 单个可满足的范围
+    HTTP_RANGE_IGNORE,          // 语法无效或多个范围，按普通请求回复整个文件
+    HTTP_RANGE_UNSATISFIABLE,   // 范围在文件之外，回复 416
+};
+
+// 功能: 解析十进制无符号数（Range 头中的偏移、命令行中的数值参数）
+// 返回: 空串、含非数字字符或超过 18 位时返回 false
+inline bool http_parse_decimal(std::string_view s, uint64_t& v) {
+    if (s.empty() || s.size() > 18) return false;
+    uint64_t x = 0;
+    for (char ch : s) {
+        if (ch < '0' || ch > '9') return false;
+        x = x * 10 + (uint64_t)(ch - '0');
+    }
+    v = x;
+    return true;
+}
+
+// 功能: 解析 Range 头（只支持单个字节范围）
+// 参数: value-Range 头的值，size-资源大小，first/last-返回闭区间 [first, last]
+inline HttpRangeStatus http_parse_range(std::string_view value, uint64_t size, uint64_t& first, uint64_t& last) {
+    if (value.size() < 6 || !http_iequals(value.substr(0, 6), "bytes=")) return HTTP_RANGE_IGNORE;
+    value = http_trim(value.substr(6));
+    if (value.find(',') != std::string_view::npos) return HTTP_RANGE_IGNORE;
+    size_t dash = value.find('-');
+    if (dash == std::string_view::npos) return HTTP_RANGE_IGNORE;
+
+    std::string_view a = value.substr(0, dash), b = value.substr(dash + 1);
+    uint64_t x = 0, y = 0;
+    if (a.empty()) {
+        // 后缀范围 "-n"：最后 n 个字节
+        if (!http_parse_decimal(b, y)) return HTTP_RANGE_IGNORE;
+        if (y == 0 || size == 0) return HTTP_RANGE_UNSATISFIABLE;
+        first = y >= size ? 0 : size - y;
+        last = size - 1;
+        return HTTP_RANGE_OK;
+    }
+    if (!http_parse_decimal(a, x)) return HTTP_RANGE_IGNORE;
+    if (b.empty()) {
+        y = size ? size - 1 : 0;
+    } else if (!http_parse_decimal(b, y) || y < x) {
+        return HTTP_RANGE_IGNORE;
+    }
+    if (x >= size) return HTTP_RANGE_UNSATISFIABLE;
+    first = x;
+    last = y < size ? y : size - 1;
+    return HTTP_RANGE_OK;
+}
+
+// 功能: 把请求目标转换为缓存中的 URL 路径
+// 说明: 去掉查询串，解码 %XX，"/" 结尾时补上 index.html；也接受绝对形式 "http://host/path"
+//       缓存只按完整路径查表，不会访问磁盘，"/../" 之类的路径只会查不到
+inline bool http_target_path(std::string_view target, std::string& path) {
+    if (target.size() > 7 && http_iequals(target.substr(0, 7), "http://")) {
+        size_t slash = target.find('/', 7);
+        target = slash == std::string_view::npos ? std::string_view("/") : target.substr(slash);
+    }
+    size_t q = target.find_first_of("?#");
+    if (q != std::string_view::npos) target = target.substr(0, q);
+    if (target.empty() || target[0] != '/') return false;
+
+    auto hex = [](char ch) -> int {
+        if (ch >= '0' && ch <= '9') return ch - '0';
+        if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+        if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+        return -1;
+    };
+    path.clear();
+    for (size_t i = 0; i < target.size(); ++i) {
+        char ch = target[i];
+        if (ch == '%') {
+            int hi = i + 2 < target.size() ? hex(target[i + 1]) : -1;
+            int lo = hi >= 0 ? hex(target[i + 2]) : -1;
+            if (lo < 0) return false;
+            ch = (char)(hi * 16 + lo);
+            if (ch == '\0') return false;
+            i += 2;
+        }
+        path.push_back(ch);
+    }
+    if (path.back() == '/') path += "index.html";
+    return true;
+}
+
+class HttpRequestParser {
+public:
+    HttpRequestParser() : scanned(0), body_left(0) {}
+
+    // 追加接收到的数据
+    void feed(const char* data, size_t n) {
+        // 正在跳过上一个请求的请求体
+        if (body_left > 0) {
+            size_t skip = n < body_left ? n : (size_t)body_left;
+            body_left -= skip;
+            data += skip;
+            n -= skip;
+        }
+        buf.append(data, n);
+    }
+
+    // 取出一个完整的请求
+    HttpParseStatus next(HttpRequest& req) {
+        if (body_left > 0) return HTTP_NEED_MORE;
+        // 请求之间允许多余的空行（RFC 9112 2.2）
+        size_t start = 0;
+        while (start + 1 < buf.size() && buf[start] == '\r' && buf[start + 1] == '\n') start += 2;
+        if (start > 0) {
+            buf.erase(0, start);
+            scanned = scanned > start ? scanned - start : 0;
+        }
+
+        size_t from = scanned >= 3 ? scanned - 3 : 0;
+        size_t end = buf.find("\r\n\r\n", from);
+        if (end == std::string::npos) {
+            scanned = buf.size();
+            return buf.size() > HTTP_MAX_HEADER_BYTES ? HTTP_HEADER_TOO_LARGE : HTTP_NEED_MORE;
+        }
+        if (end + 4 > HTTP_MAX_HEADER_BYTES) return HTTP_HEADER_TOO_LARGE;
+
+        HttpParseStatus st = parse(std::string_view(buf.data(), end + 2), req);
+        buf.erase(0, end + 4);
+        scanned = 0;
+        if (st != HTTP_REQUEST_OK) return st;
+
+        // 跳过请求体：已在缓冲区中的部分直接丢弃，其余在之后的 feed 中丢弃
+        if (content_length > 0) {
+            size_t have = buf.size() < content_length ? buf.size() : (size_t)content_length;
+            buf.erase(0, have);
+            body_left = content_length - have;
+        }
+        return HTTP_REQUEST_OK;
+    }
+
+private:
+    std::string buf;
+    size_t scanned;             // buf 中已确认不含请求头结束标记的前缀长度
+    uint64_t body_left;         // 还需要丢弃的请求体字节数
+    uint64_t content_length = 0;
+
+    // 解析请求行和请求头，head 包含最后一行的 "\r\n"
+    HttpParseStatus parse(std::string_view head, HttpRequest& req) {
+        req = HttpRequest();
+        content_length = 0;
+
+        size_t eol = head.find("\r\n");
+        std::string_view line = head.substr(0, eol);
+        head.remove_prefix(eol + 2);
+
+        // 请求行：方法 SP 目标 SP HTTP/1.x
+        size_t sp1 = line.find(' ');
+        size_t sp2 = sp1 == std::string_view::npos ? sp1 : line.find(' ', sp1 + 1);
+        if (sp1 == 0 || sp2 == std::string_view::npos || sp2 == sp1 + 1) return HTTP_BAD_REQUEST;
+        std::string_view version = line.substr(sp2 + 1);
+        if (version.size() != 8 || version.substr(0, 7) != "HTTP/1." || version[7] < '0' || version[7] > '9') {
+            return HTTP_BAD_REQUEST;
+        }
+        req.method.assign(line.data(), sp1);
+        req.target.assign(line.data() + sp1 + 1, sp2 - sp1 - 1);
+        req.minor_version = version[7] - '0';
+        req.keep_alive = req.minor_version >= 1;
+
+        bool has_host = false;
+        while (!head.empty()) {
+            eol = head.find("\r\n");
+            line = head.substr(0, eol);
+            head.remove_prefix(eol + 2);
+            size_t colon = line.find(':');
+            if (colon == std::string_view::npos || colon == 0) return HTTP_BAD_REQUEST;
+            std::string_view name = line.substr(0, colon);
+            if (name.back() == ' ' || name.back() == '\t') return HTTP_BAD_REQUEST;   // 字段名后不允许空白
+            std::string_view value = http_trim(line.substr(colon + 1));
+
+            if (http_iequals(name, "Host")) {
+                has_host = true;
+            } else if (http_iequals(name, "Connection")) {
+                std::string_view token;
+                while (http_next_token(value, token)) {
+                    if (http_iequals(token, "close")) req.keep_alive = false;
+                    else if (http_iequals(token, "keep-alive") && req.minor_version == 0) req.keep_alive = true;
+                }
+            } else if (http_iequals(name, "Accept-Encoding")) {
+                req.accept_gzip = http_accepts_gzip(value);
+            } else if (http_iequals(name, "If-None-Match")) {
+                req.if_none_match.assign(value.data(), value.size());
+            } else if (http_iequals(name, "If-Range")) {
+                req.if_range.assign(value.data(), value.size());
+            } else if (http_iequals(name, "Range")) {
+                req.range.assign(value.data(), value.size());
+            } else if (http_iequals(name, "Content-Length")) {
+                if (value.empty() || value.size() > 18) return HTTP_BAD_REQUEST;
+                uint64_t v = 0;
+                for (char ch : value) {
+                    if (ch < '0' || ch > '9') return HTTP_BAD_REQUEST;
+                    v = v * 10 + (uint64_t)(ch - '0');
+                }
+                content_length = v;
+            } else if (http_iequals(name, "Transfer-Encoding")) {
+                return HTTP_BAD_REQUEST;    // 静态文件服务不接受分块请求体
+            }
+        }
+        if (req.minor_version >= 1 && !has_host) return HTTP_BAD_REQUEST;
+        return HTTP_REQUEST_OK;
+    }
+};
+
+#endif // HTTP_REQUEST_H
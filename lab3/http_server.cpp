@@ -0,0 +1,530 @@
+// http_server.cpp
+//
+// MinGW:
+//   g++ -std=c++17 -O2 http_server.cpp -lws2_32 -o http_server.exe
+//
+// Static file server for the lab3 site, built on lab1's I/O completion port engine (../lab1/iocp_engine.h).
+// Every servable file under --root is loaded at startup (static_cache.h); requests never touch the disk
+// metadata, each response is a precomputed header + a shared in-memory body or an overlapped TransmitFile.
+//
+// Usage: http_server.exe [--root DIR] [--port N] [--workers N] [--memory-max-file N] [--no-transmitfile]
+//                        [--no-gzip] [--keepalive-sec N] [--max-age N] [--max-queue-bytes N]
+//   --root             site directory (default .)
+//   --port             listening port (default 8080)
+//   --workers          IOCP worker threads, 0 = CPU cores (default 0)
+//   --memory-max-file  files up to N bytes are kept in memory, larger ones are sent with TransmitFile (default 256 KB)
+//   --no-transmitfile  keep every file in memory (TransmitFile is throttled on client editions of Windows)
+//   --no-gzip          do not prepare gzip variants of text files
+//   --keepalive-sec    idle keep-alive connections are closed after N seconds (default 15)
+//   --max-age          Cache-Control max-age in seconds (default 3600)
+//   --max-queue-bytes  per-connection outbound queue cap, a client exceeding it is disconnected (default 64 MB)
+//
+// HTTP/1.1: persistent connections and pipelining, GET/HEAD, If-None-Match (304), single byte Range (206/416)
+//   with If-Range, gzip for text files when the client sends Accept-Encoding: gzip. HTTP/1.0 clients keep the
+//   connection only with "Connection: keep-alive".
+
+#include "../lab1/iocp_engine.h"
+#include "../common/async_log.h"
+#include "http_request.h"
+#include "static_cache.h"
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <unordered_set>
+
+#define COLOR_RED (FOREGROUND_RED | FOREGROUND_INTENSITY)
+#define COLOR_GREEN (FOREGROUND_GREEN | FOREGROUND_INTENSITY)
+#define COLOR_CYAN (FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY)
+
+const unsigned HTTP_DEFAULT_PORT = 8080;
+const unsigned HTTP_DEFAULT_KEEPALIVE_SEC = 15;
+const size_t HTTP_DEFAULT_QUEUE_BYTES = 64 << 20;
+const char HTTP_SERVER_NAME[] = "lab3-static";
+
+std::atomic<bool> server_running(true);     // 服务器运行标志
+SOCKET listen_sock = INVALID_SOCKET;        // 监听 socket
+StaticCache cache;                          // 启动时载入，之后只读
+unsigned keepalive_sec = HTTP_DEFAULT_KEEPALIVE_SEC;
+
+LogRateLimit error_log_limit(10);           // accept 失败、畸形请求等，每秒最多显示 10 条
+
+// 响应统计，/stats 显示
+struct HttpStats {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> status_200{0};
+    std::atomic<uint64_t> status_206{0};
+    std::atomic<uint64_t> status_304{0};
+    std::atomic<uint64_t> status_4xx{0};
+    std::atomic<uint64_t> gzip{0};              // 以 gzip 变体回复的 200
+    std::atomic<uint64_t> memory_bytes{0};      // 从内存缓存发出的正文字节
+    std::atomic<uint64_t> file_bytes{0};        // 由 TransmitFile 发出的正文字节
+    std::atomic<uint64_t> connections{0};       // 累计接受的连接数
+};
+HttpStats http_stats;
+
+//=====================响应头结尾=====================//
+
+// 响应头的最后几行：Server、Date、按需的 Connection 字段和空行
+enum HeadTail {
+    TAIL_KEEP_ALIVE,        // HTTP/1.1 默认保持连接，不需要 Connection 字段
+    TAIL_KEEP_ALIVE_10,     // HTTP/1.0 客户端请求了保持连接
+    TAIL_CLOSE,
+    TAIL_KINDS,
+};
+
+// Date 每秒才变化一次：每个工作线程缓存一份当前秒的三种结尾，跨秒时重新生成，请求路径上不加锁
+const SharedBuffer& head_tail(HeadTail kind) {
+    thread_local time_t cached_sec = 0;
+    thread_local SharedBuffer tails[TAIL_KINDS];
+    time_t now = time(nullptr);
+    if (now != cached_sec) {
+        static const char* const days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+        static const char* const months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                             "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+        SYSTEMTIME st;
+        GetSystemTime(&st);
+        char date[64];
+        snprintf(date, sizeof(date), "Date: %s, %02u %s %04u %02u:%02u:%02u GMT\r\n",
+                 days[st.wDayOfWeek % 7], st.wDay, months[(st.wMonth + 11) % 12], st.wYear,
+                 st.wHour, st.wMinute, st.wSecond);
+        std::string base = std::string("Server: ") + HTTP_SERVER_NAME + "\r\n" + date;
+        tails[TAIL_KEEP_ALIVE] = make_shared_buffer(base + "\r\n");
+        tails[TAIL_KEEP_ALIVE_10] = make_shared_buffer(base + "Connection: keep-alive\r\n\r\n");
+        tails[TAIL_CLOSE] = make_shared_buffer(base + "Connection: close\r\n\r\n");
+        cached_sec = now;
+    }
+    return tails[kind];
+}
+
+// 单调时钟，毫秒
+int64_t now_ms(){
+    return (int64_t)GetTickCount64();
+}
+
+//=====================连接与引擎=====================//
+
+// 一个 HTTP 连接：解析器状态只在所属分片的工作线程上访问
+struct HttpConnection : IocpConnection {
+    HttpRequestParser parser;
+    bool closing = false;                       // 已决定发送完当前响应后关闭，之后收到的数据丢弃
+    std::atomic<int64_t> last_active;           // 最近一次收到数据的时间（毫秒），空闲回收线程读取
+
+    explicit HttpConnection(SOCKET s) : IocpConnection(s), last_active(now_ms()) {}
+};
+
+class HttpEngine : public IocpEngine {
+public:
+    // 加入连接表并交给完成端口；表中每项持有一个引用，on_close 时移除
+    bool add(HttpConnection* c) {
+        {
+            std::lock_guard<std::mutex> lk(conns_mtx);
+            c->add_ref();
+            conns.insert(c);
+        }
+        if (attach(c)) return true;
+        remove(c);
+        return false;
+    }
+
+    // 关闭空闲超过 idle_ms 的保持连接；还在发送响应（例如慢速下载大图）的连接不算空闲
+    size_t close_idle(int64_t idle_ms) {
+        int64_t now = now_ms();
+        size_t n = 0;
+        std::lock_guard<std::mutex> lk(conns_mtx);
+        for (HttpConnection* c : conns) {
+            if (now - c->last_active.load() < idle_ms) continue;
+            {
+                std::lock_guard<std::mutex> slk(c->send_mtx);
+                if (c->sending || !c->send_queue.empty()) continue;
+            }
+            request_close(c);
+            n++;
+        }
+        return n;
+    }
+
+    // 服务器关闭：每个连接发送完已排队的响应后关闭
+    void close_all() {
+        std::lock_guard<std::mutex> lk(conns_mtx);
+        for (HttpConnection* c : conns) close_after_send(c);
+    }
+
+protected:
+    void on_recv(IocpConnection* base, const char* data, size_t n) override {
+        HttpConnection* c = static_cast<HttpConnection*>(base);
+        if (c->closing) return;
+        c->last_active = now_ms();
+        c->parser.feed(data, n);
+
+        // 流水线：一次收到的多个请求依次回复，响应按顺序进入同一个发送队列
+        HttpRequest req;
+        while (!c->closing) {
+            HttpParseStatus st = c->parser.next(req);
+            if (st == HTTP_NEED_MORE) break;
+            if (st == HTTP_REQUEST_OK) {
+                handle_request(c, req);
+                continue;
+            }
+            async_log().line(error_log_limit, COLOR_RED,
+                             st == HTTP_BAD_REQUEST ? "[WARN] malformed request, closing connection"
+                                                    : "[WARN] request header too large, closing connection");
+            if (st == HTTP_BAD_REQUEST) send_error(c, 400, "Bad Request", false, "", false);
+            else send_error(c, 431, "Request Header Fields Too Large", false, "", false);
+        }
+    }
+
+    void on_close(IocpConnection* base) override {
+        remove(static_cast<HttpConnection*>(base));
+    }
+
+private:
+    std::mutex conns_mtx;
+    std::unordered_set<HttpConnection*> conns;
+
+    void remove(HttpConnection* c) {
+        {
+            std::lock_guard<std::mutex> lk(conns_mtx);
+            if (!conns.erase(c)) return;
+        }
+        c->release();
+    }
+
+    // 入队失败（连接已关闭或积压超限被断开）时不再处理该连接后续的请求
+    void check(HttpConnection* c, SendResult r) {
+        if (r != SEND_OK) c->closing = true;
+    }
+
+    // 本次响应之后是否保持连接，并据此选择响应头结尾
+    HeadTail finish(HttpConnection* c, bool keep_alive, int minor_version) {
+        if (!keep_alive || !server_running) {
+            c->closing = true;
+            return TAIL_CLOSE;
+        }
+        return minor_version == 0 ? TAIL_KEEP_ALIVE_10 : TAIL_KEEP_ALIVE;
+    }
+
+    void end_response(HttpConnection* c) {
+        if (c->closing) close_after_send(c);
+    }
+
+    // 错误响应：纯文本正文，extra 为额外的头部字段（每行以 \r\n 结尾）
+    void send_error(HttpConnection* c, int code, const char* reason, bool keep_alive, const std::string& extra,
+                    bool head_only, int minor_version = 1) {
+        http_stats.status_4xx++;
+        std::string body = std::to_string(code) + " " + reason + "\n";
+        HeadTail tail = finish(c, keep_alive, minor_version);
+        std::string h = "HTTP/1.1 " + std::to_string(code) + " " + reason + "\r\n"
+                        "Content-Type: text/plain; charset=utf-8\r\n"
+                        "Content-Length: " + std::to_string(body.size()) + "\r\n" + extra;
+        check(c, send(c, make_shared_buffer(h)));
+        check(c, send(c, head_tail(tail)));
+        if (!head_only) check(c, send(c, make_shared_buffer(body)));
+        end_response(c);
+    }
+
+    // 发送正文中 [offset, offset + len) 的部分：内存缓存直接挂共享缓冲区，大文件由 TransmitFile 连同头部一起发出
+    void send_body(HttpConnection* c, const CachedVariant& v, const SharedBuffer& head, HeadTail tail,
+                   uint64_t offset, uint64_t len) {
+        const SharedBuffer& t = head_tail(tail);
+        if (v.file == INVALID_HANDLE_VALUE) {
+            check(c, send(c, head));
+            check(c, send(c, t));
+            if (len > 0) check(c, send_slice(c, v.body, (size_t)offset, (size_t)len));
+            http_stats.memory_bytes += len;
+            return;
+        }
+        // TransmitFile 的头部必须是一块连续内存，这里拼接一次（只有两百多字节）
+        SharedBuffer joined(head.size() + t.size());
+        memcpy(joined.writable(), head.data(), head.size());
+        memcpy(joined.writable() + head.size(), t.data(), t.size());
+        check(c, send_file(c, joined, v.file, offset, (DWORD)len));
+        http_stats.file_bytes += len;
+    }
+
+    void handle_request(HttpConnection* c, const HttpRequest& req) {
+        http_stats.requests++;
+        bool head_only = req.method == "HEAD";
+        if (!head_only && req.method != "GET") {
+            send_error(c, 405, "Method Not Allowed", req.keep_alive, "Allow: GET, HEAD\r\n", false, req.minor_version);
+            return;
+        }
+        std::string path;
+        if (!http_target_path(req.target, path)) {
+            send_error(c, 400, "Bad Request", false, "", head_only, req.minor_version);
+            return;
+        }
+        const CachedFile* f = cache.find(path);
+        if (!f) {
+            send_error(c, 404, "Not Found", req.keep_alive, "", head_only, req.minor_version);
+            return;
+        }
+
+        // 范围请求只针对原始编码，带 Range 的请求不使用 gzip 变体
+        bool ranged = !head_only && !req.range.empty();
+        const CachedVariant& v = req.accept_gzip && f->gzip.present() && !ranged ? f->gzip : f->identity;
+        HeadTail tail = finish(c, req.keep_alive, req.minor_version);
+
+        if (!req.if_none_match.empty() && http_etag_matches(req.if_none_match, v.etag)) {
+            http_stats.status_304++;
+            check(c, send(c, v.head_304));
+            check(c, send(c, head_tail(tail)));
+            end_response(c);
+            return;
+        }
+
+        // If-Range 与当前 ETag 不一致时忽略 Range，回复整个文件
+        if (ranged && (req.if_range.empty() || req.if_range == v.etag)) {
+            uint64_t first = 0, last = 0;
+            HttpRangeStatus rs = http_parse_range(req.range, v.size, first, last);
+            if (rs == HTTP_RANGE_UNSATISFIABLE) {
+                send_error(c, 416, "Range Not Satisfiable", req.keep_alive,
+                           "Content-Range: bytes */" + std::to_string(v.size) + "\r\n", false, req.minor_version);
+                return;
+            }
+            if (rs == HTTP_RANGE_OK) {
+                http_stats.status_206++;
+                uint64_t len = last - first + 1;
+                std::string h = "HTTP/1.1 206 Partial Content\r\n"
+                                "Content-Type: " + std::string(f->content_type) + "\r\n"
+                                "Content-Length: " + std::to_string(len) + "\r\n"
+                                "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) +
+                                "/" + std::to_string(v.size) + "\r\n"
+                                "ETag: " + v.etag + "\r\n";
+                send_body(c, v, make_shared_buffer(h), tail, first, len);
+                end_response(c);
+                return;
+            }
+        }
+
+        http_stats.status_200++;
+        if (&v == &f->gzip) http_stats.gzip++;
+        if (head_only) {
+            check(c, send(c, v.head_200));
+            check(c, send(c, head_tail(tail)));
+        } else {
+            send_body(c, v, v.head_200, tail, 0, v.size);
+        }
+        end_response(c);
+    }
+};
+
+HttpEngine* engine = nullptr;
+
+//=====================监听与空闲回收=====================//
+
+void set_nodelay(SOCKET s){
+    BOOL on = TRUE;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+// 监听线程：只负责 accept 并把连接交给完成端口，请求解析和回复都在工作线程上完成
+void accept_thread_func(){
+    while (server_running){
+        SOCKADDR_IN clientAddr;
+        int addrlen = sizeof(clientAddr);
+        SOCKET clientSock = accept(listen_sock, (SOCKADDR*)&clientAddr, &addrlen);
+        if (clientSock == INVALID_SOCKET) {
+            if (!server_running) break;
+            async_log().line(error_log_limit, COLOR_RED, "[ERROR] accept failed");
+            continue;
+        }
+        set_nodelay(clientSock);
+        http_stats.connections++;
+
+        HttpConnection* c = new HttpConnection(clientSock);
+        if (!engine->add(c)) {
+            c->release();   // 关联完成端口失败，释放连接（析构时关闭 socket）
+        }
+    }
+}
+
+// 空闲回收线程：每秒检查一次，关闭超过 keepalive_sec 没有新请求的保持连接
+void idle_thread_func(){
+    while (server_running) {
+        for (int i = 0; i < 10 && server_running; ++i) Sleep(100);
+        if (server_running && keepalive_sec > 0) engine->close_idle((int64_t)keepalive_sec * 1000);
+    }
+}
+
+// 显示缓存内容：每个文件的大小、发送方式和 gzip 变体大小，按 URL 排序
+void print_cache(){
+    std::vector<const CachedFile*> list;
+    for (const auto& kv : cache.entries()) list.push_back(&kv.second);
+    std::sort(list.begin(), list.end(), [](const CachedFile* a, const CachedFile* b) { return a->url < b->url; });
+    for (const CachedFile* p : list) {
+        const CachedFile& f = *p;
+        std::cout << "  " << f.url << "  " << f.identity.size << " bytes, "
+                  << (f.identity.file != INVALID_HANDLE_VALUE ? "TransmitFile" : "memory");
+        if (f.gzip.present()) std::cout << ", gzip " << f.gzip.size << " bytes";
+        std::cout << "\n";
+    }
+}
+
+int main(int argc, char* argv[]){
+    // 解析启动参数
+    std::string root = ".";
+    unsigned port = HTTP_DEFAULT_PORT;
+    unsigned workers = 0;                       // 0 表示取 CPU 核心数
+    size_t max_queue_bytes = HTTP_DEFAULT_QUEUE_BYTES;
+    CacheOptions opt;
+    auto usage = []{
+        std::cerr << "Usage: http_server.exe [--root DIR] [--port N] [--workers N] [--memory-max-file N]"
+                     " [--no-transmitfile] [--no-gzip] [--keepalive-sec N] [--max-age N] [--max-queue-bytes N]\n";
+        return 1;
+    };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        // 数值参数：缺少值、不是十进制数或超出 [lo, hi] 时报告并打印用法，不抛异常
+        uint64_t v = 0;
+        auto value = [&](uint64_t lo, uint64_t hi){
+            if (i + 1 < argc && http_parse_decimal(argv[i + 1], v) && v >= lo && v <= hi) { ++i; return true; }
+            std::cerr << "Invalid value for " << arg << ", expected an integer in [" << lo << ", " << hi << "]\n";
+            return false;
+        };
+        if (arg == "--root" && i + 1 < argc) {
+            root = argv[++i];
+        } else if (arg == "--port") {
+            if (!value(1, 65535)) return usage();
+            port = (unsigned)v;
+        } else if (arg == "--workers") {
+            if (!value(0, 256)) return usage();
+            workers = (unsigned)v;
+        } else if (arg == "--memory-max-file") {
+            if (!value(0, 1ull << 32)) return usage();
+            opt.memory_max_file = (size_t)v;
+        } else if (arg == "--no-transmitfile") {
+            opt.transmit_file = false;
+        } else if (arg == "--no-gzip") {
+            opt.gzip = false;
+        } else if (arg == "--keepalive-sec") {
+            if (!value(0, 86400)) return usage();
+            keepalive_sec = (unsigned)v;
+        } else if (arg == "--max-age") {
+            if (!value(0, 0x7fffffff)) return usage();
+            opt.max_age = (unsigned)v;
+        } else if (arg == "--max-queue-bytes") {
+            if (!value(0, 1ull << 40)) return usage();
+            max_queue_bytes = (size_t)v;
+        } else {
+            return usage();
+        }
+    }
+
+    SetConsoleOutputCP(CP_UTF8);
+
+    // 初始化 Winsock
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2,2), &wsa) != 0) {
+        std::cerr << "WSAStartup failed\n";
+        return 1;
+    }
+
+    // 先启动引擎：取不到 TransmitFile 时所有文件都放进内存
+    engine = new HttpEngine();
+    if (!engine->start(workers)) {
+        std::cerr << "CreateIoCompletionPort failed\n";
+        delete engine;
+        WSACleanup();
+        return 1;
+    }
+    engine->set_send_queue_limit(max_queue_bytes);
+    if (opt.transmit_file && !engine->transmit_file_available()) {
+        std::cerr << "[WARN] TransmitFile is not available, serving every file from memory\n";
+        opt.transmit_file = false;
+    }
+
+    // 载入站点目录
+    std::string error;
+    DWORD t0 = GetTickCount();
+    if (!cache.load(root, opt, error)) {
+        std::cerr << "[ERROR] " << error << "\n";
+        delete engine;
+        WSACleanup();
+        return 1;
+    }
+    std::cout << "Loaded " << cache.entries().size() << " files from " << root << " in " << GetTickCount() - t0
+              << " ms, " << cache.memory_usage() << " bytes in memory\n";
+    print_cache();
+    if (!cache.find("/index.html")) std::cout << "[WARN] no index.html under " << root << "\n";
+
+    // 创建监听 socket，绑定地址和端口，开始监听
+    listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listen_sock == INVALID_SOCKET) {
+        std::cerr << "socket failed\n";
+        delete engine;
+        WSACleanup();
+        return 1;
+    }
+    sockaddr_in srv{};
+    srv.sin_family = AF_INET;
+    srv.sin_addr.s_addr = INADDR_ANY;
+    srv.sin_port = htons((u_short)port);
+    int on = 1;                                 // 设置地址复用选项，避免重启服务器时地址被占用
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+    if (bind(listen_sock, (sockaddr*)&srv, sizeof(srv)) == SOCKET_ERROR ||
+        listen(listen_sock, SOMAXCONN) == SOCKET_ERROR) {
+        std::cerr << "bind/listen on port " << port << " failed\n";
+        closesocket(listen_sock);
+        delete engine;
+        WSACleanup();
+        return 1;
+    }
+
+    std::cout << "HTTP server started on port " << port << " (" << engine->worker_count() << " workers)\n"
+              << "Type '/stats' for counters, '/exit' to shutdown server\n";
+    async_log().set_prompt("HTTP: ", COLOR_CYAN);
+
+    std::thread accept_th(accept_thread_func);
+    std::thread idle_th(idle_thread_func);
+
+    // console 主循环：等待 /exit 命令以关闭服务器
+    std::string line;
+    while (server_running) {
+        {
+            std::lock_guard<std::mutex> lk(async_log().console_mutex());
+            SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), COLOR_CYAN);
+            std::cout << "HTTP: ";
+            SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), LOG_COLOR_DEFAULT);
+            std::cout.flush();
+        }
+        if (!std::getline(std::cin, line) || line == "/exit") break;
+        if (line == "/stats") {
+            const SendStats& st = engine->stats();
+            uint64_t responses = http_stats.status_200 + http_stats.status_206 + http_stats.status_304 +
+                                 http_stats.status_4xx;
+            double per = responses ? 1.0 / (double)responses : 0.0;
+            std::lock_guard<std::mutex> lk(async_log().console_mutex());
+            std::cout << "  requests: " << http_stats.requests.load() << "  (200: " << http_stats.status_200.load()
+                      << ", gzip " << http_stats.gzip.load() << "; 206: " << http_stats.status_206.load()
+                      << "; 304: " << http_stats.status_304.load() << "; 4xx: " << http_stats.status_4xx.load() << ")\n"
+                      << "  connections: " << engine->connection_count() << " open, "
+                      << http_stats.connections.load() << " accepted\n"
+                      << "  body bytes: " << http_stats.memory_bytes.load() << " from memory, "
+                      << http_stats.file_bytes.load() << " via TransmitFile\n"
+                      << "  send syscalls: " << st.syscalls.load() << " (" << st.syscalls.load() * per
+                      << " per response), bytes sent: " << st.bytes.load() << "\n";
+            continue;
+        }
+        if (!line.empty()) std::cout << "Unknown command, expected /stats or /exit\n";
+    }
+
+    // 关闭服务器：停止接受新连接，已排队的响应发送完毕后关闭各连接
+    server_running = false;
+    async_log().set_prompt("", LOG_COLOR_DEFAULT);
+    async_log().flush();
+    std::cout << "[TERMINATED] Shutting down...\n";
+    closesocket(listen_sock);
+    if (accept_th.joinable()) accept_th.join();
+    if (idle_th.joinable()) idle_th.join();
+    engine->close_all();
+
+    // 最多等待 1 秒让在途响应发送完毕
+    for (int i = 0; i < 100 && engine->connection_count() > 0; ++i) Sleep(10);
+    delete engine;
+    engine = nullptr;
+
+    WSACleanup();
+    async_log().flush();
+    std::cout << "[TERMINATED] Server stopped.\n";
+    return 0;
+}
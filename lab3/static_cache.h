@@ -0,0 +1,303 @@
+// static_cache.h
+//
+// 静态资源缓存：启动时扫描站点目录，一次性载入所有可服务的文件，请求路径上不再访问磁盘元数据。
+// 每个文件预先算好 ETag（内容的 64 位 FNV-1a）、Content-Length 和完整的响应头前缀；
+// 小文件的内容放在共享缓冲区里，直接挂进发送队列；大文件只保留一个重叠句柄，由 TransmitFile 从文件缓存发送。
+// 文本类型（HTML、CSS、JS 等）另外准备一份 gzip 变体：目录中有同名的 .gz 时直接使用，否则在载入时压缩。
+//
+// 只服务扩展名在 MIME 表中的文件，站点目录里的源代码、可执行文件和 .gz 原件不会被直接访问到。
+
+#ifndef STATIC_CACHE_H
+#define STATIC_CACHE_H
+
+#include <windows.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../lab1/shared_buffer.h"
+#include "gzip.h"
+
+const size_t CACHE_DEFAULT_MEMORY_FILE = 256 * 1024;    // 超过该大小的文件默认走 TransmitFile
+const unsigned CACHE_DEFAULT_MAX_AGE = 3600;            // Cache-Control 的 max-age（秒）
+const uint64_t CACHE_MAX_FILE_SIZE = 0x7FFFFFFF;        // TransmitFile 单次最多发送 2^31-1 字节
+const DWORD CACHE_READ_CHUNK = 64 * 1024;               // 计算大文件 ETag 时每次读取的字节数
+
+// 扩展名 -> Content-Type，compressible 表示值得准备 gzip 变体
+struct MimeType {
+    const char* ext;
+    const char* type;
+    bool compressible;
+};
+
+const MimeType MIME_TYPES[] = {
+    {"html", "text/html; charset=utf-8", true},
+    {"htm", "text/html; charset=utf-8", true},
+    {"css", "text/css; charset=utf-8", true},
+    {"js", "text/javascript; charset=utf-8", true},
+    {"json", "application/json", true},
+    {"svg", "image/svg+xml", true},
+    {"txt", "text/plain; charset=utf-8", true},
+    {"jpg", "image/jpeg", false},
+    {"jpeg", "image/jpeg", false},
+    {"png", "image/png", false},
+    {"gif", "image/gif", false},
+    {"webp", "image/webp", false},
+    {"ico", "image/x-icon", false},
+    {"woff2", "font/woff2", false},
+};
+
+// 按扩展名（不区分大小写）查 MIME 类型，不在表中时返回 nullptr
+inline const MimeType* mime_for(const std::string& name) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos) return nullptr;
+    std::string ext = name.substr(dot + 1);
+    for (char& ch : ext) if (ch >= 'A' && ch <= 'Z') ch = (char)(ch - 'A' + 'a');
+    for (const MimeType& m : MIME_TYPES) {
+        if (ext == m.ext) return &m;
+    }
+    return nullptr;
+}
+
+// 64 位 FNV-1a，可分段累加
+inline uint64_t fnv1a64(const void* data, size_t n, uint64_t h = 14695981039346656037ull) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+inline std::string make_etag(uint64_t hash, const char* suffix = "") {
+    char buf[40];
+    snprintf(buf, sizeof(buf), "\"%016llx%s\"", (unsigned long long)hash, suffix);
+    return buf;
+}
+
+inline SharedBuffer make_shared_buffer(const std::string& s) {
+    SharedBuffer b(s.size());
+    if (!s.empty()) memcpy(b.writable(), s.data(), s.size());
+    return b;
+}
+
+// 一种编码（原始或 gzip）的内容和预生成的响应头
+// head_200 / head_304 到最后一个固定字段为止，Date、Connection 和空行由服务器按连接状态追加
+struct CachedVariant {
+    uint64_t size = 0;
+    std::string etag;
+    SharedBuffer body;                  // 内存中的内容；走 TransmitFile 时为空
+    HANDLE file = INVALID_HANDLE_VALUE; // 以 FILE_FLAG_OVERLAPPED 打开的句柄，只有大文件的原始编码使用
+    SharedBuffer head_200;
+    SharedBuffer head_304;
+
+    bool present() const { return !etag.empty(); }
+};
+
+struct CachedFile {
+    std::string url;                    // 例如 "/index.html"
+    const char* content_type = "";
+    CachedVariant identity;
+    CachedVariant gzip;                 // 没有 gzip 变体时 present() 为 false
+};
+
+// 载入参数
+struct CacheOptions {
+    size_t memory_max_file = CACHE_DEFAULT_MEMORY_FILE;    // 不超过该大小的文件放在内存里
+    bool transmit_file = true;          // false 时所有文件都放在内存里
+    bool gzip = true;                   // 是否为文本类型准备 gzip 变体
+    unsigned max_age = CACHE_DEFAULT_MAX_AGE;
+};
+
+class StaticCache {
+public:
+    StaticCache() : memory_bytes(0) {}
+    StaticCache(const StaticCache&) = delete;
+    StaticCache& operator=(const StaticCache&) = delete;
+
+    ~StaticCache() {
+        for (auto& kv : files) {
+            if (kv.second.identity.file != INVALID_HANDLE_VALUE) CloseHandle(kv.second.identity.file);
+        }
+    }
+
+    // 功能: 扫描站点目录（含子目录）并载入所有可服务的文件
+    // 参数: root-站点目录，opt-载入参数，error-失败时的原因
+    // 返回: true-成功（目录可以为空），false-目录无法打开或某个文件读取失败
+    bool load(const std::string& root, const CacheOptions& opt, std::string& error) {
+        options = opt;
+        return scan(root, "/", error);
+    }
+
+    // 按 URL 路径查找，找不到返回 nullptr；载入完成后只读，可以被所有工作线程并发调用
+    const CachedFile* find(const std::string& url) const {
+        auto it = files.find(url);
+        return it == files.end() ? nullptr : &it->second;
+    }
+
+    const std::unordered_map<std::string, CachedFile>& entries() const { return files; }
+    size_t memory_usage() const { return memory_bytes; }
+
+private:
+    std::unordered_map<std::string, CachedFile> files;
+    CacheOptions options;
+    size_t memory_bytes;
+
+    bool scan(const std::string& dir, const std::string& url_prefix, std::string& error) {
+        WIN32_FIND_DATAA fd;
+        HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &fd);
+        if (h == INVALID_HANDLE_VALUE) {
+            error = "cannot open directory " + dir;
+            return false;
+        }
+        bool ok = true;
+        do {
+            std::string name = fd.cFileName;
+            if (name.empty() || name[0] == '.' || (fd.dwFileAttributes & FILE_ATTRIBUTE_HIDDEN)) continue;
+            std::string path = dir + "\\" + name;
+            if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                ok = scan(path, url_prefix + name + "/", error);
+            } else if (const MimeType* mime = mime_for(name)) {
+                ok = add_file(path, url_prefix + name, *mime, error);
+            }
+        } while (ok && FindNextFileA(h, &fd));
+        FindClose(h);
+        return ok;
+    }
+
+    // 读取整个文件；文件不存在时 missing 为 true
+    static bool read_all(const std::string& path, SharedBuffer& out, bool& missing) {
+        missing = false;
+        HANDLE h = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (h == INVALID_HANDLE_VALUE) {
+            missing = GetLastError() == ERROR_FILE_NOT_FOUND;
+            return false;
+        }
+        LARGE_INTEGER size;
+        bool ok = GetFileSizeEx(h, &size) && (uint64_t)size.QuadPart <= CACHE_MAX_FILE_SIZE;
+        if (ok) {
+            out = SharedBuffer((size_t)size.QuadPart);
+            size_t done = 0;
+            while (ok && done < out.size()) {
+                DWORD want = (DWORD)(std::min)((size_t)CACHE_READ_CHUNK, out.size() - done);
+                DWORD got = 0;
+                ok = ReadFile(h, out.writable() + done, want, &got, NULL) && got > 0;
+                done += got;
+            }
+        }
+        CloseHandle(h);
+        return ok;
+    }
+
+    // 大文件：分块读取计算 ETag，再以重叠方式重新打开供 TransmitFile 使用
+    static bool hash_file(const std::string& path, uint64_t& size, uint64_t& hash) {
+        HANDLE h = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (h == INVALID_HANDLE_VALUE) return false;
+        std::vector<char> chunk(CACHE_READ_CHUNK);
+        size = 0;
+        hash = fnv1a64(nullptr, 0);
+        DWORD got = 0;
+        bool ok;
+        while ((ok = ReadFile(h, chunk.data(), CACHE_READ_CHUNK, &got, NULL) != FALSE) && got > 0) {
+            hash = fnv1a64(chunk.data(), got, hash);
+            size += got;
+        }
+        CloseHandle(h);
+        return ok && size <= CACHE_MAX_FILE_SIZE;
+    }
+
+    bool add_file(const std::string& path, const std::string& url, const MimeType& mime, std::string& error) {
+        CachedFile f;
+        f.url = url;
+        f.content_type = mime.type;
+        LARGE_INTEGER size;
+        {
+            HANDLE h = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+            if (h == INVALID_HANDLE_VALUE) {
+                error = "cannot open " + path;
+                return false;
+            }
+            bool ok = GetFileSizeEx(h, &size) != FALSE;
+            CloseHandle(h);
+            if (!ok || (uint64_t)size.QuadPart > CACHE_MAX_FILE_SIZE) {
+                error = "cannot serve " + path + " (larger than 2 GB)";
+                return false;
+            }
+        }
+
+        bool missing = false;
+        if (options.transmit_file && (uint64_t)size.QuadPart > options.memory_max_file) {
+            uint64_t hash;
+            if (!hash_file(path, f.identity.size, hash)) {
+                error = "cannot read " + path;
+                return false;
+            }
+            f.identity.etag = make_etag(hash);
+            f.identity.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                          FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (f.identity.file == INVALID_HANDLE_VALUE) {
+                error = "cannot open " + path;
+                return false;
+            }
+        } else {
+            if (!read_all(path, f.identity.body, missing)) {
+                error = "cannot read " + path;
+                return false;
+            }
+            f.identity.size = f.identity.body.size();
+            f.identity.etag = make_etag(fnv1a64(f.identity.body.data(), f.identity.body.size()));
+            memory_bytes += f.identity.body.size();
+        }
+
+        if (options.gzip && mime.compressible) {
+            // 优先使用目录中预先压缩好的 .gz，没有时在这里压缩一次
+            SharedBuffer gz;
+            if (!read_all(path + ".gz", gz, missing)) {
+                if (!missing) {
+                    error = "cannot read " + path + ".gz";
+                    return false;
+                }
+                SharedBuffer src = f.identity.body;
+                if (src.empty() && f.identity.size > 0 && !read_all(path, src, missing)) {
+                    error = "cannot read " + path;
+                    return false;
+                }
+                gz = make_shared_buffer(gzip_compress((const uint8_t*)src.data(), src.size()));
+            }
+            // 压缩后没有变小（例如很小的文件）就不提供 gzip 变体
+            if (gz.size() < f.identity.size) {
+                f.gzip.size = gz.size();
+                f.gzip.etag = make_etag(fnv1a64(gz.data(), gz.size()), "-gz");
+                f.gzip.body = gz;
+                memory_bytes += gz.size();
+            }
+        }
+
+        build_heads(f.identity, f, false);
+        if (f.gzip.present()) build_heads(f.gzip, f, true);
+        files[url] = std::move(f);
+        return true;
+    }
+
+    void build_heads(CachedVariant& v, const CachedFile& f, bool gzip) {
+        std::string common = "ETag: " + v.etag + "\r\n"
+                             "Cache-Control: public, max-age=" + std::to_string(options.max_age) + "\r\n";
+        if (f.gzip.present()) common += "Vary: Accept-Encoding\r\n";
+
+        // Range 请求总是按 identity 变体回复，gzip 变体不能对外声明支持范围请求
+        std::string h = "HTTP/1.1 200 OK\r\n"
+                        "Content-Type: " + std::string(f.content_type) + "\r\n"
+                        "Content-Length: " + std::to_string(v.size) + "\r\n" +
+                        (gzip ? "Accept-Ranges: none\r\n" : "Accept-Ranges: bytes\r\n") + common;
+        if (gzip) h += "Content-Encoding: gzip\r\n";
+        v.head_200 = make_shared_buffer(h);
+        v.head_304 = make_shared_buffer("HTTP/1.1 304 Not Modified\r\n" + common);
+    }
+};
+
+#endif // STATIC_CACHE_H